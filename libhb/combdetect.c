@@ -0,0 +1,253 @@
+/* combdetect.c
+
+   Copyright (c) 2003-2015 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+
+   Tritical's work inspired much of the comb detection code:
+   http://web.missouri.edu/~kes25c/
+ */
+
+#include "hb.h"
+#include "combdetect.h"
+
+static void detect_gamma_combed_row_c( const hb_comb_params_t * params,
+                                       const uint8_t * prev,
+                                       const uint8_t * cur,
+                                       const uint8_t * next,
+                                       uint8_t * mask, int stride, int width )
+{
+    /* A mish-mash of various comb detection tricks
+       picked up from neuron2's Decomb plugin for
+       AviSynth and tritical's IsCombedT and
+       IsCombedTIVTC plugins.                       */
+
+    const float * gamma_lut = params->gamma_lut;
+
+    /* Comb scoring algorithm */
+    /* Motion threshold */
+    float mthresh         = (float)params->motion_threshold / (float)255;
+    /* Spatial threshold */
+    float athresh         = (float)params->spatial_threshold / (float)255;
+    float athresh6        = 6 *athresh;
+
+    /* These are just to make the buffer locations easier to read. */
+    int up_2    = -2 * stride ;
+    int up_1    = -1 * stride;
+    int down_1  =      stride;
+    int down_2  =  2 * stride;
+
+    int x;
+    for( x = 0; x < width; x++ )
+    {
+        float up_diff, down_diff;
+        up_diff   = gamma_lut[cur[0]] - gamma_lut[cur[up_1]];
+        down_diff = gamma_lut[cur[0]] - gamma_lut[cur[down_1]];
+
+        mask[0] = 0;
+        if( ( up_diff >  athresh && down_diff >  athresh ) ||
+            ( up_diff < -athresh && down_diff < -athresh ) )
+        {
+            /* The pixel above and below are different,
+               and they change in the same "direction" too.*/
+            int motion = 0;
+            if( mthresh > 0 )
+            {
+                /* Make sure there's sufficient motion between frame t-1 to frame t+1. */
+                if( fabs( gamma_lut[prev[0]]      - gamma_lut[cur[0]] ) > mthresh &&
+                    fabs( gamma_lut[cur[up_1]]    - gamma_lut[next[up_1]]    ) > mthresh &&
+                    fabs( gamma_lut[cur[down_1]]  - gamma_lut[next[down_1]]    ) > mthresh )
+                        motion++;
+                if( fabs( gamma_lut[next[0]]      - gamma_lut[cur[0]] ) > mthresh &&
+                    fabs( gamma_lut[prev[up_1]]   - gamma_lut[cur[up_1]] ) > mthresh &&
+                    fabs( gamma_lut[prev[down_1]] - gamma_lut[cur[down_1]] ) > mthresh )
+                        motion++;
+
+            }
+            else
+            {
+                /* User doesn't want to check for motion,
+                   so move on to the spatial check.       */
+                motion = 1;
+            }
+
+            if( motion || params->ignore_motion )
+            {
+
+                /* Tritical's noise-resistant combing scorer.
+                   The check is done on a bob+blur convolution. */
+                float combing = fabs( gamma_lut[cur[up_2]]
+                                 + ( 4 * gamma_lut[cur[0]] )
+                                 + gamma_lut[cur[down_2]]
+                                 - ( 3 * ( gamma_lut[cur[up_1]]
+                                         + gamma_lut[cur[down_1]] ) ) );
+                /* If the frame is sufficiently combed,
+                   then mark it down on the mask as 1. */
+                if( combing > athresh6 )
+                {
+                    mask[0] = 1;
+                }
+            }
+        }
+
+        cur++;
+        prev++;
+        next++;
+        mask++;
+    }
+}
+
+static void detect_combed_row_c( const hb_comb_params_t * params,
+                                 const uint8_t * prev,
+                                 const uint8_t * cur,
+                                 const uint8_t * next,
+                                 uint8_t * mask, int stride, int width )
+{
+    /* A mish-mash of various comb detection tricks
+       picked up from neuron2's Decomb plugin for
+       AviSynth and tritical's IsCombedT and
+       IsCombedTIVTC plugins.                       */
+
+    /* Comb scoring algorithm */
+    int spatial_metric  = params->spatial_metric;
+    /* Motion threshold */
+    int mthresh         = params->motion_threshold;
+    /* Spatial threshold */
+    int athresh         = params->spatial_threshold;
+    int athresh_squared = athresh * athresh;
+    int athresh6        = 6 * athresh;
+
+    /* These are just to make the buffer locations easier to read. */
+    int up_2    = -2 * stride ;
+    int up_1    = -1 * stride;
+    int down_1  =      stride;
+    int down_2  =  2 * stride;
+
+    int x;
+    for( x = 0; x < width; x++ )
+    {
+        int up_diff = cur[0] - cur[up_1];
+        int down_diff = cur[0] - cur[down_1];
+
+        mask[0] = 0;
+        if( ( up_diff >  athresh && down_diff >  athresh ) ||
+            ( up_diff < -athresh && down_diff < -athresh ) )
+        {
+            /* The pixel above and below are different,
+               and they change in the same "direction" too.*/
+            int motion = 0;
+            if( mthresh > 0 )
+            {
+                /* Make sure there's sufficient motion between frame t-1 to frame t+1. */
+                if( abs( prev[0] - cur[0] ) > mthresh &&
+                    abs(  cur[up_1] - next[up_1]    ) > mthresh &&
+                    abs(  cur[down_1] - next[down_1]    ) > mthresh )
+                        motion++;
+                if( abs(     next[0] - cur[0] ) > mthresh &&
+                    abs( prev[up_1] - cur[up_1] ) > mthresh &&
+                    abs( prev[down_1] - cur[down_1] ) > mthresh )
+                        motion++;
+            }
+            else
+            {
+                /* User doesn't want to check for motion,
+                   so move on to the spatial check.       */
+                motion = 1;
+            }
+
+            if( motion || params->ignore_motion )
+            {
+                   /* That means it's time for the spatial check.
+                      We've got several options here.             */
+                if( spatial_metric == 0 )
+                {
+                    /* Simple 32detect style comb detection */
+                    if( ( abs( cur[0] - cur[down_2] ) < 10  ) &&
+                        ( abs( cur[0] - cur[down_1] ) > 15 ) )
+                    {
+                        mask[0] = 1;
+                    }
+                }
+                else if( spatial_metric == 1 )
+                {
+                    /* This, for comparison, is what IsCombed uses.
+                       It's better, but still noise senstive.      */
+                       int combing = ( cur[up_1] - cur[0] ) *
+                                     ( cur[down_1] - cur[0] );
+
+                       if( combing > athresh_squared )
+                       {
+                           mask[0] = 1;
+                       }
+                }
+                else if( spatial_metric == 2 )
+                {
+                    /* Tritical's noise-resistant combing scorer.
+                       The check is done on a bob+blur convolution. */
+                    int combing = abs( cur[up_2]
+                                     + ( 4 * cur[0] )
+                                     + cur[down_2]
+                                     - ( 3 * ( cur[up_1]
+                                             + cur[down_1] ) ) );
+
+                    /* If the frame is sufficiently combed,
+                       then mark it down on the mask as 1. */
+                    if( combing > athresh6 )
+                    {
+                        mask[0] = 1;
+                    }
+                }
+            }
+        }
+
+        cur++;
+        prev++;
+        next++;
+        mask++;
+    }
+}
+
+static void count_combed_row_c( const uint8_t * line, int stride, int width,
+                                int color_equal, int color_diff,
+                                int * cc_1, int * cc_2 )
+{
+    int j;
+    uint16_t s1, s2, s3, s4;
+
+    for( j = 0; j < width; ++j )
+    {
+        /* Look at groups of 4 sequential horizontal lines */
+        s1 = line[ j              ];
+        s2 = line[ j +     stride ];
+        s3 = line[ j + 2 * stride ];
+        s4 = line[ j + 3 * stride ];
+
+        /* Note if the 1st and 2nd lines are more different in
+           color than the 1st and 3rd lines are similar in color.*/
+        if ( ( abs( s1 - s3 ) < color_equal ) &&
+             ( abs( s1 - s2 ) > color_diff ) )
+                ++*cc_1;
+
+        /* Note if the 2nd and 3rd lines are more different in
+           color than the 2nd and 4th lines are similar in color.*/
+        if ( ( abs( s2 - s4 ) < color_equal ) &&
+             ( abs( s2 - s3 ) > color_diff) )
+                ++*cc_2;
+    }
+}
+
+hb_comb_functions_t hb_comb_functions =
+{
+    .detect_combed_row       = detect_combed_row_c,
+    .detect_gamma_combed_row = detect_gamma_combed_row_c,
+    .count_combed_row        = count_combed_row_c,
+};
+
+void hb_comb_detect_init( void )
+{
+#if defined(ARCH_X86)
+    hb_comb_detect_init_x86( &hb_comb_functions );
+#endif
+}
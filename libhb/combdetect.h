@@ -0,0 +1,62 @@
+/* combdetect.h
+ *
+ * Copyright (c) 2003-2015 HandBrake Team
+ * This file is part of the HandBrake source code.
+ * Homepage: <http://handbrake.fr/>.
+ * It may be used under the terms of the GNU General Public License v2.
+ * For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#ifndef HB_COMBDETECT_H
+#define HB_COMBDETECT_H
+
+#include <stdint.h>
+
+/*
+ * Per row kernels of the comb detection in decomb and hb_detect_comb().
+ *
+ * hb_comb_detect_init() selects the fastest implementation for the CPU
+ * and is called once from hb_global_init().  Every implementation gives
+ * exactly the same results as the C code in combdetect.c.
+ */
+typedef struct
+{
+    int           spatial_metric;
+    int           motion_threshold;
+    int           spatial_threshold;
+    int           ignore_motion;    // Mark combing with or without motion
+    const float * gamma_lut;        // Only used by detect_gamma_combed_row
+} hb_comb_params_t;
+
+/*
+ * Sets mask[x] to 1 for each combed pixel x of the row cur and to 0
+ * otherwise.  prev, cur and next point to the same row of the previous,
+ * current and next frame, which must have 2 rows above and below it.
+ */
+typedef void (hb_comb_row_func)(const hb_comb_params_t *params,
+                                const uint8_t *prev, const uint8_t *cur,
+                                const uint8_t *next, uint8_t *mask,
+                                int stride, int width);
+
+/*
+ * Adds to cc_1 the pixels of line that differ by more than color_diff
+ * from the next line and by less than color_equal from the line after
+ * it, and to cc_2 the same for the next line.  Reads 4 lines.
+ */
+typedef void (hb_comb_count_func)(const uint8_t *line, int stride, int width,
+                                  int color_equal, int color_diff,
+                                  int *cc_1, int *cc_2);
+
+typedef struct
+{
+    hb_comb_row_func   * detect_combed_row;
+    hb_comb_row_func   * detect_gamma_combed_row;
+    hb_comb_count_func * count_combed_row;
+} hb_comb_functions_t;
+
+extern hb_comb_functions_t hb_comb_functions;
+
+void hb_comb_detect_init(void);
+void hb_comb_detect_init_x86(hb_comb_functions_t *functions);
+
+#endif // HB_COMBDETECT_H
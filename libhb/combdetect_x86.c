@@ -0,0 +1,539 @@
+/* combdetect_x86.c
+
+   Copyright (c) 2003-2015 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "hb.h"     // needed for ARCH_X86
+
+#if defined(ARCH_X86)
+
+#include <emmintrin.h>
+
+#include "libavutil/cpu.h"
+#include "x86_target.h"
+#include "combdetect.h"
+
+/*
+ * The kernels compute exactly what the C code in combdetect.c does.
+ * Pixel differences are kept in 16 bit lanes, where they can't overflow,
+ * and the thresholds are clamped to the range of values they are
+ * compared against, which doesn't change the result of any comparison.
+ * The gamma kernel does the same float operations in the same order as
+ * the C code, which is only guaranteed with SSE math, so it is limited
+ * to x86-64.  The pixels after the last whole vector are left to the C
+ * code.
+ */
+static hb_comb_functions_t comb_c;
+
+typedef struct
+{
+    int use_motion;
+    int mthresh;
+    int athresh;
+    int athresh6;
+    int athresh_squared;
+} comb_thresholds_t;
+
+static void comb_thresholds(const hb_comb_params_t *params,
+                            comb_thresholds_t *t)
+{
+    int athresh = params->spatial_threshold;
+
+    t->use_motion      = params->motion_threshold > 0 && !params->ignore_motion;
+    t->mthresh         = MIN(params->motion_threshold, 255);
+    t->athresh         = MIN(MAX(athresh, -256), 255);
+    t->athresh6        = MIN(MAX(6 * athresh, -1), 6 * 255 + 1);
+    t->athresh_squared = athresh * athresh;
+}
+
+static inline __m128i absdiff_epi16_sse2(__m128i a, __m128i b)
+{
+    return _mm_max_epi16(_mm_sub_epi16(a, b), _mm_sub_epi16(b, a));
+}
+
+static inline __m128i load8_epi16_sse2(const uint8_t *p)
+{
+    return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)p),
+                             _mm_setzero_si128());
+}
+
+static void detect_combed_row_sse2(const hb_comb_params_t *params,
+                                   const uint8_t *prev, const uint8_t *cur,
+                                   const uint8_t *next, uint8_t *mask,
+                                   int stride, int width)
+{
+    const __m128i one = _mm_set1_epi8(1);
+    comb_thresholds_t t;
+    __m128i athresh, nathresh, mthresh, athresh6, athresh_squared;
+    __m128i ten, fifteen;
+    int x;
+
+    comb_thresholds(params, &t);
+    athresh         = _mm_set1_epi16(t.athresh);
+    nathresh        = _mm_set1_epi16(-t.athresh);
+    mthresh         = _mm_set1_epi16(t.mthresh);
+    athresh6        = _mm_set1_epi16(t.athresh6);
+    athresh_squared = _mm_set1_epi32(t.athresh_squared);
+    ten             = _mm_set1_epi16(10);
+    fifteen         = _mm_set1_epi16(15);
+
+    for (x = 0; x + 8 <= width; x += 8)
+    {
+        __m128i c  = load8_epi16_sse2(cur + x);
+        __m128i u1 = load8_epi16_sse2(cur + x - stride);
+        __m128i d1 = load8_epi16_sse2(cur + x + stride);
+        __m128i ud = _mm_sub_epi16(c, u1);
+        __m128i dd = _mm_sub_epi16(c, d1);
+        __m128i m, s;
+
+        // The pixels above and below differ in the same direction
+        m = _mm_or_si128(_mm_and_si128(_mm_cmpgt_epi16(ud, athresh),
+                                       _mm_cmpgt_epi16(dd, athresh)),
+                         _mm_and_si128(_mm_cmplt_epi16(ud, nathresh),
+                                       _mm_cmplt_epi16(dd, nathresh)));
+        if (!_mm_movemask_epi8(m))
+        {
+            _mm_storel_epi64((__m128i*)(mask + x), _mm_setzero_si128());
+            continue;
+        }
+
+        if (t.use_motion)
+        {
+            __m128i p   = load8_epi16_sse2(prev + x);
+            __m128i pu1 = load8_epi16_sse2(prev + x - stride);
+            __m128i pd1 = load8_epi16_sse2(prev + x + stride);
+            __m128i n   = load8_epi16_sse2(next + x);
+            __m128i nu1 = load8_epi16_sse2(next + x - stride);
+            __m128i nd1 = load8_epi16_sse2(next + x + stride);
+            __m128i m1, m2;
+
+            m1 = _mm_and_si128(
+                _mm_and_si128(_mm_cmpgt_epi16(absdiff_epi16_sse2(p, c), mthresh),
+                              _mm_cmpgt_epi16(absdiff_epi16_sse2(u1, nu1), mthresh)),
+                _mm_cmpgt_epi16(absdiff_epi16_sse2(d1, nd1), mthresh));
+            m2 = _mm_and_si128(
+                _mm_and_si128(_mm_cmpgt_epi16(absdiff_epi16_sse2(n, c), mthresh),
+                              _mm_cmpgt_epi16(absdiff_epi16_sse2(pu1, u1), mthresh)),
+                _mm_cmpgt_epi16(absdiff_epi16_sse2(pd1, d1), mthresh));
+            m = _mm_and_si128(m, _mm_or_si128(m1, m2));
+        }
+
+        switch (params->spatial_metric)
+        {
+            case 0:
+            {
+                __m128i d2 = load8_epi16_sse2(cur + x + 2 * stride);
+                s = _mm_and_si128(_mm_cmplt_epi16(absdiff_epi16_sse2(c, d2), ten),
+                                  _mm_cmpgt_epi16(absdiff_epi16_sse2(c, d1), fifteen));
+            } break;
+
+            case 1:
+            {
+                // The product needs 17 bits, so it is compared at 32
+                __m128i a  = _mm_sub_epi16(u1, c);
+                __m128i b  = _mm_sub_epi16(d1, c);
+                __m128i lo = _mm_mullo_epi16(a, b);
+                __m128i hi = _mm_mulhi_epi16(a, b);
+                s = _mm_packs_epi32(
+                    _mm_cmpgt_epi32(_mm_unpacklo_epi16(lo, hi), athresh_squared),
+                    _mm_cmpgt_epi32(_mm_unpackhi_epi16(lo, hi), athresh_squared));
+            } break;
+
+            case 2:
+            {
+                __m128i u2 = load8_epi16_sse2(cur + x - 2 * stride);
+                __m128i d2 = load8_epi16_sse2(cur + x + 2 * stride);
+                __m128i a  = _mm_add_epi16(_mm_add_epi16(u2, d2),
+                                           _mm_slli_epi16(c, 2));
+                __m128i b  = _mm_add_epi16(u1, d1);
+                b = _mm_add_epi16(b, _mm_add_epi16(b, b));
+                s = _mm_cmpgt_epi16(absdiff_epi16_sse2(a, b), athresh6);
+            } break;
+
+            default:
+            {
+                s = _mm_setzero_si128();
+            } break;
+        }
+        m = _mm_and_si128(m, s);
+        _mm_storel_epi64((__m128i*)(mask + x),
+                         _mm_and_si128(_mm_packs_epi16(m, m), one));
+    }
+    if (x < width)
+    {
+        comb_c.detect_combed_row(params, prev + x, cur + x, next + x,
+                                 mask + x, stride, width - x);
+    }
+}
+
+static void count_combed_row_sse2(const uint8_t *line, int stride, int width,
+                                  int color_equal, int color_diff,
+                                  int *cc_1, int *cc_2)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one  = _mm_set1_epi8(1);
+    __m128i equal, diff, sum_1, sum_2;
+    int x;
+
+    // |a - b| < color_equal is |a - b| -sat (color_equal - 1) == 0 and
+    // |a - b| > color_diff is |a - b| -sat color_diff != 0
+    if (color_equal < 1 || color_equal > 255 ||
+        color_diff  < 0 || color_diff  > 254)
+    {
+        comb_c.count_combed_row(line, stride, width,
+                                color_equal, color_diff, cc_1, cc_2);
+        return;
+    }
+    equal = _mm_set1_epi8(color_equal - 1);
+    diff  = _mm_set1_epi8(color_diff);
+    sum_1 = sum_2 = _mm_setzero_si128();
+
+    for (x = 0; x + 16 <= width; x += 16)
+    {
+        __m128i s1 = _mm_loadu_si128((const __m128i*)(line + x));
+        __m128i s2 = _mm_loadu_si128((const __m128i*)(line + x + stride));
+        __m128i s3 = _mm_loadu_si128((const __m128i*)(line + x + 2 * stride));
+        __m128i s4 = _mm_loadu_si128((const __m128i*)(line + x + 3 * stride));
+        __m128i d12, d13, d23, d24, c1, c2;
+
+        d12 = _mm_or_si128(_mm_subs_epu8(s1, s2), _mm_subs_epu8(s2, s1));
+        d13 = _mm_or_si128(_mm_subs_epu8(s1, s3), _mm_subs_epu8(s3, s1));
+        d23 = _mm_or_si128(_mm_subs_epu8(s2, s3), _mm_subs_epu8(s3, s2));
+        d24 = _mm_or_si128(_mm_subs_epu8(s2, s4), _mm_subs_epu8(s4, s2));
+
+        c1 = _mm_andnot_si128(_mm_cmpeq_epi8(_mm_subs_epu8(d12, diff), zero),
+                              _mm_cmpeq_epi8(_mm_subs_epu8(d13, equal), zero));
+        c2 = _mm_andnot_si128(_mm_cmpeq_epi8(_mm_subs_epu8(d23, diff), zero),
+                              _mm_cmpeq_epi8(_mm_subs_epu8(d24, equal), zero));
+        sum_1 = _mm_add_epi64(sum_1, _mm_sad_epu8(_mm_and_si128(c1, one), zero));
+        sum_2 = _mm_add_epi64(sum_2, _mm_sad_epu8(_mm_and_si128(c2, one), zero));
+    }
+    sum_1 = _mm_add_epi64(sum_1, _mm_unpackhi_epi64(sum_1, sum_1));
+    sum_2 = _mm_add_epi64(sum_2, _mm_unpackhi_epi64(sum_2, sum_2));
+    *cc_1 += _mm_cvtsi128_si32(sum_1);
+    *cc_2 += _mm_cvtsi128_si32(sum_2);
+
+    if (x < width)
+    {
+        comb_c.count_combed_row(line + x, stride, width - x,
+                                color_equal, color_diff, cc_1, cc_2);
+    }
+}
+
+#if defined(HB_X86_AVX2)
+TARGET_AVX2
+static inline __m256i absdiff_epi16_avx2(__m256i a, __m256i b)
+{
+    return _mm256_max_epi16(_mm256_sub_epi16(a, b), _mm256_sub_epi16(b, a));
+}
+
+TARGET_AVX2
+static inline __m256i load16_epi16_avx2(const uint8_t *p)
+{
+    return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)p));
+}
+
+TARGET_AVX2
+static void detect_combed_row_avx2(const hb_comb_params_t *params,
+                                   const uint8_t *prev, const uint8_t *cur,
+                                   const uint8_t *next, uint8_t *mask,
+                                   int stride, int width)
+{
+    const __m128i one = _mm_set1_epi8(1);
+    comb_thresholds_t t;
+    __m256i athresh, nathresh, mthresh, athresh6, athresh_squared;
+    __m256i ten, fifteen;
+    int x;
+
+    comb_thresholds(params, &t);
+    athresh         = _mm256_set1_epi16(t.athresh);
+    nathresh        = _mm256_set1_epi16(-t.athresh);
+    mthresh         = _mm256_set1_epi16(t.mthresh);
+    athresh6        = _mm256_set1_epi16(t.athresh6);
+    athresh_squared = _mm256_set1_epi32(t.athresh_squared);
+    ten             = _mm256_set1_epi16(10);
+    fifteen         = _mm256_set1_epi16(15);
+
+    for (x = 0; x + 16 <= width; x += 16)
+    {
+        __m256i c  = load16_epi16_avx2(cur + x);
+        __m256i u1 = load16_epi16_avx2(cur + x - stride);
+        __m256i d1 = load16_epi16_avx2(cur + x + stride);
+        __m256i ud = _mm256_sub_epi16(c, u1);
+        __m256i dd = _mm256_sub_epi16(c, d1);
+        __m256i m, s;
+        __m128i m8;
+
+        // The pixels above and below differ in the same direction
+        m = _mm256_or_si256(
+            _mm256_and_si256(_mm256_cmpgt_epi16(ud, athresh),
+                             _mm256_cmpgt_epi16(dd, athresh)),
+            _mm256_and_si256(_mm256_cmpgt_epi16(nathresh, ud),
+                             _mm256_cmpgt_epi16(nathresh, dd)));
+        if (_mm256_testz_si256(m, m))
+        {
+            _mm_storeu_si128((__m128i*)(mask + x), _mm_setzero_si128());
+            continue;
+        }
+
+        if (t.use_motion)
+        {
+            __m256i p   = load16_epi16_avx2(prev + x);
+            __m256i pu1 = load16_epi16_avx2(prev + x - stride);
+            __m256i pd1 = load16_epi16_avx2(prev + x + stride);
+            __m256i n   = load16_epi16_avx2(next + x);
+            __m256i nu1 = load16_epi16_avx2(next + x - stride);
+            __m256i nd1 = load16_epi16_avx2(next + x + stride);
+            __m256i m1, m2;
+
+            m1 = _mm256_and_si256(
+                _mm256_and_si256(_mm256_cmpgt_epi16(absdiff_epi16_avx2(p, c), mthresh),
+                                 _mm256_cmpgt_epi16(absdiff_epi16_avx2(u1, nu1), mthresh)),
+                _mm256_cmpgt_epi16(absdiff_epi16_avx2(d1, nd1), mthresh));
+            m2 = _mm256_and_si256(
+                _mm256_and_si256(_mm256_cmpgt_epi16(absdiff_epi16_avx2(n, c), mthresh),
+                                 _mm256_cmpgt_epi16(absdiff_epi16_avx2(pu1, u1), mthresh)),
+                _mm256_cmpgt_epi16(absdiff_epi16_avx2(pd1, d1), mthresh));
+            m = _mm256_and_si256(m, _mm256_or_si256(m1, m2));
+        }
+
+        switch (params->spatial_metric)
+        {
+            case 0:
+            {
+                __m256i d2 = load16_epi16_avx2(cur + x + 2 * stride);
+                s = _mm256_and_si256(
+                    _mm256_cmpgt_epi16(ten, absdiff_epi16_avx2(c, d2)),
+                    _mm256_cmpgt_epi16(absdiff_epi16_avx2(c, d1), fifteen));
+            } break;
+
+            case 1:
+            {
+                // The product needs 17 bits, so it is compared at 32.
+                // Unpacking and packing both work within 128 bit lanes,
+                // so the pixels come out in order
+                __m256i a  = _mm256_sub_epi16(u1, c);
+                __m256i b  = _mm256_sub_epi16(d1, c);
+                __m256i lo = _mm256_mullo_epi16(a, b);
+                __m256i hi = _mm256_mulhi_epi16(a, b);
+                s = _mm256_packs_epi32(
+                    _mm256_cmpgt_epi32(_mm256_unpacklo_epi16(lo, hi), athresh_squared),
+                    _mm256_cmpgt_epi32(_mm256_unpackhi_epi16(lo, hi), athresh_squared));
+            } break;
+
+            case 2:
+            {
+                __m256i u2 = load16_epi16_avx2(cur + x - 2 * stride);
+                __m256i d2 = load16_epi16_avx2(cur + x + 2 * stride);
+                __m256i a  = _mm256_add_epi16(_mm256_add_epi16(u2, d2),
+                                              _mm256_slli_epi16(c, 2));
+                __m256i b  = _mm256_add_epi16(u1, d1);
+                b = _mm256_add_epi16(b, _mm256_add_epi16(b, b));
+                s = _mm256_cmpgt_epi16(absdiff_epi16_avx2(a, b), athresh6);
+            } break;
+
+            default:
+            {
+                s = _mm256_setzero_si256();
+            } break;
+        }
+        m  = _mm256_and_si256(m, s);
+        m8 = _mm_packs_epi16(_mm256_castsi256_si128(m),
+                             _mm256_extracti128_si256(m, 1));
+        _mm_storeu_si128((__m128i*)(mask + x), _mm_and_si128(m8, one));
+    }
+    if (x < width)
+    {
+        detect_combed_row_sse2(params, prev + x, cur + x, next + x,
+                               mask + x, stride, width - x);
+    }
+}
+
+#if ARCH_X86_64
+TARGET_AVX2
+static inline __m256 gamma8_avx2(const float *lut, const uint8_t *p)
+{
+    __m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)p));
+    return _mm256_i32gather_ps(lut, idx, 4);
+}
+
+TARGET_AVX2
+static inline __m256 gamma_absdiff_avx2(__m256 a, __m256 b)
+{
+    return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), _mm256_sub_ps(a, b));
+}
+
+TARGET_AVX2
+static void detect_gamma_combed_row_avx2(const hb_comb_params_t *params,
+                                         const uint8_t *prev,
+                                         const uint8_t *cur,
+                                         const uint8_t *next,
+                                         uint8_t *mask, int stride, int width)
+{
+    const float *lut = params->gamma_lut;
+    const __m128i one = _mm_set1_epi8(1);
+    float mthresh  = (float)params->motion_threshold / (float)255;
+    float athresh  = (float)params->spatial_threshold / (float)255;
+    float athresh6 = 6 *athresh;
+    int use_motion = mthresh > 0 && !params->ignore_motion;
+    __m256 at   = _mm256_set1_ps(athresh);
+    __m256 nat  = _mm256_set1_ps(-athresh);
+    __m256 mt   = _mm256_set1_ps(mthresh);
+    __m256 at6  = _mm256_set1_ps(athresh6);
+    int x;
+
+    for (x = 0; x + 8 <= width; x += 8)
+    {
+        __m256 c  = gamma8_avx2(lut, cur + x);
+        __m256 u1 = gamma8_avx2(lut, cur + x - stride);
+        __m256 d1 = gamma8_avx2(lut, cur + x + stride);
+        __m256 ud = _mm256_sub_ps(c, u1);
+        __m256 dd = _mm256_sub_ps(c, d1);
+        __m256 m, combing;
+        __m256i mi;
+        __m128i m16;
+
+        // The pixels above and below differ in the same direction
+        m = _mm256_or_ps(_mm256_and_ps(_mm256_cmp_ps(ud, at, _CMP_GT_OQ),
+                                       _mm256_cmp_ps(dd, at, _CMP_GT_OQ)),
+                         _mm256_and_ps(_mm256_cmp_ps(ud, nat, _CMP_LT_OQ),
+                                       _mm256_cmp_ps(dd, nat, _CMP_LT_OQ)));
+        if (_mm256_testz_ps(m, m))
+        {
+            _mm_storel_epi64((__m128i*)(mask + x), _mm_setzero_si128());
+            continue;
+        }
+
+        if (use_motion)
+        {
+            __m256 p   = gamma8_avx2(lut, prev + x);
+            __m256 pu1 = gamma8_avx2(lut, prev + x - stride);
+            __m256 pd1 = gamma8_avx2(lut, prev + x + stride);
+            __m256 n   = gamma8_avx2(lut, next + x);
+            __m256 nu1 = gamma8_avx2(lut, next + x - stride);
+            __m256 nd1 = gamma8_avx2(lut, next + x + stride);
+            __m256 m1, m2;
+
+            m1 = _mm256_and_ps(
+                _mm256_and_ps(_mm256_cmp_ps(gamma_absdiff_avx2(p, c), mt, _CMP_GT_OQ),
+                              _mm256_cmp_ps(gamma_absdiff_avx2(u1, nu1), mt, _CMP_GT_OQ)),
+                _mm256_cmp_ps(gamma_absdiff_avx2(d1, nd1), mt, _CMP_GT_OQ));
+            m2 = _mm256_and_ps(
+                _mm256_and_ps(_mm256_cmp_ps(gamma_absdiff_avx2(n, c), mt, _CMP_GT_OQ),
+                              _mm256_cmp_ps(gamma_absdiff_avx2(pu1, u1), mt, _CMP_GT_OQ)),
+                _mm256_cmp_ps(gamma_absdiff_avx2(pd1, d1), mt, _CMP_GT_OQ));
+            m = _mm256_and_ps(m, _mm256_or_ps(m1, m2));
+        }
+
+        // (u2 + 4 * c + d2) - 3 * (u1 + d1), in the order the C code
+        // evaluates it
+        combing = _mm256_add_ps(_mm256_add_ps(gamma8_avx2(lut, cur + x - 2 * stride),
+                                              _mm256_mul_ps(_mm256_set1_ps(4.0f), c)),
+                                gamma8_avx2(lut, cur + x + 2 * stride));
+        combing = _mm256_sub_ps(combing,
+                                _mm256_mul_ps(_mm256_set1_ps(3.0f),
+                                              _mm256_add_ps(u1, d1)));
+        combing = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), combing);
+        m  = _mm256_and_ps(m, _mm256_cmp_ps(combing, at6, _CMP_GT_OQ));
+
+        mi  = _mm256_castps_si256(m);
+        m16 = _mm_packs_epi32(_mm256_castsi256_si128(mi),
+                              _mm256_extracti128_si256(mi, 1));
+        _mm_storel_epi64((__m128i*)(mask + x),
+                         _mm_and_si128(_mm_packs_epi16(m16, m16), one));
+    }
+    if (x < width)
+    {
+        comb_c.detect_gamma_combed_row(params, prev + x, cur + x, next + x,
+                                       mask + x, stride, width - x);
+    }
+}
+#endif // ARCH_X86_64
+
+TARGET_AVX2
+static void count_combed_row_avx2(const uint8_t *line, int stride, int width,
+                                  int color_equal, int color_diff,
+                                  int *cc_1, int *cc_2)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one  = _mm256_set1_epi8(1);
+    __m256i equal, diff, sum_1, sum_2;
+    __m128i s;
+    int x;
+
+    if (color_equal < 1 || color_equal > 255 ||
+        color_diff  < 0 || color_diff  > 254)
+    {
+        comb_c.count_combed_row(line, stride, width,
+                                color_equal, color_diff, cc_1, cc_2);
+        return;
+    }
+    equal = _mm256_set1_epi8(color_equal - 1);
+    diff  = _mm256_set1_epi8(color_diff);
+    sum_1 = sum_2 = _mm256_setzero_si256();
+
+    for (x = 0; x + 32 <= width; x += 32)
+    {
+        __m256i s1 = _mm256_loadu_si256((const __m256i*)(line + x));
+        __m256i s2 = _mm256_loadu_si256((const __m256i*)(line + x + stride));
+        __m256i s3 = _mm256_loadu_si256((const __m256i*)(line + x + 2 * stride));
+        __m256i s4 = _mm256_loadu_si256((const __m256i*)(line + x + 3 * stride));
+        __m256i d12, d13, d23, d24, c1, c2;
+
+        d12 = _mm256_sub_epi8(_mm256_max_epu8(s1, s2), _mm256_min_epu8(s1, s2));
+        d13 = _mm256_sub_epi8(_mm256_max_epu8(s1, s3), _mm256_min_epu8(s1, s3));
+        d23 = _mm256_sub_epi8(_mm256_max_epu8(s2, s3), _mm256_min_epu8(s2, s3));
+        d24 = _mm256_sub_epi8(_mm256_max_epu8(s2, s4), _mm256_min_epu8(s2, s4));
+
+        c1 = _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_subs_epu8(d12, diff), zero),
+                                 _mm256_cmpeq_epi8(_mm256_subs_epu8(d13, equal), zero));
+        c2 = _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_subs_epu8(d23, diff), zero),
+                                 _mm256_cmpeq_epi8(_mm256_subs_epu8(d24, equal), zero));
+        sum_1 = _mm256_add_epi64(sum_1, _mm256_sad_epu8(_mm256_and_si256(c1, one), zero));
+        sum_2 = _mm256_add_epi64(sum_2, _mm256_sad_epu8(_mm256_and_si256(c2, one), zero));
+    }
+    s = _mm_add_epi64(_mm256_castsi256_si128(sum_1),
+                      _mm256_extracti128_si256(sum_1, 1));
+    *cc_1 += _mm_cvtsi128_si32(_mm_add_epi64(s, _mm_unpackhi_epi64(s, s)));
+    s = _mm_add_epi64(_mm256_castsi256_si128(sum_2),
+                      _mm256_extracti128_si256(sum_2, 1));
+    *cc_2 += _mm_cvtsi128_si32(_mm_add_epi64(s, _mm_unpackhi_epi64(s, s)));
+
+    if (x < width)
+    {
+        count_combed_row_sse2(line + x, stride, width - x,
+                              color_equal, color_diff, cc_1, cc_2);
+    }
+}
+#endif // HB_X86_AVX2
+
+void hb_comb_detect_init_x86(hb_comb_functions_t *functions)
+{
+    int cpu_flags = av_get_cpu_flags();
+
+    // The C functions finish the rows
+    comb_c = *functions;
+
+#if defined(HB_X86_AVX2)
+    if (cpu_flags & AV_CPU_FLAG_AVX2)
+    {
+        functions->detect_combed_row       = detect_combed_row_avx2;
+#if ARCH_X86_64
+        functions->detect_gamma_combed_row = detect_gamma_combed_row_avx2;
+#endif
+        functions->count_combed_row        = count_combed_row_avx2;
+        return;
+    }
+#endif
+    if (cpu_flags & AV_CPU_FLAG_SSE2)
+    {
+        functions->detect_combed_row       = detect_combed_row_sse2;
+        functions->count_combed_row        = count_combed_row_sse2;
+    }
+}
+
+#endif // ARCH_X86
@@ -3070,6 +3070,36 @@ void hb_title_close( hb_title_t ** _t )
     *_t = NULL;
 }
 
+/**********************************************************************
+ * hb_title_copy
+ **********************************************************************
+ *
+ *********************************************************************/
+hb_title_t * hb_title_copy( const hb_title_t * src )
+{
+    hb_title_t * t = NULL;
+
+    if ( src )
+    {
+        t = calloc( 1, sizeof( *t ) );
+        memcpy( t, src, sizeof( *t ) );
+        t->list_chapter    = hb_chapter_list_copy( src->list_chapter );
+        t->list_audio      = hb_audio_list_copy( src->list_audio );
+        t->list_subtitle   = hb_subtitle_list_copy( src->list_subtitle );
+        t->list_attachment = hb_attachment_list_copy( src->list_attachment );
+        t->metadata        = hb_metadata_copy( src->metadata );
+        if ( src->video_codec_name )
+        {
+            t->video_codec_name = strdup( src->video_codec_name );
+        }
+        if ( src->container_name )
+        {
+            t->container_name = strdup( src->container_name );
+        }
+    }
+    return t;
+}
+
 static void job_setup(hb_job_t * job, hb_title_t * title)
 {
     if ( job == NULL || title == NULL )
@@ -3176,6 +3206,13 @@ static void job_clean( hb_job_t * job )
         }
         hb_list_close( &job->list_subtitle );
 
+        while( ( subtitle = hb_list_item( job->list_subtitle_search, 0 ) ) )
+        {
+            hb_list_rem( job->list_subtitle_search, subtitle );
+            hb_subtitle_close( &subtitle );
+        }
+        hb_list_close( &job->list_subtitle_search );
+
         // clean up filter list
         while( ( filter = hb_list_item( job->list_filter, 0 ) ) )
         {
@@ -482,7 +482,11 @@ struct hb_job_s
          vrate:             output framerate
          cfr:               0 (vfr), 1 (cfr), 2 (pfr) [see render.c]
          pass:              0, 1 or 2 (or -1 for scan)
-         areBframes:        boolean to note if b-frames are used */
+         areBframes:        boolean to note if b-frames are used
+         segments:          encode the video in this many segments at once
+                            (0 or 1 for a single encoder) [see segment.c]
+         frame_spool:       boolean, 2-pass only, the 2nd pass encodes the
+                            frames filtered by the 1st [see framespool.c] */
 #define HB_VCODEC_MASK         0x0000FFF
 #define HB_VCODEC_INVALID      0x0000000
 #define HB_VCODEC_X264         0x0000001
@@ -510,6 +514,8 @@ struct hb_job_s
     char           *encoder_profile;
     char           *encoder_level;
     int             areBframes;
+    int             segments;
+    int             frame_spool;
 
     int             color_matrix_code;
     int             color_prim;
@@ -567,10 +573,15 @@ struct hb_job_s
     char          * file;
 
     int             mp4_optimize;
+    int             mp4_fragment;       // fragmented mp4 (moof/mdat), written
+                                        //  progressively, no fast start pass
     int             ipod_atom;
 
     int                     indepth_scan;
     hb_subtitle_config_t    select_subtitle_config;
+    // Foreign Audio Search candidates counted by this encode pass
+    // instead of a separate scan pass
+    PRIVATE hb_list_t     * list_subtitle_search;
 
     int             angle;              // dvd angle to encode
     int             frame_to_start;     // declare eof when we hit this frame
@@ -617,6 +628,11 @@ struct hb_job_s
     volatile int  * die;
     volatile int    done;
 
+    int             slot;         /* job slot the job runs in */
+    int             cpu_budget;   /* CPUs the job's codecs may use, 0 for all */
+    struct hb_segment_s * segment; /* segmented video encode, see segment.c */
+    int             segment_index; /* 0 for the job, > 0 for its segments */
+
     uint64_t        st_pause_date;
     uint64_t        st_paused;
 
@@ -1114,6 +1130,8 @@ struct hb_work_object_s
     int                 thread_sleep_interval;
 
     hb_handle_t       * h;
+
+    hb_profile_stage_t * profile;
 #endif
 };
 
@@ -1142,6 +1160,9 @@ extern hb_work_object_t hb_encca_aac;
 extern hb_work_object_t hb_encca_haac;
 extern hb_work_object_t hb_encavcodeca;
 extern hb_work_object_t hb_reader;
+extern hb_work_object_t hb_segment_encoder;
+extern hb_work_object_t hb_segment_spool;
+extern hb_work_object_t hb_frame_spool_encoder;
 
 #define HB_FILTER_OK      0
 #define HB_FILTER_DELAY   1
@@ -1200,6 +1221,17 @@ struct hb_filter_object_s
     // These are used to bridge the chapter to the next buffer
     int                 chapter_val;
     int64_t             chapter_time;
+
+    // Set by filters whose work() keeps no state from one frame to the
+    // next.  filter_loop may then run several private instances of the
+    // filter on consecutive frames concurrently (see work.c).
+    int                 frame_threaded;
+    struct hb_filter_frames_s * frames;
+    // Number of instances of the filter that filter_loop runs at once,
+    // set on every instance.  0 when the filter runs as a single one.
+    int                 frame_threads;
+
+    hb_profile_stage_t * profile;
 #endif
 };
 
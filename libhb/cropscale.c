@@ -11,6 +11,36 @@
 #include "hbffmpeg.h"
 #include "common.h"
 #include "opencl.h"
+#include "taskset.h"
+
+/* Fewest output rows of a band and the coarsest band alignment that
+ * splitting the scale into bands is worth */
+#define BAND_MIN_ROWS   128
+#define BAND_MAX_ALIGN  64
+
+/*
+ * Horizontal band of the output scaled by its own swscale context.
+ * The context scales rows src_y.. of the cropped source into the band
+ * plus 'margin' rows above and below it, so that the rows of the band
+ * see the same source rows as in the single context of the frame.
+ */
+typedef struct
+{
+    struct SwsContext * context;
+    int                 dst_y;          // first output row of the band
+    int                 dst_h;          // output rows of the band
+    int                 src_y;          // first source row the context reads
+    int                 src_h;          // source rows the context reads
+    int                 margin;         // rows the context outputs above dst_y
+    uint8_t           * scratch[4];     // output of the context
+    int                 scratch_stride[4];
+} crop_scale_band_t;
+
+typedef struct
+{
+    hb_filter_private_t * pv;
+    int                   segment;
+} crop_scale_thread_arg_t;
 
 struct hb_filter_private_s
 {
@@ -30,6 +60,13 @@ struct hb_filter_private_s
     hb_oclscale_t      *os; //ocl scaler handler
 
     struct SwsContext * context;
+
+    int                 frame_threads;  // instances scaling frames at once
+    int                 band_count;     // 0 if the frame is scaled at once
+    crop_scale_band_t * bands;
+    taskslices_t        band_taskset;   // Slices for the bands
+    AVPicture           band_in;        // cropped frame being scaled
+    AVPicture           band_out;
 };
 
 static int hb_crop_scale_init( hb_filter_object_t * filter,
@@ -44,6 +81,8 @@ static int hb_crop_scale_info( hb_filter_object_t * filter,
 
 static void hb_crop_scale_close( hb_filter_object_t * filter );
 
+static void crop_scale_bands_close( hb_filter_private_t * pv );
+
 hb_filter_object_t hb_filter_crop_scale =
 {
     .id            = HB_FILTER_CROP_SCALE,
@@ -54,6 +93,7 @@ hb_filter_object_t hb_filter_crop_scale =
     .work          = hb_crop_scale_work,
     .close         = hb_crop_scale_close,
     .info          = hb_crop_scale_info,
+    .frame_threaded = 1,
 };
 
 static int hb_crop_scale_init( hb_filter_object_t * filter,
@@ -146,6 +186,7 @@ static void hb_crop_scale_close( hb_filter_object_t * filter )
         free(pv->os);
     }
 
+    crop_scale_bands_close( pv );
     if( pv->context )
     {
         sws_freeContext( pv->context );
@@ -155,6 +196,274 @@ static void hb_crop_scale_close( hb_filter_object_t * filter )
     filter->private_data = NULL;
 }
 
+/*
+ * Scales one band of the frame, see crop_scale_bands_init.
+ */
+static void crop_scale_band( void *thread_args_v )
+{
+    crop_scale_thread_arg_t *thread_args = thread_args_v;
+    hb_filter_private_t * pv = thread_args->pv;
+    crop_scale_band_t * band = &pv->bands[thread_args->segment];
+    const uint8_t * src[4] = { NULL, };
+    int plane, y;
+
+    for( plane = 0; plane < 3; plane++ )
+    {
+        int shift = plane ? 1 : 0;
+        src[plane] = pv->band_in.data[plane] +
+                     ( band->src_y >> shift ) * pv->band_in.linesize[plane];
+    }
+    sws_scale( band->context, src, pv->band_in.linesize, 0, band->src_h,
+               band->scratch, band->scratch_stride );
+
+    // Keep the rows of the band, the rows of the margins belong to the
+    // neighbouring bands
+    for( plane = 0; plane < 3; plane++ )
+    {
+        int shift = plane ? 1 : 0;
+        int width = av_image_get_linesize( AV_PIX_FMT_YUV420P,
+                                           pv->width_out, plane );
+        uint8_t * dst = pv->band_out.data[plane] +
+                        ( band->dst_y >> shift ) * pv->band_out.linesize[plane];
+        uint8_t * row = band->scratch[plane] +
+                        ( band->margin >> shift ) * band->scratch_stride[plane];
+
+        for( y = 0; y < band->dst_h >> shift; y++ )
+        {
+            memcpy( dst, row, width );
+            dst += pv->band_out.linesize[plane];
+            row += band->scratch_stride[plane];
+        }
+    }
+}
+
+/*
+ * Scales pv->band_in into pv->band_out in bands
+ */
+static void crop_scale_bands( hb_filter_private_t * pv )
+{
+    /*
+     * Allow the shared workers to make one pass over the data.
+     */
+    taskslices_cycle( &pv->band_taskset );
+}
+
+static void crop_scale_bands_close( hb_filter_private_t * pv )
+{
+    int ii;
+
+    if( pv->bands == NULL )
+    {
+        return;
+    }
+    if( pv->band_count > 0 )
+    {
+        taskslices_fini( &pv->band_taskset );
+    }
+    for( ii = 0; ii < pv->band_count; ii++ )
+    {
+        if( pv->bands[ii].context != NULL )
+        {
+            sws_freeContext( pv->bands[ii].context );
+        }
+        av_freep( &pv->bands[ii].scratch[0] );
+    }
+    free( pv->bands );
+    pv->bands = NULL;
+    pv->band_count = 0;
+}
+
+/*
+ * Checks that the bands scale exactly like pv->context by scaling a
+ * frame of noise both ways.
+ */
+static int crop_scale_bands_check( hb_filter_private_t * pv,
+                                   int width, int height )
+{
+    uint8_t * src[4], * ref[4], * out[4];
+    int src_stride[4], ref_stride[4], out_stride[4];
+    uint32_t seed = 1;
+    int plane, y, ii, ret = -1;
+
+    if( av_image_alloc( src, src_stride, width, height,
+                        AV_PIX_FMT_YUV420P, 32 ) < 0 )
+    {
+        return -1;
+    }
+    if( av_image_alloc( ref, ref_stride, pv->width_out, pv->height_out,
+                        AV_PIX_FMT_YUV420P, 32 ) < 0 )
+    {
+        av_freep( &src[0] );
+        return -1;
+    }
+    if( av_image_alloc( out, out_stride, pv->width_out, pv->height_out,
+                        AV_PIX_FMT_YUV420P, 32 ) < 0 )
+    {
+        av_freep( &src[0] );
+        av_freep( &ref[0] );
+        return -1;
+    }
+    for( plane = 0; plane < 3; plane++ )
+    {
+        int h = plane ? height >> 1 : height;
+        for( y = 0; y < h * src_stride[plane]; y++ )
+        {
+            seed = seed * 1664525 + 1013904223;
+            src[plane][y] = seed >> 24;
+        }
+    }
+
+    sws_scale( pv->context, (const uint8_t* const*)src, src_stride,
+               0, height, ref, ref_stride );
+    for( plane = 0; plane < 4; plane++ )
+    {
+        pv->band_in.data[plane]      = src[plane];
+        pv->band_in.linesize[plane]  = src_stride[plane];
+        pv->band_out.data[plane]     = out[plane];
+        pv->band_out.linesize[plane] = out_stride[plane];
+    }
+    for( ii = 0; ii < pv->band_count; ii++ )
+    {
+        crop_scale_thread_arg_t *thread_args;
+
+        thread_args = taskslices_args( &pv->band_taskset, ii );
+        crop_scale_band( thread_args );
+    }
+
+    ret = 0;
+    for( plane = 0; plane < 3 && !ret; plane++ )
+    {
+        int h = plane ? pv->height_out >> 1 : pv->height_out;
+        int w = av_image_get_linesize( AV_PIX_FMT_YUV420P,
+                                       pv->width_out, plane );
+        for( y = 0; y < h && !ret; y++ )
+        {
+            ret = memcmp( ref[plane] + y * ref_stride[plane],
+                          out[plane] + y * out_stride[plane], w ) ? -1 : 0;
+        }
+    }
+
+    av_freep( &src[0] );
+    av_freep( &ref[0] );
+    av_freep( &out[0] );
+    return ret;
+}
+
+/*
+ * Splits the scale of a width x height yuv420 frame into horizontal
+ * bands that are scaled in parallel, one swscale context per band.
+ *
+ * The vertical filter swscale uses for an output row depends only on
+ * the position of the row in the source, and the positions step by the
+ * scale factor in 16.16 fixed point.  When that step is exact and a
+ * band starts at a row whose position is a whole source row, a context
+ * for the band computes the same filter for its rows as the context of
+ * the frame, except near its edges where the filter is clipped.  So
+ * each band context also outputs a margin above and below the band and
+ * only the rows of the band are kept.
+ *
+ * Leaves band_count at 0 when the scale factor doesn't allow it or the
+ * bands don't give exactly the output of the frame's context.
+ */
+static void crop_scale_bands_init( hb_filter_private_t * pv,
+                                   int width, int height )
+{
+    int64_t inc;
+    int align, margin, count, ii;
+
+    crop_scale_bands_close( pv );
+
+    if( pv->pix_fmt != AV_PIX_FMT_YUV420P ||
+        pv->pix_fmt_out != AV_PIX_FMT_YUV420P ||
+        ( height & 1 ) || ( pv->height_out & 1 ) ||
+        ( ( (int64_t)height << 16 ) % pv->height_out ) ||
+        ( ( (int64_t)( height >> 1 ) << 16 ) % ( pv->height_out >> 1 ) ) )
+    {
+        return;
+    }
+    inc = ( (int64_t)height << 16 ) / pv->height_out;
+
+    // Bands start at even rows that map to whole source rows in luma
+    // and chroma
+    align = 2 * ( 65536 / av_gcd( inc, 65536 ) );
+    if( align > BAND_MAX_ALIGN )
+    {
+        return;
+    }
+    // Instances running on other frames share the cpus with this one
+    count = MIN( hb_get_cpu_count() / MAX( pv->frame_threads, 1 ),
+                 pv->height_out / MAX( BAND_MIN_ROWS, align ) );
+    if( count < 2 )
+    {
+        return;
+    }
+
+    // Cover the reach of the lanczos filter in the source with margin
+    margin = 8 * ( ( height + pv->height_out - 1 ) / pv->height_out ) + 8;
+    margin = ( margin * pv->height_out + height - 1 ) / height;
+    margin = ( margin + align - 1 ) / align * align;
+
+    pv->bands = calloc( count, sizeof( crop_scale_band_t ) );
+    if( pv->bands == NULL )
+    {
+        return;
+    }
+    if( taskslices_init( &pv->band_taskset, hb_get_taskpool( pv->job->h ),
+                         count, sizeof( crop_scale_thread_arg_t ),
+                         crop_scale_band ) == 0 )
+    {
+        free( pv->bands );
+        pv->bands = NULL;
+        hb_error( "crop scale could not initialize taskset" );
+        return;
+    }
+    pv->band_count = count;
+
+    for( ii = 0; ii < count; ii++ )
+    {
+        crop_scale_band_t * band = &pv->bands[ii];
+        crop_scale_thread_arg_t * thread_args;
+        int y0, y1, top, bottom;
+
+        thread_args = taskslices_args( &pv->band_taskset, ii );
+        thread_args->pv = pv;
+        thread_args->segment = ii;
+
+        y0 = (int64_t)pv->height_out * ii / count / align * align;
+        y1 = ii == count - 1 ? pv->height_out :
+             (int64_t)pv->height_out * ( ii + 1 ) / count / align * align;
+        top    = MAX( 0, y0 - margin );
+        bottom = MIN( pv->height_out, y1 + margin );
+
+        band->dst_y  = y0;
+        band->dst_h  = y1 - y0;
+        band->margin = y0 - top;
+        band->src_y  = top * inc >> 16;
+        band->src_h  = ( bottom * inc >> 16 ) - band->src_y;
+        band->context = hb_sws_get_context( width, band->src_h,
+                                            AV_PIX_FMT_YUV420P,
+                                            pv->width_out, bottom - top,
+                                            AV_PIX_FMT_YUV420P,
+                                            SWS_LANCZOS|SWS_ACCURATE_RND );
+        if( band->context == NULL ||
+            av_image_alloc( band->scratch, band->scratch_stride,
+                            pv->width_out, bottom - top,
+                            AV_PIX_FMT_YUV420P, 32 ) < 0 )
+        {
+            crop_scale_bands_close( pv );
+            return;
+        }
+    }
+
+    if( crop_scale_bands_check( pv, width, height ) )
+    {
+        hb_log( "crop scale: bands differ from the frame, not using them" );
+        crop_scale_bands_close( pv );
+        return;
+    }
+    hb_deep_log( 2, "crop scale: scaling in %d bands", pv->band_count );
+}
+
 /* OpenCL */
 static hb_buffer_t* crop_scale( hb_filter_private_t * pv, hb_buffer_t * in )
 {
@@ -200,14 +509,31 @@ static hb_buffer_t* crop_scale( hb_filter_private_t * pv, hb_buffer_t * in )
             pv->width_in  = in->f.width;
             pv->height_in = in->f.height;
             pv->pix_fmt   = in->f.fmt;
+
+            if (pv->context != NULL)
+            {
+                crop_scale_bands_init(pv,
+                        in->f.width  - (pv->crop[2] + pv->crop[3]),
+                        in->f.height - (pv->crop[0] + pv->crop[1]));
+            }
+        }
+
+        if (pv->band_count > 0)
+        {
+            // Scale the bands of the frame in parallel
+            pv->band_in  = pic_crop;
+            pv->band_out = pic_out;
+            crop_scale_bands(pv);
+        }
+        else
+        {
+            // Scale pic_crop into pic_render according to the
+            // context set up above
+            sws_scale(pv->context,
+                      (const uint8_t* const*)pic_crop.data, pic_crop.linesize,
+                      0, in->f.height - (pv->crop[0] + pv->crop[1]),
+                      pic_out.data, pic_out.linesize);
         }
-        
-        // Scale pic_crop into pic_render according to the
-        // context set up above
-        sws_scale(pv->context,
-                  (const uint8_t* const*)pic_crop.data, pic_crop.linesize,
-                  0, in->f.height - (pv->crop[0] + pv->crop[1]),
-                  pic_out.data, pic_out.linesize);
     }
 
     out->s = in->s;
@@ -243,6 +569,7 @@ static int hb_crop_scale_work( hb_filter_object_t * filter,
         pv->width_out = in->f.width - (pv->crop[2] + pv->crop[3]);
         pv->height_out = in->f.height - (pv->crop[0] + pv->crop[1]);
     }
+    pv->frame_threads = filter->frame_threads;
 
     /* OpenCL/DXVA2 */
     if ((!pv->use_dxva &&
@@ -67,6 +67,7 @@ hb_filter_object_t hb_filter_deblock =
     .init          = hb_deblock_init,
     .work          = hb_deblock_work,
     .close         = hb_deblock_close,
+    .frame_threaded = 1,
 };
 
 static inline void pp7_dct_a( DCTELEM * dst, uint8_t * src, int stride )
@@ -109,6 +109,7 @@ struct hb_work_private_s
     int             sws_width;
     int             sws_height;
     int             sws_pix_fmt;
+    int             direct;     // decode into frame buffers, see get_frame_buffer
     int cadence[12];
     int wait_for_keyframe;
 #ifdef USE_HWD
@@ -852,6 +853,154 @@ static uint8_t *copy_plane( uint8_t *dst, uint8_t* src, int dstride, int sstride
     return dst;
 }
 
+// Decoding straight into HB frame buffers.
+//
+// libavcodec gets its pictures from get_frame_buffer.  When the picture
+// will be passed on as is, it is allocated with the layout of an HB
+// frame buffer, and copy_frame wraps the decoded picture into a buffer
+// that references it instead of copying it.  The reference keeps the
+// picture valid while libavcodec still predicts from it, and the picture
+// returns to the buffer pool once both are done with it.  Since the
+// decoder may still read it, the filters must not modify the picture,
+// so this is only done without filters that work in place.
+static void release_frame_buffer( void *opaque, uint8_t *data )
+{
+    hb_buffer_t *buf = opaque;
+    hb_buffer_close( &buf );
+}
+
+static int get_frame_buffer( AVCodecContext *context, AVFrame *frame,
+                             int flags )
+{
+    hb_work_private_t *pv = context->opaque;
+    hb_buffer_t *buf;
+    int w, h, p, linesize_align[AV_NUM_DATA_POINTERS];
+
+    // copy_frame passes on yuv420 frames of the size of the title as is
+    if ( frame->format != AV_PIX_FMT_YUV420P ||
+         context->width  != pv->title->geometry.width ||
+         context->height != pv->title->geometry.height )
+    {
+        return avcodec_default_get_buffer2( context, frame, flags );
+    }
+
+    w = frame->width;
+    h = frame->height;
+    avcodec_align_dimensions2( context, &w, &h, linesize_align );
+
+    buf = hb_frame_buffer_init( frame->format, context->width,
+                                context->height );
+    if ( buf == NULL )
+    {
+        return avcodec_default_get_buffer2( context, frame, flags );
+    }
+    for ( p = 0; p < 3; p++ )
+    {
+        // The decoder writes whole macroblocks up to the aligned size.
+        // H.264 also reads 2 lines past them, allow that after the
+        // last plane only.
+        int rows = hb_image_height( frame->format, h, p );
+        int written = rows;
+        if ( context->codec_id == AV_CODEC_ID_H264 )
+        {
+            written = hb_image_height( frame->format, h - 2, p );
+        }
+        if ( buf->plane[p].stride % linesize_align[p] ||
+             (uintptr_t)buf->plane[p].data % linesize_align[p] ||
+             buf->plane[p].stride <
+                 av_image_get_linesize( frame->format, w, p ) ||
+             buf->plane[p].height_stride < written ||
+             buf->plane[p].data + buf->plane[p].stride * rows >
+                 buf->data + buf->alloc )
+        {
+            hb_buffer_close( &buf );
+            return avcodec_default_get_buffer2( context, frame, flags );
+        }
+        frame->data[p]     = buf->plane[p].data;
+        frame->linesize[p] = buf->plane[p].stride;
+    }
+    frame->buf[0] = av_buffer_create( buf->data, buf->alloc,
+                                      release_frame_buffer, buf, 0 );
+    if ( frame->buf[0] == NULL )
+    {
+        hb_buffer_close( &buf );
+        return AVERROR(ENOMEM);
+    }
+    frame->extended_data = frame->data;
+    frame->opaque = buf;
+    return 0;
+}
+
+// Sets up get_frame_buffer for a decoder that is about to be opened
+static void setup_direct( hb_work_private_t *pv, AVCodec *codec )
+{
+    hb_filter_object_t *filter;
+    int ii;
+
+    if ( pv->job == NULL || pv->job->use_opencl ||
+         !( codec->capabilities & CODEC_CAP_DR1 ) )
+    {
+        return;
+    }
+#ifdef USE_HWD
+    if ( pv->dxva2 )
+    {
+        return;
+    }
+#endif
+#ifdef USE_QSV
+    if ( pv->qsv.decode )
+    {
+        return;
+    }
+#endif
+    for ( ii = 0; ii < hb_list_count( pv->job->list_filter ); ii++ )
+    {
+        filter = hb_list_item( pv->job->list_filter, ii );
+        if ( filter->id == HB_FILTER_RENDER_SUB )
+        {
+            // burns subtitles into the frames
+            return;
+        }
+    }
+    pv->direct = 1;
+    pv->context->opaque = pv;
+    pv->context->get_buffer2 = get_frame_buffer;
+}
+
+// Wraps the picture decoded by get_frame_buffer into a buffer, NULL if
+// it can't be passed on as is
+static hb_buffer_t *ref_frame( hb_work_private_t *pv, int w, int h )
+{
+    AVFrame *frame = pv->frame;
+    hb_buffer_t *buf;
+    int p;
+
+    if ( frame->opaque == NULL || frame->buf[0] == NULL ||
+         av_buffer_get_opaque( frame->buf[0] ) != frame->opaque ||
+         frame->format != AV_PIX_FMT_YUV420P ||
+         frame->width != w || frame->height != h )
+    {
+        return NULL;
+    }
+    buf = hb_frame_buffer_ref( frame->buf[0], AV_PIX_FMT_YUV420P, w, h );
+    if ( buf == NULL )
+    {
+        return NULL;
+    }
+    for ( p = 0; p < 3; p++ )
+    {
+        // e.g. cropping moves the data pointers
+        if ( buf->plane[p].data   != frame->data[p] ||
+             buf->plane[p].stride != frame->linesize[p] )
+        {
+            hb_buffer_close( &buf );
+            return NULL;
+        }
+    }
+    return buf;
+}
+
 // copy one video frame into an HB buf. If the frame isn't in our color space
 // or at least one of its dimensions is odd, use sws_scale to convert/rescale it.
 // Otherwise just copy the bits.
@@ -908,7 +1057,13 @@ static hb_buffer_t *copy_frame( hb_work_private_t *pv )
     else
 #endif
     {
-        hb_buffer_t *buf = hb_video_buffer_init( w, h );
+        hb_buffer_t *buf;
+
+        if ( pv->direct && ( buf = ref_frame( pv, w, h ) ) != NULL )
+        {
+            return buf;
+        }
+        buf = hb_video_buffer_init( w, h );
 			
 #ifdef USE_QSV
     // no need to copy the frame data when decoding with QSV to opaque memory
@@ -1637,7 +1792,7 @@ static int decavcodecvInit( hb_work_object_t * w, hb_job_t * job )
 
     if( pv->job && pv->job->title && !pv->job->title->has_resolution_change )
     {
-        pv->threads = HB_FFMPEG_THREADS_AUTO;
+        pv->threads = hb_avcodec_job_threads( pv->job );
     }
 
     AVCodec *codec = NULL;
@@ -1700,6 +1855,8 @@ static int decavcodecvInit( hb_work_object_t * w, hb_job_t * job )
         }
 #endif
 
+        setup_direct( pv, codec );
+
         // Set encoder opts...
         AVDictionary * av_opts = NULL;
         av_dict_set( &av_opts, "refcounted_frames", "1", 0 );
@@ -1870,6 +2027,8 @@ static int decavcodecvWork( hb_work_object_t * w, hb_buffer_t ** buf_in,
         }
 #endif
 
+        setup_direct( pv, codec );
+
         AVDictionary * av_opts = NULL;
         av_dict_set( &av_opts, "refcounted_frames", "1", 0 );
         if (pv->title->flags & HBTF_NO_IDR)
@@ -70,6 +70,7 @@ which will feed EEDI2 interpolations to yadif.
 #include "hbffmpeg.h"
 #include "eedi2.h"
 #include "taskset.h"
+#include "combdetect.h"
 
 #define PARITY_DEFAULT   -1
 
@@ -176,16 +177,16 @@ struct hb_filter_private_s
     int              cpu_count;
     int              segment_height[3];
 
-    taskset_t        yadif_taskset;       // Threads for Yadif - one per CPU
+    taskslices_t     yadif_taskset;       // Slices for Yadif - one per CPU
     yadif_arguments_t *yadif_arguments;   // Arguments to thread for work
 
-    taskset_t        decomb_filter_taskset; // Threads for comb detection
-    taskset_t        decomb_check_taskset;  // Threads for comb check
-    taskset_t        mask_filter_taskset; // Threads for decomb mask filter
-    taskset_t        mask_erode_taskset;  // Threads for decomb mask erode
-    taskset_t        mask_dilate_taskset; // Threads for decomb mask dilate
+    taskslices_t     decomb_filter_taskset; // Slices for comb detection
+    taskslices_t     decomb_check_taskset;  // Slices for comb check
+    taskslices_t     mask_filter_taskset; // Slices for decomb mask filter
+    taskslices_t     mask_erode_taskset;  // Slices for decomb mask erode
+    taskslices_t     mask_dilate_taskset; // Slices for decomb mask dilate
 
-    taskset_t        eedi2_taskset;       // Threads for eedi2 - one per plane
+    taskslices_t     eedi2_taskset;       // Slices for eedi2 - one per plane
 };
 
 typedef struct
@@ -694,137 +695,29 @@ static void build_gamma_lut( hb_filter_private_t * pv )
     }
 }
 
-static void detect_gamma_combed_segment( hb_filter_private_t * pv, int segment_start, int segment_stop )
-{
-    /* A mish-mash of various comb detection tricks
-       picked up from neuron2's Decomb plugin for
-       AviSynth and tritical's IsCombedT and
-       IsCombedTIVTC plugins.                       */
-
-    /* Comb scoring algorithm */
-    /* Motion threshold */
-    float mthresh         = (float)pv->motion_threshold / (float)255;
-    /* Spatial threshold */
-    float athresh         = (float)pv->spatial_threshold / (float)255;
-    float athresh6        = 6 *athresh;
-
-    /* One pas for Y, one pass for U, one pass for V */
-    int pp;
-    for( pp = 0; pp < 1; pp++ )
-    {
-        int x, y;
-        int stride  = pv->ref[0]->plane[pp].stride;
-        int width   = pv->ref[0]->plane[pp].width;
-        int height  = pv->ref[0]->plane[pp].height;
-
-        /* Comb detection has to start at y = 2 and end at
-           y = height - 2, because it needs to examine
-           2 pixels above and 2 below the current pixel.      */
-        if( segment_start < 2 )
-            segment_start = 2;
-        if( segment_stop > height - 2 )
-            segment_stop = height - 2;
-
-        for( y =  segment_start; y < segment_stop; y++ )
-        {
-            /* These are just to make the buffer locations easier to read. */
-            int up_2    = -2 * stride ;
-            int up_1    = -1 * stride;
-            int down_1  =      stride;
-            int down_2  =  2 * stride;
-
-            /* We need to examine a column of 5 pixels
-               in the prev, cur, and next frames.      */
-            uint8_t * prev = &pv->ref[0]->plane[pp].data[y * stride];
-            uint8_t * cur  = &pv->ref[1]->plane[pp].data[y * stride];
-            uint8_t * next = &pv->ref[2]->plane[pp].data[y * stride];
-            uint8_t * mask = &pv->mask->plane[pp].data[y * stride];
-
-            memset(mask, 0, stride);
-
-            for( x = 0; x < width; x++ )
-            {
-                float up_diff, down_diff;
-                up_diff   = pv->gamma_lut[cur[0]] - pv->gamma_lut[cur[up_1]];
-                down_diff = pv->gamma_lut[cur[0]] - pv->gamma_lut[cur[down_1]];
-
-                if( ( up_diff >  athresh && down_diff >  athresh ) ||
-                    ( up_diff < -athresh && down_diff < -athresh ) )
-                {
-                    /* The pixel above and below are different,
-                       and they change in the same "direction" too.*/
-                    int motion = 0;
-                    if( mthresh > 0 )
-                    {
-                        /* Make sure there's sufficient motion between frame t-1 to frame t+1. */
-                        if( fabs( pv->gamma_lut[prev[0]]      - pv->gamma_lut[cur[0]] ) > mthresh &&
-                            fabs( pv->gamma_lut[cur[up_1]]    - pv->gamma_lut[next[up_1]]    ) > mthresh &&
-                            fabs( pv->gamma_lut[cur[down_1]]  - pv->gamma_lut[next[down_1]]    ) > mthresh )
-                                motion++;
-                        if( fabs( pv->gamma_lut[next[0]]      - pv->gamma_lut[cur[0]] ) > mthresh &&
-                            fabs( pv->gamma_lut[prev[up_1]]   - pv->gamma_lut[cur[up_1]] ) > mthresh &&
-                            fabs( pv->gamma_lut[prev[down_1]] - pv->gamma_lut[cur[down_1]] ) > mthresh )
-                                motion++;
-
-                    }
-                    else
-                    {
-                        /* User doesn't want to check for motion,
-                           so move on to the spatial check.       */
-                        motion = 1;
-                    }
-
-                    if( motion || ( pv->deinterlaced_frames==0 && pv->blended_frames==0 && pv->unfiltered_frames==0) )
-                    {
-
-                        /* Tritical's noise-resistant combing scorer.
-                           The check is done on a bob+blur convolution. */
-                        float combing = fabs( pv->gamma_lut[cur[up_2]]
-                                         + ( 4 * pv->gamma_lut[cur[0]] )
-                                         + pv->gamma_lut[cur[down_2]]
-                                         - ( 3 * ( pv->gamma_lut[cur[up_1]]
-                                                 + pv->gamma_lut[cur[down_1]] ) ) );
-                        /* If the frame is sufficiently combed,
-                           then mark it down on the mask as 1. */
-                        if( combing > athresh6 )
-                        {
-                            mask[0] = 1;
-                        }
-                    }
-                }
-
-                cur++;
-                prev++;
-                next++;
-                mask++;
-            }
-        }
-    }
-}
-
-
 static void detect_combed_segment( hb_filter_private_t * pv, int segment_start, int segment_stop )
 {
-    /* A mish-mash of various comb detection tricks
-       picked up from neuron2's Decomb plugin for
-       AviSynth and tritical's IsCombedT and
-       IsCombedTIVTC plugins.                       */
-
-
-    /* Comb scoring algorithm */
-    int spatial_metric  = pv->spatial_metric;
-    /* Motion threshold */
-    int mthresh         = pv->motion_threshold;
-    /* Spatial threshold */
-    int athresh         = pv->spatial_threshold;
-    int athresh_squared = athresh * athresh;
-    int athresh6        = 6 * athresh;
+    hb_comb_row_func * detect_combed_row;
+    hb_comb_params_t   params;
+
+    params.spatial_metric    = pv->spatial_metric;
+    params.motion_threshold  = pv->motion_threshold;
+    params.spatial_threshold = pv->spatial_threshold;
+    params.ignore_motion     = pv->deinterlaced_frames == 0 &&
+                               pv->blended_frames == 0 &&
+                               pv->unfiltered_frames == 0;
+    params.gamma_lut         = pv->gamma_lut;
+
+    if( pv->mode & MODE_GAMMA )
+        detect_combed_row = hb_comb_functions.detect_gamma_combed_row;
+    else
+        detect_combed_row = hb_comb_functions.detect_combed_row;
 
     /* One pas for Y, one pass for U, one pass for V */
     int pp;
     for( pp = 0; pp < 1; pp++ )
     {
-        int x, y;
+        int y;
         int stride  = pv->ref[0]->plane[pp].stride;
         int width   = pv->ref[0]->plane[pp].width;
         int height  = pv->ref[0]->plane[pp].height;
@@ -839,12 +732,6 @@ static void detect_combed_segment( hb_filter_private_t * pv, int segment_start,
 
         for( y =  segment_start; y < segment_stop; y++ )
         {
-            /* These are just to make the buffer locations easier to read. */
-            int up_2    = -2 * stride ;
-            int up_1    = -1 * stride;
-            int down_1  =      stride;
-            int down_2  =  2 * stride;
-
             /* We need to examine a column of 5 pixels
                in the prev, cur, and next frames.      */
             uint8_t * prev = &pv->ref[0]->plane[pp].data[y * stride];
@@ -853,87 +740,7 @@ static void detect_combed_segment( hb_filter_private_t * pv, int segment_start,
             uint8_t * mask = &pv->mask->plane[pp].data[y * stride];
 
             memset(mask, 0, stride);
-
-            for( x = 0; x < width; x++ )
-            {
-                int up_diff = cur[0] - cur[up_1];
-                int down_diff = cur[0] - cur[down_1];
-
-                if( ( up_diff >  athresh && down_diff >  athresh ) ||
-                    ( up_diff < -athresh && down_diff < -athresh ) )
-                {
-                    /* The pixel above and below are different,
-                       and they change in the same "direction" too.*/
-                    int motion = 0;
-                    if( mthresh > 0 )
-                    {
-                        /* Make sure there's sufficient motion between frame t-1 to frame t+1. */
-                        if( abs( prev[0] - cur[0] ) > mthresh &&
-                            abs(  cur[up_1] - next[up_1]    ) > mthresh &&
-                            abs(  cur[down_1] - next[down_1]    ) > mthresh )
-                                motion++;
-                        if( abs(     next[0] - cur[0] ) > mthresh &&
-                            abs( prev[up_1] - cur[up_1] ) > mthresh &&
-                            abs( prev[down_1] - cur[down_1] ) > mthresh )
-                                motion++;
-                    }
-                    else
-                    {
-                        /* User doesn't want to check for motion,
-                           so move on to the spatial check.       */
-                        motion = 1;
-                    }
-
-                    if( motion || ( pv->deinterlaced_frames==0 && pv->blended_frames==0 && pv->unfiltered_frames==0) )
-                    {
-                           /* That means it's time for the spatial check.
-                              We've got several options here.             */
-                        if( spatial_metric == 0 )
-                        {
-                            /* Simple 32detect style comb detection */
-                            if( ( abs( cur[0] - cur[down_2] ) < 10  ) &&
-                                ( abs( cur[0] - cur[down_1] ) > 15 ) )
-                            {
-                                mask[0] = 1;
-                            }
-                        }
-                        else if( spatial_metric == 1 )
-                        {
-                            /* This, for comparison, is what IsCombed uses.
-                               It's better, but still noise senstive.      */
-                               int combing = ( cur[up_1] - cur[0] ) *
-                                             ( cur[down_1] - cur[0] );
-
-                               if( combing > athresh_squared )
-                               {
-                                   mask[0] = 1;
-                               }
-                        }
-                        else if( spatial_metric == 2 )
-                        {
-                            /* Tritical's noise-resistant combing scorer.
-                               The check is done on a bob+blur convolution. */
-                            int combing = abs( cur[up_2]
-                                             + ( 4 * cur[0] )
-                                             + cur[down_2]
-                                             - ( 3 * ( cur[up_1]
-                                                     + cur[down_1] ) ) );
-
-                            /* If the frame is sufficiently combed,
-                               then mark it down on the mask as 1. */
-                            if( combing > athresh6 )
-                            {
-                                mask[0] = 1;
-                            }
-                        }
-                    }
-                }
-
-                cur++;
-                prev++;
-                next++;
-                mask++;
-            }
+            detect_combed_row( &params, prev, cur, next, mask, stride, width );
         }
     }
 }
@@ -1020,7 +827,7 @@ static void eedi2_interpolate_plane( hb_filter_private_t * pv, int plane )
 /*
  *  eedi2 interpolate this plane in a single thread.
  */
-static void eedi2_filter_thread( void *thread_args_v )
+static void eedi2_filter_slice( void *thread_args_v )
 {
     hb_filter_private_t * pv;
     int plane;
@@ -1029,39 +836,14 @@ static void eedi2_filter_thread( void *thread_args_v )
     pv = thread_args->pv;
     plane = thread_args->plane;
 
-    hb_log("eedi2 thread started for plane %d", plane);
-
-    while (1)
-    {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->eedi2_taskset, plane );
-
-        if( taskset_thread_stop( &pv->eedi2_taskset, plane ) )
-        {
-            /*
-             * No more work to do, exit this thread.
-             */
-            break;
-        }
-
-        /*
-         * Process plane
-         */
-        eedi2_interpolate_plane( pv, plane );
-
-        /*
-         * Finished this segment, let everyone know.
-         */
-        taskset_thread_complete( &pv->eedi2_taskset, plane );
-    }
-
-    taskset_thread_complete( &pv->eedi2_taskset, plane );
+    /*
+     * Process plane
+     */
+    eedi2_interpolate_plane( pv, plane );
 }
 
 // Sets up the input field planes for EEDI2 in pv->eedi_half[SRCPF]
-// and then runs eedi2_filter_thread for each plane.
+// and then runs eedi2_filter_slice for each plane.
 static void eedi2_planer( hb_filter_private_t * pv )
 {
     /* Copy the first field from the source to a half-height frame. */
@@ -1081,318 +863,240 @@ static void eedi2_planer( hb_filter_private_t * pv )
      * Now that all data is ready for our threads, fire them off
      * and wait for their completion.
      */
-    taskset_cycle( &pv->eedi2_taskset );
+    taskslices_cycle( &pv->eedi2_taskset );
 }
 
 
-static void mask_dilate_thread( void *thread_args_v )
+static void mask_dilate_slice( void *thread_args_v )
 {
     hb_filter_private_t * pv;
-    int segment, segment_start, segment_stop;
+    int segment_start, segment_stop;
     decomb_thread_arg_t *thread_args = thread_args_v;
 
     pv = thread_args->pv;
-    segment = thread_args->segment;
 
-    hb_log("mask dilate thread started for segment %d", segment);
+    int xx, yy, pp;
+
+    int count;
+    int dilation_threshold = 4;
 
-    while (1)
+    for( pp = 0; pp < 1; pp++ )
     {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->mask_dilate_taskset, segment );
+        int width = pv->mask_filtered->plane[pp].width;
+        int height = pv->mask_filtered->plane[pp].height;
+        int stride = pv->mask_filtered->plane[pp].stride;
+
+        int start, stop, p, c, n;
+        segment_start = thread_args->segment_start[pp];
+        segment_stop = segment_start + thread_args->segment_height[pp];
 
-        if (taskset_thread_stop(&pv->mask_dilate_taskset, segment))
+        if (segment_start == 0)
         {
-            /*
-             * No more work to do, exit this thread.
-             */
-            break;
+            start = 1;
+            p = 0;
+            c = 1;
+            n = 2;
         }
-
-        int xx, yy, pp;
-
-        int count;
-        int dilation_threshold = 4;
-
-        for( pp = 0; pp < 1; pp++ )
+        else
         {
-            int width = pv->mask_filtered->plane[pp].width;
-            int height = pv->mask_filtered->plane[pp].height;
-            int stride = pv->mask_filtered->plane[pp].stride;
-
-            int start, stop, p, c, n;
-            segment_start = thread_args->segment_start[pp];
-            segment_stop = segment_start + thread_args->segment_height[pp];
-
-            if (segment_start == 0)
-            {
-                start = 1;
-                p = 0;
-                c = 1;
-                n = 2;
-            }
-            else
-            {
-                start = segment_start;
-                p = segment_start - 1;
-                c = segment_start;
-                n = segment_start + 1;
-            }
+            start = segment_start;
+            p = segment_start - 1;
+            c = segment_start;
+            n = segment_start + 1;
+        }
 
-            if (segment_stop == height)
-            {
-                stop = height -1;
-            }
-            else
-            {
-                stop = segment_stop;
-            }
+        if (segment_stop == height)
+        {
+            stop = height -1;
+        }
+        else
+        {
+            stop = segment_stop;
+        }
 
-            uint8_t *curp = &pv->mask_filtered->plane[pp].data[p * stride + 1];
-            uint8_t *cur  = &pv->mask_filtered->plane[pp].data[c * stride + 1];
-            uint8_t *curn = &pv->mask_filtered->plane[pp].data[n * stride + 1];
-            uint8_t *dst = &pv->mask_temp->plane[pp].data[c * stride + 1];
+        uint8_t *curp = &pv->mask_filtered->plane[pp].data[p * stride + 1];
+        uint8_t *cur  = &pv->mask_filtered->plane[pp].data[c * stride + 1];
+        uint8_t *curn = &pv->mask_filtered->plane[pp].data[n * stride + 1];
+        uint8_t *dst = &pv->mask_temp->plane[pp].data[c * stride + 1];
 
-            for( yy = start; yy < stop; yy++ )
+        for( yy = start; yy < stop; yy++ )
+        {
+            for( xx = 1; xx < width - 1; xx++ )
             {
-                for( xx = 1; xx < width - 1; xx++ )
+                if (cur[xx])
                 {
-                    if (cur[xx])
-                    {
-                        dst[xx] = 1;
-                        continue;
-                    }
+                    dst[xx] = 1;
+                    continue;
+                }
 
-                    count = curp[xx-1] + curp[xx] + curp[xx+1] +
-                            cur [xx-1] +            cur [xx+1] +
-                            curn[xx-1] + curn[xx] + curn[xx+1];
+                count = curp[xx-1] + curp[xx] + curp[xx+1] +
+                        cur [xx-1] +            cur [xx+1] +
+                        curn[xx-1] + curn[xx] + curn[xx+1];
 
-                    dst[xx] = count >= dilation_threshold;
-                }
-                curp += stride;
-                cur += stride;
-                curn += stride;
-                dst += stride;
+                dst[xx] = count >= dilation_threshold;
             }
+            curp += stride;
+            cur += stride;
+            curn += stride;
+            dst += stride;
         }
-
-        taskset_thread_complete( &pv->mask_dilate_taskset, segment );
     }
-
-    /*
-     * Finished this segment, let everyone know.
-     */
-    taskset_thread_complete( &pv->mask_dilate_taskset, segment );
 }
 
-static void mask_erode_thread( void *thread_args_v )
+static void mask_erode_slice( void *thread_args_v )
 {
     hb_filter_private_t * pv;
-    int segment, segment_start, segment_stop;
+    int segment_start, segment_stop;
     decomb_thread_arg_t *thread_args = thread_args_v;
 
     pv = thread_args->pv;
-    segment = thread_args->segment;
 
-    hb_log("mask erode thread started for segment %d", segment);
+    int xx, yy, pp;
 
-    while (1)
+    int count;
+    int erosion_threshold = 2;
+
+    for( pp = 0; pp < 1; pp++ )
     {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->mask_erode_taskset, segment );
+        int width = pv->mask_filtered->plane[pp].width;
+        int height = pv->mask_filtered->plane[pp].height;
+        int stride = pv->mask_filtered->plane[pp].stride;
+
+        int start, stop, p, c, n;
+        segment_start = thread_args->segment_start[pp];
+        segment_stop = segment_start + thread_args->segment_height[pp];
 
-        if( taskset_thread_stop( &pv->mask_erode_taskset, segment ) )
+        if (segment_start == 0)
         {
-            /*
-             * No more work to do, exit this thread.
-             */
-            break;
+            start = 1;
+            p = 0;
+            c = 1;
+            n = 2;
         }
-
-        int xx, yy, pp;
-
-        int count;
-        int erosion_threshold = 2;
-
-        for( pp = 0; pp < 1; pp++ )
+        else
         {
-            int width = pv->mask_filtered->plane[pp].width;
-            int height = pv->mask_filtered->plane[pp].height;
-            int stride = pv->mask_filtered->plane[pp].stride;
-
-            int start, stop, p, c, n;
-            segment_start = thread_args->segment_start[pp];
-            segment_stop = segment_start + thread_args->segment_height[pp];
-
-            if (segment_start == 0)
-            {
-                start = 1;
-                p = 0;
-                c = 1;
-                n = 2;
-            }
-            else
-            {
-                start = segment_start;
-                p = segment_start - 1;
-                c = segment_start;
-                n = segment_start + 1;
-            }
+            start = segment_start;
+            p = segment_start - 1;
+            c = segment_start;
+            n = segment_start + 1;
+        }
 
-            if (segment_stop == height)
-            {
-                stop = height -1;
-            }
-            else
-            {
-                stop = segment_stop;
-            }
+        if (segment_stop == height)
+        {
+            stop = height -1;
+        }
+        else
+        {
+            stop = segment_stop;
+        }
 
-            uint8_t *curp = &pv->mask_temp->plane[pp].data[p * stride + 1];
-            uint8_t *cur  = &pv->mask_temp->plane[pp].data[c * stride + 1];
-            uint8_t *curn = &pv->mask_temp->plane[pp].data[n * stride + 1];
-            uint8_t *dst = &pv->mask_filtered->plane[pp].data[c * stride + 1];
+        uint8_t *curp = &pv->mask_temp->plane[pp].data[p * stride + 1];
+        uint8_t *cur  = &pv->mask_temp->plane[pp].data[c * stride + 1];
+        uint8_t *curn = &pv->mask_temp->plane[pp].data[n * stride + 1];
+        uint8_t *dst = &pv->mask_filtered->plane[pp].data[c * stride + 1];
 
-            for( yy = start; yy < stop; yy++ )
+        for( yy = start; yy < stop; yy++ )
+        {
+            for( xx = 1; xx < width - 1; xx++ )
             {
-                for( xx = 1; xx < width - 1; xx++ )
+                if( cur[xx] == 0 )
                 {
-                    if( cur[xx] == 0 )
-                    {
-                        dst[xx] = 0;
-                        continue;
-                    }
+                    dst[xx] = 0;
+                    continue;
+                }
 
-                    count = curp[xx-1] + curp[xx] + curp[xx+1] +
-                            cur [xx-1] +            cur [xx+1] +
-                            curn[xx-1] + curn[xx] + curn[xx+1];
+                count = curp[xx-1] + curp[xx] + curp[xx+1] +
+                        cur [xx-1] +            cur [xx+1] +
+                        curn[xx-1] + curn[xx] + curn[xx+1];
 
-                    dst[xx] = count >= erosion_threshold;
-                }
-                curp += stride;
-                cur += stride;
-                curn += stride;
-                dst += stride;
+                dst[xx] = count >= erosion_threshold;
             }
+            curp += stride;
+            cur += stride;
+            curn += stride;
+            dst += stride;
         }
-
-        taskset_thread_complete( &pv->mask_erode_taskset, segment );
     }
-
-    /*
-     * Finished this segment, let everyone know.
-     */
-    taskset_thread_complete( &pv->mask_erode_taskset, segment );
 }
 
-static void mask_filter_thread( void *thread_args_v )
+static void mask_filter_slice( void *thread_args_v )
 {
     hb_filter_private_t * pv;
-    int segment, segment_start, segment_stop;
+    int segment_start, segment_stop;
     decomb_thread_arg_t *thread_args = thread_args_v;
 
     pv = thread_args->pv;
-    segment = thread_args->segment;
 
-    hb_log("mask filter thread started for segment %d", segment);
+    int xx, yy, pp;
 
-    while (1)
+    for( pp = 0; pp < 1; pp++ )
     {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->mask_filter_taskset, segment );
+        int width = pv->mask->plane[pp].width;
+        int height = pv->mask->plane[pp].height;
+        int stride = pv->mask->plane[pp].stride;
+
+        int start, stop, p, c, n;
+        segment_start = thread_args->segment_start[pp];
+        segment_stop = segment_start + thread_args->segment_height[pp];
 
-        if( taskset_thread_stop( &pv->mask_filter_taskset, segment ) )
+        if (segment_start == 0)
         {
-            /*
-             * No more work to do, exit this thread.
-             */
-            break;
+            start = 1;
+            p = 0;
+            c = 1;
+            n = 2;
         }
-
-        int xx, yy, pp;
-
-        for( pp = 0; pp < 1; pp++ )
+        else
         {
-            int width = pv->mask->plane[pp].width;
-            int height = pv->mask->plane[pp].height;
-            int stride = pv->mask->plane[pp].stride;
+            start = segment_start;
+            p = segment_start - 1;
+            c = segment_start;
+            n = segment_start + 1;
+        }
 
-            int start, stop, p, c, n;
-            segment_start = thread_args->segment_start[pp];
-            segment_stop = segment_start + thread_args->segment_height[pp];
+        if (segment_stop == height)
+        {
+            stop = height - 1;
+        }
+        else
+        {
+            stop = segment_stop;
+        }
 
-            if (segment_start == 0)
-            {
-                start = 1;
-                p = 0;
-                c = 1;
-                n = 2;
-            }
-            else
-            {
-                start = segment_start;
-                p = segment_start - 1;
-                c = segment_start;
-                n = segment_start + 1;
-            }
+        uint8_t *curp = &pv->mask->plane[pp].data[p * stride + 1];
+        uint8_t *cur = &pv->mask->plane[pp].data[c * stride + 1];
+        uint8_t *curn = &pv->mask->plane[pp].data[n * stride + 1];
+        uint8_t *dst = (pv->filter_mode == FILTER_CLASSIC ) ?
+            &pv->mask_filtered->plane[pp].data[c * stride + 1] :
+            &pv->mask_temp->plane[pp].data[c * stride + 1] ;
 
-            if (segment_stop == height)
-            {
-                stop = height - 1;
-            }
-            else
+        for( yy = start; yy < stop; yy++ )
+        {
+            for( xx = 1; xx < width - 1; xx++ )
             {
-                stop = segment_stop;
-            }
+                int h_count, v_count;
 
-            uint8_t *curp = &pv->mask->plane[pp].data[p * stride + 1];
-            uint8_t *cur = &pv->mask->plane[pp].data[c * stride + 1];
-            uint8_t *curn = &pv->mask->plane[pp].data[n * stride + 1];
-            uint8_t *dst = (pv->filter_mode == FILTER_CLASSIC ) ?
-                &pv->mask_filtered->plane[pp].data[c * stride + 1] :
-                &pv->mask_temp->plane[pp].data[c * stride + 1] ;
+                h_count = cur[xx-1] & cur[xx] & cur[xx+1];
+                v_count = curp[xx] & cur[xx] & curn[xx];
 
-            for( yy = start; yy < stop; yy++ )
-            {
-                for( xx = 1; xx < width - 1; xx++ )
+                if (pv->filter_mode == FILTER_CLASSIC)
                 {
-                    int h_count, v_count;
-
-                    h_count = cur[xx-1] & cur[xx] & cur[xx+1];
-                    v_count = curp[xx] & cur[xx] & curn[xx];
-
-                    if (pv->filter_mode == FILTER_CLASSIC)
-                    {
-                        dst[xx] = h_count;
-                    }
-                    else
-                    {
-                        dst[xx] = h_count & v_count;
-                    }
+                    dst[xx] = h_count;
+                }
+                else
+                {
+                    dst[xx] = h_count & v_count;
                 }
-                curp += stride;
-                cur += stride;
-                curn += stride;
-                dst += stride;
             }
+            curp += stride;
+            cur += stride;
+            curn += stride;
+            dst += stride;
         }
-
-        taskset_thread_complete( &pv->mask_filter_taskset, segment );
     }
-
-    /*
-     * Finished this segment, let everyone know.
-     */
-    taskset_thread_complete( &pv->mask_filter_taskset, segment );
 }
 
-static void decomb_check_thread( void *thread_args_v )
+static void decomb_check_slice( void *thread_args_v )
 {
     hb_filter_private_t * pv;
     int segment, segment_start, segment_stop;
@@ -1401,99 +1105,41 @@ static void decomb_check_thread( void *thread_args_v )
     pv = thread_args->pv;
     segment = thread_args->segment;
 
-    hb_log("decomb check thread started for segment %d", segment);
+    segment_start = thread_args->segment_start[0];
+    segment_stop = segment_start + thread_args->segment_height[0];
 
-    while (1)
+    if( pv->mode & MODE_FILTER )
     {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->decomb_check_taskset, segment );
-
-        if( taskset_thread_stop( &pv->decomb_check_taskset, segment ) )
-        {
-            /*
-             * No more work to do, exit this thread.
-             */
-            break;
-        }
-
-        segment_start = thread_args->segment_start[0];
-        segment_stop = segment_start + thread_args->segment_height[0];
-
-        if( pv->mode & MODE_FILTER )
-        {
-            check_filtered_combing_mask(pv, segment, segment_start, segment_stop);
-        }
-        else
-        {
-            check_combing_mask(pv, segment, segment_start, segment_stop);
-        }
-
-        taskset_thread_complete( &pv->decomb_check_taskset, segment );
+        check_filtered_combing_mask(pv, segment, segment_start, segment_stop);
+    }
+    else
+    {
+        check_combing_mask(pv, segment, segment_start, segment_stop);
     }
-
-    /*
-     * Finished this segment, let everyone know.
-     */
-    taskset_thread_complete( &pv->decomb_check_taskset, segment );
 }
 
 /*
  * comb detect this segment of all three planes in a single thread.
  */
-static void decomb_filter_thread( void *thread_args_v )
+static void decomb_filter_slice( void *thread_args_v )
 {
     hb_filter_private_t * pv;
-    int segment, segment_start, segment_stop;
+    int segment_start, segment_stop;
     decomb_thread_arg_t *thread_args = thread_args_v;
 
     pv = thread_args->pv;
-    segment = thread_args->segment;
-
-    hb_log("decomb filter thread started for segment %d", segment);
 
-    while (1)
+    /*
+     * Process segment (for now just from luma)
+     */
+    int pp;
+    for( pp = 0; pp < 1; pp++)
     {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->decomb_filter_taskset, segment );
+        segment_start = thread_args->segment_start[pp];
+        segment_stop = segment_start + thread_args->segment_height[pp];
 
-        if( taskset_thread_stop( &pv->decomb_filter_taskset, segment ) )
-        {
-            /*
-             * No more work to do, exit this thread.
-             */
-            break;
-        }
-
-        /*
-         * Process segment (for now just from luma)
-         */
-        int pp;
-        for( pp = 0; pp < 1; pp++)
-        {
-            segment_start = thread_args->segment_start[pp];
-            segment_stop = segment_start + thread_args->segment_height[pp];
-
-            if( pv->mode & MODE_GAMMA )
-            {
-                detect_gamma_combed_segment( pv, segment_start, segment_stop );
-            }
-            else
-            {
-                detect_combed_segment( pv, segment_start, segment_stop );
-            }
-        }
-
-        taskset_thread_complete( &pv->decomb_filter_taskset, segment );
+        detect_combed_segment( pv, segment_start, segment_stop );
     }
-
-    /*
-     * Finished this segment, let everyone know.
-     */
-    taskset_thread_complete( &pv->decomb_filter_taskset, segment );
 }
 
 static int comb_segmenter( hb_filter_private_t * pv )
@@ -1502,16 +1148,16 @@ static int comb_segmenter( hb_filter_private_t * pv )
      * Now that all data for decomb detection is ready for
      * our threads, fire them off and wait for their completion.
      */
-    taskset_cycle( &pv->decomb_filter_taskset );
+    taskslices_cycle( &pv->decomb_filter_taskset );
 
     if( pv->mode & MODE_FILTER )
     {
-         taskset_cycle( &pv->mask_filter_taskset );
+         taskslices_cycle( &pv->mask_filter_taskset );
         if( pv->filter_mode == FILTER_ERODE_DILATE )
         {
-            taskset_cycle( &pv->mask_erode_taskset );
-            taskset_cycle( &pv->mask_dilate_taskset );
-            taskset_cycle( &pv->mask_erode_taskset );
+            taskslices_cycle( &pv->mask_erode_taskset );
+            taskslices_cycle( &pv->mask_dilate_taskset );
+            taskslices_cycle( &pv->mask_erode_taskset );
         }
         //return check_filtered_combing_mask( pv );
     }
@@ -1520,7 +1166,7 @@ static int comb_segmenter( hb_filter_private_t * pv )
         //return check_combing_mask( pv );
     }
     reset_combing_results(pv);
-    taskset_cycle( &pv->decomb_check_taskset );
+    taskslices_cycle( &pv->decomb_check_taskset );
     return check_combing_results(pv);
 }
 
@@ -1691,7 +1337,7 @@ static void yadif_filter_line(
 /*
  * deinterlace this segment of all three planes in a single thread.
  */
-static void yadif_decomb_filter_thread( void *thread_args_v )
+static void yadif_decomb_filter_slice( void *thread_args_v )
 {
     yadif_arguments_t *yadif_work = NULL;
     hb_filter_private_t * pv;
@@ -1709,120 +1355,89 @@ static void yadif_decomb_filter_thread( void *thread_args_v )
     pv = thread_args->pv;
     segment = thread_args->segment;
 
-    hb_log("yadif thread started for segment %d", segment);
+    yadif_work = &pv->yadif_arguments[segment];
 
-    while (1)
-    {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->yadif_taskset, segment );
+    /*
+     * Process all three planes, but only this segment of it.
+     */
+    hb_buffer_t *dst;
+    int parity, tff, is_combed;
 
-        if( taskset_thread_stop( &pv->yadif_taskset, segment ) )
-        {
-            /*
-             * No more work to do, exit this thread.
-             */
-            break;
-        }
+    is_combed = pv->yadif_arguments[segment].is_combed;
+    dst = yadif_work->dst;
+    tff = yadif_work->tff;
+    parity = yadif_work->parity;
 
-        yadif_work = &pv->yadif_arguments[segment];
+    int pp;
+    for (pp = 0; pp < 3; pp++)
+    {
+        int yy;
+        int width = dst->plane[pp].width;
+        int stride = dst->plane[pp].stride;
+        int height = dst->plane[pp].height_stride;
+        int penultimate = height - 2;
 
-        /*
-         * Process all three planes, but only this segment of it.
-         */
-        hb_buffer_t *dst;
-        int parity, tff, is_combed;
+        segment_start = thread_args->segment_start[pp];
+        segment_stop = segment_start + thread_args->segment_height[pp];
 
-        is_combed = pv->yadif_arguments[segment].is_combed;
-        dst = yadif_work->dst;
-        tff = yadif_work->tff;
-        parity = yadif_work->parity;
+        // Filter parity lines
+        int start = parity ? (segment_start + 1) & ~1 : segment_start | 1;
+        uint8_t *dst2 = &dst->plane[pp].data[start * stride];
+        uint8_t *prev = &pv->ref[0]->plane[pp].data[start * stride];
+        uint8_t *cur  = &pv->ref[1]->plane[pp].data[start * stride];
+        uint8_t *next = &pv->ref[2]->plane[pp].data[start * stride];
 
-        int pp;
-        for (pp = 0; pp < 3; pp++)
+        if( is_combed == 2 )
         {
-            int yy;
-            int width = dst->plane[pp].width;
-            int stride = dst->plane[pp].stride;
-            int height = dst->plane[pp].height_stride;
-            int penultimate = height - 2;
-
-            segment_start = thread_args->segment_start[pp];
-            segment_stop = segment_start + thread_args->segment_height[pp];
-
-            // Filter parity lines
-            int start = parity ? (segment_start + 1) & ~1 : segment_start | 1;
-            uint8_t *dst2 = &dst->plane[pp].data[start * stride];
-            uint8_t *prev = &pv->ref[0]->plane[pp].data[start * stride];
-            uint8_t *cur  = &pv->ref[1]->plane[pp].data[start * stride];
-            uint8_t *next = &pv->ref[2]->plane[pp].data[start * stride];
-
-            if( is_combed == 2 )
+            /* These will be useful if we ever do temporal blending. */
+            for( yy = start; yy < segment_stop; yy += 2 )
             {
-                /* These will be useful if we ever do temporal blending. */
-                for( yy = start; yy < segment_stop; yy += 2 )
-                {
-                    /* This line gets blend filtered, not yadif filtered. */
-                    blend_filter_line(&filter, dst2, cur, width, height, stride, yy);
-                    dst2 += stride * 2;
-                    cur += stride * 2;
-                }
+                /* This line gets blend filtered, not yadif filtered. */
+                blend_filter_line(&filter, dst2, cur, width, height, stride, yy);
+                dst2 += stride * 2;
+                cur += stride * 2;
             }
-            else if (pv->mode == MODE_CUBIC && is_combed)
+        }
+        else if (pv->mode == MODE_CUBIC && is_combed)
+        {
+            for( yy = start; yy < segment_stop; yy += 2 )
             {
-                for( yy = start; yy < segment_stop; yy += 2 )
-                {
-                    /* Just apply vertical cubic interpolation */
-                    cubic_interpolate_line(dst2, cur, width, height, stride, yy);
-                    dst2 += stride * 2;
-                    cur += stride * 2;
-                }
+                /* Just apply vertical cubic interpolation */
+                cubic_interpolate_line(dst2, cur, width, height, stride, yy);
+                dst2 += stride * 2;
+                cur += stride * 2;
             }
-            else if ((pv->mode & MODE_YADIF) && is_combed == 1)
+        }
+        else if ((pv->mode & MODE_YADIF) && is_combed == 1)
+        {
+            for( yy = start; yy < segment_stop; yy += 2 )
             {
-                for( yy = start; yy < segment_stop; yy += 2 )
+                if( yy > 1 && yy < penultimate )
                 {
-                    if( yy > 1 && yy < penultimate )
-                    {
-                        // This isn't the top or bottom,
-                        // proceed as normal to yadif
-                        yadif_filter_line(pv, dst2, prev, cur, next, pp,
-                                          width, height, stride,
-                                          parity ^ tff, yy);
-                    }
-                    else
-                    {
-                        // parity == 0 (TFF), y1 = y0
-                        // parity == 1 (BFF), y0 = y1
-                        // parity == 0 (TFF), yu = yp
-                        // parity == 1 (BFF), yp = yu
-                        int yp = (yy ^ parity) * stride;
-                        memcpy(dst2, &pv->ref[1]->plane[pp].data[yp], width);
-                    }
-                    dst2 += stride * 2;
-                    prev += stride * 2;
-                    cur += stride * 2;
-                    next += stride * 2;
+                    // This isn't the top or bottom,
+                    // proceed as normal to yadif
+                    yadif_filter_line(pv, dst2, prev, cur, next, pp,
+                                      width, height, stride,
+                                      parity ^ tff, yy);
                 }
-            }
-            else
-            {
-                // No combing, copy frame
-                for( yy = start; yy < segment_stop; yy += 2 )
+                else
                 {
-                    memcpy(dst2, cur, width);
-                    dst2 += stride * 2;
-                    cur += stride * 2;
+                    // parity == 0 (TFF), y1 = y0
+                    // parity == 1 (BFF), y0 = y1
+                    // parity == 0 (TFF), yu = yp
+                    // parity == 1 (BFF), yp = yu
+                    int yp = (yy ^ parity) * stride;
+                    memcpy(dst2, &pv->ref[1]->plane[pp].data[yp], width);
                 }
+                dst2 += stride * 2;
+                prev += stride * 2;
+                cur += stride * 2;
+                next += stride * 2;
             }
-
-            // Copy unfiltered lines
-            start = !parity ? (segment_start + 1) & ~1 : segment_start | 1;
-            dst2 = &dst->plane[pp].data[start * stride];
-            prev = &pv->ref[0]->plane[pp].data[start * stride];
-            cur  = &pv->ref[1]->plane[pp].data[start * stride];
-            next = &pv->ref[2]->plane[pp].data[start * stride];
+        }
+        else
+        {
+            // No combing, copy frame
             for( yy = start; yy < segment_stop; yy += 2 )
             {
                 memcpy(dst2, cur, width);
@@ -1830,13 +1445,20 @@ static void yadif_decomb_filter_thread( void *thread_args_v )
                 cur += stride * 2;
             }
         }
-        taskset_thread_complete( &pv->yadif_taskset, segment );
-    }
 
-    /*
-     * Finished this segment, let everyone know.
-     */
-    taskset_thread_complete( &pv->yadif_taskset, segment );
+        // Copy unfiltered lines
+        start = !parity ? (segment_start + 1) & ~1 : segment_start | 1;
+        dst2 = &dst->plane[pp].data[start * stride];
+        prev = &pv->ref[0]->plane[pp].data[start * stride];
+        cur  = &pv->ref[1]->plane[pp].data[start * stride];
+        next = &pv->ref[2]->plane[pp].data[start * stride];
+        for( yy = start; yy < segment_stop; yy += 2 )
+        {
+            memcpy(dst2, cur, width);
+            dst2 += stride * 2;
+            cur += stride * 2;
+        }
+    }
 }
 
 static void yadif_filter( hb_filter_private_t * pv,
@@ -1949,7 +1571,7 @@ static void yadif_filter( hb_filter_private_t * pv,
             /*
              * Allow the taskset threads to make one pass over the data.
              */
-            taskset_cycle( &pv->yadif_taskset );
+            taskslices_cycle( &pv->yadif_taskset );
 
             /*
              * Entire frame is now deinterlaced.
@@ -2063,8 +1685,9 @@ static int hb_decomb_init( hb_filter_object_t * filter,
      */
     pv->yadif_arguments = malloc( sizeof( yadif_arguments_t ) * pv->cpu_count );
     if( pv->yadif_arguments == NULL ||
-        taskset_init( &pv->yadif_taskset, pv->cpu_count,
-                      sizeof( yadif_thread_arg_t ) ) == 0 )
+        taskslices_init( &pv->yadif_taskset, hb_get_taskpool( init->job->h ),
+                         pv->cpu_count, sizeof( yadif_thread_arg_t ),
+                         yadif_decomb_filter_slice ) == 0 )
     {
         hb_error( "yadif could not initialize taskset" );
     }
@@ -2074,7 +1697,7 @@ static int hb_decomb_init( hb_filter_object_t * filter,
     {
         yadif_thread_arg_t *thread_args;
 
-        thread_args = taskset_thread_args( &pv->yadif_taskset, ii );
+        thread_args = taskslices_args( &pv->yadif_taskset, ii );
         thread_args->pv = pv;
         thread_args->segment = ii;
 
@@ -2100,21 +1723,15 @@ static int hb_decomb_init( hb_filter_object_t * filter,
             }
         }
         pv->yadif_arguments[ii].dst = NULL;
-        if( taskset_thread_spawn( &pv->yadif_taskset, ii,
-                                 "yadif_filter_segment",
-                                 yadif_decomb_filter_thread,
-                                 HB_NORMAL_PRIORITY ) == 0 )
-        {
-            hb_error( "yadif could not spawn thread" );
-        }
         yadif_prev_thread_args = thread_args;
     }
 
     /*
      * Create comb detection taskset.
      */
-    if( taskset_init( &pv->decomb_filter_taskset, pv->cpu_count,
-                      sizeof( decomb_thread_arg_t ) ) == 0 )
+    if( taskslices_init( &pv->decomb_filter_taskset, hb_get_taskpool( init->job->h ),
+                         pv->cpu_count, sizeof( decomb_thread_arg_t ),
+                         decomb_filter_slice ) == 0 )
     {
         hb_error( "decomb could not initialize taskset" );
     }
@@ -2124,7 +1741,7 @@ static int hb_decomb_init( hb_filter_object_t * filter,
     {
         decomb_thread_arg_t *thread_args;
 
-        thread_args = taskset_thread_args( &pv->decomb_filter_taskset, ii );
+        thread_args = taskslices_args( &pv->decomb_filter_taskset, ii );
         thread_args->pv = pv;
         thread_args->segment = ii;
 
@@ -2150,14 +1767,6 @@ static int hb_decomb_init( hb_filter_object_t * filter,
             }
         }
 
-        if( taskset_thread_spawn( &pv->decomb_filter_taskset, ii,
-                                 "decomb_filter_segment",
-                                 decomb_filter_thread,
-                                 HB_NORMAL_PRIORITY ) == 0 )
-        {
-            hb_error( "decomb could not spawn thread" );
-        }
-
         decomb_prev_thread_args = thread_args;
     }
 
@@ -2171,8 +1780,9 @@ static int hb_decomb_init( hb_filter_object_t * filter,
     /*
      * Create comb check taskset.
      */
-    if( taskset_init( &pv->decomb_check_taskset, pv->comb_check_nthreads,
-                      sizeof( decomb_thread_arg_t ) ) == 0 )
+    if( taskslices_init( &pv->decomb_check_taskset, hb_get_taskpool( init->job->h ),
+                         pv->comb_check_nthreads, sizeof( decomb_thread_arg_t ),
+                         decomb_check_slice ) == 0 )
     {
         hb_error( "decomb check could not initialize taskset" );
     }
@@ -2182,7 +1792,7 @@ static int hb_decomb_init( hb_filter_object_t * filter,
     {
         decomb_thread_arg_t *thread_args, *decomb_prev_thread_args = NULL;
 
-        thread_args = taskset_thread_args( &pv->decomb_check_taskset, ii );
+        thread_args = taskslices_args( &pv->decomb_check_taskset, ii );
         thread_args->pv = pv;
         thread_args->segment = ii;
 
@@ -2215,21 +1825,14 @@ static int hb_decomb_init( hb_filter_object_t * filter,
             }
         }
 
-        if( taskset_thread_spawn( &pv->decomb_check_taskset, ii,
-                                 "decomb_check_segment",
-                                 decomb_check_thread,
-                                 HB_NORMAL_PRIORITY ) == 0 )
-        {
-            hb_error( "decomb check could not spawn thread" );
-        }
-
         decomb_prev_thread_args = thread_args;
     }
 
     if( pv->mode & MODE_FILTER )
     {
-        if( taskset_init( &pv->mask_filter_taskset, pv->cpu_count,
-                          sizeof( decomb_thread_arg_t ) ) == 0 )
+        if( taskslices_init( &pv->mask_filter_taskset, hb_get_taskpool( init->job->h ),
+                             pv->cpu_count, sizeof( decomb_thread_arg_t ),
+                             mask_filter_slice ) == 0 )
         {
             hb_error( "maske filter could not initialize taskset" );
         }
@@ -2239,7 +1842,7 @@ static int hb_decomb_init( hb_filter_object_t * filter,
         {
             decomb_thread_arg_t *thread_args;
 
-            thread_args = taskset_thread_args( &pv->mask_filter_taskset, ii );
+            thread_args = taskslices_args( &pv->mask_filter_taskset, ii );
             thread_args->pv = pv;
             thread_args->segment = ii;
 
@@ -2266,21 +1869,14 @@ static int hb_decomb_init( hb_filter_object_t * filter,
                 }
             }
 
-            if( taskset_thread_spawn( &pv->mask_filter_taskset, ii,
-                                     "mask_filter_segment",
-                                     mask_filter_thread,
-                                     HB_NORMAL_PRIORITY ) == 0 )
-            {
-                hb_error( "mask filter could not spawn thread" );
-            }
-
             decomb_prev_thread_args = thread_args;
         }
 
         if( pv->filter_mode == FILTER_ERODE_DILATE )
         {
-            if( taskset_init( &pv->mask_erode_taskset, pv->cpu_count,
-                              sizeof( decomb_thread_arg_t ) ) == 0 )
+            if( taskslices_init( &pv->mask_erode_taskset, hb_get_taskpool( init->job->h ),
+                                 pv->cpu_count, sizeof( decomb_thread_arg_t ),
+                                 mask_erode_slice ) == 0 )
             {
                 hb_error( "mask erode could not initialize taskset" );
             }
@@ -2290,7 +1886,7 @@ static int hb_decomb_init( hb_filter_object_t * filter,
             {
                 decomb_thread_arg_t *thread_args;
 
-                thread_args = taskset_thread_args( &pv->mask_erode_taskset, ii );
+                thread_args = taskslices_args( &pv->mask_erode_taskset, ii );
                 thread_args->pv = pv;
                 thread_args->segment = ii;
 
@@ -2317,19 +1913,12 @@ static int hb_decomb_init( hb_filter_object_t * filter,
                     }
                 }
 
-                if( taskset_thread_spawn( &pv->mask_erode_taskset, ii,
-                                         "mask_erode_segment",
-                                         mask_erode_thread,
-                                         HB_NORMAL_PRIORITY ) == 0 )
-                {
-                    hb_error( "mask erode could not spawn thread" );
-                }
-
                 decomb_prev_thread_args = thread_args;
             }
 
-            if( taskset_init( &pv->mask_dilate_taskset, pv->cpu_count,
-                              sizeof( decomb_thread_arg_t ) ) == 0 )
+            if( taskslices_init( &pv->mask_dilate_taskset, hb_get_taskpool( init->job->h ),
+                                 pv->cpu_count, sizeof( decomb_thread_arg_t ),
+                                 mask_dilate_slice ) == 0 )
             {
                 hb_error( "mask dilate could not initialize taskset" );
             }
@@ -2339,7 +1928,7 @@ static int hb_decomb_init( hb_filter_object_t * filter,
             {
                 decomb_thread_arg_t *thread_args;
 
-                thread_args = taskset_thread_args( &pv->mask_dilate_taskset, ii );
+                thread_args = taskslices_args( &pv->mask_dilate_taskset, ii );
                 thread_args->pv = pv;
                 thread_args->segment = ii;
 
@@ -2366,14 +1955,6 @@ static int hb_decomb_init( hb_filter_object_t * filter,
                     }
                 }
 
-                if( taskset_thread_spawn( &pv->mask_dilate_taskset, ii,
-                                         "mask_dilate_segment",
-                                         mask_dilate_thread,
-                                         HB_NORMAL_PRIORITY ) == 0 )
-                {
-                    hb_error( "mask dilate could not spawn thread" );
-                }
-
                 decomb_prev_thread_args = thread_args;
             }
         }
@@ -2384,8 +1965,9 @@ static int hb_decomb_init( hb_filter_object_t * filter,
         /*
          * Create eedi2 taskset.
          */
-        if( taskset_init( &pv->eedi2_taskset, /*thread_count*/3,
-                          sizeof( eedi2_thread_arg_t ) ) == 0 )
+        if( taskslices_init( &pv->eedi2_taskset, hb_get_taskpool( init->job->h ),
+                             3, sizeof( eedi2_thread_arg_t ),
+                             eedi2_filter_slice ) == 0 )
         {
             hb_error( "eedi2 could not initialize taskset" );
         }
@@ -2417,18 +1999,10 @@ static int hb_decomb_init( hb_filter_object_t * filter,
         {
             eedi2_thread_arg_t *eedi2_thread_args;
 
-            eedi2_thread_args = taskset_thread_args( &pv->eedi2_taskset, ii );
+            eedi2_thread_args = taskslices_args( &pv->eedi2_taskset, ii );
 
             eedi2_thread_args->pv = pv;
             eedi2_thread_args->plane = ii;
-
-            if( taskset_thread_spawn( &pv->eedi2_taskset, ii,
-                                      "eedi2_filter_segment",
-                                      eedi2_filter_thread,
-                                      HB_NORMAL_PRIORITY ) == 0 )
-            {
-                hb_error( "eedi2 could not spawn thread" );
-            }
         }
     }
 
@@ -2448,23 +2022,23 @@ static void hb_decomb_close( hb_filter_object_t * filter )
 
     hb_log("decomb: deinterlaced %i | blended %i | unfiltered %i | total %i", pv->deinterlaced_frames, pv->blended_frames, pv->unfiltered_frames, pv->deinterlaced_frames + pv->blended_frames + pv->unfiltered_frames);
 
-    taskset_fini( &pv->yadif_taskset );
-    taskset_fini( &pv->decomb_filter_taskset );
-    taskset_fini( &pv->decomb_check_taskset );
+    taskslices_fini( &pv->yadif_taskset );
+    taskslices_fini( &pv->decomb_filter_taskset );
+    taskslices_fini( &pv->decomb_check_taskset );
 
     if( pv->mode & MODE_FILTER )
     {
-        taskset_fini( &pv->mask_filter_taskset );
+        taskslices_fini( &pv->mask_filter_taskset );
         if( pv->filter_mode == FILTER_ERODE_DILATE )
         {
-            taskset_fini( &pv->mask_erode_taskset );
-            taskset_fini( &pv->mask_dilate_taskset );
+            taskslices_fini( &pv->mask_erode_taskset );
+            taskslices_fini( &pv->mask_dilate_taskset );
         }
     }
 
     if( pv->mode & MODE_EEDI2 )
     {
-        taskset_fini( &pv->eedi2_taskset );
+        taskslices_fini( &pv->eedi2_taskset );
     }
 
 
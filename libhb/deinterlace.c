@@ -65,8 +65,8 @@ struct hb_filter_private_s
 
     int              deint_nsegs;
 
-    taskset_t        deint_taskset;         // Threads for fast deint
-    taskset_t        yadif_taskset;         // Threads for Yadif
+    taskslices_t     deint_taskset;         // Slices for fast deint
+    taskslices_t     yadif_taskset;         // Slices for Yadif
 
     deint_arguments_t *deint_arguments;     // Arguments to thread for work
     yadif_arguments_t *yadif_arguments;     // Arguments to thread for work
@@ -176,121 +176,94 @@ typedef struct yadif_thread_arg_s {
 } yadif_thread_arg_t;
 
 /*
- * deinterlace this segment of all three planes in a single thread.
+ * deinterlace this segment of all three planes in a single slice.
  */
-void yadif_filter_thread( void *thread_args_v )
+static void yadif_filter_slice( void *thread_args_v )
 {
     yadif_arguments_t *yadif_work = NULL;
     hb_filter_private_t * pv;
-    int run = 1;
     int segment, segment_start, segment_stop;
     yadif_thread_arg_t *thread_args = thread_args_v;
 
     pv = thread_args->pv;
     segment = thread_args->segment;
 
-    hb_log("Yadif Deinterlace thread started for segment %d", segment);
+    yadif_work = &pv->yadif_arguments[segment];
 
-    while( run )
+    if( yadif_work->dst == NULL )
     {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->yadif_taskset, segment );
-
+        hb_error( "Thread started when no work available" );
+        return;
+    }
 
-        if( taskset_thread_stop( &pv->yadif_taskset, segment ) )
+    /*
+     * Process all three planes, but only this segment of it.
+     */
+    int pp;
+    for(pp = 0; pp < 3; pp++)
+    {
+        hb_buffer_t *dst = yadif_work->dst;
+        int w = dst->plane[pp].width;
+        int s = dst->plane[pp].stride;
+        int h = dst->plane[pp].height;
+        int yy;
+        int parity = yadif_work->parity;
+        int tff = yadif_work->tff;
+        int penultimate = h - 2;
+
+        int segment_height = (h / pv->segments) & ~1;
+        segment_start = segment_height * segment;
+        if( segment == pv->segments - 1 )
         {
             /*
-             * No more work to do, exit this thread.
+             * Final segment
              */
-            run = 0;
-            goto report_completion;
-        }
-
-        yadif_work = &pv->yadif_arguments[segment];
-
-        if( yadif_work->dst == NULL )
-        {
-            hb_error( "Thread started when no work available" );
-            goto report_completion;
+            segment_stop = h;
+        } else {
+            segment_stop = segment_height * ( segment + 1 );
         }
 
-        /*
-         * Process all three planes, but only this segment of it.
-         */
-        int pp;
-        for(pp = 0; pp < 3; pp++)
+        uint8_t *dst2 = &dst->plane[pp].data[segment_start * s];
+        uint8_t *prev = &pv->yadif_ref[0]->plane[pp].data[segment_start * s];
+        uint8_t *cur  = &pv->yadif_ref[1]->plane[pp].data[segment_start * s];
+        uint8_t *next = &pv->yadif_ref[2]->plane[pp].data[segment_start * s];
+        for( yy = segment_start; yy < segment_stop; yy++ )
         {
-            hb_buffer_t *dst = yadif_work->dst;
-            int w = dst->plane[pp].width;
-            int s = dst->plane[pp].stride;
-            int h = dst->plane[pp].height;
-            int yy;
-            int parity = yadif_work->parity;
-            int tff = yadif_work->tff;
-            int penultimate = h - 2;
-
-            int segment_height = (h / pv->segments) & ~1;
-            segment_start = segment_height * segment;
-            if( segment == pv->segments - 1 )
-            {
-                /*
-                 * Final segment
-                 */
-                segment_stop = h;
-            } else {
-                segment_stop = segment_height * ( segment + 1 );
-            }
-
-            uint8_t *dst2 = &dst->plane[pp].data[segment_start * s];
-            uint8_t *prev = &pv->yadif_ref[0]->plane[pp].data[segment_start * s];
-            uint8_t *cur  = &pv->yadif_ref[1]->plane[pp].data[segment_start * s];
-            uint8_t *next = &pv->yadif_ref[2]->plane[pp].data[segment_start * s];
-            for( yy = segment_start; yy < segment_stop; yy++ )
+            if(((yy ^ parity) &  1))
             {
-                if(((yy ^ parity) &  1))
+                /* This is the bottom field when TFF and vice-versa.
+                   It's the field that gets filtered. Because yadif
+                   needs 2 lines above and below the one being filtered,
+                   we need to mirror the edges. When TFF, this means
+                   replacing the 2nd line with a copy of the 1st,
+                   and the last with the second-to-last.                  */
+                if( yy > 1 && yy < penultimate )
                 {
-                    /* This is the bottom field when TFF and vice-versa.
-                       It's the field that gets filtered. Because yadif
-                       needs 2 lines above and below the one being filtered,
-                       we need to mirror the edges. When TFF, this means
-                       replacing the 2nd line with a copy of the 1st,
-                       and the last with the second-to-last.                  */
-                    if( yy > 1 && yy < penultimate )
-                    {
-                        /* This isn't the top or bottom,
-                         * proceed as normal to yadif. */
-                        yadif_filter_line(pv, dst2, prev, cur, next, w, s,
-                                          parity ^ tff);
-                    }
-                    else
-                    {
-                        // parity == 0 (TFF), y1 = y0
-                        // parity == 1 (BFF), y0 = y1
-                        // parity == 0 (TFF), yu = yp
-                        // parity == 1 (BFF), yp = yu
-                        uint8_t *src  = &pv->yadif_ref[1]->plane[pp].data[(yy^parity)*s];
-                        memcpy(dst2, src, w);
-                    }
+                    /* This isn't the top or bottom,
+                     * proceed as normal to yadif. */
+                    yadif_filter_line(pv, dst2, prev, cur, next, w, s,
+                                      parity ^ tff);
                 }
                 else
                 {
-                    /* Preserve this field unfiltered */
-                    memcpy(dst2, cur, w);
+                    // parity == 0 (TFF), y1 = y0
+                    // parity == 1 (BFF), y0 = y1
+                    // parity == 0 (TFF), yu = yp
+                    // parity == 1 (BFF), yp = yu
+                    uint8_t *src  = &pv->yadif_ref[1]->plane[pp].data[(yy^parity)*s];
+                    memcpy(dst2, src, w);
                 }
-                dst2 += s;
-                prev += s;
-                cur += s;
-                next += s;
             }
+            else
+            {
+                /* Preserve this field unfiltered */
+                memcpy(dst2, cur, w);
+            }
+            dst2 += s;
+            prev += s;
+            cur += s;
+            next += s;
         }
-
-report_completion:
-        /*
-         * Finished this segment, let everyone know.
-         */
-        taskset_thread_complete( &pv->yadif_taskset, segment );
     }
 }
 
@@ -318,8 +291,8 @@ static void yadif_filter( hb_filter_private_t * pv,
         pv->yadif_arguments[segment].dst = dst;
     }
 
-    /* Allow the taskset threads to make one pass over the data. */
-    taskset_cycle( &pv->yadif_taskset );
+    /* Allow the shared workers to make one pass over the data. */
+    taskslices_cycle( &pv->yadif_taskset );
 
     /*
      * Entire frame is now deinterlaced.
@@ -327,57 +300,30 @@ static void yadif_filter( hb_filter_private_t * pv,
 }
 
 /*
- * deinterlace a frame in a single thread.
+ * deinterlace a frame in a single slice.
  */
-void deint_filter_thread( void *thread_args_v )
+static void deint_filter_slice( void *thread_args_v )
 {
     deint_arguments_t *args = NULL;
     hb_filter_private_t * pv;
-    int run = 1;
     int segment;
     deint_thread_arg_t *thread_args = thread_args_v;
 
     pv = thread_args->pv;
     segment = thread_args->segment;
 
-    hb_log("Fast Deinterlace thread started for segment %d", segment);
+    args = &pv->deint_arguments[segment];
 
-    while( run )
+    if( args->dst == NULL )
     {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->deint_taskset, segment );
-
-
-        if( taskset_thread_stop( &pv->deint_taskset, segment ) )
-        {
-            /*
-             * No more work to do, exit this thread.
-             */
-            run = 0;
-            goto report_completion;
-        }
-
-        args = &pv->deint_arguments[segment];
-
-        if( args->dst == NULL )
-        {
-            // This can happen when flushing final buffers.
-            goto report_completion;
-        }
-
-        /*
-         * Process all three planes, but only this segment of it.
-         */
-        hb_deinterlace(args->dst, args->src);
-
-report_completion:
-        /*
-         * Finished this segment, let everyone know.
-         */
-        taskset_thread_complete( &pv->deint_taskset, segment );
+        // This can happen when flushing final buffers.
+        return;
     }
+
+    /*
+     * Process all three planes, but only this segment of it.
+     */
+    hb_deinterlace(args->dst, args->src);
 }
 
 /*
@@ -405,8 +351,8 @@ static hb_buffer_t * deint_fast(hb_filter_private_t * pv, hb_buffer_t * in)
 
     if (pv->deint_nsegs > 0)
     {
-        /* Allow the taskset threads to make one pass over the data. */
-        taskset_cycle( &pv->deint_taskset );
+        /* Allow the shared workers to make one pass over the data. */
+        taskslices_cycle( &pv->deint_taskset );
     }
 
     hb_buffer_t *first = NULL, *last = NULL;
@@ -479,8 +425,9 @@ static int hb_deinterlace_init( hb_filter_object_t * filter,
         pv->segments = pv->cpu_count;
         pv->yadif_arguments = malloc( sizeof( yadif_arguments_t ) * pv->segments );
         if( pv->yadif_arguments == NULL ||
-            taskset_init( &pv->yadif_taskset, /*thread_count*/pv->segments,
-                          sizeof( yadif_thread_arg_t ) ) == 0 )
+            taskslices_init( &pv->yadif_taskset, hb_get_taskpool( init->job->h ),
+                             pv->segments, sizeof( yadif_thread_arg_t ),
+                             yadif_filter_slice ) == 0 )
         {
             hb_error( "yadif could not initialize taskset" );
         }
@@ -490,19 +437,11 @@ static int hb_deinterlace_init( hb_filter_object_t * filter,
         {
             yadif_thread_arg_t *thread_args;
 
-            thread_args = taskset_thread_args( &pv->yadif_taskset, ii );
+            thread_args = taskslices_args( &pv->yadif_taskset, ii );
 
             thread_args->pv = pv;
             thread_args->segment = ii;
             pv->yadif_arguments[ii].dst = NULL;
-
-            if( taskset_thread_spawn( &pv->yadif_taskset, ii,
-                                      "yadif_filter_segment",
-                                      yadif_filter_thread,
-                                      HB_NORMAL_PRIORITY ) == 0 )
-            {
-                hb_error( "yadif could not spawn thread" );
-            }
         }
     }
     else
@@ -513,8 +452,9 @@ static int hb_deinterlace_init( hb_filter_object_t * filter,
         pv->segments = pv->cpu_count;
         pv->deint_arguments = malloc( sizeof( deint_arguments_t ) * pv->segments );
         if( pv->deint_arguments == NULL ||
-            taskset_init( &pv->deint_taskset, pv->segments,
-                          sizeof( deint_thread_arg_t ) ) == 0 )
+            taskslices_init( &pv->deint_taskset, hb_get_taskpool( init->job->h ),
+                             pv->segments, sizeof( deint_thread_arg_t ),
+                             deint_filter_slice ) == 0 )
         {
             hb_error( "deint could not initialize taskset" );
         }
@@ -524,19 +464,11 @@ static int hb_deinterlace_init( hb_filter_object_t * filter,
         {
             deint_thread_arg_t *thread_args;
 
-            thread_args = taskset_thread_args( &pv->deint_taskset, ii );
+            thread_args = taskslices_args( &pv->deint_taskset, ii );
 
             thread_args->pv = pv;
             thread_args->segment = ii;
             pv->deint_arguments[ii].dst = NULL;
-
-            if( taskset_thread_spawn( &pv->deint_taskset, ii,
-                                      "deint_filter_segment",
-                                      deint_filter_thread,
-                                      HB_NORMAL_PRIORITY ) == 0 )
-            {
-                hb_error( "deint could not spawn thread" );
-            }
         }
     }
 
@@ -555,7 +487,7 @@ static void hb_deinterlace_close( hb_filter_object_t * filter )
     /* Cleanup yadif specific buffers */
     if( pv->yadif_mode & MODE_YADIF_ENABLE )
     {
-        taskset_fini( &pv->yadif_taskset );
+        taskslices_fini( &pv->yadif_taskset );
 
         int ii;
         for(ii = 0; ii < 3; ii++)
@@ -567,7 +499,7 @@ static void hb_deinterlace_close( hb_filter_object_t * filter )
     }
     else
     {
-        taskset_fini( &pv->deint_taskset );
+        taskslices_fini( &pv->deint_taskset );
         free( pv->deint_arguments );
     }
 
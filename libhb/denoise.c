@@ -19,6 +19,8 @@
 
 #include "hb.h"
 #include "hbffmpeg.h"
+#include "taskset.h"
+#include "denoise.h"
 
 #define HQDN3D_SPATIAL_LUMA_DEFAULT    4.0f
 #define HQDN3D_SPATIAL_CHROMA_DEFAULT  3.0f
@@ -27,11 +29,24 @@
 #define ABS(A) ( (A) > 0 ? (A) : -(A) )
 #define MIN( a, b ) ( (a) > (b) ? (b) : (a) )
 
+typedef struct
+{
+    hb_filter_private_t * pv;
+    int                   plane;
+    hb_buffer_t         * in;
+    hb_buffer_t         * out;
+} hqdn3d_arg_t;
+
 struct hb_filter_private_s
 {
-    short            hqdn3d_coef[6][512*16];
-    unsigned short * hqdn3d_line;
+    // One spare entry for the 32 bit gathers in denoise_x86.c
+    short            hqdn3d_coef[6][512*16+1];
+    unsigned short * hqdn3d_line[3];
+    unsigned int   * hqdn3d_row[3];
     unsigned short * hqdn3d_frame[3];
+
+    HQDN3DFunctions  functions;
+    taskslices_t     hqdn3d_taskslices;   // Slices for the three planes
 };
 
 static int hb_denoise_init( hb_filter_object_t * filter,
@@ -166,9 +181,24 @@ static void hqdn3d_denoise_spatial( unsigned char * frame_src,
     }
 }
 
-static void hqdn3d_denoise( unsigned char * frame_src,
+static void hqdn3d_denoise_spatial_c( unsigned char * frame_src,
+                                      unsigned char * frame_dst,
+                                      unsigned short * line_ant,
+                                      unsigned int * row_ant,
+                                      unsigned short * frame_ant,
+                                      int w, int h,
+                                      short * spatial,
+                                      short * temporal )
+{
+    hqdn3d_denoise_spatial( frame_src, frame_dst, line_ant, frame_ant,
+                            w, h, spatial, temporal );
+}
+
+static void hqdn3d_denoise( HQDN3DFunctions * functions,
+                            unsigned char * frame_src,
                             unsigned char * frame_dst,
                             unsigned short * line_ant,
+                            unsigned int * row_ant,
                             unsigned short ** frame_ant_ptr,
                             int w,
                             int h,
@@ -196,22 +226,54 @@ static void hqdn3d_denoise( unsigned char * frame_src,
     /* If no spatial coefficients, do temporal denoise only */
     if( spatial[0] )
     {
-        hqdn3d_denoise_spatial( frame_src,
-                                frame_dst,
-                                line_ant,
-                                frame_ant,
-                                w, h,
-                                spatial,
-                                temporal );
+        functions->denoise_spatial( frame_src,
+                                    frame_dst,
+                                    line_ant,
+                                    row_ant,
+                                    frame_ant,
+                                    w, h,
+                                    spatial,
+                                    temporal );
     }
     else
     {
-        hqdn3d_denoise_temporal( frame_src,
-                                 frame_dst,
-                                 frame_ant,
-                                 w, h,
-                                 temporal);
+        functions->denoise_temporal( frame_src,
+                                     frame_dst,
+                                     frame_ant,
+                                     w, h,
+                                     temporal);
+    }
+}
+
+/*
+ * Denoise one plane.  The planes are independent of each other, each
+ * has its own line and previous frame buffers.
+ */
+static void hqdn3d_slice( void *thread_args_v )
+{
+    hqdn3d_arg_t * arg = thread_args_v;
+    hb_filter_private_t * pv = arg->pv;
+    hb_buffer_t * in = arg->in;
+    int c = arg->plane;
+
+    if( !pv->hqdn3d_line[c] )
+    {
+        pv->hqdn3d_line[c] = malloc( in->plane[c].stride *
+                                     sizeof(unsigned short) );
+        pv->hqdn3d_row[c]  = malloc( HQDN3D_ROWS * in->plane[c].stride *
+                                     sizeof(unsigned int) );
     }
+
+    hqdn3d_denoise( &pv->functions,
+                    in->plane[c].data,
+                    arg->out->plane[c].data,
+                    pv->hqdn3d_line[c],
+                    pv->hqdn3d_row[c],
+                    &pv->hqdn3d_frame[c],
+                    in->plane[c].stride,
+                    in->plane[c].height,
+                    pv->hqdn3d_coef[c * 2],
+                    pv->hqdn3d_coef[c * 2 + 1] );
 }
 
 static int hb_denoise_init( hb_filter_object_t * filter,
@@ -290,6 +352,27 @@ static int hb_denoise_init( hb_filter_object_t * filter,
     hqdn3d_precalc_coef( pv->hqdn3d_coef[4], spatial_chroma_r );
     hqdn3d_precalc_coef( pv->hqdn3d_coef[5], temporal_chroma_r );
 
+    pv->functions.denoise_temporal = hqdn3d_denoise_temporal;
+    pv->functions.denoise_spatial  = hqdn3d_denoise_spatial_c;
+#if defined(ARCH_X86)
+    hqdn3d_init_x86( &pv->functions );
+#endif
+
+    if( taskslices_init( &pv->hqdn3d_taskslices, hb_get_taskpool( init->job->h ),
+                         3, sizeof( hqdn3d_arg_t ), hqdn3d_slice ) == 0 )
+    {
+        hb_error( "denoise could not initialize taskslices" );
+        return -1;
+    }
+
+    int c;
+    for( c = 0; c < 3; c++ )
+    {
+        hqdn3d_arg_t * arg = taskslices_args( &pv->hqdn3d_taskslices, c );
+        arg->pv = pv;
+        arg->plane = c;
+    }
+
     return 0;
 }
 
@@ -302,25 +385,17 @@ static void hb_denoise_close( hb_filter_object_t * filter )
         return;
     }
 
-	if( pv->hqdn3d_line )
-    {
-        free( pv->hqdn3d_line );
-        pv->hqdn3d_line = NULL;
-    }
-	if( pv->hqdn3d_frame[0] )
-    {
-        free( pv->hqdn3d_frame[0] );
-        pv->hqdn3d_frame[0] = NULL;
-    }
-	if( pv->hqdn3d_frame[1] )
-    {
-        free( pv->hqdn3d_frame[1] );
-        pv->hqdn3d_frame[1] = NULL;
-    }
-	if( pv->hqdn3d_frame[2] )
+    taskslices_fini( &pv->hqdn3d_taskslices );
+
+    int c;
+    for( c = 0; c < 3; c++ )
     {
-        free( pv->hqdn3d_frame[2] );
-        pv->hqdn3d_frame[2] = NULL;
+        free( pv->hqdn3d_line[c] );
+        free( pv->hqdn3d_row[c] );
+        free( pv->hqdn3d_frame[c] );
+        pv->hqdn3d_line[c] = NULL;
+        pv->hqdn3d_row[c] = NULL;
+        pv->hqdn3d_frame[c] = NULL;
     }
 
     free( pv );
@@ -343,25 +418,14 @@ static int hb_denoise_work( hb_filter_object_t * filter,
 
     out = hb_video_buffer_init( in->f.width, in->f.height );
 
-    if( !pv->hqdn3d_line )
-    {
-        pv->hqdn3d_line = malloc( in->plane[0].stride * sizeof(unsigned short) );
-    }
-
-    int c, coef_index;
-
+    int c;
     for ( c = 0; c < 3; c++ )
     {
-        coef_index = c * 2;
-        hqdn3d_denoise( in->plane[c].data,
-                        out->plane[c].data,
-                        pv->hqdn3d_line,
-                        &pv->hqdn3d_frame[c],
-                        in->plane[c].stride,
-                        in->plane[c].height,
-                        pv->hqdn3d_coef[coef_index],
-                        pv->hqdn3d_coef[coef_index+1] );
+        hqdn3d_arg_t * arg = taskslices_args( &pv->hqdn3d_taskslices, c );
+        arg->in = in;
+        arg->out = out;
     }
+    taskslices_cycle( &pv->hqdn3d_taskslices );
 
     out->s = in->s;
     hb_buffer_move_subs( out, in );
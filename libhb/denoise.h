@@ -0,0 +1,34 @@
+/* denoise.h
+
+   Copyright (c) 2003-2015 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+// Rows of the spatial filter whose horizontal passes are interleaved
+#define HQDN3D_ROWS 4
+
+typedef struct
+{
+    void (*denoise_temporal)(unsigned char  *frame_src,
+                             unsigned char  *frame_dst,
+                             unsigned short *frame_ant,
+                             int             w,
+                             int             h,
+                             short          *temporal);
+
+    // row_ant is scratch space for HQDN3D_ROWS * w unsigned ints
+    void (*denoise_spatial)(unsigned char  *frame_src,
+                            unsigned char  *frame_dst,
+                            unsigned short *line_ant,
+                            unsigned int   *row_ant,
+                            unsigned short *frame_ant,
+                            int             w,
+                            int             h,
+                            short          *spatial,
+                            short          *temporal);
+} HQDN3DFunctions;
+
+void hqdn3d_init_x86(HQDN3DFunctions *functions);
@@ -0,0 +1,433 @@
+/* denoise_x86.c
+
+   Copyright (c) 2003-2015 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "hb.h"     // needed for ARCH_X86
+
+#if defined(ARCH_X86)
+
+#include <emmintrin.h>
+
+#include "libavutil/cpu.h"
+#include "x86_target.h"
+#include "denoise.h"
+
+/*
+ * The kernels below compute exactly what the scalar code in denoise.c
+ * does.  All intermediate values are kept at 32 bits and are only
+ * truncated where the scalar code stores them to 16 or 8 bit memory.
+ */
+
+static inline unsigned int lowpass_mul(int prev_mul,
+                                       int curr_mul,
+                                 const short *coef)
+{
+    int d = (prev_mul - curr_mul) >> 4;
+    return curr_mul + coef[d];
+}
+
+typedef void (temporal_row_func)(const unsigned int *row_ant,
+                                       unsigned short *frame_ant,
+                                       unsigned char  *frame_dst,
+                                       int             w,
+                                 const short          *temporal);
+
+typedef void (spatial_row_func)(const unsigned int *row_ant,
+                                      unsigned short *line_ant,
+                                      unsigned short *frame_ant,
+                                      unsigned char  *frame_dst,
+                                      int             w,
+                                const short          *spatial,
+                                const short          *temporal);
+
+/*
+ * The horizontal recursion of the spatial filter is serial within a row
+ * and bound by the latency of the coefficient lookups.  Rows don't
+ * depend on each other though, so the recursions of HQDN3D_ROWS rows
+ * are interleaved.  The vertical and temporal passes, which are
+ * independent for each pixel of a row, are then done a vector at a time.
+ */
+static void denoise_spatial_rows(unsigned char  *frame_src,
+                                 unsigned char  *frame_dst,
+                                 unsigned short *line_ant,
+                                 unsigned int   *row_ant,
+                                 unsigned short *frame_ant,
+                                 int             w,
+                                 int             h,
+                                 short          *spatial,
+                                 short          *temporal,
+                                 temporal_row_func *temporal_row,
+                                 spatial_row_func  *spatial_row)
+{
+    unsigned int pixel_ant;
+    int x, y;
+
+    spatial  += 0x1000;
+    temporal += 0x1000;
+
+    // First line has no top neighbor
+    pixel_ant = frame_src[0] << 8;
+    for (x = 0; x < w; x++)
+    {
+        row_ant[x] = pixel_ant = lowpass_mul(pixel_ant, frame_src[x] << 8,
+                                             spatial);
+        line_ant[x] = pixel_ant;
+    }
+    temporal_row(row_ant, frame_ant, frame_dst, w, temporal);
+
+    for (y = 1; y < h; y += HQDN3D_ROWS)
+    {
+        int rows = MIN(HQDN3D_ROWS, h - y);
+        int r;
+
+        frame_src += w;
+        if (rows == HQDN3D_ROWS)
+        {
+            unsigned int p0, p1, p2, p3;
+
+            row_ant[0]     = p0 = frame_src[0]     << 8;
+            row_ant[w]     = p1 = frame_src[w]     << 8;
+            row_ant[2 * w] = p2 = frame_src[2 * w] << 8;
+            row_ant[3 * w] = p3 = frame_src[3 * w] << 8;
+            for (x = 1; x < w; x++)
+            {
+                row_ant[x]         = p0 = lowpass_mul(p0, frame_src[x] << 8,
+                                                      spatial);
+                row_ant[w + x]     = p1 = lowpass_mul(p1, frame_src[w + x] << 8,
+                                                      spatial);
+                row_ant[2 * w + x] = p2 = lowpass_mul(p2, frame_src[2 * w + x] << 8,
+                                                      spatial);
+                row_ant[3 * w + x] = p3 = lowpass_mul(p3, frame_src[3 * w + x] << 8,
+                                                      spatial);
+            }
+        }
+        else
+        {
+            for (r = 0; r < rows; r++)
+            {
+                row_ant[r * w] = pixel_ant = frame_src[r * w] << 8;
+                for (x = 1; x < w; x++)
+                {
+                    row_ant[r * w + x] = pixel_ant =
+                        lowpass_mul(pixel_ant, frame_src[r * w + x] << 8,
+                                    spatial);
+                }
+            }
+        }
+        frame_src += (rows - 1) * w;
+
+        for (r = 0; r < rows; r++)
+        {
+            frame_dst += w;
+            frame_ant += w;
+            spatial_row(row_ant + r * w, line_ant, frame_ant, frame_dst, w,
+                        spatial, temporal);
+        }
+    }
+}
+
+/* SSE2 */
+
+/*
+ * Filters 2x4 pixels.  SSE2 has no gather, so the coefficients are looked
+ * up one at a time.  The table indexes always fit in 16 bits.
+ */
+static inline void lowpass_mul_sse2(__m128i *lo, __m128i *hi,
+                                    __m128i prev_lo, __m128i prev_hi,
+                                    const short *coef)
+{
+    __m128i d, c;
+
+    d = _mm_packs_epi32(_mm_srai_epi32(_mm_sub_epi32(prev_lo, *lo), 4),
+                        _mm_srai_epi32(_mm_sub_epi32(prev_hi, *hi), 4));
+    c = _mm_cvtsi32_si128(coef[(short)_mm_extract_epi16(d, 0)]);
+    c = _mm_insert_epi16(c, coef[(short)_mm_extract_epi16(d, 1)], 1);
+    c = _mm_insert_epi16(c, coef[(short)_mm_extract_epi16(d, 2)], 2);
+    c = _mm_insert_epi16(c, coef[(short)_mm_extract_epi16(d, 3)], 3);
+    c = _mm_insert_epi16(c, coef[(short)_mm_extract_epi16(d, 4)], 4);
+    c = _mm_insert_epi16(c, coef[(short)_mm_extract_epi16(d, 5)], 5);
+    c = _mm_insert_epi16(c, coef[(short)_mm_extract_epi16(d, 6)], 6);
+    c = _mm_insert_epi16(c, coef[(short)_mm_extract_epi16(d, 7)], 7);
+
+    // Sign extend the coefficients and add them to curr
+    *lo = _mm_add_epi32(*lo, _mm_srai_epi32(_mm_unpacklo_epi16(c, c), 16));
+    *hi = _mm_add_epi32(*hi, _mm_srai_epi32(_mm_unpackhi_epi16(c, c), 16));
+}
+
+// Truncate 2x4 32 bit values to 16 bits
+static inline __m128i pack_u16_sse2(__m128i lo, __m128i hi)
+{
+    lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+    hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+    return _mm_packs_epi32(lo, hi);
+}
+
+// (tmp + 0x7F) >> 8 truncated to 8 bits, in the low 8 bytes
+static inline __m128i round_u8_sse2(__m128i lo, __m128i hi)
+{
+    const __m128i bias = _mm_set1_epi32(0x7F);
+    const __m128i mask = _mm_set1_epi32(0xFF);
+
+    lo = _mm_and_si128(_mm_srli_epi32(_mm_add_epi32(lo, bias), 8), mask);
+    hi = _mm_and_si128(_mm_srli_epi32(_mm_add_epi32(hi, bias), 8), mask);
+    lo = _mm_packs_epi32(lo, hi);
+    return _mm_packus_epi16(lo, lo);
+}
+
+static void temporal_row_sse2(const unsigned int *row_ant,
+                                    unsigned short *frame_ant,
+                                    unsigned char  *frame_dst,
+                                    int             w,
+                              const short          *temporal)
+{
+    const __m128i zero = _mm_setzero_si128();
+    unsigned int tmp;
+    int x;
+
+    for (x = 0; x + 8 <= w; x += 8)
+    {
+        __m128i ant, lo, hi;
+
+        ant = _mm_loadu_si128((__m128i*)(frame_ant + x));
+        lo = _mm_loadu_si128((__m128i*)(row_ant + x));
+        hi = _mm_loadu_si128((__m128i*)(row_ant + x + 4));
+        lowpass_mul_sse2(&lo, &hi, _mm_unpacklo_epi16(ant, zero),
+                         _mm_unpackhi_epi16(ant, zero), temporal);
+
+        _mm_storeu_si128((__m128i*)(frame_ant + x), pack_u16_sse2(lo, hi));
+        _mm_storel_epi64((__m128i*)(frame_dst + x), round_u8_sse2(lo, hi));
+    }
+    for (; x < w; x++)
+    {
+        frame_ant[x] = tmp = lowpass_mul(frame_ant[x], row_ant[x], temporal);
+        frame_dst[x] = (tmp + 0x7F) >> 8;
+    }
+}
+
+static void spatial_row_sse2(const unsigned int *row_ant,
+                                   unsigned short *line_ant,
+                                   unsigned short *frame_ant,
+                                   unsigned char  *frame_dst,
+                                   int             w,
+                             const short          *spatial,
+                             const short          *temporal)
+{
+    const __m128i zero = _mm_setzero_si128();
+    unsigned int tmp;
+    int x;
+
+    for (x = 0; x + 8 <= w; x += 8)
+    {
+        __m128i line, ant, lo, hi;
+
+        line = _mm_loadu_si128((__m128i*)(line_ant + x));
+        lo = _mm_loadu_si128((__m128i*)(row_ant + x));
+        hi = _mm_loadu_si128((__m128i*)(row_ant + x + 4));
+        lowpass_mul_sse2(&lo, &hi, _mm_unpacklo_epi16(line, zero),
+                         _mm_unpackhi_epi16(line, zero), spatial);
+        _mm_storeu_si128((__m128i*)(line_ant + x), pack_u16_sse2(lo, hi));
+
+        ant = _mm_loadu_si128((__m128i*)(frame_ant + x));
+        lowpass_mul_sse2(&lo, &hi, _mm_unpacklo_epi16(ant, zero),
+                         _mm_unpackhi_epi16(ant, zero), temporal);
+
+        _mm_storeu_si128((__m128i*)(frame_ant + x), pack_u16_sse2(lo, hi));
+        _mm_storel_epi64((__m128i*)(frame_dst + x), round_u8_sse2(lo, hi));
+    }
+    for (; x < w; x++)
+    {
+        line_ant[x] = tmp = lowpass_mul(line_ant[x], row_ant[x], spatial);
+        frame_ant[x] = tmp = lowpass_mul(frame_ant[x], tmp, temporal);
+        frame_dst[x] = (tmp + 0x7F) >> 8;
+    }
+}
+
+static void denoise_spatial_sse2(unsigned char  *frame_src,
+                                 unsigned char  *frame_dst,
+                                 unsigned short *line_ant,
+                                 unsigned int   *row_ant,
+                                 unsigned short *frame_ant,
+                                 int             w,
+                                 int             h,
+                                 short          *spatial,
+                                 short          *temporal)
+{
+    denoise_spatial_rows(frame_src, frame_dst, line_ant, row_ant, frame_ant,
+                         w, h, spatial, temporal,
+                         temporal_row_sse2, spatial_row_sse2);
+}
+
+#if defined(HB_X86_AVX2)
+
+/* AVX2 */
+
+static inline TARGET_AVX2 __m256i lowpass_mul_avx2(__m256i prev, __m256i curr,
+                                                   const short *coef)
+{
+    __m256i d, c;
+
+    // Gather 32 bits at each 16 bit coefficient and sign extend the low half.
+    // The coefficient tables have a spare entry so this can't overrun.
+    d = _mm256_srai_epi32(_mm256_sub_epi32(prev, curr), 4);
+    c = _mm256_i32gather_epi32((const int*)coef, d, 2);
+    c = _mm256_srai_epi32(_mm256_slli_epi32(c, 16), 16);
+    return _mm256_add_epi32(curr, c);
+}
+
+// Truncate 8 32 bit values to 16 bits
+static inline TARGET_AVX2 __m128i pack_u16_avx2(__m256i v)
+{
+    v = _mm256_and_si256(v, _mm256_set1_epi32(0xFFFF));
+    v = _mm256_packus_epi32(v, v);
+    return _mm256_castsi256_si128(_mm256_permute4x64_epi64(v, 0x08));
+}
+
+// (tmp + 0x7F) >> 8 truncated to 8 bits, in the low 8 bytes
+static inline TARGET_AVX2 __m128i round_u8_avx2(__m256i v)
+{
+    __m128i w;
+
+    v = _mm256_add_epi32(v, _mm256_set1_epi32(0x7F));
+    v = _mm256_and_si256(_mm256_srli_epi32(v, 8), _mm256_set1_epi32(0xFF));
+    w = pack_u16_avx2(v);
+    return _mm_packus_epi16(w, w);
+}
+
+static TARGET_AVX2 void denoise_temporal_avx2(unsigned char  *frame_src,
+                                              unsigned char  *frame_dst,
+                                              unsigned short *frame_ant,
+                                              int             w,
+                                              int             h,
+                                              short          *temporal)
+{
+    unsigned int tmp;
+    int x, n = w * h;
+
+    temporal += 0x1000;
+
+    // Planes are contiguous, so all rows can be done in one pass
+    for (x = 0; x + 8 <= n; x += 8)
+    {
+        __m256i src, ant, v;
+
+        src = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i*)(frame_src + x)));
+        ant = _mm256_cvtepu16_epi32(_mm_loadu_si128((__m128i*)(frame_ant + x)));
+        v = lowpass_mul_avx2(ant, _mm256_slli_epi32(src, 8), temporal);
+
+        _mm_storeu_si128((__m128i*)(frame_ant + x), pack_u16_avx2(v));
+        _mm_storel_epi64((__m128i*)(frame_dst + x), round_u8_avx2(v));
+    }
+    for (; x < n; x++)
+    {
+        frame_ant[x] = tmp = lowpass_mul(frame_ant[x], frame_src[x] << 8,
+                                         temporal);
+        frame_dst[x] = (tmp + 0x7F) >> 8;
+    }
+}
+
+static TARGET_AVX2 void temporal_row_avx2(const unsigned int *row_ant,
+                                                unsigned short *frame_ant,
+                                                unsigned char  *frame_dst,
+                                                int             w,
+                                          const short          *temporal)
+{
+    unsigned int tmp;
+    int x;
+
+    for (x = 0; x + 8 <= w; x += 8)
+    {
+        __m256i ant, v;
+
+        ant = _mm256_cvtepu16_epi32(_mm_loadu_si128((__m128i*)(frame_ant + x)));
+        v = lowpass_mul_avx2(ant, _mm256_loadu_si256((__m256i*)(row_ant + x)),
+                             temporal);
+
+        _mm_storeu_si128((__m128i*)(frame_ant + x), pack_u16_avx2(v));
+        _mm_storel_epi64((__m128i*)(frame_dst + x), round_u8_avx2(v));
+    }
+    for (; x < w; x++)
+    {
+        frame_ant[x] = tmp = lowpass_mul(frame_ant[x], row_ant[x], temporal);
+        frame_dst[x] = (tmp + 0x7F) >> 8;
+    }
+}
+
+static TARGET_AVX2 void spatial_row_avx2(const unsigned int *row_ant,
+                                               unsigned short *line_ant,
+                                               unsigned short *frame_ant,
+                                               unsigned char  *frame_dst,
+                                               int             w,
+                                         const short          *spatial,
+                                         const short          *temporal)
+{
+    unsigned int tmp;
+    int x;
+
+    for (x = 0; x + 8 <= w; x += 8)
+    {
+        __m256i line, ant, v;
+
+        line = _mm256_cvtepu16_epi32(_mm_loadu_si128((__m128i*)(line_ant + x)));
+        v = lowpass_mul_avx2(line, _mm256_loadu_si256((__m256i*)(row_ant + x)),
+                             spatial);
+        _mm_storeu_si128((__m128i*)(line_ant + x), pack_u16_avx2(v));
+
+        ant = _mm256_cvtepu16_epi32(_mm_loadu_si128((__m128i*)(frame_ant + x)));
+        v = lowpass_mul_avx2(ant, v, temporal);
+
+        _mm_storeu_si128((__m128i*)(frame_ant + x), pack_u16_avx2(v));
+        _mm_storel_epi64((__m128i*)(frame_dst + x), round_u8_avx2(v));
+    }
+    for (; x < w; x++)
+    {
+        line_ant[x] = tmp = lowpass_mul(line_ant[x], row_ant[x], spatial);
+        frame_ant[x] = tmp = lowpass_mul(frame_ant[x], tmp, temporal);
+        frame_dst[x] = (tmp + 0x7F) >> 8;
+    }
+}
+
+static void denoise_spatial_avx2(unsigned char  *frame_src,
+                                 unsigned char  *frame_dst,
+                                 unsigned short *line_ant,
+                                 unsigned int   *row_ant,
+                                 unsigned short *frame_ant,
+                                 int             w,
+                                 int             h,
+                                 short          *spatial,
+                                 short          *temporal)
+{
+    denoise_spatial_rows(frame_src, frame_dst, line_ant, row_ant, frame_ant,
+                         w, h, spatial, temporal,
+                         temporal_row_avx2, spatial_row_avx2);
+}
+
+#endif // HB_X86_AVX2
+
+void hqdn3d_init_x86(HQDN3DFunctions *functions)
+{
+    int cpu_flags = av_get_cpu_flags();
+
+#if defined(HB_X86_AVX2)
+    if (cpu_flags & AV_CPU_FLAG_AVX2)
+    {
+        functions->denoise_temporal = denoise_temporal_avx2;
+        functions->denoise_spatial  = denoise_spatial_avx2;
+        hb_log("Denoise (hqdn3d) using AVX2 optimizations");
+        return;
+    }
+#endif
+    if (cpu_flags & AV_CPU_FLAG_SSE2)
+    {
+        // Without a gather, the temporal only pass is no faster than
+        // the scalar code, which is left in place
+        functions->denoise_spatial  = denoise_spatial_sse2;
+        hb_log("Denoise (hqdn3d) using SSE2 optimizations");
+    }
+}
+
+#endif // ARCH_X86
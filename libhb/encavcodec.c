@@ -101,7 +101,7 @@ int encavcodecInit( hb_work_object_t * w, hb_job_t * job )
     // override with advanced settings.
     if( job->pass_id == HB_PASS_ENCODE_2ND )
     {
-        hb_interjob_t * interjob = hb_interjob_get( job->h );
+        hb_interjob_t * interjob = hb_job_interjob( job );
         fps.den = interjob->vrate.den;
         fps.num = interjob->vrate.num;
     }
@@ -248,7 +248,8 @@ int encavcodecInit( hb_work_object_t * w, hb_job_t * job )
         job->pass_id == HB_PASS_ENCODE_2ND )
     {
         char filename[1024]; memset( filename, 0, 1024 );
-        hb_get_tempory_filename( job->h, filename, "ffmpeg.log" );
+        hb_get_tempory_filename( job->h, filename, "ffmpeg_%d.log",
+                                 job->slot );
 
         if( job->pass_id == HB_PASS_ENCODE_1ST )
         {
@@ -275,7 +276,7 @@ int encavcodecInit( hb_work_object_t * w, hb_job_t * job )
         }
     }
 
-    if (hb_avcodec_open(context, codec, &av_opts, HB_FFMPEG_THREADS_AUTO))
+    if (hb_avcodec_open(context, codec, &av_opts, hb_avcodec_job_threads(job)))
     {
         hb_log( "encavcodecInit: avcodec_open failed" );
     }
@@ -49,7 +49,8 @@ int enctheoraInit( hb_work_object_t * w, hb_job_t * job )
     {
         char filename[1024];
         memset( filename, 0, 1024 );
-        hb_get_tempory_filename( job->h, filename, "theroa.log" );
+        hb_get_tempory_filename( job->h, filename, "theroa_%d.log",
+                                 job->slot );
         if ( job->pass_id == HB_PASS_ENCODE_1ST )
         {
             pv->file = hb_fopen(filename, "wb");
@@ -74,7 +75,7 @@ int enctheoraInit( hb_work_object_t * w, hb_job_t * job )
 
     if( job->pass_id == HB_PASS_ENCODE_2ND )
     {
-        hb_interjob_t * interjob = hb_interjob_get( job->h );
+        hb_interjob_t * interjob = hb_job_interjob( job );
         ti.fps_numerator = interjob->vrate.num;
         ti.fps_denominator = interjob->vrate.den;
     }
@@ -125,7 +125,7 @@ int encx264Init( hb_work_object_t * w, hb_job_t * job )
      * using the encoder_options string. */
     if( job->pass_id == HB_PASS_ENCODE_2ND && job->cfr != 1 )
     {
-        hb_interjob_t * interjob = hb_interjob_get( job->h );
+        hb_interjob_t * interjob = hb_job_interjob( job );
         param.i_fps_num = interjob->vrate.num;
         param.i_fps_den = interjob->vrate.den;
     }
@@ -154,6 +154,13 @@ int encx264Init( hb_work_object_t * w, hb_job_t * job )
 
     param.i_log_level  = X264_LOG_INFO;
 
+    /* Jobs encoded concurrently share the CPUs, use as many threads
+     * as x264 would pick automatically for the job's share. */
+    if( job->cpu_budget > 0 )
+    {
+        param.i_threads = job->cpu_budget * 3 / 2;
+    }
+
     /* set up the VUI color model & gamma to match what the COLR atom
      * set in muxmp4.c says. See libhb/muxmp4.c for notes. */
     if( job->color_matrix_code == 4 )
@@ -281,7 +288,8 @@ int encx264Init( hb_work_object_t * w, hb_job_t * job )
             job->pass_id == HB_PASS_ENCODE_2ND )
         {
             memset( pv->filename, 0, 1024 );
-            hb_get_tempory_filename( job->h, pv->filename, "x264.log" );
+            hb_get_tempory_filename( job->h, pv->filename, "x264_%d.log",
+                                     job->slot );
         }
         switch( job->pass_id )
         {
@@ -141,6 +141,21 @@ int encx265Init(hb_work_object_t *w, hb_job_t *job)
     param->keyframeMin = (double)vrate.num / vrate.den + 0.5;
     param->keyframeMax = param->keyframeMin * 10;
 
+    /*
+     * Jobs encoded concurrently share the CPUs, size the thread pool
+     * to the job's share.  Older x265 only knows the "threads" option.
+     */
+    if (job->cpu_budget > 0)
+    {
+        char threads[11];
+        snprintf(threads, sizeof(threads), "%d", job->cpu_budget);
+        if (x265_param_parse(param, "pools", threads) == X265_PARAM_BAD_NAME &&
+            param_parse(param, "threads", threads))
+        {
+            goto fail;
+        }
+    }
+
     /*
      * Video Signal Type (color description only).
      *
@@ -250,7 +265,8 @@ int encx265Init(hb_work_object_t *w, hb_job_t *job)
             char stats_file[1024] = "";
             char pass[2];
             snprintf(pass, sizeof(pass), "%d", job->pass_id);
-            hb_get_tempory_filename(job->h, stats_file, "x265.log");
+            hb_get_tempory_filename(job->h, stats_file, "x265_%d.log",
+                                    job->slot);
             if (param_parse(param, "stats", stats_file) ||
                 param_parse(param, "pass", pass))
             {
@@ -270,7 +286,8 @@ int encx265Init(hb_work_object_t *w, hb_job_t *job)
     {
         if (param->csvfn == NULL)
         {
-            hb_get_tempory_filename(job->h, pv->csvfn, "x265.csv");
+            hb_get_tempory_filename(job->h, pv->csvfn, "x265_%d.csv",
+                                    job->slot);
             param->csvfn = pv->csvfn;
         }
         else
@@ -9,6 +9,7 @@
 
 #include "hb.h"
 #include "openclwrapper.h"
+#include <pthread.h>
 
 #ifndef SYS_DARWIN
 #include <malloc.h>
@@ -18,6 +19,16 @@
 //#define HB_FIFO_DEBUG 1
 //#define HB_BUFFER_DEBUG 1
 
+/* Smallest ring allocated for a single-producer/single-consumer fifo.
+ * Fifo capacity is only a soft limit (a work object may push a list of
+ * several buffers at once), so the ring is sized generously and anything
+ * that still doesn't fit goes to a locked overflow list. */
+#define FIFO_SPSC_MIN_RING 16
+
+#define fifo_atomic_load(p)     __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define fifo_atomic_store(p, v) __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#define fifo_atomic_add(p, v)   __atomic_add_fetch((p), (v), __ATOMIC_SEQ_CST)
+
 /* Fifo */
 struct hb_fifo_s
 {
@@ -33,6 +44,19 @@ struct hb_fifo_s
     hb_buffer_t  * first;
     hb_buffer_t  * last;
 
+    // Lock-free ring used when the fifo is created with hb_fifo_init_spsc().
+    // 'tail' is only written by the producer, 'head' only by the consumer.
+    // 'first'/'last' then hold overflow buffers that didn't fit in the ring
+    // and 'overflow' counts them.  'lock' is only taken to park a thread
+    // or to touch the overflow list.
+    int            spsc;
+    hb_buffer_t ** ring;
+    uint32_t       ring_mask;
+    uint32_t       overflow;
+    uint32_t       tail;
+    uint8_t        pad[64];
+    uint32_t       head;
+
 #if defined(HB_FIFO_DEBUG)
     // Fifo list for debugging
     hb_fifo_t    * next;
@@ -68,8 +92,32 @@ struct hb_buffer_pools_s
 #if defined(HB_BUFFER_DEBUG)
     hb_list_t *alloc_list;
 #endif
+
+    // Per-thread buffer caches (see buffer_cache_get/buffer_cache_put)
+    pthread_key_t cache_key;
+    int           cache_key_valid;
+    int64_t       cache_hits;
+    int64_t       cache_misses;
+    int64_t       cache_bytes;
 } buffers;
 
+/* Each thread keeps a small "magazine" of recycled buffers per pool so that
+ * the common alloc/free of small packets doesn't touch the shared pool
+ * lock.  Magazines are refilled from and drained to the shared pools
+ * BUFFER_CACHE_BATCH buffers at a time.  Only the smaller pools are cached
+ * since large frame buffers would tie up too much memory per thread. */
+#define BUFFER_CACHE_LAST         16
+#define BUFFER_CACHE_MAX_ELEMENTS 8
+#define BUFFER_CACHE_BATCH        4
+
+typedef struct
+{
+    hb_buffer_t * list[BUFFER_CACHE_LAST + 1];
+    int           count[BUFFER_CACHE_LAST + 1];
+} buffer_cache_t;
+
+static void buffer_cache_close( void * _cache );
+
 
 void hb_buffer_pool_init( void )
 {
@@ -99,6 +147,9 @@ void hb_buffer_pool_init( void )
         buffers.pool[i] = hb_fifo_init(BUFFER_POOL_MAX_ELEMENTS, 1);
         buffers.pool[i]->buffer_size = 1 << i;
     }
+
+    buffers.cache_key_valid =
+        !pthread_key_create( &buffers.cache_key, buffer_cache_close );
 }
 
 #if defined(HB_FIFO_DEBUG)
@@ -185,6 +236,12 @@ void fifo_list_validate( void )
     buffer_pools_validate();
     while ( next )
     {
+        if ( next->spsc )
+        {
+            // ring contents can't be validated without stopping the threads
+            next = next->next;
+            continue;
+        }
         count = 0;
         hb_lock( next->lock );
         b = next->first;
@@ -248,6 +305,22 @@ void hb_buffer_pool_free( void )
     int count;
     int64_t freed = 0;
     hb_buffer_t *b;
+    hb_buffer_cache_stats_t stats;
+
+    // Return the calling thread's cached buffers so they are freed below.
+    // Pipeline threads have already returned theirs when they exited.
+    if ( buffers.cache_key_valid )
+    {
+        buffer_cache_close( pthread_getspecific( buffers.cache_key ) );
+        pthread_setspecific( buffers.cache_key, NULL );
+    }
+
+    hb_buffer_cache_stats( &stats );
+    hb_deep_log( 2, "Buffer cache: %"PRId64" hits, %"PRId64" misses, "
+                 "%"PRId64" bytes held by other threads",
+                 stats.hits, stats.misses, stats.bytes_held );
+    fifo_atomic_store( &buffers.cache_hits, 0 );
+    fifo_atomic_store( &buffers.cache_misses, 0 );
 
     hb_lock(buffers.lock);
 
@@ -300,17 +373,191 @@ void hb_buffer_pool_free( void )
     hb_unlock(buffers.lock);
 }
 
-static hb_fifo_t *size_to_pool( int size )
+static int size_to_pool_index( int size )
 {
     int i;
     for ( i = BUFFER_POOL_FIRST; i <= BUFFER_POOL_LAST; ++i )
     {
         if ( size <= (1 << i) )
         {
-            return buffers.pool[i];
+            return i;
+        }
+    }
+    return -1;
+}
+
+static hb_fifo_t *size_to_pool( int size )
+{
+    int i = size_to_pool_index( size );
+    return i < 0 ? NULL : buffers.pool[i];
+}
+
+static buffer_cache_t * buffer_cache_get_thread( void )
+{
+    buffer_cache_t * cache;
+
+    if ( !buffers.cache_key_valid )
+    {
+        return NULL;
+    }
+    cache = pthread_getspecific( buffers.cache_key );
+    if ( cache == NULL )
+    {
+        cache = calloc( sizeof( buffer_cache_t ), 1 );
+        if ( cache != NULL )
+        {
+            pthread_setspecific( buffers.cache_key, cache );
+        }
+    }
+    return cache;
+}
+
+// Thread exit destructor. Hands the magazines back to the shared pools.
+static void buffer_cache_close( void * _cache )
+{
+    buffer_cache_t * cache = _cache;
+    int              i;
+
+    if ( cache == NULL )
+    {
+        return;
+    }
+    for ( i = BUFFER_POOL_FIRST; i <= BUFFER_CACHE_LAST; i++ )
+    {
+        if ( cache->list[i] == NULL )
+        {
+            continue;
+        }
+        fifo_atomic_add( &buffers.cache_bytes,
+                         -( (int64_t)cache->count[i] << i ) );
+        // Pool capacity is a soft limit, and a magazine is small
+        hb_fifo_push_head( buffers.pool[i], cache->list[i] );
+    }
+    free( cache );
+}
+
+// Takes up to 'count' buffers from the shared pool with one lock.
+static hb_buffer_t * buffer_pool_get_list( hb_fifo_t * f, int * count )
+{
+    hb_buffer_t * list, * last;
+    int           n = 0;
+
+    hb_lock( f->lock );
+    list = last = f->first;
+    while ( last != NULL && ++n < *count && last->next != NULL )
+    {
+        last = last->next;
+    }
+    if ( last != NULL )
+    {
+        f->first = last->next;
+        if ( f->first == NULL )
+        {
+            f->last = NULL;
+        }
+        last->next = NULL;
+        f->size -= n;
+    }
+    hb_unlock( f->lock );
+
+    *count = n;
+    return list;
+}
+
+// Returns a recycled buffer for the given pool index, or NULL.
+static hb_buffer_t * buffer_cache_get( int pool_index )
+{
+    buffer_cache_t * cache;
+    hb_buffer_t    * b;
+
+    if ( pool_index > BUFFER_CACHE_LAST ||
+         ( cache = buffer_cache_get_thread() ) == NULL )
+    {
+        return hb_fifo_get( buffers.pool[pool_index] );
+    }
+
+    if ( cache->count[pool_index] > 0 )
+    {
+        fifo_atomic_add( &buffers.cache_hits, 1 );
+    }
+    else
+    {
+        int count = BUFFER_CACHE_BATCH;
+
+        fifo_atomic_add( &buffers.cache_misses, 1 );
+        cache->list[pool_index] =
+            buffer_pool_get_list( buffers.pool[pool_index], &count );
+        cache->count[pool_index] = count;
+        fifo_atomic_add( &buffers.cache_bytes, (int64_t)count << pool_index );
+        if ( count == 0 )
+        {
+            return NULL;
+        }
+    }
+
+    b = cache->list[pool_index];
+    cache->list[pool_index] = b->next;
+    cache->count[pool_index]--;
+    fifo_atomic_add( &buffers.cache_bytes, -((int64_t)1 << pool_index) );
+    b->next = NULL;
+
+    return b;
+}
+
+// Recycles a buffer into this thread's cache or the shared pool.
+// Returns 0 if there's no room anywhere and the buffer must be freed.
+static int buffer_cache_put( int pool_index, hb_buffer_t * b )
+{
+    buffer_cache_t * cache;
+    hb_fifo_t      * pool = buffers.pool[pool_index];
+
+    if ( pool_index > BUFFER_CACHE_LAST ||
+         ( cache = buffer_cache_get_thread() ) == NULL )
+    {
+        if ( hb_fifo_is_full( pool ) )
+        {
+            return 0;
+        }
+        hb_fifo_push_head( pool, b );
+        return 1;
+    }
+
+    if ( cache->count[pool_index] >= BUFFER_CACHE_MAX_ELEMENTS )
+    {
+        // Magazine is full, drain a batch to the shared pool
+        hb_buffer_t * batch, * last;
+        int           i;
+
+        if ( hb_fifo_is_full( pool ) )
+        {
+            return 0;
         }
+        batch = last = cache->list[pool_index];
+        for ( i = 1; i < BUFFER_CACHE_BATCH; i++ )
+        {
+            last = last->next;
+        }
+        cache->list[pool_index] = last->next;
+        cache->count[pool_index] -= BUFFER_CACHE_BATCH;
+        last->next = NULL;
+        fifo_atomic_add( &buffers.cache_bytes,
+                         -( (int64_t)BUFFER_CACHE_BATCH << pool_index ) );
+        hb_fifo_push_head( pool, batch );
     }
-    return NULL;
+
+    b->next = cache->list[pool_index];
+    cache->list[pool_index] = b;
+    cache->count[pool_index]++;
+    fifo_atomic_add( &buffers.cache_bytes, (int64_t)1 << pool_index );
+
+    return 1;
+}
+
+void hb_buffer_cache_stats( hb_buffer_cache_stats_t * stats )
+{
+    stats->hits       = fifo_atomic_load( &buffers.cache_hits );
+    stats->misses     = fifo_atomic_load( &buffers.cache_misses );
+    stats->bytes_held = fifo_atomic_load( &buffers.cache_bytes );
 }
 
 hb_buffer_t * hb_buffer_init_internal( int size , int needsMapped )
@@ -322,11 +569,12 @@ hb_buffer_t * hb_buffer_init_internal( int size , int needsMapped )
     // sometimes we feed data to these libraries starting from arbitrary
     // points within the buffer.
     int alloc = size + 16;
-    hb_fifo_t *buffer_pool = size_to_pool( alloc );
+    int pool_index = size_to_pool_index( alloc );
+    hb_fifo_t *buffer_pool = pool_index < 0 ? NULL : buffers.pool[pool_index];
 
     if( buffer_pool )
     {
-        b = hb_fifo_get( buffer_pool );
+        b = buffer_cache_get( pool_index );
 
         /* OpenCL */
         if (b != NULL && needsMapped && b->cl.buffer == NULL)
@@ -416,7 +664,7 @@ hb_buffer_t * hb_buffer_init_internal( int size , int needsMapped )
             /* FIXME */
             b->data  = malloc( b->alloc + 17 );
 #else
-            b->data  = memalign( 16, b->alloc );
+            b->data  = memalign( 32, b->alloc );
 #endif
         }
 
@@ -599,6 +847,51 @@ hb_buffer_t * hb_frame_buffer_init( int pix_fmt, int width, int height )
     return buf;
 }
 
+// this routine gets a buffer for an uncompressed picture with pixel
+// format pix_fmt and dimensions width x height whose data is the
+// picture held by 'ref' (e.g. a frame decoded by libavcodec) instead of
+// a copy of it.  The picture must have the layout hb_frame_buffer_init
+// would give it.  The buffer keeps a reference to the picture until it
+// is closed.
+hb_buffer_t * hb_frame_buffer_ref( AVBufferRef * ref, int pix_fmt,
+                                   int width, int height )
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pix_fmt);
+    hb_buffer_t * buf;
+    int p;
+
+    if (desc == NULL)
+    {
+        return NULL;
+    }
+    if( !( buf = calloc( sizeof( hb_buffer_t ), 1 ) ) )
+    {
+        hb_log( "out of memory" );
+        return NULL;
+    }
+    buf->data = ref->data;
+    buf->s.type = FRAME_BUF;
+    buf->s.start = AV_NOPTS_VALUE;
+    buf->s.stop = AV_NOPTS_VALUE;
+    buf->s.renderOffset = AV_NOPTS_VALUE;
+    buf->f.width = width;
+    buf->f.height = height;
+    buf->f.fmt = pix_fmt;
+    hb_buffer_init_planes( buf );
+    for( p = 0; p < 4; p++ )
+    {
+        buf->size += buf->plane[p].size;
+    }
+    if ( buf->size > ref->size ||
+         ( buf->av_buffer = av_buffer_ref( ref ) ) == NULL )
+    {
+        free( buf );
+        return NULL;
+    }
+    buf->alloc = buf->size;
+    return buf;
+}
+
 // this routine reallocs a buffer for an uncompressed YUV420 video frame
 // with dimensions width x height.
 void hb_video_buffer_realloc( hb_buffer_t * buf, int width, int height )
@@ -669,7 +962,7 @@ void hb_buffer_close( hb_buffer_t ** _b )
     while( b )
     {
         hb_buffer_t * next = b->next;
-        hb_fifo_t *buffer_pool = size_to_pool( b->alloc );
+        int pool_index = size_to_pool_index( b->alloc );
 
         b->next = NULL;
 
@@ -681,9 +974,16 @@ void hb_buffer_close( hb_buffer_t ** _b )
         // Close any attached subtitle buffers
         hb_buffer_close( &b->sub );
 
-        if( buffer_pool && b->data && !hb_fifo_is_full( buffer_pool ) )
+        if( b->av_buffer != NULL )
+        {
+            // the data belongs to the referenced picture
+            av_buffer_unref( &b->av_buffer );
+            free( b );
+            b = next;
+            continue;
+        }
+        if( pool_index >= 0 && b->data && buffer_cache_put( pool_index, b ) )
         {
-            hb_fifo_push_head( buffer_pool, b );
             b = next;
             continue;
         }
@@ -846,7 +1146,180 @@ void hb_image_close(hb_image_t **_image)
     }
 }
 
-hb_fifo_t * hb_fifo_init( int capacity, int thresh )
+/*
+ * Single-producer/single-consumer fifo
+ *
+ * Used for the fixed stage to stage hand-offs of the video pipeline where
+ * exactly one thread pushes and exactly one thread pulls.  Buffers are
+ * passed through a power of 2 ring of pointers without taking the fifo
+ * lock.  A side only takes the lock when it has to park (empty on get,
+ * full on full_wait) or when the ring overflows.
+ *
+ * Ordering between the ring and the overflow list: the producer only
+ * appends to the ring while the overflow list is empty, so overflow
+ * buffers are always newer than anything in the ring and the consumer
+ * only takes from the overflow list once the ring has been drained.
+ */
+static uint32_t spsc_size( hb_fifo_t * f )
+{
+    uint32_t head = fifo_atomic_load( &f->head );
+    uint32_t tail = fifo_atomic_load( &f->tail );
+
+    return ( tail - head ) + fifo_atomic_load( &f->overflow );
+}
+
+// Producer side. Appends a single buffer.
+static void spsc_push_one( hb_fifo_t * f, hb_buffer_t * b )
+{
+    b->next = NULL;
+    if ( fifo_atomic_load( &f->overflow ) == 0 )
+    {
+        uint32_t tail = f->tail;
+        uint32_t head = fifo_atomic_load( &f->head );
+
+        if ( tail - head <= f->ring_mask )
+        {
+            f->ring[tail & f->ring_mask] = b;
+            fifo_atomic_store( &f->tail, tail + 1 );
+            return;
+        }
+    }
+
+    hb_lock( f->lock );
+    if ( f->first == NULL )
+    {
+        f->first = b;
+    }
+    else
+    {
+        f->last->next = b;
+    }
+    f->last = b;
+    fifo_atomic_add( &f->overflow, 1 );
+    hb_unlock( f->lock );
+}
+
+// Producer side. Wakes the consumer if it is parked in get_wait/see_wait.
+static void spsc_wake_consumer( hb_fifo_t * f )
+{
+    if ( fifo_atomic_load( &f->wait_empty ) )
+    {
+        hb_lock( f->lock );
+        if ( f->wait_empty )
+        {
+            fifo_atomic_store( &f->wait_empty, 0 );
+            hb_cond_signal( f->cond_empty );
+        }
+        hb_unlock( f->lock );
+    }
+}
+
+// Consumer side. Wakes the producer if it is parked in full_wait.
+static void spsc_wake_producer( hb_fifo_t * f )
+{
+    if ( fifo_atomic_load( &f->wait_full ) &&
+         spsc_size( f ) <= f->capacity - f->thresh )
+    {
+        hb_lock( f->lock );
+        if ( f->wait_full )
+        {
+            fifo_atomic_store( &f->wait_full, 0 );
+            hb_cond_signal( f->cond_full );
+        }
+        hb_unlock( f->lock );
+    }
+}
+
+// Consumer side. Returns the n'th buffer in the fifo without removing it.
+static hb_buffer_t * spsc_see( hb_fifo_t * f, uint32_t n )
+{
+    hb_buffer_t * b = NULL;
+    uint32_t      head = f->head;
+    uint32_t      count = fifo_atomic_load( &f->tail ) - head;
+
+    if ( n < count )
+    {
+        return f->ring[( head + n ) & f->ring_mask];
+    }
+    if ( fifo_atomic_load( &f->overflow ) == 0 )
+    {
+        return NULL;
+    }
+
+    hb_lock( f->lock );
+    // The producer does not add to the ring while there is overflow,
+    // so the ring count is stable from here on.
+    count = fifo_atomic_load( &f->tail ) - head;
+    if ( n < count )
+    {
+        b = f->ring[( head + n ) & f->ring_mask];
+    }
+    else
+    {
+        b = f->first;
+        for ( n -= count; b != NULL && n > 0; n-- )
+        {
+            b = b->next;
+        }
+    }
+    hb_unlock( f->lock );
+
+    return b;
+}
+
+// Consumer side. Removes and returns the first buffer in the fifo.
+static hb_buffer_t * spsc_get( hb_fifo_t * f )
+{
+    hb_buffer_t * b = NULL;
+    uint32_t      head = f->head;
+
+    if ( fifo_atomic_load( &f->tail ) == head )
+    {
+        if ( fifo_atomic_load( &f->overflow ) == 0 )
+        {
+            return NULL;
+        }
+        hb_lock( f->lock );
+        // Recheck, the producer may have filled the ring (and then
+        // started overflowing) since we looked.
+        if ( fifo_atomic_load( &f->tail ) == head )
+        {
+            b = f->first;
+            f->first = b->next;
+            if ( f->first == NULL )
+            {
+                f->last = NULL;
+            }
+            b->next = NULL;
+            fifo_atomic_add( &f->overflow, -1 );
+        }
+        hb_unlock( f->lock );
+    }
+    if ( b == NULL )
+    {
+        b = f->ring[head & f->ring_mask];
+        fifo_atomic_store( &f->head, head + 1 );
+    }
+    spsc_wake_producer( f );
+
+    return b;
+}
+
+// Consumer side. Parks until the producer pushes something or
+// FIFO_TIMEOUT milliseconds have elapsed.
+static void spsc_wait_empty( hb_fifo_t * f )
+{
+    hb_lock( f->lock );
+    fifo_atomic_store( &f->wait_empty, 1 );
+    if ( spsc_size( f ) < 1 )
+    {
+        hb_cond_timedwait( f->cond_empty, f->lock, FIFO_TIMEOUT );
+    }
+    fifo_atomic_store( &f->wait_empty, 0 );
+    hb_unlock( f->lock );
+}
+
+static hb_fifo_t * fifo_init( int capacity, int thresh, int spsc )
 {
     hb_fifo_t * f;
     f             = calloc( sizeof( hb_fifo_t ), 1 );
@@ -857,6 +1330,19 @@ hb_fifo_t * hb_fifo_init( int capacity, int thresh )
     f->thresh     = thresh;
     f->buffer_size = 0;
 
+    if ( spsc )
+    {
+        uint32_t ring_size = FIFO_SPSC_MIN_RING;
+
+        while ( ring_size < 2 * (uint32_t)capacity )
+        {
+            ring_size <<= 1;
+        }
+        f->ring      = calloc( sizeof( hb_buffer_t * ), ring_size );
+        f->ring_mask = ring_size - 1;
+        f->spsc      = 1;
+    }
+
 #if defined(HB_FIFO_DEBUG)
     // Add the fifo to the global fifo list
     fifo_list_add( f );
@@ -864,11 +1350,33 @@ hb_fifo_t * hb_fifo_init( int capacity, int thresh )
     return f;
 }
 
+hb_fifo_t * hb_fifo_init( int capacity, int thresh )
+{
+    return fifo_init( capacity, thresh, 0 );
+}
+
+// Creates a fifo that is fed by exactly one thread and drained by
+// exactly one other thread.  Any thread may query its size.
+hb_fifo_t * hb_fifo_init_spsc( int capacity, int thresh )
+{
+    return fifo_init( capacity, thresh, 1 );
+}
+
 int hb_fifo_size_bytes( hb_fifo_t * f )
 {
     int ret = 0;
     hb_buffer_t * link;
 
+    if ( f->spsc )
+    {
+        // Only safe when called from the consumer thread
+        uint32_t ii, head = f->head, tail = fifo_atomic_load( &f->tail );
+        for ( ii = head; ii != tail; ii++ )
+        {
+            ret += f->ring[ii & f->ring_mask]->size;
+        }
+    }
+
     hb_lock( f->lock );
     link = f->first;
     while ( link )
@@ -885,6 +1393,11 @@ int hb_fifo_size( hb_fifo_t * f )
 {
     int ret;
 
+    if ( f->spsc )
+    {
+        return spsc_size( f );
+    }
+
     hb_lock( f->lock );
     ret = f->size;
     hb_unlock( f->lock );
@@ -896,6 +1409,11 @@ int hb_fifo_is_full( hb_fifo_t * f )
 {
     int ret;
 
+    if ( f->spsc )
+    {
+        return spsc_size( f ) >= f->capacity;
+    }
+
     hb_lock( f->lock );
     ret = ( f->size >= f->capacity );
     hb_unlock( f->lock );
@@ -907,6 +1425,11 @@ float hb_fifo_percent_full( hb_fifo_t * f )
 {
     float ret;
 
+    if ( f->spsc )
+    {
+        return spsc_size( f ) / f->capacity;
+    }
+
     hb_lock( f->lock );
     ret = f->size / f->capacity;
     hb_unlock( f->lock );
@@ -920,6 +1443,17 @@ hb_buffer_t * hb_fifo_get_wait( hb_fifo_t * f )
 {
     hb_buffer_t * b;
 
+    if ( f->spsc )
+    {
+        b = spsc_get( f );
+        if ( b == NULL )
+        {
+            spsc_wait_empty( f );
+            b = spsc_get( f );
+        }
+        return b;
+    }
+
     hb_lock( f->lock );
     if( f->size < 1 )
     {
@@ -950,6 +1484,11 @@ hb_buffer_t * hb_fifo_get( hb_fifo_t * f )
 {
     hb_buffer_t * b;
 
+    if ( f->spsc )
+    {
+        return spsc_get( f );
+    }
+
     hb_lock( f->lock );
     if( f->size < 1 )
     {
@@ -974,6 +1513,17 @@ hb_buffer_t * hb_fifo_see_wait( hb_fifo_t * f )
 {
     hb_buffer_t * b;
 
+    if ( f->spsc )
+    {
+        b = spsc_see( f, 0 );
+        if ( b == NULL )
+        {
+            spsc_wait_empty( f );
+            b = spsc_see( f, 0 );
+        }
+        return b;
+    }
+
     hb_lock( f->lock );
     if( f->size < 1 )
     {
@@ -997,6 +1547,11 @@ hb_buffer_t * hb_fifo_see( hb_fifo_t * f )
 {
     hb_buffer_t * b;
 
+    if ( f->spsc )
+    {
+        return spsc_see( f, 0 );
+    }
+
     hb_lock( f->lock );
     if( f->size < 1 )
     {
@@ -1013,6 +1568,11 @@ hb_buffer_t * hb_fifo_see2( hb_fifo_t * f )
 {
     hb_buffer_t * b;
 
+    if ( f->spsc )
+    {
+        return spsc_see( f, 1 );
+    }
+
     hb_lock( f->lock );
     if( f->size < 2 )
     {
@@ -1031,6 +1591,23 @@ int hb_fifo_full_wait( hb_fifo_t * f )
 {
     int result;
 
+    if ( f->spsc )
+    {
+        if ( spsc_size( f ) < f->capacity )
+        {
+            return 1;
+        }
+        hb_lock( f->lock );
+        fifo_atomic_store( &f->wait_full, 1 );
+        if ( spsc_size( f ) >= f->capacity )
+        {
+            hb_cond_timedwait( f->cond_full, f->lock, FIFO_TIMEOUT );
+        }
+        fifo_atomic_store( &f->wait_full, 0 );
+        hb_unlock( f->lock );
+        return spsc_size( f ) < f->capacity;
+    }
+
     hb_lock( f->lock );
     if( f->size >= f->capacity )
     {
@@ -1051,6 +1628,13 @@ void hb_fifo_push_wait( hb_fifo_t * f, hb_buffer_t * b )
         return;
     }
 
+    if ( f->spsc )
+    {
+        hb_fifo_full_wait( f );
+        hb_fifo_push( f, b );
+        return;
+    }
+
     hb_lock( f->lock );
     if( f->size >= f->capacity )
     {
@@ -1088,6 +1672,18 @@ void hb_fifo_push( hb_fifo_t * f, hb_buffer_t * b )
         return;
     }
 
+    if ( f->spsc )
+    {
+        while ( b )
+        {
+            hb_buffer_t * next = b->next;
+            spsc_push_one( f, b );
+            b = next;
+        }
+        spsc_wake_consumer( f );
+        return;
+    }
+
     hb_lock( f->lock );
     if( f->size > 0 )
     {
@@ -1123,6 +1719,14 @@ void hb_fifo_push_head( hb_fifo_t * f, hb_buffer_t * b )
         return;
     }
 
+    if ( f->spsc )
+    {
+        // Only the consumer may remove from the front of the ring
+        hb_error( "hb_fifo_push_head: not supported by spsc fifo, appending" );
+        hb_fifo_push( f, b );
+        return;
+    }
+
     hb_lock( f->lock );
 
     /*
@@ -1190,6 +1794,7 @@ void hb_fifo_close( hb_fifo_t ** _f )
     hb_lock_close( &f->lock );
     hb_cond_close( &f->cond_empty );
     hb_cond_close( &f->cond_full );
+    free( f->ring );
 
 #if defined(HB_FIFO_DEBUG)
     // Remove the fifo from the global fifo list
@@ -0,0 +1,687 @@
+/* framespool.c
+
+   Copyright (c) 2003-2015 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include <zlib.h>
+
+#include "hb.h"
+#include "taskset.h"
+
+/*
+ * Frame spool for two pass encodes.
+ *
+ * The first pass writes every frame that leaves the filters to a
+ * temporary file on its way into the video encoder.  The second pass
+ * finds the spool in the interjob data of its slot and runs without
+ * filters: the encoder wrapper drops the frames coming from sync and
+ * encodes the spooled ones instead.  Reader, decoders and sync still
+ * run, they carry the audio, the soft subtitles and the chapters.
+ *
+ * Each frame is a header followed by FRAME_SPOOL_BANDS bands, a band is
+ * the same share of the rows of every plane.  Rows are stored as the
+ * difference to the pixel on their left and deflated at the fastest
+ * level, the bands are (de)compressed in parallel on the task pool.
+ * If writing the spool fails the first pass drops it and the second
+ * pass filters its frames as usual.
+ */
+
+#define FRAME_SPOOL_BANDS   8
+#define FRAME_SPOOL_BUFFER  (4 * 1024 * 1024)
+
+struct hb_frame_spool_s
+{
+    char        path[1024];
+    FILE      * file;
+    int         sequence_id;    // job->sequence_id & 0xFFFFFF of the 1st pass
+    int         width;
+    int         height;
+    int         complete;       // the 1st pass spooled all of its frames
+    int64_t     frames;
+    int64_t     bytes;          // size of the spool
+    int64_t     raw_bytes;      // size of the frames spooled
+};
+
+typedef struct
+{
+    hb_buffer_settings_t s;
+    hb_image_format_t    f;
+    int                  size[FRAME_SPOOL_BANDS];   // deflated band sizes
+} frame_spool_header_t;
+
+typedef struct
+{
+    hb_work_private_t * pv;
+    int                 index;
+    z_stream            z;
+    int                 z_init;
+    uint8_t           * data;       // deflated band
+    int                 alloc;
+    int                 size;
+    uint8_t           * row;        // predicted row, 1st pass
+    int                 row_alloc;
+    int                 error;
+} frame_spool_band_t;
+
+struct hb_work_private_s
+{
+    hb_job_t           * job;
+    hb_work_object_t   * encoder;
+    hb_frame_spool_t   * spool;
+    int                  reading;   // 2nd pass
+    taskslices_t         slices;
+    frame_spool_band_t * band[FRAME_SPOOL_BANDS];
+    hb_buffer_t        * frame;     // frame the bands work on
+    hb_buffer_t        * next;      // next spooled frame, 2nd pass
+    int64_t              frames;
+};
+
+static int  frame_spool_encoder_init( hb_work_object_t *, hb_job_t * );
+static int  frame_spool_encoder_work( hb_work_object_t *, hb_buffer_t **,
+                                      hb_buffer_t ** );
+static void frame_spool_encoder_close( hb_work_object_t * );
+
+hb_work_object_t hb_frame_spool_encoder =
+{
+    WORK_FRAME_SPOOL,
+    "Frame spool encoder",
+    frame_spool_encoder_init,
+    frame_spool_encoder_work,
+    frame_spool_encoder_close
+};
+
+/**
+ * Closes a spool and deletes its file.
+ * @param _spool Spool to close, set to NULL.
+ */
+void hb_frame_spool_close( hb_frame_spool_t ** _spool )
+{
+    hb_frame_spool_t * spool = *_spool;
+
+    if( spool == NULL )
+    {
+        return;
+    }
+    if( spool->file != NULL )
+    {
+        fclose( spool->file );
+    }
+    remove( spool->path );
+    free( spool );
+    *_spool = NULL;
+}
+
+static const char * frame_spool_check( hb_job_t * job )
+{
+    if( job->indepth_scan || job->pass_id != HB_PASS_ENCODE_1ST )
+        return "not the first of two passes";
+    if( job->vcodec & HB_VCODEC_QSV_MASK )
+        return "QSV encoder";
+#ifdef USE_QSV
+    if( hb_qsv_decode_is_enabled( job ) )
+        return "QSV decoder";
+#endif
+    if( job->use_opencl )
+        return "OpenCL filters";
+    if( job->list_subtitle_search != NULL &&
+        job->select_subtitle_config.dest == RENDERSUB )
+        return "the 2nd pass may burn in the Foreign Audio Search result";
+    return NULL;
+}
+
+/**
+ * Sets up the frame spool of a pass.  The first pass of a job that asks
+ * for it creates the spool, the second pass takes the spool if the first
+ * pass completed it and drops the burned-in subtitles, they are in the
+ * spooled frames already.  Call after the filters are initialized.
+ * @param job Job of the pass.
+ * @return HB_FRAME_SPOOL_WRITE, HB_FRAME_SPOOL_READ or 0 for no spool.
+ */
+int hb_frame_spool_init( hb_job_t * job )
+{
+    hb_interjob_t    * interjob = hb_job_interjob( job );
+    hb_frame_spool_t * spool;
+    hb_subtitle_t    * subtitle;
+    const char       * reason;
+    int                i;
+
+    if( job->pass_id == HB_PASS_ENCODE_2ND )
+    {
+        spool = interjob->frame_spool;
+        if( spool == NULL )
+        {
+            return 0;
+        }
+        if( !spool->complete ||
+            spool->sequence_id != ( job->sequence_id & 0xFFFFFF ) ||
+            spool->width != job->width || spool->height != job->height )
+        {
+            hb_log( "framespool: spool doesn't match this pass, not using it" );
+            hb_frame_spool_close( &interjob->frame_spool );
+            return 0;
+        }
+        spool->file = hb_fopen( spool->path, "rb" );
+        if( spool->file == NULL )
+        {
+            hb_error( "framespool: can't open %s", spool->path );
+            hb_frame_spool_close( &interjob->frame_spool );
+            return 0;
+        }
+        setvbuf( spool->file, NULL, _IOFBF, FRAME_SPOOL_BUFFER );
+
+        for( i = 0; i < hb_list_count( job->list_subtitle ); )
+        {
+            subtitle = hb_list_item( job->list_subtitle, i );
+            if( subtitle->config.dest == RENDERSUB )
+            {
+                hb_list_rem( job->list_subtitle, subtitle );
+                hb_subtitle_close( &subtitle );
+                continue;
+            }
+            // Output tracks still need to be in sequential order
+            subtitle->out_track = ++i;
+        }
+        hb_log( "framespool: encoding %"PRId64" frames spooled by the first pass",
+                spool->frames );
+        return HB_FRAME_SPOOL_READ;
+    }
+
+    if( !job->frame_spool )
+    {
+        return 0;
+    }
+    if( ( reason = frame_spool_check( job ) ) != NULL )
+    {
+        hb_log( "framespool: disabled, %s", reason );
+        return 0;
+    }
+
+    // A spool left behind by a job that never ran its 2nd pass
+    hb_frame_spool_close( &interjob->frame_spool );
+
+    spool = calloc( 1, sizeof( hb_frame_spool_t ) );
+    spool->sequence_id = job->sequence_id & 0xFFFFFF;
+    spool->width       = job->width;
+    spool->height      = job->height;
+    hb_get_tempory_filename( job->h, spool->path, "frames%d_%d.spool",
+                             hb_get_instance_id(job->h), job->slot );
+    spool->file = hb_fopen( spool->path, "wb" );
+    if( spool->file == NULL )
+    {
+        hb_error( "framespool: can't create %s", spool->path );
+        free( spool );
+        return 0;
+    }
+    setvbuf( spool->file, NULL, _IOFBF, FRAME_SPOOL_BUFFER );
+    interjob->frame_spool = spool;
+    return HB_FRAME_SPOOL_WRITE;
+}
+
+static int band_rows( hb_buffer_t * buf, int band, int plane, int * row )
+{
+    int height = buf->plane[plane].height;
+
+    *row = height * band / FRAME_SPOOL_BANDS;
+    return height * ( band + 1 ) / FRAME_SPOOL_BANDS - *row;
+}
+
+static int band_grow( uint8_t ** data, int * alloc, int size )
+{
+    uint8_t * tmp;
+
+    if( size <= *alloc )
+    {
+        return 0;
+    }
+    tmp = realloc( *data, size );
+    if( tmp == NULL )
+    {
+        return -1;
+    }
+    *data  = tmp;
+    *alloc = size;
+    return 0;
+}
+
+static void band_deflate( frame_spool_band_t * band, int flush )
+{
+    z_stream * z = &band->z;
+    int        ret;
+
+    do
+    {
+        if( z->avail_out == 0 )
+        {
+            // deflateBound() is meant for a single call, don't rely on it
+            int used = band->alloc;
+            if( band_grow( &band->data, &band->alloc, band->alloc * 2 ) )
+            {
+                band->error = 1;
+                return;
+            }
+            z->next_out  = band->data + used;
+            z->avail_out = band->alloc - used;
+        }
+        ret = deflate( z, flush );
+        if( ret == Z_STREAM_ERROR )
+        {
+            band->error = 1;
+            return;
+        }
+    } while( z->avail_out == 0 ||
+             ( flush == Z_FINISH && ret != Z_STREAM_END ) );
+}
+
+static void band_compress( void * _band )
+{
+    frame_spool_band_t * band = _band;
+    hb_buffer_t        * buf  = band->pv->frame;
+    z_stream           * z    = &band->z;
+    uint8_t            * src, prev;
+    int                  pp, yy, xx, row, rows, width, raw = 0;
+
+    band->error = 0;
+    band->size  = 0;
+    for( pp = 0; pp < 4 && buf->plane[pp].data != NULL; pp++ )
+    {
+        raw += band_rows( buf, band->index, pp, &row ) * buf->plane[pp].width;
+    }
+    if( band_grow( &band->data, &band->alloc, deflateBound( z, raw ) ) )
+    {
+        band->error = 1;
+        return;
+    }
+    deflateReset( z );
+    z->next_out  = band->data;
+    z->avail_out = band->alloc;
+
+    for( pp = 0; pp < 4 && buf->plane[pp].data != NULL; pp++ )
+    {
+        width = buf->plane[pp].width;
+        rows  = band_rows( buf, band->index, pp, &row );
+        if( band_grow( &band->row, &band->row_alloc, width ) )
+        {
+            band->error = 1;
+            return;
+        }
+        for( yy = row; yy < row + rows && !band->error; yy++ )
+        {
+            src  = buf->plane[pp].data + yy * buf->plane[pp].stride;
+            prev = 0;
+            for( xx = 0; xx < width; xx++ )
+            {
+                band->row[xx] = src[xx] - prev;
+                prev = src[xx];
+            }
+            z->next_in  = band->row;
+            z->avail_in = width;
+            band_deflate( band, Z_NO_FLUSH );
+        }
+    }
+    if( !band->error )
+    {
+        band_deflate( band, Z_FINISH );
+    }
+    band->size = z->total_out;
+}
+
+static void band_decompress( void * _band )
+{
+    frame_spool_band_t * band = _band;
+    hb_buffer_t        * buf  = band->pv->frame;
+    z_stream           * z    = &band->z;
+    uint8_t            * dst;
+    int                  pp, yy, xx, row, rows, width, ret = Z_OK;
+
+    band->error = 0;
+    inflateReset( z );
+    z->next_in  = band->data;
+    z->avail_in = band->size;
+
+    for( pp = 0; pp < 4 && buf->plane[pp].data != NULL; pp++ )
+    {
+        width = buf->plane[pp].width;
+        rows  = band_rows( buf, band->index, pp, &row );
+        for( yy = row; yy < row + rows; yy++ )
+        {
+            dst = buf->plane[pp].data + yy * buf->plane[pp].stride;
+            z->next_out  = dst;
+            z->avail_out = width;
+            while( z->avail_out > 0 )
+            {
+                ret = inflate( z, Z_NO_FLUSH );
+                if( ret != Z_OK && !( ret == Z_STREAM_END && z->avail_out == 0 ) )
+                {
+                    band->error = 1;
+                    return;
+                }
+            }
+            for( xx = 1; xx < width; xx++ )
+            {
+                dst[xx] += dst[xx - 1];
+            }
+        }
+    }
+    if( ret != Z_STREAM_END )
+    {
+        // Only the end of the stream is left, empty bands have no rows
+        uint8_t end;
+
+        z->next_out  = &end;
+        z->avail_out = 1;
+        if( inflate( z, Z_FINISH ) != Z_STREAM_END || z->avail_out == 0 )
+        {
+            band->error = 1;
+        }
+    }
+}
+
+/**
+ * Wraps the video encoder of a pass that writes or reads the spool.
+ * @param job Job of the pass.
+ * @param encoder Video encoder, set up with its fifos and config.
+ */
+hb_work_object_t * hb_frame_spool_encoder_init( hb_job_t * job,
+                                                hb_work_object_t * encoder )
+{
+    hb_work_object_t  * w = hb_get_work( job->h, WORK_FRAME_SPOOL );
+    hb_work_private_t * pv = calloc( 1, sizeof( hb_work_private_t ) );
+
+    pv->job       = job;
+    pv->encoder   = encoder;
+    pv->spool     = hb_job_interjob( job )->frame_spool;
+    pv->reading   = job->pass_id == HB_PASS_ENCODE_2ND;
+    w->name       = encoder->name;
+    w->private_data = pv;
+    w->fifo_in    = encoder->fifo_in;
+    w->fifo_out   = encoder->fifo_out;
+    w->config     = encoder->config;
+    return w;
+}
+
+static int frame_spool_encoder_init( hb_work_object_t * w, hb_job_t * job )
+{
+    hb_work_private_t * pv = w->private_data;
+    hb_work_object_t  * encoder = pv->encoder;
+    int                 ii, ret;
+
+    encoder->done = w->done;
+    encoder->thread_sleep_interval = w->thread_sleep_interval;
+
+    if( taskslices_init( &pv->slices, hb_get_taskpool( job->h ),
+                         FRAME_SPOOL_BANDS, sizeof( frame_spool_band_t ),
+                         pv->reading ? band_decompress : band_compress ) == 0 )
+    {
+        hb_error( "framespool: taskslices_init failed" );
+        return 1;
+    }
+    for( ii = 0; ii < FRAME_SPOOL_BANDS; ii++ )
+    {
+        frame_spool_band_t * band = taskslices_args( &pv->slices, ii );
+
+        band->pv    = pv;
+        band->index = ii;
+        if( pv->reading )
+            ret = inflateInit( &band->z );
+        else
+            ret = deflateInit( &band->z, Z_BEST_SPEED );
+        if( ret != Z_OK )
+        {
+            hb_error( "framespool: zlib init failed" );
+            return 1;
+        }
+        band->z_init = 1;
+        pv->band[ii] = band;
+    }
+    return encoder->init( encoder, job );
+}
+
+static void frame_spool_encoder_close( hb_work_object_t * w )
+{
+    hb_work_private_t * pv = w->private_data;
+    hb_frame_spool_t  * spool = pv->spool;
+    hb_interjob_t     * interjob = hb_job_interjob( pv->job );
+    int                 ii;
+
+    pv->encoder->close( pv->encoder );
+    free( pv->encoder );
+
+    if( spool != NULL && pv->reading )
+    {
+        hb_log( "framespool: encoded %"PRId64" spooled frames", pv->frames );
+        hb_frame_spool_close( &interjob->frame_spool );
+    }
+    else if( spool != NULL && spool->complete )
+    {
+        hb_log( "framespool: spooled %"PRId64" frames, %.1f MiB (%.1f%% of raw)",
+                spool->frames, spool->bytes / 1048576.,
+                spool->raw_bytes ? 100. * spool->bytes / spool->raw_bytes : 0. );
+        fclose( spool->file );
+        spool->file = NULL;
+    }
+    else if( spool != NULL )
+    {
+        // The 1st pass didn't finish, nothing to reuse
+        hb_frame_spool_close( &interjob->frame_spool );
+    }
+
+    hb_buffer_close( &pv->next );
+    for( ii = 0; ii < FRAME_SPOOL_BANDS; ii++ )
+    {
+        frame_spool_band_t * band = pv->band[ii];
+
+        if( band == NULL )
+            continue;
+        if( band->z_init )
+        {
+            if( pv->reading )
+                inflateEnd( &band->z );
+            else
+                deflateEnd( &band->z );
+        }
+        free( band->data );
+        free( band->row );
+    }
+    taskslices_fini( &pv->slices );
+    free( pv );
+}
+
+static int frame_spool_write( hb_work_private_t * pv, hb_buffer_t * buf )
+{
+    hb_frame_spool_t     * spool = pv->spool;
+    frame_spool_header_t   header;
+    int                    ii, pp;
+
+    pv->frame = buf;
+    taskslices_cycle( &pv->slices );
+    pv->frame = NULL;
+
+    memset( &header, 0, sizeof( header ) );
+    header.s = buf->s;
+    header.f = buf->f;
+    for( ii = 0; ii < FRAME_SPOOL_BANDS; ii++ )
+    {
+        if( pv->band[ii]->error )
+        {
+            return -1;
+        }
+        header.size[ii] = pv->band[ii]->size;
+    }
+    if( fwrite( &header, sizeof( header ), 1, spool->file ) != 1 )
+    {
+        return -1;
+    }
+    spool->bytes += sizeof( header );
+    for( ii = 0; ii < FRAME_SPOOL_BANDS; ii++ )
+    {
+        if( fwrite( pv->band[ii]->data, 1, header.size[ii],
+                    spool->file ) != header.size[ii] )
+        {
+            return -1;
+        }
+        spool->bytes += header.size[ii];
+    }
+    for( pp = 0; pp < 4 && buf->plane[pp].data != NULL; pp++ )
+    {
+        spool->raw_bytes += buf->plane[pp].width * buf->plane[pp].height;
+    }
+    spool->frames++;
+    return 0;
+}
+
+// Returns the next spooled frame, NULL at the end of the spool or on
+// errors (*error set).
+static hb_buffer_t * frame_spool_read( hb_work_private_t * pv, int * error )
+{
+    hb_frame_spool_t     * spool = pv->spool;
+    frame_spool_header_t   header;
+    hb_buffer_t          * buf;
+    int                    ii;
+
+    *error = 0;
+    if( fread( &header, sizeof( header ), 1, spool->file ) != 1 )
+    {
+        *error = !feof( spool->file );
+        return NULL;
+    }
+    for( ii = 0; ii < FRAME_SPOOL_BANDS; ii++ )
+    {
+        frame_spool_band_t * band = pv->band[ii];
+
+        if( header.size[ii] < 0 ||
+            band_grow( &band->data, &band->alloc, header.size[ii] ) ||
+            fread( band->data, 1, header.size[ii],
+                   spool->file ) != header.size[ii] )
+        {
+            *error = 1;
+            return NULL;
+        }
+        band->size = header.size[ii];
+    }
+
+    buf = hb_frame_buffer_init( header.f.fmt, header.f.width,
+                                header.f.height );
+    if( buf == NULL )
+    {
+        *error = 1;
+        return NULL;
+    }
+    buf->f = header.f;
+    buf->s = header.s;
+
+    pv->frame = buf;
+    taskslices_cycle( &pv->slices );
+    pv->frame = NULL;
+    for( ii = 0; ii < FRAME_SPOOL_BANDS; ii++ )
+    {
+        if( pv->band[ii]->error )
+        {
+            hb_buffer_close( &buf );
+            *error = 1;
+            return NULL;
+        }
+    }
+    return buf;
+}
+
+// Encodes buf and appends what the encoder returns to *tail
+static int frame_spool_encode( hb_work_private_t * pv, hb_buffer_t * buf,
+                               hb_buffer_t *** tail )
+{
+    hb_buffer_t * out = NULL;
+    int           status;
+
+    status = pv->encoder->work( pv->encoder, &buf, &out );
+    hb_buffer_close( &buf );
+    **tail = out;
+    while( **tail != NULL )
+    {
+        *tail = &(**tail)->next;
+    }
+    return status;
+}
+
+static int frame_spool_encoder_work( hb_work_object_t * w,
+                                     hb_buffer_t ** buf_in,
+                                     hb_buffer_t ** buf_out )
+{
+    hb_work_private_t * pv = w->private_data;
+    hb_job_t          * job = pv->job;
+    hb_interjob_t     * interjob = hb_job_interjob( job );
+    hb_buffer_t       * in = *buf_in, * out = NULL, ** tail = &out;
+    int                 status = HB_WORK_OK, error = 0;
+
+    if( pv->spool == NULL )
+    {
+        return pv->encoder->work( pv->encoder, buf_in, buf_out );
+    }
+
+    if( !pv->reading )
+    {
+        if( in->size <= 0 )
+        {
+            pv->spool->complete = 1;
+            if( fflush( pv->spool->file ) != 0 )
+            {
+                error = 1;
+            }
+        }
+        else
+        {
+            error = frame_spool_write( pv, in );
+        }
+        if( error )
+        {
+            hb_error( "framespool: failed to write %s, the second pass "
+                      "will filter its frames again", pv->spool->path );
+            hb_frame_spool_close( &interjob->frame_spool );
+            pv->spool = NULL;
+        }
+        return pv->encoder->work( pv->encoder, buf_in, buf_out );
+    }
+
+    // 2nd pass, the frames from sync only pace the spooled ones.  They
+    // have not been through the filters, so the spool may be a bit ahead
+    // or behind, the encoder gets the rest of the spool at the end.
+    while( !*job->die )
+    {
+        if( pv->next == NULL )
+        {
+            pv->next = frame_spool_read( pv, &error );
+            if( pv->next == NULL )
+            {
+                break;
+            }
+        }
+        if( in->size > 0 && pv->next->s.start > in->s.start )
+        {
+            break;
+        }
+        status = frame_spool_encode( pv, pv->next, &tail );
+        pv->next = NULL;
+        pv->frames++;
+    }
+    if( error )
+    {
+        hb_error( "framespool: failed to read %s", pv->spool->path );
+        *job->done_error = HB_ERROR_UNKNOWN;
+        *job->die = 1;
+    }
+    // The spooled frames carry their own chapter marks, don't let
+    // work_loop copy the ones of the frame from sync
+    *buf_in = NULL;
+    if( in->size <= 0 )
+    {
+        status = frame_spool_encode( pv, in, &tail );
+    }
+    else
+    {
+        hb_buffer_close( &in );
+    }
+    *buf_out = out;
+    return status;
+}
@@ -10,6 +10,9 @@
 #include "hb.h"
 #include "opencl.h"
 #include "hbffmpeg.h"
+#include "taskset.h"
+#include "nal_units.h"
+#include "combdetect.h"
 #include <stdio.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -25,6 +28,8 @@
 #endif
 #endif
 
+typedef struct hb_scan_cache_s hb_scan_cache_t;
+
 struct hb_handle_s
 {
     int            id;
@@ -47,7 +52,6 @@ struct hb_handle_s
     /* The thread which processes the jobs. Others threads are launched
        from this one (see work.c) */
     hb_list_t    * jobs;
-    hb_job_t     * current_job;
     volatile int   work_die;
     hb_error_code  work_error;
     hb_thread_t  * work_thread;
@@ -55,6 +59,12 @@ struct hb_handle_s
     hb_lock_t    * state_lock;
     hb_state_t     state;
 
+    /* Jobs encoded concurrently, one per job slot.  The state of the
+       job in the first occupied slot is also reported in state. */
+    int            job_slots;
+    hb_job_t     * current_job[HB_MAX_JOB_SLOTS];
+    hb_state_t     job_state[HB_MAX_JOB_SLOTS];
+
     int            paused;
     hb_lock_t    * pause_lock;
     /* For MacGui active queue
@@ -64,7 +74,8 @@ struct hb_handle_s
     
     /* Stash of persistent data between jobs, for stuff
        like correcting frame count and framerate estimates
-       on multi-pass encodes where frames get dropped.     */
+       on multi-pass encodes where frames get dropped.
+       One per job slot. */
     hb_interjob_t * interjob;
 
     // power management opaque pointer
@@ -74,8 +85,66 @@ struct hb_handle_s
     // libav hardware decode contest is used.  So set hardware
     // decoding as a global property on the hb instance.
     hb_hwd_t       hwd;
+
+    // Worker threads shared by the filters of all jobs on this instance
+    hb_taskpool_t * taskpool;
+
+    // Pipeline statistics of the current (or last) job
+    hb_profile_t  * profile;
+
+    // Scan previews kept in memory, least recently used first.
+    // Previews that don't fit in preview_size_max spill to disk.
+    hb_lock_t     * preview_lock;
+    hb_list_t     * preview_list;
+    int64_t         preview_size;
+    int64_t         preview_size_max;
+
+    // Threads used by scan, see hb_set_scan_threads()
+    int             scan_threads;
+
+    // Titles of recent JSON job scans, see hb_scan_cache_get()
+    hb_scan_cache_t * scan_cache;
+};
+
+// Scans kept by the scan cache
+#define HB_SCAN_CACHE_MAX 8
+
+typedef struct
+{
+    char        path[1024];
+    int         title_index;
+    int         hwd;            // scanned with hardware decoding
+    int64_t     size;
+    int64_t     mtime;
+    uint64_t    used;           // scan_cache clock of the last use
+    hb_list_t * list_title;     // copies of the titles found
+    int         feature;
+} hb_scan_cache_entry_t;
+
+// Shared by an instance and the private scan instances of its jobs
+struct hb_scan_cache_s
+{
+    hb_lock_t * lock;
+    int         ref;
+    uint64_t    clock;
+    hb_list_t * entries;
 };
 
+typedef struct
+{
+    int       title;
+    int       preview;
+    int       width;
+    int       height;
+    int       size;
+    uint8_t * data;     // Packed YUV 4:2:0 planes
+} hb_preview_t;
+
+/* Default limit of the in memory preview store, about 80 1080p previews */
+#define HB_PREVIEW_STORE_DEFAULT (256 * 1024 * 1024)
+
+#define HB_MAX_SCAN_THREADS 64
+
 hb_work_object_t * hb_objects = NULL;
 int hb_instance_counter = 0;
 
@@ -94,7 +163,19 @@ hb_hwd_t * hb_hwd_get_context( hb_handle_t *h )
     return &h->hwd;
 }
 
+hb_taskpool_t * hb_get_taskpool( hb_handle_t *h )
+{
+    return h->taskpool;
+}
+
+hb_profile_t * hb_get_profile( hb_handle_t *h )
+{
+    return h->profile;
+}
+
 static void thread_func( void * );
+static hb_scan_cache_t * scan_cache_init( void );
+static void scan_cache_release( hb_scan_cache_t ** );
 
 static int ff_lockmgr_cb(void **mutex, enum AVLockOp op)
 {
@@ -164,6 +245,20 @@ int hb_avcodec_open(AVCodecContext *avctx, AVCodec *codec,
     return ret;
 }
 
+/*
+ * Thread count for the libav video codecs of a job, to be passed to
+ * hb_avcodec_open().  Jobs sharing the CPUs with other jobs get the
+ * automatic thread count for their share of the CPUs.
+ */
+int hb_avcodec_job_threads(hb_job_t *job)
+{
+    if (job == NULL || job->cpu_budget <= 0)
+    {
+        return HB_FFMPEG_THREADS_AUTO;
+    }
+    return job->cpu_budget / 2 + 1;
+}
+
 int hb_avcodec_close(AVCodecContext *avctx)
 {
     int ret;
@@ -435,7 +530,18 @@ hb_handle_t * hb_init( int verbose, int update_check )
 
     h->pause_lock = hb_lock_init();
 
-    h->interjob = calloc( sizeof( hb_interjob_t ), 1 );
+
+    h->taskpool = taskpool_init( hb_get_cpu_count() );
+    h->profile = hb_profile_init();
+
+    h->preview_lock = hb_lock_init();
+    h->preview_list = hb_list_init();
+    h->preview_size_max = HB_PREVIEW_STORE_DEFAULT;
+    h->scan_threads = 1;
+
+    h->job_slots = 1;
+    h->interjob  = calloc( sizeof( hb_interjob_t ), HB_MAX_JOB_SLOTS );
+    h->scan_cache = scan_cache_init();
 
     /* Start library thread */
     hb_log( "hb_init: starting libhb thread" );
@@ -500,13 +606,24 @@ hb_handle_t * hb_init_dl( int verbose, int update_check )
 
     h->title_set.list_title = hb_list_init();
     h->jobs       = hb_list_init();
-    h->current_job = NULL;
 
     h->state_lock  = hb_lock_init();
     h->state.state = HB_STATE_IDLE;
 
     h->pause_lock = hb_lock_init();
 
+    h->taskpool = taskpool_init( hb_get_cpu_count() );
+    h->profile = hb_profile_init();
+
+    h->preview_lock = hb_lock_init();
+    h->preview_list = hb_list_init();
+    h->preview_size_max = HB_PREVIEW_STORE_DEFAULT;
+    h->scan_threads = 1;
+
+    h->job_slots = 1;
+    h->interjob  = calloc( sizeof( hb_interjob_t ), HB_MAX_JOB_SLOTS );
+    h->scan_cache = scan_cache_init();
+
     /* Start library thread */
     hb_log( "hb_init: starting libhb thread" );
     h->die         = 0;
@@ -558,10 +675,22 @@ void hb_remove_previews( hb_handle_t * h )
     char            filename[1024];
     char            dirname[1024];
     hb_title_t    * title;
+    hb_preview_t  * preview;
     int             i, count, len;
     DIR           * dir;
     struct dirent * entry;
 
+    hb_lock( h->preview_lock );
+    while( ( preview = hb_list_item( h->preview_list, 0 ) ) )
+    {
+        hb_list_rem( h->preview_list, preview );
+        free( preview->data );
+        free( preview );
+    }
+    h->preview_size = 0;
+    hb_unlock( h->preview_lock );
+
+    /* Previews that were spilled to disk */
     memset( dirname, 0, 1024 );
     hb_get_temporary_directory( dirname );
     dir = opendir( dirname );
@@ -589,6 +718,25 @@ void hb_remove_previews( hb_handle_t * h )
     closedir( dir );
 }
 
+/**
+ * Sets the number of threads used by scan.
+ * @param h Handle to hb_handle_t
+ * @param threads Number of threads, 1 to scan serially, 0 for one per CPU.
+ */
+void hb_set_scan_threads( hb_handle_t * h, int threads )
+{
+    if( threads <= 0 )
+    {
+        threads = hb_get_cpu_count();
+    }
+    h->scan_threads = MIN( threads, HB_MAX_SCAN_THREADS );
+}
+
+int hb_get_scan_threads( hb_handle_t * h )
+{
+    return h->scan_threads;
+}
+
 /**
  * Initializes a scan of the by calling hb_scan_init
  * @param h Handle to hb_handle_t
@@ -634,6 +782,17 @@ void hb_scan( hb_handle_t * h, const char * path, int title_index,
     h->scan_thread = hb_scan_init( h, &h->scan_die, path, title_index, 
                                    &h->title_set, preview_count, 
                                    store_previews, min_duration );
+
+    // A scan handle has no libhb thread to notice the end of the scan
+    if( hb_is_scan_handle( h ) )
+    {
+        hb_thread_close( &h->scan_thread );
+        hb_log( "libhb: scan thread found %d valid title(s)",
+                hb_list_count( h->title_set.list_title ) );
+        hb_lock( h->state_lock );
+        h->state.state = HB_STATE_SCANDONE;
+        hb_unlock( h->state_lock );
+    }
 }
 
 /**
@@ -651,13 +810,300 @@ hb_title_set_t * hb_get_title_set( hb_handle_t * h )
     return &h->title_set;
 }
 
-int hb_save_preview( hb_handle_t * h, int title, int preview, hb_buffer_t *buf )
+static hb_scan_cache_t * scan_cache_init( void )
+{
+    hb_scan_cache_t * cache = calloc( 1, sizeof( hb_scan_cache_t ) );
+
+    cache->lock    = hb_lock_init();
+    cache->ref     = 1;
+    cache->entries = hb_list_init();
+    return cache;
+}
+
+static void scan_cache_entry_close( hb_scan_cache_entry_t ** _entry )
+{
+    hb_scan_cache_entry_t * entry = *_entry;
+    hb_title_t            * title;
+
+    while( ( title = hb_list_item( entry->list_title, 0 ) ) )
+    {
+        hb_list_rem( entry->list_title, title );
+        hb_title_close( &title );
+    }
+    hb_list_close( &entry->list_title );
+    free( entry );
+    *_entry = NULL;
+}
+
+static void scan_cache_release( hb_scan_cache_t ** _cache )
+{
+    hb_scan_cache_t       * cache = *_cache;
+    hb_scan_cache_entry_t * entry;
+    int                     ref;
+
+    if( cache == NULL )
+    {
+        return;
+    }
+    *_cache = NULL;
+
+    hb_lock( cache->lock );
+    ref = --cache->ref;
+    hb_unlock( cache->lock );
+    if( ref > 0 )
+    {
+        return;
+    }
+
+    while( ( entry = hb_list_item( cache->entries, 0 ) ) )
+    {
+        hb_list_rem( cache->entries, entry );
+        scan_cache_entry_close( &entry );
+    }
+    hb_list_close( &cache->entries );
+    hb_lock_close( &cache->lock );
+    free( cache );
+}
+
+// Returns the cached scan of path with the same size, mtime and scan
+// settings, NULL if there is none.  Call with the cache locked.
+static hb_scan_cache_entry_t * scan_cache_find( hb_handle_t * h,
+                                                const char * path,
+                                                int title_index,
+                                                hb_stat_t * st )
+{
+    hb_scan_cache_entry_t * entry;
+    int                     i;
+
+    for( i = 0; ( entry = hb_list_item( h->scan_cache->entries, i ) ); i++ )
+    {
+        if( entry->title_index == title_index &&
+            entry->hwd == hb_hwd_enabled( h ) &&
+            entry->size == (int64_t)st->st_size &&
+            entry->mtime == (int64_t)st->st_mtime &&
+            !strcmp( entry->path, path ) )
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Creates a handle that only scans, for the JSON jobs of concurrent job
+ * slots.  A scan replaces the titles of its handle while the other
+ * running jobs still use the titles of the main one.  The handle has no
+ * libhb thread, task pool or job state, shares the scan cache of
+ * 'from' and scans synchronously, see hb_scan().
+ * @param from Handle of the running jobs.
+ * @return Handle to close with hb_scan_handle_close().
+ */
+hb_handle_t * hb_scan_handle_init( hb_handle_t * from )
+{
+    hb_handle_t * h = calloc( sizeof( hb_handle_t ), 1 );
+
+    h->id    = from->id;
+    h->pid   = getpid();
+    h->build = -1;
+
+    h->title_set.list_title = hb_list_init();
+
+    h->state_lock  = hb_lock_init();
+    h->state.state = HB_STATE_IDLE;
+    h->pause_lock  = hb_lock_init();
+
+    h->preview_lock     = hb_lock_init();
+    h->preview_list     = hb_list_init();
+    h->preview_size_max = from->preview_size_max;
+    h->scan_threads     = from->scan_threads;
+    h->job_slots        = 1;
+
+    hb_lock( from->scan_cache->lock );
+    from->scan_cache->ref++;
+    hb_unlock( from->scan_cache->lock );
+    h->scan_cache = from->scan_cache;
+
+    return h;
+}
+
+/**
+ * Closes a handle of hb_scan_handle_init() and the titles it scanned.
+ * @param _h Pointer to handle to hb_handle_t.
+ */
+void hb_scan_handle_close( hb_handle_t ** _h )
+{
+    hb_handle_t * h = *_h;
+    hb_title_t  * title;
+
+    if( h == NULL )
+    {
+        return;
+    }
+
+    hb_remove_previews( h );
+    while( ( title = hb_list_item( h->title_set.list_title, 0 ) ) )
+    {
+        hb_list_rem( h->title_set.list_title, title );
+        hb_title_close( &title );
+    }
+    hb_list_close( &h->title_set.list_title );
+
+    hb_lock_close( &h->state_lock );
+    hb_lock_close( &h->pause_lock );
+    hb_list_close( &h->preview_list );
+    hb_lock_close( &h->preview_lock );
+    scan_cache_release( &h->scan_cache );
+
+    free( h );
+    *_h = NULL;
+}
+
+int hb_is_scan_handle( hb_handle_t * h )
+{
+    return h->main_thread == NULL;
+}
+
+/**
+ * Replaces the titles of h with copies of the cached scan of path, like
+ * hb_scan( h, path, title_index, ... ) would.  The cached scan is used
+ * while the source keeps the size and modification time it had when it
+ * was scanned.
+ * @param h Handle to hb_handle_t.
+ * @param path Source to scan.
+ * @param title_index Title of the source, 0 for all.
+ * @return 1 if the titles came from the cache, 0 if the source has to be
+ *         scanned.
+ */
+int hb_scan_cache_get( hb_handle_t * h, const char * path, int title_index )
+{
+    hb_scan_cache_t       * cache = h->scan_cache;
+    hb_scan_cache_entry_t * entry;
+    hb_title_t            * title;
+    hb_stat_t               st;
+    int                     i;
+
+    if( hb_stat( path, &st ) != 0 )
+    {
+        return 0;
+    }
+
+    hb_lock( cache->lock );
+    entry = scan_cache_find( h, path, title_index, &st );
+    if( entry == NULL )
+    {
+        hb_unlock( cache->lock );
+        return 0;
+    }
+    entry->used = ++cache->clock;
+
+    hb_remove_previews( h );
+    while( ( title = hb_list_item( h->title_set.list_title, 0 ) ) )
+    {
+        hb_list_rem( h->title_set.list_title, title );
+        hb_title_close( &title );
+    }
+    for( i = 0; ( title = hb_list_item( entry->list_title, i ) ); i++ )
+    {
+        hb_list_add( h->title_set.list_title, hb_title_copy( title ) );
+    }
+    h->title_set.feature = entry->feature;
+    hb_unlock( cache->lock );
+
+    hb_log( "hb_scan: path=%s, title_index=%d, using the titles of an "
+            "earlier scan", path, title_index );
+    return 1;
+}
+
+/**
+ * Keeps copies of the titles h just scanned from path for
+ * hb_scan_cache_get().  Incomplete scans are not kept.
+ * @param h Handle to hb_handle_t.
+ * @param path Source scanned.
+ * @param title_index Title of the source scanned, 0 for all.
+ */
+void hb_scan_cache_put( hb_handle_t * h, const char * path, int title_index )
+{
+    hb_scan_cache_t       * cache = h->scan_cache;
+    hb_scan_cache_entry_t * entry, * oldest;
+    hb_title_t            * title;
+    hb_stat_t               st;
+    int                     i;
+
+    if( h->scan_die || hb_list_count( h->title_set.list_title ) == 0 ||
+        strlen( path ) >= sizeof( entry->path ) ||
+        hb_stat( path, &st ) != 0 )
+    {
+        return;
+    }
+    for( i = 0; ( title = hb_list_item( h->title_set.list_title, i ) ); i++ )
+    {
+        if( !( title->flags & HBTF_SCAN_COMPLETE ) )
+        {
+            return;
+        }
+    }
+
+    entry = calloc( 1, sizeof( hb_scan_cache_entry_t ) );
+    strcpy( entry->path, path );
+    entry->title_index = title_index;
+    entry->hwd         = hb_hwd_enabled( h );
+    entry->size        = st.st_size;
+    entry->mtime       = st.st_mtime;
+    entry->feature     = h->title_set.feature;
+    entry->list_title  = hb_list_init();
+    for( i = 0; ( title = hb_list_item( h->title_set.list_title, i ) ); i++ )
+    {
+        hb_list_add( entry->list_title, hb_title_copy( title ) );
+    }
+
+    hb_lock( cache->lock );
+    // Replace an older scan of the source, drop the least recently used
+    // scan when the cache is full
+    oldest = scan_cache_find( h, path, title_index, &st );
+    if( oldest == NULL && hb_list_count( cache->entries ) >= HB_SCAN_CACHE_MAX )
+    {
+        hb_scan_cache_entry_t * e;
+
+        oldest = hb_list_item( cache->entries, 0 );
+        for( i = 1; ( e = hb_list_item( cache->entries, i ) ); i++ )
+        {
+            if( e->used < oldest->used )
+            {
+                oldest = e;
+            }
+        }
+    }
+    if( oldest != NULL )
+    {
+        hb_list_rem( cache->entries, oldest );
+        scan_cache_entry_close( &oldest );
+    }
+    entry->used = ++cache->clock;
+    hb_list_add( cache->entries, entry );
+    hb_unlock( cache->lock );
+}
+
+/**
+ * Sets the amount of memory the previews generated by scan may use.
+ * Previews beyond the limit are stored in temporary files.
+ * @param h Handle to hb_handle_t
+ * @param size Limit in bytes, 0 to always use temporary files.
+ */
+void hb_set_preview_store_size( hb_handle_t * h, int64_t size )
+{
+    hb_lock( h->preview_lock );
+    h->preview_size_max = size;
+    hb_unlock( h->preview_lock );
+}
+
+static int preview_write_file( hb_handle_t * h, hb_preview_t * preview )
 {
     FILE * file;
     char   filename[1024];
 
     hb_get_tempory_filename( h, filename, "%d_%d_%d",
-                             hb_get_instance_id(h), title, preview );
+                             hb_get_instance_id(h), preview->title,
+                             preview->preview );
 
     file = hb_fopen(filename, "wb");
     if( !file )
@@ -665,8 +1111,52 @@ int hb_save_preview( hb_handle_t * h, int title, int preview, hb_buffer_t *buf )
         hb_error( "hb_save_preview: fopen failed (%s)", filename );
         return -1;
     }
+    fwrite( preview->data, preview->size, 1, file );
+    fclose( file );
+    return 0;
+}
+
+static hb_preview_t * preview_find( hb_handle_t * h, int title, int preview )
+{
+    hb_preview_t * p;
+    int ii;
+
+    for( ii = 0; ii < hb_list_count( h->preview_list ); ii++ )
+    {
+        p = hb_list_item( h->preview_list, ii );
+        if( p->title == title && p->preview == preview )
+        {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+int hb_save_preview( hb_handle_t * h, int title, int preview, hb_buffer_t *buf )
+{
+    hb_preview_t * p, * old;
+    uint8_t      * dst;
+    int            pp, hh, size = 0;
 
-    int pp, hh;
+    for( pp = 0; pp < 3; pp++ )
+    {
+        size += buf->plane[pp].width * buf->plane[pp].height;
+    }
+
+    p = calloc( 1, sizeof( hb_preview_t ) );
+    if( p == NULL || ( p->data = malloc( size ) ) == NULL )
+    {
+        hb_error( "hb_save_preview: out of memory" );
+        free( p );
+        return -1;
+    }
+    p->title   = title;
+    p->preview = preview;
+    p->width   = buf->f.width;
+    p->height  = buf->f.height;
+    p->size    = size;
+
+    dst = p->data;
     for( pp = 0; pp < 3; pp++ )
     {
         uint8_t *data = buf->plane[pp].data;
@@ -676,18 +1166,76 @@ int hb_save_preview( hb_handle_t * h, int title, int preview, hb_buffer_t *buf )
 
         for( hh = 0; hh < h; hh++ )
         {
-            fwrite( data, w, 1, file );
+            memcpy( dst, data, w );
+            dst += w;
             data += stride;
         }
     }
-    fclose( file );
+
+    hb_lock( h->preview_lock );
+    if( ( old = preview_find( h, title, preview ) ) != NULL )
+    {
+        hb_list_rem( h->preview_list, old );
+        h->preview_size -= old->size;
+        free( old->data );
+        free( old );
+    }
+    hb_list_add( h->preview_list, p );
+    h->preview_size += p->size;
+
+    // Spill the least recently used previews to disk
+    while( h->preview_size > h->preview_size_max &&
+           ( old = hb_list_item( h->preview_list, 0 ) ) != NULL )
+    {
+        hb_list_rem( h->preview_list, old );
+        h->preview_size -= old->size;
+        preview_write_file( h, old );
+        free( old->data );
+        free( old );
+    }
+    hb_unlock( h->preview_lock );
+
     return 0;
 }
 
 hb_buffer_t * hb_read_preview(hb_handle_t * h, hb_title_t *title, int preview)
 {
-    FILE * file;
-    char   filename[1024];
+    FILE         * file;
+    char           filename[1024];
+    hb_preview_t * p;
+    hb_buffer_t  * buf;
+    int            pp, hh;
+
+    hb_lock(h->preview_lock);
+    p = preview_find(h, title->index, preview);
+    if (p != NULL)
+    {
+        uint8_t *src = p->data;
+
+        buf = hb_frame_buffer_init(AV_PIX_FMT_YUV420P, p->width, p->height);
+        for (pp = 0; pp < 3; pp++)
+        {
+            uint8_t *data = buf->plane[pp].data;
+            int stride = buf->plane[pp].stride;
+            int w = buf->plane[pp].width;
+            int h = buf->plane[pp].height;
+
+            for (hh = 0; hh < h; hh++)
+            {
+                memcpy(data, src, w);
+                src += w;
+                data += stride;
+            }
+        }
+
+        // Most recently used previews go last
+        hb_list_rem(h->preview_list, p);
+        hb_list_add(h->preview_list, p);
+        hb_unlock(h->preview_lock);
+
+        return buf;
+    }
+    hb_unlock(h->preview_lock);
 
     hb_get_tempory_filename(h, filename, "%d_%d_%d",
                             hb_get_instance_id(h), title->index, preview);
@@ -699,11 +1247,9 @@ hb_buffer_t * hb_read_preview(hb_handle_t * h, hb_title_t *title, int preview)
         return NULL;
     }
 
-    hb_buffer_t * buf;
     buf = hb_frame_buffer_init(AV_PIX_FMT_YUV420P,
                                title->geometry.width, title->geometry.height);
 
-    int pp, hh;
     for (pp = 0; pp < 3; pp++)
     {
         uint8_t *data = buf->plane[pp].data;
@@ -827,9 +1373,8 @@ fail:
  */
 int hb_detect_comb( hb_buffer_t * buf, int color_equal, int color_diff, int threshold, int prog_equal, int prog_diff, int prog_threshold )
 {
-    int j, k, n, off, cc_1, cc_2, cc[3];
+    int k, n, cc_1, cc_2, cc[3];
 	// int flag[3] ; // debugging flag
-    uint16_t s1, s2, s3, s4;
     cc_1 = 0; cc_2 = 0;
 
     if ( buf->s.flags & 16 )
@@ -848,33 +1393,13 @@ int hb_detect_comb( hb_buffer_t * buf, int color_equal, int color_diff, int thre
         int stride = buf->plane[k].stride;
         int height = buf->plane[k].height;
 
-        for( j = 0; j < width; ++j )
+        /* Look at groups of 4 sequential horizontal lines, moving
+           down 2 lines at a time. */
+        for( n = 0; n < ( height - 4 ); n = n + 2 )
         {
-            off = 0;
-
-            for( n = 0; n < ( height - 4 ); n = n + 2 )
-            {
-                /* Look at groups of 4 sequential horizontal lines */
-                s1 = ( ( data )[ off + j              ] & 0xff );
-                s2 = ( ( data )[ off + j +     stride ] & 0xff );
-                s3 = ( ( data )[ off + j + 2 * stride ] & 0xff );
-                s4 = ( ( data )[ off + j + 3 * stride ] & 0xff );
-
-                /* Note if the 1st and 2nd lines are more different in
-                   color than the 1st and 3rd lines are similar in color.*/
-                if ( ( abs( s1 - s3 ) < color_equal ) &&
-                     ( abs( s1 - s2 ) > color_diff ) )
-                        ++cc_1;
-
-                /* Note if the 2nd and 3rd lines are more different in
-                   color than the 2nd and 4th lines are similar in color.*/
-                if ( ( abs( s2 - s4 ) < color_equal ) &&
-                     ( abs( s2 - s3 ) > color_diff) )
-                        ++cc_2;
-
-                /* Now move down 2 horizontal lines before starting over.*/
-                off += 2 * stride;
-            }
+            hb_comb_functions.count_combed_row( data + n * stride, stride,
+                                                width, color_equal, color_diff,
+                                                &cc_1, &cc_2 );
         }
 
         // compare results
@@ -1263,9 +1788,72 @@ hb_job_t * hb_job( hb_handle_t * h, int i )
     return hb_list_item( h->jobs, i );
 }
 
+/**
+ * Returns the running job, the one in the first occupied job slot if
+ * several jobs are running.
+ * @param h Handle to hb_handle_t.
+ */
 hb_job_t * hb_current_job( hb_handle_t * h )
 {
-    return( h->current_job );
+    int ii;
+
+    for( ii = 0; ii < HB_MAX_JOB_SLOTS; ii++ )
+    {
+        if( h->current_job[ii] != NULL )
+        {
+            return h->current_job[ii];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Sets the number of jobs encoded concurrently.  Each running job gets
+ * an equal share of the CPUs for its decoder and encoder threads.
+ * Takes effect at the next hb_start().
+ * @param h Handle to hb_handle_t.
+ * @param slots Number of concurrent jobs, 1 (the default) to encode one
+ *              job at a time.
+ */
+void hb_set_job_slots( hb_handle_t * h, int slots )
+{
+    h->job_slots = MAX( MIN( slots, HB_MAX_JOB_SLOTS ), 1 );
+}
+
+int hb_get_job_slots( hb_handle_t * h )
+{
+    return h->job_slots;
+}
+
+void hb_set_current_job( hb_handle_t * h, int slot, hb_job_t * job )
+{
+    hb_lock( h->state_lock );
+    h->current_job[slot] = job;
+    h->job_state[slot].state = HB_STATE_IDLE;
+    hb_unlock( h->state_lock );
+}
+
+/**
+ * Copies the states of the running jobs to states, which must have
+ * room for HB_MAX_JOB_SLOTS states.  Returns the number of jobs.
+ * @param h Handle to hb_handle_t.
+ * @param states Array receiving the job states.
+ */
+int hb_get_job_states( hb_handle_t * h, hb_state_t * states )
+{
+    int ii, count = 0;
+
+    hb_lock( h->state_lock );
+    for( ii = 0; ii < HB_MAX_JOB_SLOTS; ii++ )
+    {
+        if( h->current_job[ii] != NULL )
+        {
+            states[count++] = h->job_state[ii];
+        }
+    }
+    hb_unlock( h->state_lock );
+
+    return count;
 }
 
 /**
@@ -1295,6 +1883,7 @@ static void hb_add_internal( hb_handle_t * h, hb_job_t * job, hb_list_t *list_pa
 
     if( job->indepth_scan )
     {
+        hb_list_t * list_search;
 
         /* Find the first audio language that is being encoded, then add all the
          * matching subtitles for that language. */
@@ -1311,7 +1900,7 @@ static void hb_add_internal( hb_handle_t * h, hb_job_t * job, hb_list_t *list_pa
          * If doing a subtitle scan then add all the matching subtitles for this
          * language.
          */
-        job_copy->list_subtitle = hb_list_init();
+        list_search = hb_list_init();
     
         for( i = 0; i < hb_list_count( job->title->list_subtitle ); i++ )
         {
@@ -1324,10 +1913,22 @@ static void hb_add_internal( hb_handle_t * h, hb_job_t * job, hb_list_t *list_pa
                  *
                  * We will update the subtitle list on the next pass later, after
                  * the subtitle scan pass has completed. */
-                hb_list_add( job_copy->list_subtitle,
-                             hb_subtitle_copy( subtitle ) );
+                hb_list_add( list_search, hb_subtitle_copy( subtitle ) );
             }
         }
+
+        if( job->pass_id == HB_PASS_SUBTITLE )
+        {
+            job_copy->list_subtitle = list_search;
+        }
+        else
+        {
+            /* The search is folded into this encode pass, which also
+             * encodes the subtitles of the input job. */
+            job_copy->list_subtitle = hb_subtitle_list_copy( job->list_subtitle );
+            job_copy->list_subtitle_search = list_search;
+            job_copy->indepth_scan = 0;
+        }
     }
     else
     {
@@ -1380,6 +1981,9 @@ hb_job_t* hb_job_copy(hb_job_t * job)
     memcpy( job_copy, job, sizeof( hb_job_t ) );
 
     job_copy->list_subtitle = hb_subtitle_list_copy( job->list_subtitle );
+    if (job->list_subtitle_search != NULL)
+        job_copy->list_subtitle_search =
+            hb_subtitle_list_copy( job->list_subtitle_search );
     job_copy->list_chapter = hb_chapter_list_copy( job->list_chapter );
     job_copy->list_audio = hb_audio_list_copy( job->list_audio );
     job_copy->list_attachment = hb_attachment_list_copy( job->list_attachment );
@@ -1416,7 +2020,7 @@ void hb_job_setup_passes(hb_handle_t * h, hb_job_t * job, hb_list_t * list_pass)
     {
         job->twopass = 0;
     }
-    if (job->indepth_scan)
+    if (job->indepth_scan && !job->twopass)
     {
         hb_deep_log(2, "Adding subtitle scan pass");
         job->pass_id = HB_PASS_SUBTITLE;
@@ -1426,8 +2030,15 @@ void hb_job_setup_passes(hb_handle_t * h, hb_job_t * job, hb_list_t * list_pass)
     if (job->twopass)
     {
         hb_deep_log(2, "Adding two-pass encode");
+        if (job->indepth_scan)
+        {
+            // The first pass reads the whole title anyway, it does the
+            // subtitle scan too and the second pass uses the result
+            hb_deep_log(2, "Adding subtitle scan to the first pass");
+        }
         job->pass_id = HB_PASS_ENCODE_1ST;
         hb_add_internal(h, job, list_pass);
+        job->indepth_scan = 0;
         job->pass_id = HB_PASS_ENCODE_2ND;
         hb_add_internal(h, job, list_pass);
     }
@@ -1473,7 +2084,7 @@ void hb_start( hb_handle_t * h )
 
     h->work_die    = 0;
     h->work_error  = HB_ERROR_NONE;
-    h->work_thread = hb_work_init( h->jobs, &h->work_die, &h->work_error, &h->current_job );
+    h->work_thread = hb_work_init( h->jobs, &h->work_die, &h->work_error );
 }
 
 /**
@@ -1484,12 +2095,20 @@ void hb_pause( hb_handle_t * h )
 {
     if( !h->paused )
     {
+        int ii;
+
         hb_lock( h->pause_lock );
         h->paused = 1;
 
-        hb_current_job( h )->st_pause_date = hb_get_date();
-
         hb_lock( h->state_lock );
+        for( ii = 0; ii < HB_MAX_JOB_SLOTS; ii++ )
+        {
+            if( h->current_job[ii] != NULL )
+            {
+                h->current_job[ii]->st_pause_date = hb_get_date();
+                h->job_state[ii].state = HB_STATE_PAUSED;
+            }
+        }
         h->state.state = HB_STATE_PAUSED;
         hb_unlock( h->state_lock );
     }
@@ -1503,12 +2122,19 @@ void hb_resume( hb_handle_t * h )
 {
     if( h->paused )
     {
-#define job hb_current_job( h )
-        if( job->st_pause_date != -1 )
+        int ii;
+
+        hb_lock( h->state_lock );
+        for( ii = 0; ii < HB_MAX_JOB_SLOTS; ii++ )
         {
-           job->st_paused += hb_get_date() - job->st_pause_date;
-        }
+#define job h->current_job[ii]
+            if( job != NULL && job->st_pause_date != -1 )
+            {
+               job->st_paused += hb_get_date() - job->st_pause_date;
+            }
 #undef job
+        }
+        hb_unlock( h->state_lock );
 
         hb_unlock( h->pause_lock );
         h->paused = 0;
@@ -1568,6 +2194,7 @@ void hb_close( hb_handle_t ** _h )
 {
     hb_handle_t * h = *_h;
     hb_title_t * title;
+    int i;
 
     h->die = 1;
     
@@ -1586,7 +2213,18 @@ void hb_close( hb_handle_t ** _h )
 
     hb_system_sleep_opaque_close(&h->system_sleep_opaque);
 
+    taskpool_close( &h->taskpool );
+    hb_profile_close( &h->profile );
+
+    hb_list_close( &h->preview_list );
+    hb_lock_close( &h->preview_lock );
+
+    for( i = 0; i < HB_MAX_JOB_SLOTS; i++ )
+    {
+        hb_frame_spool_close( &h->interjob[i].frame_spool );
+    }
     free( h->interjob );
+    scan_cache_release( &h->scan_cache );
 
     free( h );
     *_h = NULL;
@@ -1614,10 +2252,15 @@ int hb_global_init()
 
     /* libavcodec */
     hb_avcodec_init();
+    hb_find_startcode_init();
+    hb_comb_detect_init();
 
     /* HB work objects */
     hb_register(&hb_muxer);
     hb_register(&hb_reader);
+    hb_register(&hb_segment_encoder);
+    hb_register(&hb_segment_spool);
+    hb_register(&hb_frame_spool_encoder);
     hb_register(&hb_sync_video);
     hb_register(&hb_sync_audio);
     hb_register(&hb_decavcodecv);
@@ -1839,8 +2482,9 @@ void hb_set_state( hb_handle_t * h, hb_state_t * s )
         h->state.state == HB_STATE_SEARCHING )
     {
         // Set which job is being worked on
-        if (h->current_job)
-            h->state.param.working.sequence_id = h->current_job->sequence_id & 0xFFFFFF;
+        hb_job_t * job = hb_current_job( h );
+        if (job)
+            h->state.param.working.sequence_id = job->sequence_id & 0xFFFFFF;
         else
             h->state.param.working.sequence_id = 0;
     }
@@ -1848,6 +2492,45 @@ void hb_set_state( hb_handle_t * h, hb_state_t * s )
     hb_unlock( h->pause_lock );
 }
 
+/**
+ * Sets the state of a running job.  Like hb_set_state(), blocks while
+ * the jobs are paused.
+ * @param job Handle to the running hb_job_t
+ * @param s Handle to new hb_state_t
+ */
+void hb_set_job_state( hb_job_t * job, hb_state_t * s )
+{
+    hb_handle_t * h = job->h;
+    hb_state_t  * state = &h->job_state[job->slot];
+
+    hb_lock( h->pause_lock );
+    hb_lock( h->state_lock );
+    memcpy( state, s, sizeof( hb_state_t ) );
+    if( state->state == HB_STATE_WORKING ||
+        state->state == HB_STATE_SEARCHING )
+    {
+        state->param.working.sequence_id = job->sequence_id & 0xFFFFFF;
+    }
+    // The segment pipelines of a job (see segment.c) report through
+    // the job's slot as well
+    if( h->current_job[job->slot] != NULL &&
+        hb_current_job( h ) == h->current_job[job->slot] )
+    {
+        memcpy( &h->state, state, sizeof( hb_state_t ) );
+    }
+    hb_unlock( h->state_lock );
+    hb_unlock( h->pause_lock );
+}
+
+void hb_get_job_state( hb_job_t * job, hb_state_t * s )
+{
+    hb_handle_t * h = job->h;
+
+    hb_lock( h->state_lock );
+    memcpy( s, &h->job_state[job->slot], sizeof( hb_state_t ) );
+    hb_unlock( h->state_lock );
+}
+
 void hb_system_sleep_allow(hb_handle_t *h)
 {
     hb_system_sleep_private_enable(h->system_sleep_opaque);
@@ -1861,5 +2544,12 @@ void hb_system_sleep_prevent(hb_handle_t *h)
 /* Passes a pointer to persistent data */
 hb_interjob_t * hb_interjob_get( hb_handle_t * h )
 {
-    return h->interjob;
+    return &h->interjob[0];
+}
+
+/* Persistent data of the passes of job, which may run concurrently
+ * with other jobs */
+hb_interjob_t * hb_job_interjob( hb_job_t * job )
+{
+    return &job->h->interjob[job->slot];
 }
@@ -55,6 +55,11 @@ void          hb_scan( hb_handle_t *, const char * path,
                        int title_index, int preview_count,
                        int store_previews, uint64_t min_duration );
 void          hb_scan_stop( hb_handle_t * );
+/* hb_set_scan_threads()
+   Number of threads used by the following scans to scan the files of a
+   batch and the previews of a title concurrently. 1 (the default) scans
+   serially, 0 uses one thread per CPU. */
+void          hb_set_scan_threads( hb_handle_t *, int threads );
 uint64_t      hb_first_duration( hb_handle_t * );
 
 /* hb_get_titles()
@@ -76,6 +81,7 @@ int           hb_save_preview( hb_handle_t * h, int title, int preview,
                                hb_buffer_t *buf );
 hb_buffer_t * hb_read_preview( hb_handle_t * h, hb_title_t *title,
                                int preview );
+void          hb_set_preview_store_size( hb_handle_t * h, int64_t size );
 hb_image_t  * hb_get_preview2(hb_handle_t * h, int title_idx, int picture,
                               hb_geometry_settings_t *geo, int deinterlace);
 void          hb_set_anamorphic_size2(hb_geometry_t *src_geo,
@@ -100,6 +106,13 @@ void          hb_pause( hb_handle_t * );
 void          hb_resume( hb_handle_t * );
 void          hb_stop( hb_handle_t * );
 
+/* hb_set_job_slots()
+   Number of jobs hb_start() encodes concurrently, 1 by default.
+   hb_get_job_states() returns the states of the running jobs. */
+#define HB_MAX_JOB_SLOTS 16
+void          hb_set_job_slots( hb_handle_t *, int slots );
+int           hb_get_job_states( hb_handle_t *, hb_state_t * states );
+
 void          hb_system_sleep_allow(hb_handle_t*);
 void          hb_system_sleep_prevent(hb_handle_t*);
 
@@ -113,6 +126,7 @@ typedef struct hb_interjob_s
     hb_rational_t vrate;   /* actual measured output vrate from 1st pass */
 
     hb_subtitle_t *select_subtitle; /* foreign language scan subtitle */
+    struct hb_frame_spool_s *frame_spool; /* frames filtered by 1st pass */
 } hb_interjob_t;
 
 hb_interjob_t * hb_interjob_get( hb_handle_t * ); 
@@ -82,6 +82,84 @@ hb_dict_t* hb_state_to_dict( hb_state_t * state)
     return dict;
 }
 
+/**
+ * Convert the pipeline statistics of the current job to a jansson array
+ * @param profile - Pointer to the hb_profile_t to convert
+ */
+static hb_value_array_t* hb_profile_to_array( hb_profile_t * profile )
+{
+    hb_value_array_t *array;
+    hb_profile_stage_t *stages;
+    json_error_t error;
+    int ii, count;
+
+    if (profile == NULL)
+        return NULL;
+
+    count = hb_profile_get_stages(profile, &stages);
+    if (count == 0)
+        return NULL;
+
+    array = hb_value_array_init();
+    for (ii = 0; ii < count; ii++)
+    {
+        hb_profile_stage_t *stage = &stages[ii];
+        double samples = stage->samples ? stage->samples : 1;
+        hb_dict_t *dict;
+
+        dict = json_pack_ex(&error, 0,
+            "{s:o, s:o, s:o, s:o, s:o, s:o,"
+            " s:{s:o, s:o}, s:{s:o, s:o}}",
+            "Name",         hb_value_string(stage->name),
+            "Buffers",      hb_value_int(stage->buffers),
+            "CPUTime",      hb_value_int(stage->cpu_time),
+            "WorkTime",     hb_value_int(stage->work_time),
+            "WaitInTime",   hb_value_int(stage->wait_in_time),
+            "WaitOutTime",  hb_value_int(stage->wait_out_time),
+            "FifoIn",
+                "Average",  hb_value_double(stage->fifo_in_total / samples),
+                "Max",      hb_value_int(stage->fifo_in_max),
+            "FifoOut",
+                "Average",  hb_value_double(stage->fifo_out_total / samples),
+                "Max",      hb_value_int(stage->fifo_out_max));
+        if (dict == NULL)
+        {
+            hb_error("json pack failure: %s", error.text);
+            continue;
+        }
+        hb_value_array_append(array, dict);
+    }
+    free(stages);
+
+    return array;
+}
+
+/**
+ * Convert the states of the running jobs to a jansson array
+ * @param h - Pointer to an hb_handle_t hb instance
+ */
+static hb_value_array_t* hb_job_states_to_array( hb_handle_t * h )
+{
+    hb_state_t states[HB_MAX_JOB_SLOTS];
+    hb_value_array_t *array;
+    int ii, count;
+
+    count = hb_get_job_states(h, states);
+    if (count == 0)
+        return NULL;
+
+    array = hb_value_array_init();
+    for (ii = 0; ii < count; ii++)
+    {
+        hb_dict_t *dict = hb_state_to_dict(&states[ii]);
+        if (dict != NULL)
+        {
+            hb_value_array_append(array, dict);
+        }
+    }
+    return array;
+}
+
 /**
  * Get the current state of an hb instance as a json string
  * @param h - Pointer to an hb_handle_t hb instance
@@ -93,6 +171,28 @@ char* hb_get_state_json( hb_handle_t * h )
     hb_get_state(h, &state);
     hb_dict_t *dict = hb_state_to_dict(&state);
 
+    // One state per running job when jobs are encoded concurrently
+    if (dict != NULL && hb_get_job_slots(h) > 1)
+    {
+        hb_value_array_t *jobs = hb_job_states_to_array(h);
+        if (jobs != NULL)
+        {
+            hb_dict_set(dict, "Jobs", jobs);
+        }
+    }
+
+    // Per stage statistics of the running (or just finished) job
+    if (dict != NULL &&
+        (state.state == HB_STATE_WORKING || state.state == HB_STATE_PAUSED ||
+         state.state == HB_STATE_SEARCHING || state.state == HB_STATE_WORKDONE))
+    {
+        hb_value_array_t *pipeline = hb_profile_to_array(hb_get_profile(h));
+        if (pipeline != NULL)
+        {
+            hb_dict_set(dict, "Pipeline", pipeline);
+        }
+    }
+
     char *json_state = hb_value_get_json(dict);
     hb_value_free(&dict);
 
@@ -453,8 +553,9 @@ hb_dict_t* hb_job_to_dict( const hb_job_t * job )
     if (job->mux & HB_MUX_MASK_MP4)
     {
         hb_dict_t *mp4_dict;
-        mp4_dict = json_pack_ex(&error, 0, "{s:o, s:o}",
+        mp4_dict = json_pack_ex(&error, 0, "{s:o, s:o, s:o}",
             "Mp4Optimize",      hb_value_bool(job->mp4_optimize),
+            "Mp4Fragment",      hb_value_bool(job->mp4_fragment),
             "IpodAtom",         hb_value_bool(job->ipod_atom));
         hb_dict_set(dest_dict, "Mp4Options", mp4_dict);
     }
@@ -500,11 +601,17 @@ hb_dict_t* hb_job_to_dict( const hb_job_t * job )
     if (job->vquality >= 0)
     {
         hb_dict_set(video_dict, "Quality", hb_value_double(job->vquality));
+        if (job->segments > 1)
+        {
+            hb_dict_set(video_dict, "Segments", hb_value_int(job->segments));
+        }
     }
     else
     {
         hb_dict_set(video_dict, "Bitrate", hb_value_int(job->vbitrate));
         hb_dict_set(video_dict, "TwoPass", hb_value_bool(job->twopass));
+        hb_dict_set(video_dict, "FrameSpool",
+                            hb_value_bool(job->frame_spool));
         hb_dict_set(video_dict, "Turbo",
                             hb_value_bool(job->fastfirstpass));
     }
@@ -749,6 +856,12 @@ void hb_json_job_scan( hb_handle_t * h, const char * json_job )
     // If the job wants to use Hardware decode, it must also be
     // enabled during scan.  So enable it here.
     hb_hwd_set_enable(h, use_hwd);
+
+    // Queues often have several jobs for one source, scan it once
+    if (hb_scan_cache_get(h, path, title_index))
+    {
+        return;
+    }
     hb_scan(h, path, title_index, 10, 0, 0);
 
     // Wait for scan to complete
@@ -758,6 +871,8 @@ void hb_json_job_scan( hb_handle_t * h, const char * json_job )
         hb_snooze(50);
         hb_get_state2(h, &state);
     } while (state.state == HB_STATE_SCANNING);
+
+    hb_scan_cache_put(h, path, title_index);
 }
 
 static int validate_audio_codec_mux(int codec, int mux, int track)
@@ -828,17 +943,17 @@ hb_job_t* hb_dict_to_job( hb_handle_t * h, hb_dict_t *dict )
     // SequenceID
     "s:i,"
     // Destination {File, Mux, ChapterMarkers, ChapterList,
-    //              Mp4Options {Mp4Optimize, IpodAtom}}
-    "s:{s?s, s:o, s:b, s?o s?{s?b, s?b}},"
+    //              Mp4Options {Mp4Optimize, Mp4Fragment, IpodAtom}}
+    "s:{s?s, s:o, s:b, s?o s?{s?b, s?b, s?b}},"
     // Source {Angle, Range {Type, Start, End, SeekPoints}}
     "s:{s?i, s?{s:s, s?I, s?I, s?I}},"
     // PAR {Num, Den}
     "s?{s:i, s:i},"
     // Video {Codec, Quality, Bitrate, Preset, Tune, Profile, Level, Options
-    //        TwoPass, Turbo, ColorMatrixCode,
+    //        TwoPass, Turbo, ColorMatrixCode, Segments, FrameSpool,
     //        OpenCL, HWDecode, QSV {Decode, AsyncDepth}}
     "s:{s:o, s?f, s?i, s?s, s?s, s?s, s?s, s?s,"
-    "   s?b, s?b, s?i,"
+    "   s?b, s?b, s?i, s?i, s?b,"
     "   s?b, s?b, s?{s?b, s?i}},"
     // Audio {CopyMask, FallbackEncoder, AudioList}
     "s?{s?o, s?o, s?o},"
@@ -858,6 +973,7 @@ hb_job_t* hb_dict_to_job( hb_handle_t * h, hb_dict_t *dict )
             "ChapterList",          unpack_o(&chapter_list),
             "Mp4Options",
                 "Mp4Optimize",      unpack_b(&job->mp4_optimize),
+                "Mp4Fragment",      unpack_b(&job->mp4_fragment),
                 "IpodAtom",         unpack_b(&job->ipod_atom),
         "Source",
             "Angle",                unpack_i(&job->angle),
@@ -881,6 +997,8 @@ hb_job_t* hb_dict_to_job( hb_handle_t * h, hb_dict_t *dict )
             "TwoPass",              unpack_b(&job->twopass),
             "Turbo",                unpack_b(&job->fastfirstpass),
             "ColorMatrixCode",      unpack_i(&job->color_matrix_code),
+            "Segments",             unpack_i(&job->segments),
+            "FrameSpool",           unpack_b(&job->frame_spool),
             "OpenCL",               unpack_b(&job->use_opencl),
             "HWDecode",             unpack_b(&job->use_hwd),
             "QSV",
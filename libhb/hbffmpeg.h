@@ -23,6 +23,7 @@
 
 void hb_avcodec_init(void);
 int  hb_avcodec_open(AVCodecContext *, AVCodec *, AVDictionary **, int);
+int  hb_avcodec_job_threads(hb_job_t *);
 int  hb_avcodec_close(AVCodecContext *);
 
 uint64_t hb_ff_mixdown_xlat(int hb_mixdown, int *downmix_mode);
@@ -33,3 +34,11 @@ hb_sws_get_context(int srcW, int srcH, enum AVPixelFormat srcFormat,
                    int dstW, int dstH, enum AVPixelFormat dstFormat,
                    int flags);
 int hb_avpicture_fill(AVPicture *pic, hb_buffer_t *buf);
+
+/* Write-behind muxer output, see writebehind.c */
+typedef struct hb_write_behind_s hb_write_behind_t;
+
+int hb_write_behind_open(hb_write_behind_t **, AVIOContext **pb,
+                         const char *url, const AVIOInterruptCB *int_cb);
+int hb_write_behind_sync(hb_write_behind_t *);
+int hb_write_behind_close(hb_write_behind_t **);
@@ -42,6 +42,7 @@ void hb_list_empty( hb_list_t ** );
 
 hb_title_t * hb_title_init( char * dvd, int index );
 void         hb_title_close( hb_title_t ** );
+hb_title_t * hb_title_copy( const hb_title_t * );
 
 /***********************************************************************
  * hb.c
@@ -49,6 +50,11 @@ void         hb_title_close( hb_title_t ** );
 int  hb_get_pid( hb_handle_t * );
 void hb_set_state( hb_handle_t *, hb_state_t * );
 void hb_job_setup_passes(hb_handle_t *h, hb_job_t *job, hb_list_t *list_pass);
+hb_handle_t * hb_scan_handle_init( hb_handle_t * from );
+void hb_scan_handle_close( hb_handle_t ** _h );
+int  hb_is_scan_handle( hb_handle_t * h );
+int  hb_scan_cache_get( hb_handle_t * h, const char * path, int title_index );
+void hb_scan_cache_put( hb_handle_t * h, const char * path, int title_index );
 
 /***********************************************************************
  * fifo.c
@@ -142,6 +148,11 @@ struct hb_buffer_s
         enum { HOST, DEVICE } buffer_location;
     } cl;
 
+    // Frame buffers made by hb_frame_buffer_ref: a reference to the
+    // picture decoded by libavcodec that 'data' points into.  The data
+    // may still be a reference picture of the decoder, don't modify it.
+    AVBufferRef * av_buffer;
+
     // libav may attach AV_PKT_DATA_PALETTE side data to some AVPackets
     // Store this data here when read and pass to decoder.
     hb_buffer_t * palette;
@@ -164,8 +175,19 @@ struct hb_buffer_s
 void hb_buffer_pool_init( void );
 void hb_buffer_pool_free( void );
 
+typedef struct
+{
+    int64_t hits;       // allocations served from a thread's buffer cache
+    int64_t misses;     // allocations that had to refill from the shared pool
+    int64_t bytes_held; // bytes currently sitting in thread buffer caches
+} hb_buffer_cache_stats_t;
+
+void hb_buffer_cache_stats( hb_buffer_cache_stats_t * stats );
+
 hb_buffer_t * hb_buffer_init( int size );
 hb_buffer_t * hb_frame_buffer_init( int pix_fmt, int w, int h);
+hb_buffer_t * hb_frame_buffer_ref( AVBufferRef * ref, int pix_fmt,
+                                   int w, int h );
 void          hb_buffer_init_planes( hb_buffer_t * b );
 void          hb_buffer_realloc( hb_buffer_t *, int size );
 void          hb_video_buffer_realloc( hb_buffer_t * b, int w, int h );
@@ -179,6 +201,7 @@ hb_image_t  * hb_image_init(int pix_fmt, int width, int height);
 hb_image_t  * hb_buffer_to_image(hb_buffer_t *buf);
 
 hb_fifo_t   * hb_fifo_init( int capacity, int thresh );
+hb_fifo_t   * hb_fifo_init_spsc( int capacity, int thresh );
 int           hb_fifo_size( hb_fifo_t * );
 int           hb_fifo_size_bytes( hb_fifo_t * );
 int           hb_fifo_is_full( hb_fifo_t * );
@@ -263,19 +286,97 @@ hb_thread_t * hb_scan_init( hb_handle_t *, volatile int * die,
                             const char * path, int title_index, 
                             hb_title_set_t * title_set, int preview_count, 
                             int store_previews, uint64_t min_duration );
+int           hb_get_scan_threads( hb_handle_t * );
 hb_thread_t * hb_work_init( hb_list_t * jobs,
-                            volatile int * die, hb_error_code * error, hb_job_t ** job );
+                            volatile int * die, hb_error_code * error );
+int           hb_get_job_slots( hb_handle_t * );
+void          hb_set_current_job( hb_handle_t *, int slot, hb_job_t * );
+void          hb_set_job_state( hb_job_t *, hb_state_t * );
+void          hb_get_job_state( hb_job_t *, hb_state_t * );
+struct hb_interjob_s * hb_job_interjob( hb_job_t * );
 void ReadLoop( void * _w );
+void hb_work_segment( hb_job_t * );
 hb_work_object_t * hb_muxer_init( hb_job_t * );
 hb_work_object_t * hb_get_work( hb_handle_t *, int );
 hb_work_object_t * hb_codec_decoder( hb_handle_t *, int );
 hb_work_object_t * hb_codec_encoder( hb_handle_t *, int );
 
+/***********************************************************************
+ * profile.c
+ ***********************************************************************
+ * Per stage instrumentation of the encoding pipeline.  Each stage is
+ * only updated by its own thread, readers get a consistent copy
+ * through hb_profile_get_stages().  All times are in microseconds.
+ **********************************************************************/
+typedef struct hb_profile_s hb_profile_t;
+typedef struct hb_profile_stage_s
+{
+    char        name[40];
+    hb_fifo_t * fifo_in;
+    hb_fifo_t * fifo_out;
+
+    int64_t     buffers;        // Buffers passed to work()
+    int64_t     work_time;      // Wall time spent in work()
+    int64_t     cpu_time;       // Thread CPU time spent in work()
+    int64_t     wait_in_time;   // Wall time waiting on an empty fifo_in
+    int64_t     wait_out_time;  // Wall time waiting on a full fifo_out
+
+    // Fifo occupancy, sampled every HB_PROFILE_SAMPLE_INTERVAL
+    int64_t     samples;
+    int64_t     fifo_in_total;
+    int64_t     fifo_out_total;
+    int         fifo_in_max;
+    int         fifo_out_max;
+} hb_profile_stage_t;
+
+#define HB_PROFILE_SAMPLE_INTERVAL 100000
+
+hb_profile_t       * hb_profile_init( void );
+void                 hb_profile_close( hb_profile_t ** );
+hb_profile_t       * hb_get_profile( hb_handle_t * );
+void                 hb_profile_start( hb_profile_t * );
+hb_profile_stage_t * hb_profile_add_stage( hb_profile_t *, const char * name,
+                                           hb_fifo_t * fifo_in,
+                                           hb_fifo_t * fifo_out );
+void                 hb_profile_sample( hb_profile_t * );
+void                 hb_profile_stop( hb_profile_t * );
+int                  hb_profile_get_stages( hb_profile_t *,
+                                            hb_profile_stage_t ** stages );
+
 /***********************************************************************
  * sync.c
  **********************************************************************/
 hb_work_object_t * hb_sync_init( hb_job_t * job );
 
+/***********************************************************************
+ * segment.c
+ **********************************************************************/
+typedef struct hb_segment_s hb_segment_t;
+
+void               hb_segment_init( hb_job_t * );
+void               hb_segment_close( hb_job_t * );
+int64_t            hb_segment_stop( hb_job_t * );
+int                hb_segment_frames( hb_job_t *, int count );
+int64_t            hb_segment_zero( hb_job_t *, int64_t zero );
+int64_t            hb_segment_seek( hb_job_t * );
+int                hb_segment_pace( hb_job_t *, int64_t start, int audio );
+hb_work_object_t * hb_segment_encoder_init( hb_job_t *,
+                                            hb_work_object_t * encoder );
+hb_work_object_t * hb_segment_spool_init( hb_job_t * );
+
+/***********************************************************************
+ * framespool.c
+ **********************************************************************/
+typedef struct hb_frame_spool_s hb_frame_spool_t;
+
+#define HB_FRAME_SPOOL_WRITE 1
+#define HB_FRAME_SPOOL_READ  2
+
+int                hb_frame_spool_init( hb_job_t * );
+void               hb_frame_spool_close( hb_frame_spool_t ** );
+hb_work_object_t * hb_frame_spool_encoder_init( hb_job_t *,
+                                                hb_work_object_t * encoder );
+
 /***********************************************************************
  * mpegdemux.c
  **********************************************************************/
@@ -437,7 +538,10 @@ enum
     WORK_ENCAVCODEC_AUDIO,
     WORK_MUX,
     WORK_READER,
-    WORK_DECPGSSUB
+    WORK_DECPGSSUB,
+    WORK_SEGMENT,
+    WORK_SEGMENT_SPOOL,
+    WORK_FRAME_SPOOL
 };
 
 extern hb_filter_object_t hb_filter_detelecine;
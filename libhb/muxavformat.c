@@ -13,8 +13,13 @@
 #include "libavutil/intreadwrite.h"
 
 #include "hb.h"
+#include "hbffmpeg.h"
 #include "lang.h"
 
+/* Longest fragment of fragmented mp4 output in microseconds, bounds the
+ * memory used by the muxer when keyframes are far apart */
+#define MP4_FRAGMENT_DURATION "10000000"
+
 struct hb_mux_data_s
 {
     enum
@@ -44,6 +49,7 @@ struct hb_mux_object_s
 
     AVFormatContext   * oc;
     AVRational          time_base;
+    hb_write_behind_t * output;     // Queues oc->pb writes for an I/O thread
 
     int                 ntracks;
     hb_mux_data_t    ** tracks;
@@ -109,6 +115,23 @@ static char* lookup_lang_code(int mux, char *iso639_2)
     return out;
 }
 
+/*
+ * Whether the mov muxer of the libavformat we are linked with knows
+ * 'flag' of its movflags option.  Setting an unknown flag makes
+ * avformat_write_header fail.
+ */
+static int mov_has_flag( const char *muxer_name, const char *flag )
+{
+    AVOutputFormat *fmt = av_guess_format(muxer_name, NULL, NULL);
+
+    if (fmt == NULL || fmt->priv_class == NULL)
+    {
+        return 0;
+    }
+    return av_opt_find2((void*)&fmt->priv_class, flag, "movflags", 0,
+                        AV_OPT_SEARCH_FAKE_OBJ, NULL) != NULL;
+}
+
 /**********************************************************************
  * avformatInit
  **********************************************************************
@@ -155,7 +178,33 @@ static int avformatInit( hb_mux_object_t * m )
             meta_mux = META_MUX_MP4;
 
             av_dict_set(&av_opts, "brand", "mp42", 0);
-            if (job->mp4_optimize)
+            if (job->mp4_fragment)
+            {
+                // Write a moov without samples up front and a fragment
+                // at each keyframe, at most MP4_FRAGMENT_DURATION long.
+                // Nothing is buffered beyond the current fragment, the
+                // file stays playable if the job dies and there is no
+                // rewrite of the file at the end.
+                av_dict_set(&av_opts, "movflags",
+                            "frag_keyframe+empty_moov+disable_chpl", 0);
+                // Fragments that don't depend on the file offset, when
+                // the muxer supports them (libav 11 doesn't)
+                if (mov_has_flag(muxer_name, "default_base_moof"))
+                {
+                    av_dict_set(&av_opts, "movflags", "+default_base_moof",
+                                AV_DICT_APPEND);
+                }
+                av_dict_set(&av_opts, "frag_duration",
+                            MP4_FRAGMENT_DURATION, 0);
+                if (job->chapter_markers)
+                {
+                    // The chapter track is only known at the end, after
+                    // the moov has been written
+                    hb_log("muxavformat: chapter markers are not written "
+                           "to fragmented mp4");
+                }
+            }
+            else if (job->mp4_optimize)
                 av_dict_set(&av_opts, "movflags", "faststart+disable_chpl", 0);
             else
                 av_dict_set(&av_opts, "movflags", "+disable_chpl", 0);
@@ -183,11 +232,11 @@ static int avformatInit( hb_mux_object_t * m )
         goto error;
     }
     av_strlcpy(m->oc->filename, job->file, sizeof(m->oc->filename));
-    ret = avio_open2(&m->oc->pb, job->file, AVIO_FLAG_WRITE,
-                     &m->oc->interrupt_callback, NULL);
+    ret = hb_write_behind_open(&m->output, &m->oc->pb, job->file,
+                               &m->oc->interrupt_callback);
     if( ret < 0 )
     {
-        hb_error( "avio_open2 failed, errno %d", ret);
+        hb_error( "hb_write_behind_open failed, errno %d", ret);
         goto error;
     }
 
@@ -354,7 +403,7 @@ static int avformatInit( hb_mux_object_t * m )
     hb_rational_t vrate;
     if( job->pass_id == HB_PASS_ENCODE_2ND )
     {
-        hb_interjob_t * interjob = hb_interjob_get( job->h );
+        hb_interjob_t * interjob = hb_job_interjob( job );
         vrate = interjob->vrate;
     }
     else
@@ -939,6 +988,11 @@ static int avformatInit( hb_mux_object_t * m )
 error:
     free(job->mux_data);
     job->mux_data = NULL;
+    if (m->output != NULL)
+    {
+        hb_write_behind_close(&m->output);
+        m->oc->pb = NULL;
+    }
     avformat_free_context(m->oc);
     *job->done_error = HB_ERROR_INIT;
     *job->die = 1;
@@ -1325,8 +1379,20 @@ static int avformatEnd(hb_mux_object_t *m)
         }
     }
 
+    // The trailer may read back what was written (mp4 faststart), so
+    // it is written without the write-behind queue
+    hb_write_behind_sync(m->output);
     av_write_trailer(m->oc);
-    avio_close(m->oc->pb);
+    int ret = hb_write_behind_close(&m->output);
+    if (ret < 0)
+    {
+        char errstr[64];
+        av_strerror(ret, errstr, sizeof(errstr));
+        hb_error("avformatEnd: writing the output failed with error '%s'",
+                 errstr);
+        *job->done_error = HB_ERROR_UNKNOWN;
+    }
+    m->oc->pb = NULL;
     avformat_free_context(m->oc);
     free(m->tracks);
     m->oc = NULL;
@@ -479,7 +479,7 @@ void muxClose( hb_work_object_t * w )
             hb_state_t state;
             state.state = HB_STATE_MUXING;
             state.param.muxing.progress = 0;
-            hb_set_state( job->h, &state );
+            hb_set_job_state( job, &state );
         }
 
         if( mux->m )
@@ -49,45 +49,86 @@ size_t hb_nal_unit_write_isomp4(uint8_t *buf,
     return sizeof(length) + nal_unit_size;
 }
 
-uint8_t* hb_annexb_find_next_nalu(const uint8_t *start, size_t *size)
+static const uint8_t* find_startcode_c(const uint8_t *start,
+                                       const uint8_t *end)
 {
-    uint8_t *nal = NULL;
-    uint8_t *buf = (uint8_t*)start;
-    uint8_t *end = (uint8_t*)start + *size;
+    const uint8_t *buf = start;
 
-    /* Look for an Annex B start code prefix (3-byte sequence == 1) */
-    while (end - buf > 3)
+    /*
+     * buf[2] decides how far we can skip: a start code beginning at
+     * buf, buf + 1 or buf + 2 needs it to be 0 or 1, and one beginning
+     * at buf or buf + 1 needs buf[1] to be 0.
+     */
+    while (end - buf >= 3)
     {
-        if (!buf[0] && !buf[1] && buf[2] == 1)
+        if (buf[2] > 1)
+        {
+            buf += 3;
+        }
+        else if (buf[1])
         {
-            nal = (buf += 3); // NAL unit begins after start code
-            break;
+            buf += 2;
+        }
+        else if (buf[0] || buf[2] != 1)
+        {
+            buf++;
+        }
+        else
+        {
+            return buf;
         }
-        buf++;
     }
 
-    if (nal == NULL)
+    return end;
+}
+
+static hb_find_startcode_func *find_startcode = find_startcode_c;
+
+void hb_find_startcode_init(void)
+{
+#if defined(ARCH_X86)
+    hb_find_startcode_func *func = hb_find_startcode_init_x86();
+    if (func != NULL)
+    {
+        find_startcode = func;
+    }
+#endif
+}
+
+const uint8_t* hb_find_startcode(const uint8_t *start, const uint8_t *end)
+{
+    return find_startcode(start, end);
+}
+
+uint8_t* hb_annexb_find_next_nalu(const uint8_t *start, size_t *size)
+{
+    uint8_t *nal;
+    uint8_t *buf = (uint8_t*)start;
+    uint8_t *end = (uint8_t*)start + *size;
+
+    /* Look for an Annex B start code prefix (3-byte sequence == 1) */
+    buf = (uint8_t*)hb_find_startcode(buf, end);
+    if (end - buf <= 3)
     {
         *size = 0;
         return NULL;
     }
+    nal = (buf += 3); // NAL unit begins after start code
 
     /*
      * Start code prefix found, look for the next one to determine the size
      *
-     * A 4-byte sequence == 1 is also a start code, so check for a 3-byte
-     * sequence == 0 too (start code emulation prevention will prevent such a
-     * sequence from occurring outside of a start code prefix)
+     * A 4-byte sequence == 1 is also a start code, and zero bytes may
+     * pad the end of a NAL unit, so leave out any zeros that precede the
+     * next start code or the end of the buffer (a NAL unit never ends
+     * with a zero byte, its last byte holds the rbsp stop bit)
      */
-    while (end - buf > 3)
+    buf = (uint8_t*)hb_find_startcode(buf, end);
+    while (buf > nal && !buf[-1])
     {
-        if (!buf[0] && !buf[1] && (!buf[2] || buf[2] == 1))
-        {
-            end = buf;
-            break;
-        }
-        buf++;
+        buf--;
     }
+    end = buf;
 
     *size = end - nal;
     return  nal;
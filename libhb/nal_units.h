@@ -41,6 +41,19 @@ size_t hb_nal_unit_write_isomp4(uint8_t *buf, const uint8_t *nal_unit, const siz
  */
 uint8_t* hb_annexb_find_next_nalu(const uint8_t *start, size_t *size);
 
+/*
+ * Returns a pointer to the first 00 00 01 start code prefix in the
+ * buffer [start, end), or end if there is none.
+ *
+ * hb_find_startcode_init() selects the fastest implementation for
+ * the CPU and is called once from hb_global_init().
+ */
+typedef const uint8_t* (hb_find_startcode_func)(const uint8_t *start, const uint8_t *end);
+
+void           hb_find_startcode_init(void);
+const uint8_t* hb_find_startcode(const uint8_t *start, const uint8_t *end);
+hb_find_startcode_func* hb_find_startcode_init_x86(void);
+
 /*
  * Returns a newly-allocated buffer holding a copy of the provided
  * NAL unit bitstream data, converted to the requested format.
@@ -0,0 +1,107 @@
+/* nal_units_x86.c
+
+   Copyright (c) 2003-2015 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "hb.h"     // needed for ARCH_X86
+
+#if defined(ARCH_X86)
+
+#include <emmintrin.h>
+
+#include "libavutil/cpu.h"
+#include "x86_target.h"
+#include "nal_units.h"
+
+/*
+ * Both kernels test every position of a block at once by comparing the
+ * block and the two blocks starting one and two bytes later against
+ * 00 00 01.  The bytes after the last whole block are left to the
+ * scalar loop.
+ */
+static const uint8_t* find_startcode_tail(const uint8_t *buf,
+                                          const uint8_t *end)
+{
+    for (; end - buf >= 3; buf++)
+    {
+        if (!buf[0] && !buf[1] && buf[2] == 1)
+        {
+            return buf;
+        }
+    }
+    return end;
+}
+
+static const uint8_t* find_startcode_sse2(const uint8_t *start,
+                                          const uint8_t *end)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one  = _mm_set1_epi8(1);
+    const uint8_t *buf = start;
+
+    for (; end - buf >= 16 + 2; buf += 16)
+    {
+        __m128i b0 = _mm_loadu_si128((const __m128i*)(buf));
+        __m128i b1 = _mm_loadu_si128((const __m128i*)(buf + 1));
+        __m128i b2 = _mm_loadu_si128((const __m128i*)(buf + 2));
+        __m128i m  = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(b0, zero),
+                                                 _mm_cmpeq_epi8(b1, zero)),
+                                   _mm_cmpeq_epi8(b2, one));
+        int mask = _mm_movemask_epi8(m);
+        if (mask)
+        {
+            return buf + __builtin_ctz(mask);
+        }
+    }
+    return find_startcode_tail(buf, end);
+}
+
+#if defined(HB_X86_AVX2)
+TARGET_AVX2
+static const uint8_t* find_startcode_avx2(const uint8_t *start,
+                                          const uint8_t *end)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one  = _mm256_set1_epi8(1);
+    const uint8_t *buf = start;
+
+    for (; end - buf >= 32 + 2; buf += 32)
+    {
+        __m256i b0 = _mm256_loadu_si256((const __m256i*)(buf));
+        __m256i b1 = _mm256_loadu_si256((const __m256i*)(buf + 1));
+        __m256i b2 = _mm256_loadu_si256((const __m256i*)(buf + 2));
+        __m256i m  = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(b0, zero),
+                                                       _mm256_cmpeq_epi8(b1, zero)),
+                                      _mm256_cmpeq_epi8(b2, one));
+        unsigned mask = _mm256_movemask_epi8(m);
+        if (mask)
+        {
+            return buf + __builtin_ctz(mask);
+        }
+    }
+    return find_startcode_sse2(buf, end);
+}
+#endif // HB_X86_AVX2
+
+hb_find_startcode_func* hb_find_startcode_init_x86(void)
+{
+    int cpu_flags = av_get_cpu_flags();
+
+#if defined(HB_X86_AVX2)
+    if (cpu_flags & AV_CPU_FLAG_AVX2)
+    {
+        return find_startcode_avx2;
+    }
+#endif
+    if (cpu_flags & AV_CPU_FLAG_SSE2)
+    {
+        return find_startcode_sse2;
+    }
+    return NULL;
+}
+
+#endif // ARCH_X86
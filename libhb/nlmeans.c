@@ -87,12 +87,17 @@
 #define NLMEANS_FRAMES_MAX  32
 #define NLMEANS_EXPSIZE     128
 
+// Fewest rows in a tile, each tile recomputes patch_size - 1 rows of
+// integral image
+#define NLMEANS_TILE_ROWS_MIN 32
+
 typedef struct
 {
     uint8_t *mem;
     uint8_t *mem_pre;
     uint8_t *image;
     uint8_t *image_pre;
+    uint8_t *mem_prefilter; // Prefilter output, kept with the frame slot
     int w;
     int h;
     int border;
@@ -109,17 +114,16 @@ typedef struct
     hb_buffer_settings_t s;
 } Frame;
 
-struct PixelSum
-{
-    float weight_sum;
-    float pixel_sum;
-};
-
 typedef struct
 {
     hb_filter_private_t *pv;
     int segment;
-    hb_buffer_t *out;
+
+    // Scratch space for this slice's tiles
+    struct PixelSum *tmp_data;
+    size_t           tmp_size;
+    uint32_t        *integral_mem;
+    size_t           integral_size;
 } nlmeans_thread_arg_t;
 
 struct hb_filter_private_s
@@ -137,11 +141,18 @@ struct hb_filter_private_s
 
     NLMeansFunctions functions;
 
-    Frame      *frame;
-    int         next_frame;
+    Frame      *frame;          // Ring of max_frames frames
+    int         frame_head;     // Oldest frame in the ring
+    int         frame_count;    // Frames in the ring
     int         max_frames;
 
-    taskset_t   taskset;
+    // Frame being filtered, filtered in tiles by the taskset
+    Frame      *window[NLMEANS_FRAMES_MAX]; // It and the frames after it
+    int         window_frames;
+    int         tile_count;
+    hb_buffer_t *out;
+
+    taskslices_t taskset;
     int         thread_count;
     nlmeans_thread_arg_t **thread_data;
 };
@@ -152,7 +163,7 @@ static int nlmeans_work(hb_filter_object_t *filter,
                            hb_buffer_t **buf_out);
 static void nlmeans_close(hb_filter_object_t *filter);
 
-static void nlmeans_filter_thread(void *thread_args_v);
+static void nlmeans_filter_slice(void *thread_args_v);
 
 hb_filter_object_t hb_filter_nlmeans =
 {
@@ -194,7 +205,8 @@ static void nlmeans_deborder(const BorderedPlane *src,
                              uint8_t *dst,
                              const int w,
                              const int s,
-                             const int h)
+                             const int y_start,
+                             const int y_end)
 {
     const int bw = src->w + 2 * src->border;
     uint8_t *image = src->mem + src->border + bw * src->border;
@@ -206,13 +218,23 @@ static void nlmeans_deborder(const BorderedPlane *src,
     }
 
     // Copy main image
-    for (int y = 0; y < h; y++)
+    for (int y = y_start; y < y_end; y++)
     {
         memcpy(dst + y * s, image + y * bw, width);
     }
 
 }
 
+static void nlmeans_plane_free(BorderedPlane *plane)
+{
+    free(plane->mem);
+    free(plane->mem_prefilter);
+    plane->mem           = NULL;
+    plane->mem_pre       = NULL;
+    plane->mem_prefilter = NULL;
+}
+
+// Copies src into dst, whose buffers are reused from frame to frame
 static void nlmeans_alloc(const uint8_t *src,
                           const int src_w,
                           const int src_s,
@@ -223,7 +245,17 @@ static void nlmeans_alloc(const uint8_t *src,
     const int bw = src_w + 2 * border;
     const int bh = src_h + 2 * border;
 
-    uint8_t *mem   = malloc(bw * bh * sizeof(uint8_t));
+    if (dst->mem != NULL &&
+        (dst->w != src_w || dst->h != src_h || dst->border != border))
+    {
+        nlmeans_plane_free(dst);
+    }
+    if (dst->mem == NULL)
+    {
+        dst->mem = malloc(bw * bh * sizeof(uint8_t));
+    }
+
+    uint8_t *mem   = dst->mem;
     uint8_t *image = mem + border + bw * border;
 
     // Copy main image
@@ -239,8 +271,9 @@ static void nlmeans_alloc(const uint8_t *src,
     dst->border    = border;
 
     nlmeans_border(dst->mem, dst->w, dst->h, dst->border);
-    dst->mem_pre   = dst->mem;
-    dst->image_pre = dst->image;
+    dst->mem_pre     = dst->mem;
+    dst->image_pre   = dst->image;
+    dst->prefiltered = 0;
 
 }
 
@@ -502,7 +535,11 @@ static void nlmeans_prefilter(BorderedPlane *src,
         const int bh         = h + 2 * border;
 
         // Duplicate plane
-        uint8_t *mem_pre = malloc(bw * bh * sizeof(uint8_t));
+        if (src->mem_prefilter == NULL)
+        {
+            src->mem_prefilter = malloc(bw * bh * sizeof(uint8_t));
+        }
+        uint8_t *mem_pre = src->mem_prefilter;
         uint8_t *image_pre = mem_pre + border + bw * border;
         for (int y = 0; y < h; y++)
         {
@@ -621,8 +658,52 @@ static void build_integral_scalar(uint32_t *integral,
     }
 }
 
+/*
+ * Adds the patches whose top left corners are in one row of the integral
+ * image to the pixel sums of their centers.  tmp and compare point at the
+ * first center and its displaced pixel.
+ */
+static void accumulate_row_scalar(struct PixelSum *tmp,
+                            const uint32_t *integral_ptr1,
+                            const uint32_t *integral_ptr2,
+                            const uint8_t  *compare,
+                                  int       n,
+                                  int       count,
+                            const float    *exptable,
+                                  float     weight_fact_table,
+                                  int       diff_max)
+{
+    for (int x = 0; x < count; x++)
+    {
+        // Difference between patches
+        const int diff = (uint32_t)(integral_ptr2[n] - integral_ptr2[0] - integral_ptr1[n] + integral_ptr1[0]);
+
+        // Sum pixel with weight
+        if (diff < diff_max)
+        {
+            const int diffidx = diff * weight_fact_table;
+
+            //float weight = exp(-diff*weightFact);
+            const float weight = exptable[diffidx];
+
+            tmp[x].weight_sum += weight;
+            tmp[x].pixel_sum  += weight * compare[x];
+        }
+
+        integral_ptr1++;
+        integral_ptr2++;
+    }
+}
+
+/*
+ * Filters rows y_start to y_end of a plane.  The integral image is built
+ * only for the patches centered on those rows.  Patch differences are
+ * differences of integral values, which are exact whatever row the
+ * integral starts at, so a tile gives exactly the pixels the whole plane
+ * would.
+ */
 static void nlmeans_plane(NLMeansFunctions *functions,
-                          Frame *frame,
+                          Frame **frame,
                           int prefilter,
                           int plane,
                           int nframes,
@@ -630,40 +711,67 @@ static void nlmeans_plane(NLMeansFunctions *functions,
                           int dst_w,
                           int dst_s,
                           int dst_h,
+                          int y_start,
+                          int y_end,
                           double h_param,
                           double origin_tune,
                           int n,
                           int r,
                     const float *exptable,
                     const float  weight_fact_table,
-                    const int    diff_max)
+                    const int    diff_max,
+                    nlmeans_thread_arg_t *scratch)
 {
     const int n_half = (n-1) /2;
     const int r_half = (r-1) /2;
 
+    // Prefilter every frame before its pixels are compared
+    for (int f = 0; f < nframes; f++)
+    {
+        nlmeans_prefilter(&frame[f]->plane[plane], prefilter);
+    }
+
     // Source image
-    const uint8_t *src     = frame[0].plane[plane].image;
-    const uint8_t *src_pre = frame[0].plane[plane].image_pre;
-    const int w      = frame[0].plane[plane].w;
-    const int border = frame[0].plane[plane].border;
+    const uint8_t *src     = frame[0]->plane[plane].image;
+    const uint8_t *src_pre = frame[0]->plane[plane].image_pre;
+    const int w      = frame[0]->plane[plane].w;
+    const int border = frame[0]->plane[plane].border;
     const int bw     = w + 2 * border;
 
-    // Allocate temporary pixel sums
-    struct PixelSum *tmp_data = calloc(dst_w * dst_h, sizeof(struct PixelSum));
+    // Rows of the top left corners of the patches centered on the tile
+    const int py_start = MAX(0, y_start - n_half);
+    const int py_end   = MIN(dst_h - n + 1, y_end - n_half);
+    const int integral_h = py_end - py_start + n - 1;
 
-    // Allocate integral image
-    const int integral_stride    = ((dst_w + 15) / 16 * 16) + 2 * 16;
-    uint32_t* const integral_mem = calloc(integral_stride * (dst_h+1), sizeof(uint32_t));
-    uint32_t* const integral     = integral_mem + integral_stride + 16;
+    // Temporary pixel sums of the tile
+    const size_t tmp_size = (size_t)(y_end - y_start) * dst_w;
+    if (scratch->tmp_size < tmp_size)
+    {
+        free(scratch->tmp_data);
+        scratch->tmp_data = malloc(tmp_size * sizeof(struct PixelSum));
+        scratch->tmp_size = tmp_size;
+    }
+    struct PixelSum *tmp_data = scratch->tmp_data;
+    memset(tmp_data, 0, tmp_size * sizeof(struct PixelSum));
+
+    // Integral image of the tile
+    const int integral_stride = ((dst_w + 15) / 16 * 16) + 2 * 16;
+    const size_t integral_size = (size_t)integral_stride * (MAX(integral_h, 0) + 1);
+    if (scratch->integral_size < integral_size)
+    {
+        free(scratch->integral_mem);
+        scratch->integral_mem  = malloc(integral_size * sizeof(uint32_t));
+        scratch->integral_size = integral_size;
+    }
+    memset(scratch->integral_mem, 0, integral_size * sizeof(uint32_t));
+    uint32_t* const integral = scratch->integral_mem + integral_stride + 16;
 
     // Iterate through available frames
     for (int f = 0; f < nframes; f++)
     {
-        nlmeans_prefilter(&frame[f].plane[plane], prefilter);
-
         // Compare image
-        const uint8_t *compare     = frame[f].plane[plane].image;
-        const uint8_t *compare_pre = frame[f].plane[plane].image_pre;
+        const uint8_t *compare     = frame[f]->plane[plane].image;
+        const uint8_t *compare_pre = frame[f]->plane[plane].image_pre;
 
         // Iterate through all displacements
         for (int dy = -r_half; dy <= r_half; dy++)
@@ -674,69 +782,57 @@ static void nlmeans_plane(NLMeansFunctions *functions,
                 // Apply special weight tuning to origin patch
                 if (dx == 0 && dy == 0 && f == 0)
                 {
-                    // TODO: Parallelize this
-                    for (int y = n_half; y < dst_h-n + n_half; y++)
+                    for (int y = MAX(n_half, y_start); y < MIN(dst_h-n + n_half, y_end); y++)
                     {
+                        struct PixelSum *tmp = tmp_data + (y - y_start)*dst_w;
                         for (int x = n_half; x < dst_w-n + n_half; x++)
                         {
-                            tmp_data[y*dst_w + x].weight_sum += origin_tune;
-                            tmp_data[y*dst_w + x].pixel_sum  += origin_tune * src[y*bw + x];
+                            tmp[x].weight_sum += origin_tune;
+                            tmp[x].pixel_sum  += origin_tune * src[y*bw + x];
                         }
                     }
                     continue;
                 }
+                if (py_end <= py_start)
+                {
+                    continue;
+                }
 
                 // Build integral
                 functions->build_integral(integral,
                                           integral_stride,
-                                          src,
-                                          src_pre,
-                                          compare,
-                                          compare_pre,
+                                          src + py_start*bw,
+                                          src_pre + py_start*bw,
+                                          compare + py_start*bw,
+                                          compare_pre + py_start*bw,
                                           w,
                                           border,
                                           dst_w,
-                                          dst_h,
+                                          integral_h,
                                           dx,
                                           dy);
 
                 // Average displacement
-                // TODO: Parallelize this
-                for (int y = 0; y <= dst_h-n; y++)
+                for (int y = py_start; y < py_end; y++)
                 {
-                    const uint32_t *integral_ptr1 = integral + (y  -1)*integral_stride - 1;
-                    const uint32_t *integral_ptr2 = integral + (y+n-1)*integral_stride - 1;
-
-                    for (int x = 0; x <= dst_w-n; x++)
-                    {
-                        const int xc = x + n_half;
-                        const int yc = y + n_half;
-
-                        // Difference between patches
-                        const int diff = (uint32_t)(integral_ptr2[n] - integral_ptr2[0] - integral_ptr1[n] + integral_ptr1[0]);
-
-                        // Sum pixel with weight
-                        if (diff < diff_max)
-                        {
-                            const int diffidx = diff * weight_fact_table;
-
-                            //float weight = exp(-diff*weightFact);
-                            const float weight = exptable[diffidx];
-
-                            tmp_data[yc*dst_w + xc].weight_sum += weight;
-                            tmp_data[yc*dst_w + xc].pixel_sum  += weight * compare[(yc+dy)*bw + xc + dx];
-                        }
-
-                        integral_ptr1++;
-                        integral_ptr2++;
-                    }
+                    const int yc = y + n_half;
+
+                    functions->accumulate_row(tmp_data + (yc - y_start)*dst_w + n_half,
+                                              integral + (y-py_start  -1)*integral_stride - 1,
+                                              integral + (y-py_start+n-1)*integral_stride - 1,
+                                              compare + (yc+dy)*bw + n_half + dx,
+                                              n,
+                                              dst_w-n + 1,
+                                              exptable,
+                                              weight_fact_table,
+                                              diff_max);
                 }
             }
         }
     }
 
     // Copy edges
-    for (int y = 0; y < dst_h; y++)
+    for (int y = y_start; y < y_end; y++)
     {
         for (int x = 0; x < n_half; x++)
         {
@@ -746,24 +842,28 @@ static void nlmeans_plane(NLMeansFunctions *functions,
     }
     for (int y = 0; y < n_half; y++)
     {
-        memcpy(dst +           y*dst_s, src -     (y+1)*bw, dst_w);
-        memcpy(dst + (dst_h-y-1)*dst_s, src + (y+dst_h)*bw, dst_w);
+        if (y >= y_start && y < y_end)
+        {
+            memcpy(dst +           y*dst_s, src -     (y+1)*bw, dst_w);
+        }
+        if (dst_h-y-1 >= y_start && dst_h-y-1 < y_end)
+        {
+            memcpy(dst + (dst_h-y-1)*dst_s, src + (y+dst_h)*bw, dst_w);
+        }
     }
 
     // Copy main image
     uint8_t result;
-    for (int y = n_half; y < dst_h-n_half; y++)
+    for (int y = MAX(n_half, y_start); y < MIN(dst_h-n_half, y_end); y++)
     {
+        const struct PixelSum *tmp = tmp_data + (y - y_start)*dst_w;
         for (int x = n_half; x < dst_w-n_half; x++)
         {
-            result = (uint8_t)(tmp_data[y*dst_w + x].pixel_sum / tmp_data[y*dst_w + x].weight_sum);
+            result = (uint8_t)(tmp[x].pixel_sum / tmp[x].weight_sum);
             *(dst + y*dst_s + x) = result ? result : *(src + y*bw + x);
         }
     }
 
-    free(tmp_data);
-    free(integral_mem);
-
 }
 
 static int nlmeans_init(hb_filter_object_t *filter,
@@ -774,6 +874,7 @@ static int nlmeans_init(hb_filter_object_t *filter,
     NLMeansFunctions *functions = &pv->functions;
 
     functions->build_integral = build_integral_scalar;
+    functions->accumulate_row = accumulate_row_scalar;
 #if defined(ARCH_X86)
     nlmeans_init_x86(functions);
 #endif
@@ -851,8 +952,8 @@ static int nlmeans_init(hb_filter_object_t *filter,
     }
 
     pv->thread_count = hb_get_cpu_count();
-    pv->frame = calloc(pv->thread_count + pv->max_frames, sizeof(Frame));
-    for (int ii = 0; ii < pv->thread_count + pv->max_frames; ii++)
+    pv->frame = calloc(pv->max_frames, sizeof(Frame));
+    for (int ii = 0; ii < pv->max_frames; ii++)
     {
         for (int c = 0; c < 3; c++)
         {
@@ -861,8 +962,9 @@ static int nlmeans_init(hb_filter_object_t *filter,
     }
 
     pv->thread_data = malloc(pv->thread_count * sizeof(nlmeans_thread_arg_t*));
-    if (taskset_init(&pv->taskset, pv->thread_count,
-                     sizeof(nlmeans_thread_arg_t)) == 0)
+    if (taskslices_init(&pv->taskset, hb_get_taskpool(init->job->h),
+                        pv->thread_count, sizeof(nlmeans_thread_arg_t),
+                        nlmeans_filter_slice) == 0)
     {
         hb_error("NLMeans could not initialize taskset");
         goto fail;
@@ -870,7 +972,7 @@ static int nlmeans_init(hb_filter_object_t *filter,
 
     for (int ii = 0; ii < pv->thread_count; ii++)
     {
-        pv->thread_data[ii] = taskset_thread_args(&pv->taskset, ii);
+        pv->thread_data[ii] = taskslices_args(&pv->taskset, ii);
         if (pv->thread_data[ii] == NULL)
         {
             hb_error("NLMeans could not create thread args");
@@ -878,18 +980,12 @@ static int nlmeans_init(hb_filter_object_t *filter,
         }
         pv->thread_data[ii]->pv = pv;
         pv->thread_data[ii]->segment = ii;
-        if (taskset_thread_spawn(&pv->taskset, ii, "nlmeans_filter",
-                                 nlmeans_filter_thread, HB_NORMAL_PRIORITY) == 0)
-        {
-            hb_error("NLMeans could not spawn thread");
-            goto fail;
-        }
     }
 
     return 0;
 
 fail:
-    taskset_fini(&pv->taskset);
+    taskslices_fini(&pv->taskset);
     free(pv->thread_data);
     free(pv);
     return -1;
@@ -904,29 +1000,18 @@ static void nlmeans_close(hb_filter_object_t *filter)
         return;
     }
 
-    taskset_fini(&pv->taskset);
-    for (int c = 0; c < 3; c++)
+    for (int ii = 0; ii < pv->thread_count; ii++)
     {
-        for (int f = 0; f < pv->nframes[c]; f++)
-        {
-            if (pv->frame[f].plane[c].mem_pre != NULL &&
-                pv->frame[f].plane[c].mem_pre != pv->frame[f].plane[c].mem)
-            {
-                free(pv->frame[f].plane[c].mem_pre);
-                pv->frame[f].plane[c].mem_pre = NULL;
-            }
-            if (pv->frame[f].plane[c].mem != NULL)
-            {
-                free(pv->frame[f].plane[c].mem);
-                pv->frame[f].plane[c].mem = NULL;
-            }
-        }
+        free(pv->thread_data[ii]->tmp_data);
+        free(pv->thread_data[ii]->integral_mem);
     }
+    taskslices_fini(&pv->taskset);
 
-    for (int ii = 0; ii < pv->thread_count + pv->max_frames; ii++)
+    for (int ii = 0; ii < pv->max_frames; ii++)
     {
         for (int c = 0; c < 3; c++)
         {
+            nlmeans_plane_free(&pv->frame[ii].plane[c]);
             hb_lock_close(&pv->frame[ii].plane[c].mutex);
         }
     }
@@ -937,77 +1022,86 @@ static void nlmeans_close(hb_filter_object_t *filter)
     filter->private_data = NULL;
 }
 
-static void nlmeans_filter_thread(void *thread_args_v)
+/*
+ * Each slice filters one horizontal tile of every plane of the frame
+ * being filtered.
+ */
+static void nlmeans_filter_slice(void *thread_args_v)
 {
     nlmeans_thread_arg_t *thread_data = thread_args_v;
     hb_filter_private_t *pv = thread_data->pv;
     int segment = thread_data->segment;
 
-    hb_log("NLMeans thread started for segment %d", segment);
+    Frame *frame = pv->window[0];
+    hb_buffer_t *buf = pv->out;
+
+    NLMeansFunctions *functions = &pv->functions;
+
+    if (segment >= pv->tile_count)
+    {
+        return;
+    }
 
-    while (1)
+    for (int c = 0; c < 3; c++)
     {
-        // Wait until there is work to do.
-        taskset_thread_wait4start(&pv->taskset, segment);
+        const int h       = buf->plane[c].height;
+        const int y_start = h *  segment      / pv->tile_count;
+        const int y_end   = h * (segment + 1) / pv->tile_count;
 
-        if (taskset_thread_stop(&pv->taskset, segment))
+        if (y_start >= y_end)
         {
-            break;
+            continue;
         }
-
-        Frame *frame = &pv->frame[segment];
-        hb_buffer_t *buf;
-        buf = hb_frame_buffer_init(frame->fmt, frame->width, frame->height);
-
-        NLMeansFunctions *functions = &pv->functions;
-
-        for (int c = 0; c < 3; c++)
+        if (pv->strength[c] == 0)
         {
-            if (pv->strength[c] == 0)
-            {
-                nlmeans_deborder(&frame->plane[c], buf->plane[c].data,
-                                 buf->plane[c].width, buf->plane[c].stride,
-                                 buf->plane[c].height);
-                continue;
-            }
-            if (pv->prefilter[c] & NLMEANS_PREFILTER_MODE_PASSTHRU)
-            {
-                nlmeans_prefilter(&pv->frame->plane[c], pv->prefilter[c]);
-                nlmeans_deborder(&frame->plane[c], buf->plane[c].data,
-                                 buf->plane[c].width, buf->plane[c].stride,
-                                 buf->plane[c].height);
-                continue;
-            }
+            nlmeans_deborder(&frame->plane[c], buf->plane[c].data,
+                             buf->plane[c].width, buf->plane[c].stride,
+                             y_start, y_end);
+            continue;
+        }
+        if (pv->prefilter[c] & NLMEANS_PREFILTER_MODE_PASSTHRU)
+        {
+            nlmeans_prefilter(&frame->plane[c], pv->prefilter[c]);
+            nlmeans_deborder(&frame->plane[c], buf->plane[c].data,
+                             buf->plane[c].width, buf->plane[c].stride,
+                             y_start, y_end);
+            continue;
+        }
 
-            // Process current plane
-            nlmeans_plane(functions,
-                          frame,
-                          pv->prefilter[c],
-                          c,
-                          pv->nframes[c],
-                          buf->plane[c].data,
-                          buf->plane[c].width,
-                          buf->plane[c].stride,
-                          buf->plane[c].height,
-                          pv->strength[c],
-                          pv->origin_tune[c],
-                          pv->patch_size[c],
-                          pv->range[c],
-                          pv->exptable[c],
-                          pv->weight_fact_table[c],
-                          pv->diff_max[c]);
+        int nframes = pv->window_frames;
+        if (pv->nframes[c] < nframes)
+        {
+            nframes = pv->nframes[c];
         }
-        buf->s = pv->frame[segment].s;
-        thread_data->out = buf;
 
-        // Finished this segment, notify.
-        taskset_thread_complete(&pv->taskset, segment);
+        // Process current plane
+        nlmeans_plane(functions,
+                      pv->window,
+                      pv->prefilter[c],
+                      c,
+                      nframes,
+                      buf->plane[c].data,
+                      buf->plane[c].width,
+                      buf->plane[c].stride,
+                      buf->plane[c].height,
+                      y_start,
+                      y_end,
+                      pv->strength[c],
+                      pv->origin_tune[c],
+                      pv->patch_size[c],
+                      pv->range[c],
+                      pv->exptable[c],
+                      pv->weight_fact_table[c],
+                      pv->diff_max[c],
+                      thread_data);
     }
-    taskset_thread_complete(&pv->taskset, segment);
 }
 
 static void nlmeans_add_frame(hb_filter_private_t *pv, hb_buffer_t *buf)
 {
+    Frame *frame = &pv->frame[(pv->frame_head + pv->frame_count) %
+                              pv->max_frames];
+
     for (int c = 0; c < 3; c++)
     {
         // Extend copy of plane with extra border and place in buffer
@@ -1016,130 +1110,59 @@ static void nlmeans_add_frame(hb_filter_private_t *pv, hb_buffer_t *buf)
                       buf->plane[c].width,
                       buf->plane[c].stride,
                       buf->plane[c].height,
-                      &pv->frame[pv->next_frame].plane[c],
+                      &frame->plane[c],
                       border);
-        pv->frame[pv->next_frame].s = buf->s;
-        pv->frame[pv->next_frame].width = buf->f.width;
-        pv->frame[pv->next_frame].height = buf->f.height;
-        pv->frame[pv->next_frame].fmt = buf->f.fmt;
     }
-    pv->next_frame++;
+    frame->s = buf->s;
+    frame->width = buf->f.width;
+    frame->height = buf->f.height;
+    frame->fmt = buf->f.fmt;
+    pv->frame_count++;
 }
 
-static hb_buffer_t * nlmeans_filter(hb_filter_private_t *pv)
+// Filters the oldest frame in the ring with the frames after it
+static hb_buffer_t * nlmeans_filter_frame(hb_filter_private_t *pv)
 {
-    if (pv->next_frame < pv->max_frames + pv->thread_count)
+    for (int f = 0; f < pv->frame_count; f++)
     {
-        return NULL;
+        pv->window[f] = &pv->frame[(pv->frame_head + f) % pv->max_frames];
     }
+    pv->window_frames = pv->frame_count;
 
-    taskset_cycle(&pv->taskset);
+    Frame *frame = pv->window[0];
+    pv->out = hb_frame_buffer_init(frame->fmt, frame->width, frame->height);
+    pv->tile_count = MIN(pv->thread_count,
+                         MAX(1, frame->height / NLMEANS_TILE_ROWS_MIN));
 
-    // Free buffers that are not needed for next taskset cycle
-    for (int c = 0; c < 3; c++)
-    {
-        for (int t = 0; t < pv->thread_count; t++)
-        {
-            // Release last frame in buffer
-            if (pv->frame[t].plane[c].mem_pre != NULL &&
-                pv->frame[t].plane[c].mem_pre != pv->frame[t].plane[c].mem)
-            {
-                free(pv->frame[t].plane[c].mem_pre);
-                pv->frame[t].plane[c].mem_pre = NULL;
-            }
-            if (pv->frame[t].plane[c].mem != NULL)
-            {
-                free(pv->frame[t].plane[c].mem);
-                pv->frame[t].plane[c].mem = NULL;
-            }
-        }
-    }
-    // Shift frames in buffer down
-    for (int f = 0; f < pv->max_frames; f++)
-    {
-        // Don't move the mutex!
-        Frame frame = pv->frame[f];
-        pv->frame[f] = pv->frame[f+pv->thread_count];
-        for (int c = 0; c < 3; c++)
-        {
-            pv->frame[f].plane[c].mutex = frame.plane[c].mutex;
-            pv->frame[f+pv->thread_count].plane[c].mem_pre = NULL;
-            pv->frame[f+pv->thread_count].plane[c].mem = NULL;
-        }
-    }
-    pv->next_frame -= pv->thread_count;
+    taskslices_cycle(&pv->taskset);
+
+    hb_buffer_t *out = pv->out;
+    out->s = frame->s;
+    pv->out = NULL;
 
-    // Collect results from taskset
-    hb_buffer_t *last = NULL, *out = NULL;
-    for (int t = 0; t < pv->thread_count; t++)
+    // The frame's slot is reused for the next frame added
+    pv->frame_head = (pv->frame_head + 1) % pv->max_frames;
+    pv->frame_count--;
+
+    return out;
+}
+
+static hb_buffer_t * nlmeans_filter(hb_filter_private_t *pv)
+{
+    if (pv->frame_count < pv->max_frames)
     {
-        if (out == NULL)
-        {
-            out = last = pv->thread_data[t]->out;
-        }
-        else
-        {
-            last->next = pv->thread_data[t]->out;
-            last = pv->thread_data[t]->out;
-        }
+        return NULL;
     }
-    return out;
+    return nlmeans_filter_frame(pv);
 }
 
 static hb_buffer_t * nlmeans_filter_flush(hb_filter_private_t *pv)
 {
     hb_buffer_t *out = NULL, *last = NULL;
 
-    for (int f = 0; f < pv->next_frame; f++)
+    while (pv->frame_count > 0)
     {
-        Frame *frame = &pv->frame[f];
-        hb_buffer_t *buf;
-        buf = hb_frame_buffer_init(frame->fmt, frame->width, frame->height);
-
-        NLMeansFunctions *functions = &pv->functions;
-
-        for (int c = 0; c < 3; c++)
-        {
-            if (pv->strength[c] == 0)
-            {
-                nlmeans_deborder(&frame->plane[c], buf->plane[c].data,
-                                 buf->plane[c].width, buf->plane[c].stride,
-                                 buf->plane[c].height);
-                continue;
-            }
-            if (pv->prefilter[c] & NLMEANS_PREFILTER_MODE_PASSTHRU)
-            {
-                nlmeans_prefilter(&pv->frame[f].plane[c], pv->prefilter[c]);
-                nlmeans_deborder(&frame->plane[c], buf->plane[c].data,
-                                 buf->plane[c].width, buf->plane[c].stride,
-                                 buf->plane[c].height);
-                continue;
-            }
-
-            int nframes = pv->next_frame - f;
-            if (pv->nframes[c] < nframes)
-            {
-                nframes = pv->nframes[c];
-            }
-            // Process current plane
-            nlmeans_plane(functions,
-                          frame,
-                          pv->prefilter[c],
-                          c,
-                          nframes,
-                          buf->plane[c].data,
-                          buf->plane[c].width,
-                          buf->plane[c].stride,
-                          buf->plane[c].height,
-                          pv->strength[c],
-                          pv->origin_tune[c],
-                          pv->patch_size[c],
-                          pv->range[c],
-                          pv->exptable[c],
-                          pv->weight_fact_table[c],
-                          pv->diff_max[c]);
-        }
-        buf->s = frame->s;
+        hb_buffer_t *buf = nlmeans_filter_frame(pv);
         if (out == NULL)
         {
             out = last = buf;
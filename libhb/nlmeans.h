@@ -8,6 +8,12 @@
    For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
  */
 
+struct PixelSum
+{
+    float weight_sum;
+    float pixel_sum;
+};
+
 typedef struct
 {
     void (*build_integral)(uint32_t *integral,
@@ -22,6 +28,15 @@ typedef struct
                            int       dst_h,
                            int       dx,
                            int       dy);
+    void (*accumulate_row)(struct PixelSum *tmp,
+                     const uint32_t *integral_ptr1,
+                     const uint32_t *integral_ptr2,
+                     const uint8_t  *compare,
+                           int       n,
+                           int       count,
+                     const float    *exptable,
+                           float     weight_fact_table,
+                           int       diff_max);
 } NLMeansFunctions;
 
 void nlmeans_init_x86(NLMeansFunctions *functions);
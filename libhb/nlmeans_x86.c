@@ -15,8 +15,20 @@
 #include <emmintrin.h>
 
 #include "libavutil/cpu.h"
+#include "x86_target.h"
 #include "nlmeans.h"
 
+/*
+ * The AVX2 and AVX-512 kernels compute exactly what the C code in
+ * nlmeans.c does.  The integral image is integer math.  The accumulation
+ * kernels do the same float operations in the same order for every
+ * pixel, which is only guaranteed with SSE math, so they are limited to
+ * x86-64.  Patches that fail diff_max add a zero weight, which leaves the
+ * (non negative) sums unchanged.  The pixels after the last whole vector
+ * are left to the C code.
+ */
+static NLMeansFunctions nlmeans_c;
+
 static void build_integral_sse2(uint32_t *integral,
                                 int       integral_stride,
                           const uint8_t  *src,
@@ -143,9 +155,317 @@ static void build_integral_sse2(uint32_t *integral,
     }
 }
 
+#if defined(HB_X86_AVX2)
+// Prefix sums of the 8 32 bit lanes of v
+TARGET_AVX2
+static inline __m256i prefix_sum_avx2(__m256i v)
+{
+    v = _mm256_add_epi32(v, _mm256_slli_si256(v, 4));
+    v = _mm256_add_epi32(v, _mm256_slli_si256(v, 8));
+
+    // Add the total of the low 128 bit lane to the high lane
+    return _mm256_add_epi32(v, _mm256_shuffle_epi32(
+                                _mm256_permute2x128_si256(v, v, 0x08), 0xff));
+}
+
+TARGET_AVX2
+static void build_integral_avx2(uint32_t *integral,
+                                int       integral_stride,
+                          const uint8_t  *src,
+                          const uint8_t  *src_pre,
+                          const uint8_t  *compare,
+                          const uint8_t  *compare_pre,
+                                int       w,
+                                int       border,
+                                int       dst_w,
+                                int       dst_h,
+                                int       dx,
+                                int       dy)
+{
+    const __m256i last = _mm256_set1_epi32(7);
+    const int bw = w + 2 * border;
+
+    for (int y = 0; y < dst_h; y++)
+    {
+        __m256i prevadd = _mm256_setzero_si256();
+
+        const uint8_t *p1 = src_pre + y*bw;
+        const uint8_t *p2 = compare_pre + (y+dy)*bw + dx;
+        uint32_t *out = integral + (y*integral_stride);
+
+        // Same 16 pixel steps as SSE2, the row may be written up to the
+        // next multiple of 16
+        for (int x = 0; x < dst_w; x += 16)
+        {
+            __m256i pa = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)p1));
+            __m256i pb = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)p2));
+            __m256i diff = _mm256_sub_epi16(pa, pb);
+
+            // Squares are at most 255^2 and fit unsigned 16 bit lanes
+            diff = _mm256_mullo_epi16(diff, diff);
+
+            __m256i lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(diff));
+            __m256i hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(diff, 1));
+
+            lo = _mm256_add_epi32(prefix_sum_avx2(lo), prevadd);
+            prevadd = _mm256_permutevar8x32_epi32(lo, last);
+            hi = _mm256_add_epi32(prefix_sum_avx2(hi), prevadd);
+            prevadd = _mm256_permutevar8x32_epi32(hi, last);
+
+            _mm256_storeu_si256((__m256i*)(out),     lo);
+            _mm256_storeu_si256((__m256i*)(out + 8), hi);
+
+            out += 16;
+            p1  += 16;
+            p2  += 16;
+        }
+
+        if (y > 0)
+        {
+            out = integral + y*integral_stride;
+
+            for (int x = 0; x < dst_w; x += 16)
+            {
+                const uint32_t *above = out - integral_stride;
+
+                _mm256_storeu_si256((__m256i*)(out),
+                    _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(above)),
+                                     _mm256_loadu_si256((const __m256i*)(out))));
+                _mm256_storeu_si256((__m256i*)(out + 8),
+                    _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(above + 8)),
+                                     _mm256_loadu_si256((const __m256i*)(out + 8))));
+
+                out += 16;
+            }
+        }
+    }
+}
+
+#if ARCH_X86_64
+TARGET_AVX2
+static void accumulate_row_avx2(struct PixelSum *tmp,
+                          const uint32_t *integral_ptr1,
+                          const uint32_t *integral_ptr2,
+                          const uint8_t  *compare,
+                                int       n,
+                                int       count,
+                          const float    *exptable,
+                                float     weight_fact_table,
+                                int       diff_max)
+{
+    const __m256  weight_fact = _mm256_set1_ps(weight_fact_table);
+    const __m256i max         = _mm256_set1_epi32(diff_max);
+    int x;
+
+    for (x = 0; x + 8 <= count; x += 8)
+    {
+        // Difference between patches
+        __m256i diff = _mm256_sub_epi32(
+            _mm256_loadu_si256((const __m256i*)(integral_ptr2 + x + n)),
+            _mm256_loadu_si256((const __m256i*)(integral_ptr2 + x)));
+        diff = _mm256_sub_epi32(diff,
+            _mm256_loadu_si256((const __m256i*)(integral_ptr1 + x + n)));
+        diff = _mm256_add_epi32(diff,
+            _mm256_loadu_si256((const __m256i*)(integral_ptr1 + x)));
+
+        __m256i mask = _mm256_cmpgt_epi32(max, diff);
+        if (_mm256_testz_si256(mask, mask))
+        {
+            continue;
+        }
+
+        // Look up the weights of the patches that pass
+        __m256i diffidx = _mm256_cvttps_epi32(
+            _mm256_mul_ps(_mm256_cvtepi32_ps(diff), weight_fact));
+        __m256 weight = _mm256_mask_i32gather_ps(_mm256_setzero_ps(),
+                                                 exptable, diffidx,
+                                                 _mm256_castsi256_ps(mask), 4);
+        __m256 pixel = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+                            _mm_loadl_epi64((const __m128i*)(compare + x))));
+        pixel = _mm256_mul_ps(weight, pixel);
+
+        // Interleave into PixelSums
+        __m256 lo = _mm256_unpacklo_ps(weight, pixel);
+        __m256 hi = _mm256_unpackhi_ps(weight, pixel);
+        float *sum = (float*)(tmp + x);
+
+        _mm256_storeu_ps(sum, _mm256_add_ps(_mm256_loadu_ps(sum),
+                                   _mm256_permute2f128_ps(lo, hi, 0x20)));
+        _mm256_storeu_ps(sum + 8, _mm256_add_ps(_mm256_loadu_ps(sum + 8),
+                                   _mm256_permute2f128_ps(lo, hi, 0x31)));
+    }
+
+    if (x < count)
+    {
+        nlmeans_c.accumulate_row(tmp + x, integral_ptr1 + x, integral_ptr2 + x,
+                                 compare + x, n, count - x, exptable,
+                                 weight_fact_table, diff_max);
+    }
+}
+#endif // ARCH_X86_64
+#endif // HB_X86_AVX2
+
+#if defined(HB_X86_AVX512)
+TARGET_AVX512
+static void build_integral_avx512(uint32_t *integral,
+                                  int       integral_stride,
+                            const uint8_t  *src,
+                            const uint8_t  *src_pre,
+                            const uint8_t  *compare,
+                            const uint8_t  *compare_pre,
+                                  int       w,
+                                  int       border,
+                                  int       dst_w,
+                                  int       dst_h,
+                                  int       dx,
+                                  int       dy)
+{
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i last = _mm512_set1_epi32(15);
+    const int bw = w + 2 * border;
+
+    for (int y = 0; y < dst_h; y++)
+    {
+        __m512i prevadd = zero;
+
+        const uint8_t *p1 = src_pre + y*bw;
+        const uint8_t *p2 = compare_pre + (y+dy)*bw + dx;
+        uint32_t *out = integral + (y*integral_stride);
+
+        // 16 pixels fill a vector, the same steps as SSE2
+        for (int x = 0; x < dst_w; x += 16)
+        {
+            __m512i diff = _mm512_sub_epi32(
+                _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)p1)),
+                _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)p2)));
+            diff = _mm512_mullo_epi32(diff, diff);
+
+            // Prefix sums, shifting in zeros 1, 2, 4 and 8 lanes
+            diff = _mm512_add_epi32(diff, _mm512_alignr_epi32(diff, zero, 15));
+            diff = _mm512_add_epi32(diff, _mm512_alignr_epi32(diff, zero, 14));
+            diff = _mm512_add_epi32(diff, _mm512_alignr_epi32(diff, zero, 12));
+            diff = _mm512_add_epi32(diff, _mm512_alignr_epi32(diff, zero, 8));
+            diff = _mm512_add_epi32(diff, prevadd);
+            prevadd = _mm512_permutexvar_epi32(last, diff);
+
+            _mm512_storeu_si512(out, diff);
+
+            out += 16;
+            p1  += 16;
+            p2  += 16;
+        }
+
+        if (y > 0)
+        {
+            out = integral + y*integral_stride;
+
+            for (int x = 0; x < dst_w; x += 16)
+            {
+                _mm512_storeu_si512(out,
+                    _mm512_add_epi32(_mm512_loadu_si512(out - integral_stride),
+                                     _mm512_loadu_si512(out)));
+
+                out += 16;
+            }
+        }
+    }
+}
+
+#if ARCH_X86_64
+TARGET_AVX512
+static void accumulate_row_avx512(struct PixelSum *tmp,
+                            const uint32_t *integral_ptr1,
+                            const uint32_t *integral_ptr2,
+                            const uint8_t  *compare,
+                                  int       n,
+                                  int       count,
+                            const float    *exptable,
+                                  float     weight_fact_table,
+                                  int       diff_max)
+{
+    const __m512  weight_fact = _mm512_set1_ps(weight_fact_table);
+    const __m512i max         = _mm512_set1_epi32(diff_max);
+    const __m512i order_lo    = _mm512_set_epi32(23, 22, 21, 20,  7,  6,  5,  4,
+                                                 19, 18, 17, 16,  3,  2,  1,  0);
+    const __m512i order_hi    = _mm512_set_epi32(31, 30, 29, 28, 15, 14, 13, 12,
+                                                 27, 26, 25, 24, 11, 10,  9,  8);
+    int x;
+
+    for (x = 0; x + 16 <= count; x += 16)
+    {
+        // Difference between patches
+        __m512i diff = _mm512_sub_epi32(_mm512_loadu_si512(integral_ptr2 + x + n),
+                                        _mm512_loadu_si512(integral_ptr2 + x));
+        diff = _mm512_sub_epi32(diff, _mm512_loadu_si512(integral_ptr1 + x + n));
+        diff = _mm512_add_epi32(diff, _mm512_loadu_si512(integral_ptr1 + x));
+
+        __mmask16 mask = _mm512_cmpgt_epi32_mask(max, diff);
+        if (mask == 0)
+        {
+            continue;
+        }
+
+        // Look up the weights of the patches that pass
+        __m512i diffidx = _mm512_cvttps_epi32(
+            _mm512_mul_ps(_mm512_cvtepi32_ps(diff), weight_fact));
+        __m512 weight = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), mask,
+                                                 diffidx, exptable, 4);
+        __m512 pixel = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(
+                            _mm_loadu_si128((const __m128i*)(compare + x))));
+        pixel = _mm512_mul_ps(weight, pixel);
+
+        // Interleave into PixelSums
+        __m512 lo = _mm512_unpacklo_ps(weight, pixel);
+        __m512 hi = _mm512_unpackhi_ps(weight, pixel);
+        float *sum = (float*)(tmp + x);
+
+        _mm512_storeu_ps(sum, _mm512_add_ps(_mm512_loadu_ps(sum),
+                                  _mm512_permutex2var_ps(lo, order_lo, hi)));
+        _mm512_storeu_ps(sum + 16, _mm512_add_ps(_mm512_loadu_ps(sum + 16),
+                                  _mm512_permutex2var_ps(lo, order_hi, hi)));
+    }
+
+    if (x < count)
+    {
+        nlmeans_c.accumulate_row(tmp + x, integral_ptr1 + x, integral_ptr2 + x,
+                                 compare + x, n, count - x, exptable,
+                                 weight_fact_table, diff_max);
+    }
+}
+#endif // ARCH_X86_64
+#endif // HB_X86_AVX512
+
 void nlmeans_init_x86(NLMeansFunctions *functions)
 {
-    if (av_get_cpu_flags() & AV_CPU_FLAG_SSE2)
+    int cpu_flags = av_get_cpu_flags();
+
+    // The C functions finish the rows
+    nlmeans_c = *functions;
+
+#if defined(HB_X86_AVX512)
+    if ((cpu_flags & AV_CPU_FLAG_AVX2) &&
+        (hb_get_cpu_flags() & HB_CPU_FLAG_AVX512F))
+    {
+        functions->build_integral = build_integral_avx512;
+#if ARCH_X86_64
+        functions->accumulate_row = accumulate_row_avx512;
+#endif
+        hb_log("NLMeans using AVX-512 optimizations");
+        return;
+    }
+#endif
+#if defined(HB_X86_AVX2)
+    if (cpu_flags & AV_CPU_FLAG_AVX2)
+    {
+        functions->build_integral = build_integral_avx2;
+#if ARCH_X86_64
+        functions->accumulate_row = accumulate_row_avx2;
+#endif
+        hb_log("NLMeans using AVX2 optimizations");
+        return;
+    }
+#endif
+    if (cpu_flags & AV_CPU_FLAG_SSE2)
     {
         functions->build_integral = build_integral_sse2;
         hb_log("NLMeans using SSE2 optimizations");
@@ -194,6 +194,21 @@ uint64_t hb_get_time_us()
 #endif
 }
 
+/* CPU time used by the calling thread.  Falls back to wall clock time
+ * where the platform can't tell. */
+uint64_t hb_get_thread_cpu_time_us()
+{
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+    {
+        return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+    }
+#endif
+    return hb_get_time_us();
+}
+
 /************************************************************************
  * hb_snooze()
  ************************************************************************
@@ -229,6 +244,7 @@ struct
         uint32_t buf4[12];
     };
     int count;
+    int flags;
 } hb_cpu_info;
 
 int hb_get_cpu_count()
@@ -241,6 +257,11 @@ int hb_get_cpu_platform()
     return hb_cpu_info.platform;
 }
 
+int hb_get_cpu_flags()
+{
+    return hb_cpu_info.flags;
+}
+
 const char* hb_get_cpu_name()
 {
     return hb_cpu_info.name;
@@ -288,6 +309,18 @@ const char* hb_get_cpu_platform_name()
         "xchg   %%"REG_b", %%"REG_S                             \
         : "=a" (*eax), "=S" (*ebx), "=c" (*ecx), "=d" (*edx)    \
         : "0" (index))
+#define cpuid_count(index, count, eax, ebx, ecx, edx)           \
+    __asm__ volatile (                                          \
+        "mov    %%"REG_b", %%"REG_S" \n\t"                      \
+        "cpuid                       \n\t"                      \
+        "xchg   %%"REG_b", %%"REG_S                             \
+        : "=a" (*eax), "=S" (*ebx), "=c" (*ecx), "=d" (*edx)    \
+        : "0" (index), "2" (count))
+#define xgetbv(index, eax, edx)                                 \
+    __asm__ volatile (                                          \
+        ".byte 0x0f, 0x01, 0xd0"                                \
+        : "=a" (*eax), "=d" (*edx)                              \
+        : "c" (index))
 #endif // ARCH_X86_64 || ARCH_X86_32
 
 static void init_cpu_info()
@@ -295,6 +328,7 @@ static void init_cpu_info()
     hb_cpu_info.name     = NULL;
     hb_cpu_info.count    = init_cpu_count();
     hb_cpu_info.platform = HB_CPU_PLATFORM_UNSPECIFIED;
+    hb_cpu_info.flags    = 0;
 
     if (av_get_cpu_flags() & AV_CPU_FLAG_SSE)
     {
@@ -358,6 +392,25 @@ static void init_cpu_info()
                 break;
         }
 
+        // Intel 64 and IA-32 Architectures Software Developer's Manual, Vol. 1
+        // 15.2: Detection of AVX-512 Foundation Instructions
+        // The OS must save the opmask and all of the ZMM registers (XCR0)
+        if ((ecx & (1 << 27)) && (av_get_cpu_flags() & AV_CPU_FLAG_AVX2))
+        {
+            int xcr0, xcr0_hi, max_leaf;
+
+            xgetbv(0, &xcr0, &xcr0_hi);
+            cpuid(0, &max_leaf, &ebx, &ecx, &edx);
+            if ((xcr0 & 0xe6) == 0xe6 && max_leaf >= 7)
+            {
+                cpuid_count(7, 0, &eax, &ebx, &ecx, &edx);
+                if (ebx & (1 << 16))
+                {
+                    hb_cpu_info.flags |= HB_CPU_FLAG_AVX512F;
+                }
+            }
+        }
+
         // Intel 64 and IA-32 Architectures Software Developer's Manual, Vol. 2A
         // Figure 3-8: Determination of Support for the Processor Brand String
         // Table 3-17: Information Returned by CPUID Instruction
@@ -40,8 +40,12 @@ enum hb_cpu_platform
     HB_CPU_PLATFORM_INTEL_BDW,
     HB_CPU_PLATFORM_INTEL_CHT,
 };
+// instruction sets libavutil's cpu flags don't report
+#define HB_CPU_FLAG_AVX512F 0x0001
+
 int         hb_get_cpu_count();
 int         hb_get_cpu_platform();
+int         hb_get_cpu_flags();
 const char* hb_get_cpu_name();
 const char* hb_get_cpu_platform_name();
 
@@ -52,6 +56,7 @@ const char* hb_get_cpu_platform_name();
 uint64_t hb_get_date();
 // provide time in us
 uint64_t hb_get_time_us();
+uint64_t hb_get_thread_cpu_time_us();
 
 void     hb_snooze( int delay );
 int      hb_platform_init();
@@ -0,0 +1,236 @@
+/* profile.c
+
+   Copyright (c) 2003-2015 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "hb.h"
+
+/*
+ * Pipeline profiler.
+ *
+ * do_job registers a stage for every work object, filter and the muxer
+ * of the running job.  The thread of each stage accounts the time it
+ * spends in work() and waiting on its fifos directly in its stage.
+ * Fifo occupancy is sampled periodically by hb_profile_sample(), which
+ * is driven from sync's progress updates.
+ *
+ * Only one job is profiled at a time.  do_job passes a NULL profile
+ * for the other jobs, which hb_profile_start(), hb_profile_add_stage()
+ * and hb_profile_stop() ignore.
+ */
+struct hb_profile_s
+{
+    hb_lock_t  * lock;
+    hb_list_t  * stages;
+    int          sampling;      // Fifos of the stages may be sampled
+    uint64_t     start_time;
+    uint64_t     last_sample;
+};
+
+hb_profile_t * hb_profile_init( void )
+{
+    hb_profile_t * p = calloc( 1, sizeof( hb_profile_t ) );
+    if( p == NULL )
+    {
+        return NULL;
+    }
+    p->lock   = hb_lock_init();
+    p->stages = hb_list_init();
+    return p;
+}
+
+static void profile_clear( hb_profile_t * p )
+{
+    hb_profile_stage_t * stage;
+
+    while( ( stage = hb_list_item( p->stages, 0 ) ) != NULL )
+    {
+        hb_list_rem( p->stages, stage );
+        free( stage );
+    }
+}
+
+void hb_profile_close( hb_profile_t ** _p )
+{
+    hb_profile_t * p = *_p;
+
+    if( p == NULL )
+    {
+        return;
+    }
+    profile_clear( p );
+    hb_list_close( &p->stages );
+    hb_lock_close( &p->lock );
+    free( p );
+    *_p = NULL;
+}
+
+/*
+ * Forget the stages of the previous job and start sampling.
+ */
+void hb_profile_start( hb_profile_t * p )
+{
+    if( p == NULL )
+    {
+        return;
+    }
+    hb_lock( p->lock );
+    profile_clear( p );
+    p->sampling    = 1;
+    p->start_time  = hb_get_time_us();
+    p->last_sample = 0;
+    hb_unlock( p->lock );
+}
+
+hb_profile_stage_t * hb_profile_add_stage( hb_profile_t * p, const char * name,
+                                           hb_fifo_t * fifo_in,
+                                           hb_fifo_t * fifo_out )
+{
+    hb_profile_stage_t * stage;
+
+    if( p == NULL || ( stage = calloc( 1, sizeof( hb_profile_stage_t ) ) ) == NULL )
+    {
+        return NULL;
+    }
+    snprintf( stage->name, sizeof( stage->name ), "%s", name );
+    stage->fifo_in  = fifo_in;
+    stage->fifo_out = fifo_out;
+
+    hb_lock( p->lock );
+    hb_list_add( p->stages, stage );
+    hb_unlock( p->lock );
+
+    return stage;
+}
+
+/*
+ * Sample the occupancy of all fifos of the running job.  Cheap to call
+ * often, a sample is only taken every HB_PROFILE_SAMPLE_INTERVAL.
+ */
+void hb_profile_sample( hb_profile_t * p )
+{
+    uint64_t now = hb_get_time_us();
+    int ii;
+
+    if( !p->sampling || now - p->last_sample < HB_PROFILE_SAMPLE_INTERVAL )
+    {
+        return;
+    }
+
+    hb_lock( p->lock );
+    if( p->sampling )
+    {
+        p->last_sample = now;
+        for( ii = 0; ii < hb_list_count( p->stages ); ii++ )
+        {
+            hb_profile_stage_t * stage = hb_list_item( p->stages, ii );
+            int size;
+
+            stage->samples++;
+            if( stage->fifo_in != NULL )
+            {
+                size = hb_fifo_size( stage->fifo_in );
+                stage->fifo_in_total += size;
+                if( size > stage->fifo_in_max )
+                    stage->fifo_in_max = size;
+            }
+            if( stage->fifo_out != NULL )
+            {
+                size = hb_fifo_size( stage->fifo_out );
+                stage->fifo_out_total += size;
+                if( size > stage->fifo_out_max )
+                    stage->fifo_out_max = size;
+            }
+        }
+    }
+    hb_unlock( p->lock );
+}
+
+/*
+ * Returns a copy of the current stage statistics in *stages, which the
+ * caller must free.  The number of stages is returned.
+ */
+int hb_profile_get_stages( hb_profile_t * p, hb_profile_stage_t ** stages )
+{
+    int ii, count;
+
+    hb_lock( p->lock );
+    count = hb_list_count( p->stages );
+    *stages = NULL;
+    if( count > 0 )
+    {
+        *stages = malloc( count * sizeof( hb_profile_stage_t ) );
+        if( *stages == NULL )
+        {
+            count = 0;
+        }
+        for( ii = 0; ii < count; ii++ )
+        {
+            (*stages)[ii] = *(hb_profile_stage_t*)hb_list_item( p->stages, ii );
+            (*stages)[ii].fifo_in  = NULL;
+            (*stages)[ii].fifo_out = NULL;
+        }
+    }
+    hb_unlock( p->lock );
+
+    return count;
+}
+
+/*
+ * Stop sampling and log a summary of the job.  Must be called before
+ * the fifos of the job are closed.  The statistics stay available until
+ * the next hb_profile_start().
+ */
+void hb_profile_stop( hb_profile_t * p )
+{
+    hb_profile_stage_t * busiest = NULL;
+    double elapsed;
+    int ii;
+
+    if( p == NULL )
+    {
+        return;
+    }
+    hb_lock( p->lock );
+    if( !p->sampling )
+    {
+        // No job was started since the last stop
+        hb_unlock( p->lock );
+        return;
+    }
+    p->sampling = 0;
+    elapsed = ( hb_get_time_us() - p->start_time ) / 1000000.;
+
+    hb_log( "profile: %d stages, %.2fs", hb_list_count( p->stages ), elapsed );
+    for( ii = 0; ii < hb_list_count( p->stages ); ii++ )
+    {
+        hb_profile_stage_t * stage = hb_list_item( p->stages, ii );
+
+        stage->fifo_in  = NULL;
+        stage->fifo_out = NULL;
+        if( busiest == NULL || stage->work_time > busiest->work_time )
+        {
+            busiest = stage;
+        }
+        hb_log( "profile: %-24s %8"PRId64" buffers, cpu %.2fs, busy %.2fs, "
+                "starved %.2fs, blocked %.2fs, fifo in %.1f (max %d), "
+                "fifo out %.1f (max %d)",
+                stage->name, stage->buffers,
+                stage->cpu_time / 1000000., stage->work_time / 1000000.,
+                stage->wait_in_time / 1000000., stage->wait_out_time / 1000000.,
+                stage->samples ? (double)stage->fifo_in_total / stage->samples : 0.,
+                stage->fifo_in_max,
+                stage->samples ? (double)stage->fifo_out_total / stage->samples : 0.,
+                stage->fifo_out_max );
+    }
+    if( busiest != NULL && elapsed > 0 )
+    {
+        hb_log( "profile: busiest stage '%s', %.0f%% of the job",
+                busiest->name, 100. * busiest->work_time / 1000000. / elapsed );
+    }
+    hb_unlock( p->lock );
+}
@@ -453,6 +453,30 @@ void ReadLoop( void * _w )
                         ( r->job->seek_points ? ( r->job->seek_points + 1.0 ) : 11.0 ) );
 
     } 
+    else if ( r->stream && r->job->segment != NULL &&
+              r->job->segment_index > 0 )
+    {
+        /*
+         * Segment of a segmented encode (see segment.c).  Timestamps are
+         * taken on the clock of the job's reader, so seek relative to
+         * the first timestamp of the stream to just before the segment.
+         * sync drops the frames before job->pts_to_start.
+         */
+        hb_chapter_t *chap = hb_list_item( r->job->list_chapter, chapter_end - 1 );
+        int64_t pts_to_seek = hb_segment_seek( r->job );
+
+        chapter_end = chap->index;
+        if ( ( buf = hb_stream_read( r->stream ) ) )
+        {
+            if (buf->s.start != AV_NOPTS_VALUE)
+            {
+                pts_to_seek -= buf->s.start;
+            }
+            hb_buffer_close(&buf);
+        }
+        hb_stream_seek_ts( r->stream, MAX( 0, pts_to_seek ) );
+        r->start_found = 1;
+    }
     else if ( r->stream && r->job->pts_to_start )
     {
         int64_t pts_to_start = r->job->pts_to_start;
@@ -478,9 +502,10 @@ void ReadLoop( void * _w )
             r->job->pts_to_start = pts_to_start;
             hb_buffer_close(&buf);
         }
-        // hb_stream_seek_ts does nothing for TS streams and will return
-        // an error.  In this case, the current buf remains valid and
-        // gets processed below.
+        // hb_stream_seek_ts does nothing for program streams and fails
+        // for transport streams whose timestamps aren't increasing, and
+        // will return an error.  In this case, the current buf remains
+        // valid and gets processed below.
     } 
     else if( r->stream )
     {
@@ -621,6 +646,12 @@ void ReadLoop( void * _w )
                         {
                             new_scr_offset( r, buf );
                             r->sub_scr_set = 0;
+                            if ( r->job->segment != NULL )
+                            {
+                                // All segments run on one clock
+                                r->scr_offset = hb_segment_zero( r->job,
+                                                          r->scr_offset );
+                            }
                         }
                         else
                         {
@@ -724,6 +755,14 @@ void ReadLoop( void * _w )
                     hb_buffer_close( &buf );
                     continue;
                 }
+                if ( r->job->segment != NULL && r->job->segment_index == 0 &&
+                     !hb_segment_pace( r->job, buf->s.start,
+                                       is_audio( r, buf->s.id ) ) )
+                {
+                    // The video of the job is done
+                    hb_buffer_close( &buf );
+                    continue;
+                }
 
                 buf->sequence = r->sequence++;
                 /* if there are mutiple output fifos, send a copy of the
@@ -765,6 +804,11 @@ void ReadLoop( void * _w )
             if ( subtitle->fifo_in && subtitle->source == VOBSUB)
                 push_buf( r, subtitle->fifo_in, hb_buffer_init(0) );
         }
+        for( n = 0; (subtitle = hb_list_item( r->job->list_subtitle_search, n)); ++n )
+        {
+            if ( subtitle->fifo_in && subtitle->source == VOBSUB)
+                push_buf( r, subtitle->fifo_in, hb_buffer_init(0) );
+        }
     }
 
     hb_list_empty( &list );
@@ -788,7 +832,7 @@ static void UpdateState( hb_work_private_t  * r, int64_t start)
         r->st_first = now;
     }
 
-    hb_get_state2(r->job->h, &state);
+    hb_get_job_state(r->job, &state);
 #define p state.param.working
     if ( !r->job->indepth_scan )
     {
@@ -827,7 +871,7 @@ static void UpdateState( hb_work_private_t  * r, int64_t start)
     }
 #undef p
 
-    hb_set_state( r->job->h, &state );
+    hb_set_job_state( r->job, &state );
 }
 /***********************************************************************
  * GetFifoForId
@@ -875,6 +919,16 @@ static hb_fifo_t ** GetFifoForId( hb_work_private_t * r, int id )
             r->fifos[n++] = subtitle->fifo_in;
         }
     }
+    /* and the subtitles the Foreign Audio Search counts in this pass */
+    count = hb_list_count( job->list_subtitle_search );
+    for( i = 0; i < count && n < 99; i++ )
+    {
+        subtitle =  hb_list_item( job->list_subtitle_search, i );
+        if (id == subtitle->id)
+        {
+            r->fifos[n++] = subtitle->fifo_in;
+        }
+    }
     if ( n != 0 )
     {
         return r->fifos;
@@ -9,14 +9,49 @@
 
 #include "hb.h"
 #include "hbffmpeg.h"
+#include "taskset.h"
+#include "rendersub.h"
 #include <ass/ass.h>
 
+// Overlays at least this many pixels are blended by several threads
+#define BLEND_THREAD_PIXELS     (256 * 256)
+
+typedef struct
+{
+    hb_buffer_t     * sub;
+    int             * span;     // First and end opaque column of each row
+} rendersub_span_t;
+
+typedef struct
+{
+    hb_buffer_t     * dst;
+    hb_buffer_t     * src;
+    const int       * span;
+    int               left;
+    int               top;
+    int               x0, y0;
+    int               ww, hh;
+} rendersub_blend_t;
+
+typedef struct
+{
+    hb_filter_private_t * pv;
+    int                   segment;
+} rendersub_thread_arg_t;
+
 struct hb_filter_private_s
 {
     // Common
     int               crop[4];
     int               type;
 
+    // Blending
+    RenderSubFunctions functions;
+    hb_list_t       * span_list;    // Opaque spans of the active subs
+    taskslices_t      blend_taskset;
+    int               blend_slices;
+    rendersub_blend_t blend;        // Overlay being blended by blend_taskset
+
     // VOBSUB
     hb_list_t       * sub_list; // List of active subs
 
@@ -96,52 +131,164 @@ hb_filter_object_t hb_filter_render_sub =
     .close         = hb_rendersub_close,
 };
 
-static void blend( hb_buffer_t *dst, hb_buffer_t *src, int left, int top )
+static void blend_row_c( uint8_t *dst, const uint8_t *src,
+                         const uint8_t *alpha, int w )
 {
-    int xx, yy;
-    int ww, hh;
-    int x0, y0;
-    uint8_t *y_in, *y_out;
-    uint8_t *u_in, *u_out;
-    uint8_t *v_in, *v_out;
-    uint8_t *a_in, alpha;
+    int xx;
 
-    x0 = y0 = 0;
-    if( left < 0 )
+    for( xx = 0; xx < w; xx++ )
     {
-        x0 = -left;
+        /*
+         * Merge the luminance and alpha with the picture
+         */
+        dst[xx] = ( (uint16_t)dst[xx] * ( 255 - alpha[xx] ) +
+                    (uint16_t)src[xx] * alpha[xx] ) / 255;
     }
-    if( top < 0 )
+}
+
+static void blend_row_x2_c( uint8_t *dst, const uint8_t *src,
+                            const uint8_t *alpha, int w )
+{
+    int xx;
+
+    for( xx = 0; xx < w; xx++ )
+    {
+        dst[xx] = ( (uint16_t)dst[xx] * ( 255 - alpha[xx << 1] ) +
+                    (uint16_t)src[xx] * alpha[xx << 1] ) / 255;
+    }
+}
+
+static void ssa_alpha_row_c( uint8_t *alpha, const uint8_t *bitmap,
+                             unsigned opacity, int w )
+{
+    int xx;
+
+    for( xx = 0; xx < w; xx++ )
+    {
+        alpha[xx] = opacity * bitmap[xx] >> 8;
+    }
+}
+
+/*
+ * Finds the first and end column of the non-transparent pixels of each
+ * row of a subtitle.  Pixels with alpha 0 leave the picture unchanged,
+ * so blending only needs to look at the columns in between.
+ */
+static int * span_find( hb_buffer_t * sub )
+{
+    int   * span;
+    int     xx, yy;
+
+    span = malloc( 2 * sub->f.height * sizeof(int) );
+    if( span == NULL )
+    {
+        return NULL;
+    }
+    for( yy = 0; yy < sub->f.height; yy++ )
+    {
+        const uint8_t * a = sub->plane[3].data + yy * sub->plane[3].stride;
+        int first = 0, end = sub->f.width;
+
+        while( first < end && a[first] == 0 )
+            first++;
+        while( end > first && a[end - 1] == 0 )
+            end--;
+        span[2 * yy]     = first;
+        span[2 * yy + 1] = end;
+    }
+    return span;
+}
+
+// Spans are found once per subtitle and kept until the subtitle is closed
+static const int * span_get( hb_filter_private_t * pv, hb_buffer_t * sub )
+{
+    rendersub_span_t * entry;
+    int ii;
+
+    for( ii = 0; ii < hb_list_count( pv->span_list ); ii++ )
     {
-        y0 = -top;
+        entry = hb_list_item( pv->span_list, ii );
+        if( entry->sub == sub )
+        {
+            return entry->span;
+        }
     }
 
-    ww = src->f.width;
-    if( src->f.width - x0 > dst->f.width - left )
+    entry = calloc( 1, sizeof(rendersub_span_t) );
+    if( entry == NULL )
     {
-        ww = dst->f.width - left + x0;
+        return NULL;
     }
-    hh = src->f.height;
-    if( src->f.height - y0 > dst->f.height - top )
+    entry->span = span_find( sub );
+    if( entry->span == NULL )
     {
-        hh = dst->f.height - top + y0;
+        free( entry );
+        return NULL;
     }
+    entry->sub = sub;
+    hb_list_add( pv->span_list, entry );
+    return entry->span;
+}
+
+static void span_drop( hb_filter_private_t * pv, hb_buffer_t * sub )
+{
+    rendersub_span_t * entry;
+    int ii;
+
+    if( sub == NULL )
+    {
+        return;
+    }
+    for( ii = 0; ii < hb_list_count( pv->span_list ); ii++ )
+    {
+        entry = hb_list_item( pv->span_list, ii );
+        if( entry->sub == sub )
+        {
+            hb_list_rem( pv->span_list, entry );
+            free( entry->span );
+            free( entry );
+            break;
+        }
+    }
+    span_drop( pv, sub->next );
+    span_drop( pv, sub->sub );
+}
+
+static void sub_close( hb_filter_private_t * pv, hb_buffer_t ** _sub )
+{
+    span_drop( pv, *_sub );
+    hb_buffer_close( _sub );
+}
+
+static void blend_rows( const RenderSubFunctions * functions,
+                        const rendersub_blend_t * b, int y_start, int y_end )
+{
+    hb_buffer_t * dst = b->dst;
+    hb_buffer_t * src = b->src;
+    int xx, yy, end;
+    uint8_t *y_in, *y_out;
+    uint8_t *u_in, *u_out;
+    uint8_t *v_in, *v_out;
+    uint8_t *a_in;
+
     // Blend luma
-    for( yy = y0; yy < hh; yy++ )
+    for( yy = y_start; yy < y_end; yy++ )
     {
-        y_in   = src->plane[0].data + yy * src->plane[0].stride;
-        y_out   = dst->plane[0].data + ( yy + top ) * dst->plane[0].stride;
-        a_in = src->plane[3].data + yy * src->plane[3].stride;
-        for( xx = x0; xx < ww; xx++ )
+        xx  = b->x0;
+        end = b->ww;
+        if( b->span != NULL )
         {
-            alpha = a_in[xx];
-            /*
-             * Merge the luminance and alpha with the picture
-             */
-            y_out[left + xx] =
-                ( (uint16_t)y_out[left + xx] * ( 255 - alpha ) +
-                     (uint16_t)y_in[xx] * alpha ) / 255;
+            xx  = MAX( xx, b->span[2 * yy] );
+            end = MIN( end, b->span[2 * yy + 1] );
         }
+        if( xx >= end )
+            continue;
+
+        y_in  = src->plane[0].data + yy * src->plane[0].stride;
+        y_out = dst->plane[0].data + ( yy + b->top ) * dst->plane[0].stride;
+        a_in  = src->plane[3].data + yy * src->plane[3].stride;
+        functions->blend_row( y_out + b->left + xx, y_in + xx, a_in + xx,
+                              end - xx );
     }
 
     // Blend U & V
@@ -153,28 +300,125 @@ static void blend( hb_buffer_t *dst, hb_buffer_t *src, int left, int top )
     if( dst->plane[1].width < dst->plane[0].width )
         wshift = 1;
 
-    for( yy = y0 >> hshift; yy < hh >> hshift; yy++ )
+    for( yy = y_start >> hshift; yy < y_end >> hshift; yy++ )
     {
+        xx  = b->x0 >> wshift;
+        end = b->ww >> wshift;
+        if( b->span != NULL )
+        {
+            // Chroma pixel xx takes the alpha of luma column xx << wshift
+            const int * span = b->span + 2 * ( yy << hshift );
+            xx  = MAX( xx, ( span[0] + wshift ) >> wshift );
+            end = MIN( end, ( span[1] + wshift ) >> wshift );
+        }
+        if( xx >= end )
+            continue;
+
         u_in = src->plane[1].data + yy * src->plane[1].stride;
-        u_out = dst->plane[1].data + ( yy + ( top >> hshift ) ) * dst->plane[1].stride;
+        u_out = dst->plane[1].data + ( yy + ( b->top >> hshift ) ) * dst->plane[1].stride;
         v_in = src->plane[2].data + yy * src->plane[2].stride;
-        v_out = dst->plane[2].data + ( yy + ( top >> hshift ) ) * dst->plane[2].stride;
+        v_out = dst->plane[2].data + ( yy + ( b->top >> hshift ) ) * dst->plane[2].stride;
         a_in = src->plane[3].data + ( yy << hshift ) * src->plane[3].stride;
 
-        for( xx = x0 >> wshift; xx < ww >> wshift; xx++ )
+        u_out += ( b->left >> wshift ) + xx;
+        v_out += ( b->left >> wshift ) + xx;
+        if( wshift )
         {
-            alpha = a_in[xx << wshift];
+            functions->blend_row_x2( u_out, u_in + xx, a_in + ( xx << 1 ), end - xx );
+            functions->blend_row_x2( v_out, v_in + xx, a_in + ( xx << 1 ), end - xx );
+        }
+        else
+        {
+            functions->blend_row( u_out, u_in + xx, a_in + xx, end - xx );
+            functions->blend_row( v_out, v_in + xx, a_in + xx, end - xx );
+        }
+    }
+}
 
-            // Blend averge U and alpha
-            u_out[(left >> wshift) + xx] =
-                ( (uint16_t)u_out[(left >> wshift) + xx] * ( 255 - alpha ) +
-                  (uint16_t)u_in[xx] * alpha ) / 255;
+/*
+ * Each slice blends a range of overlay rows.  The chroma rows of
+ * consecutive ranges, y_start >> hshift to y_end >> hshift, do not
+ * overlap either, so no two slices write the same row.
+ */
+static void blend_thread( void * thread_args_v )
+{
+    rendersub_thread_arg_t * thread_args = thread_args_v;
+    hb_filter_private_t    * pv = thread_args->pv;
+    const rendersub_blend_t * b = &pv->blend;
+    int64_t rows  = b->hh - b->y0;
+    int     count = pv->blend_slices;
+    int     ii    = thread_args->segment;
+
+    blend_rows( &pv->functions, b, b->y0 + rows * ii / count,
+                                   b->y0 + rows * ( ii + 1 ) / count );
+}
 
-            // Blend V and alpha
-            v_out[(left >> wshift) + xx] =
-                ( (uint16_t)v_out[(left >> wshift) + xx] * ( 255 - alpha ) +
-                  (uint16_t)v_in[xx] * alpha ) / 255;
+static void blend( hb_filter_private_t * pv, hb_buffer_t *dst,
+                   hb_buffer_t *src, const int *span, int left, int top )
+{
+    rendersub_blend_t b;
+
+    b.dst  = dst;
+    b.src  = src;
+    b.span = span;
+    b.left = left;
+    b.top  = top;
+
+    b.x0 = b.y0 = 0;
+    if( left < 0 )
+    {
+        b.x0 = -left;
+    }
+    if( top < 0 )
+    {
+        b.y0 = -top;
+    }
+
+    b.ww = src->f.width;
+    if( src->f.width - b.x0 > dst->f.width - left )
+    {
+        b.ww = dst->f.width - left + b.x0;
+    }
+    b.hh = src->f.height;
+    if( src->f.height - b.y0 > dst->f.height - top )
+    {
+        b.hh = dst->f.height - top + b.y0;
+    }
+    if( b.ww <= b.x0 || b.hh <= b.y0 )
+    {
+        return;
+    }
+
+    if( pv->blend_slices > 1 &&
+        ( b.ww - b.x0 ) * ( b.hh - b.y0 ) >= BLEND_THREAD_PIXELS )
+    {
+        pv->blend = b;
+        taskslices_cycle( &pv->blend_taskset );
+    }
+    else
+    {
+        blend_rows( &pv->functions, &b, b.y0, b.hh );
+    }
+}
+
+static void blend_close( hb_filter_private_t * pv )
+{
+    rendersub_span_t * entry;
+
+    if( pv->span_list )
+    {
+        while( ( entry = hb_list_item( pv->span_list, 0 ) ) )
+        {
+            hb_list_rem( pv->span_list, entry );
+            free( entry->span );
+            free( entry );
         }
+        hb_list_close( &pv->span_list );
+    }
+    if( pv->blend_slices > 0 )
+    {
+        taskslices_fini( &pv->blend_taskset );
+        pv->blend_slices = 0;
     }
 }
 
@@ -259,7 +503,7 @@ static void ApplySub( hb_filter_private_t * pv, hb_buffer_t * buf, hb_buffer_t *
         left = sub->f.x;
     }
 
-    blend( buf, sub, left, top );
+    blend( pv, buf, sub, pv->ssa ? NULL : span_get( pv, sub ), left, top );
 }
 
 // Assumes that the input buffer has the same dimensions
@@ -282,7 +526,7 @@ static void ApplyVOBSubs( hb_filter_private_t * pv, hb_buffer_t * buf )
         {
             // Subtitle stop is in the past, delete it
             hb_list_rem( pv->sub_list, sub );
-            hb_buffer_close( &sub );
+            sub_close( pv, &sub );
         }
         else if( sub->s.start <= buf->s.start )
         {
@@ -357,22 +601,10 @@ static int vobsub_work( hb_filter_object_t * filter,
     return HB_FILTER_OK;
 }
 
-static uint8_t ssaAlpha( ASS_Image *frame, int x, int y )
-{
-    unsigned frameA = ( frame->color ) & 0xff;
-    unsigned gliphA = frame->bitmap[y*frame->stride + x];
-
-    // Alpha for this pixel is the frame opacity (255 - frameA)
-    // multiplied by the gliph alfa (gliphA) for this pixel
-    unsigned alpha = (255 - frameA) * gliphA >> 8;
-
-    return (uint8_t)alpha;
-}
-
 static hb_buffer_t * RenderSSAFrame( hb_filter_private_t * pv, ASS_Image * frame )
 {
     hb_buffer_t *sub;
-    int xx, yy;
+    int yy;
 
     unsigned r = ( frame->color >> 24 ) & 0xff;
     unsigned g = ( frame->color >> 16 ) & 0xff;
@@ -384,6 +616,11 @@ static hb_buffer_t * RenderSSAFrame( hb_filter_private_t * pv, ASS_Image * frame
     unsigned frameV = (yuv >> 8 ) & 0xff;
     unsigned frameU = (yuv >> 0 ) & 0xff;
 
+    // Alpha for each pixel is the frame opacity (255 - frameA)
+    // multiplied by the gliph alpha for the pixel
+    unsigned frameA = ( frame->color ) & 0xff;
+    unsigned opacity = 255 - frameA;
+
     sub = hb_frame_buffer_init( AV_PIX_FMT_YUVA420P, frame->w, frame->h );
     if( sub == NULL )
         return NULL;
@@ -396,16 +633,14 @@ static hb_buffer_t * RenderSSAFrame( hb_filter_private_t * pv, ASS_Image * frame
 
     for( yy = 0; yy < frame->h; yy++ )
     {
-        for( xx = 0; xx < frame->w; xx++ )
+        memset( y_out, frameY, frame->w );
+        if( ( yy & 1 ) == 0 )
         {
-            y_out[xx] = frameY;
-            if( ( yy & 1 ) == 0 )
-            {
-                u_out[xx>>1] = frameU;
-                v_out[xx>>1] = frameV;
-            }
-            a_out[xx] = ssaAlpha( frame, xx, yy );;
+            memset( u_out, frameU, ( frame->w + 1 ) >> 1 );
+            memset( v_out, frameV, ( frame->w + 1 ) >> 1 );
         }
+        pv->functions.ssa_alpha_row( a_out, frame->bitmap + yy * frame->stride,
+                                     opacity, frame->w );
         y_out += sub->plane[0].stride;
         if( ( yy & 1 ) == 0 )
         {
@@ -749,7 +984,7 @@ static void ApplyPGSSubs( hb_filter_private_t * pv, hb_buffer_t * buf )
             {
                 old_sub = hb_list_item( pv->sub_list, index - 1);
                 hb_list_rem( pv->sub_list, old_sub );
-                hb_buffer_close( &old_sub );
+                sub_close( pv, &old_sub );
                 index--;
             }
         }
@@ -765,7 +1000,7 @@ static void ApplyPGSSubs( hb_filter_private_t * pv, hb_buffer_t * buf )
             break;
 
         hb_list_rem( pv->sub_list, sub );
-        hb_buffer_close( &sub );
+        sub_close( pv, &sub );
     }
 
     // Check to see if there's an active subtitle, and apply it.
@@ -862,6 +1097,36 @@ static int hb_rendersub_init( hb_filter_object_t * filter,
         hb_log("rendersub: no subtitle marked for burn");
         return 1;
     }
+
+    pv->functions.blend_row     = blend_row_c;
+    pv->functions.blend_row_x2  = blend_row_x2_c;
+    pv->functions.ssa_alpha_row = ssa_alpha_row_c;
+#if defined(ARCH_X86)
+    rendersub_init_x86( &pv->functions );
+#endif
+
+    pv->span_list = hb_list_init();
+
+    int slices = hb_get_cpu_count();
+    if( slices > 1 )
+    {
+        if( taskslices_init( &pv->blend_taskset, hb_get_taskpool( init->job->h ),
+                             slices, sizeof( rendersub_thread_arg_t ),
+                             blend_thread ) == 0 )
+        {
+            hb_error( "rendersub could not initialize taskset" );
+            return 1;
+        }
+        pv->blend_slices = slices;
+        for( ii = 0; ii < slices; ii++ )
+        {
+            rendersub_thread_arg_t *thread_args;
+
+            thread_args = taskslices_args( &pv->blend_taskset, ii );
+            thread_args->pv = pv;
+            thread_args->segment = ii;
+        }
+    }
     return 0;
 }
 
@@ -953,6 +1218,11 @@ static int hb_rendersub_work( hb_filter_object_t * filter,
 static void hb_rendersub_close( hb_filter_object_t * filter )
 {
     hb_filter_private_t * pv = filter->private_data;
+
+    // The subs still in pv->sub_list are closed with pv, after their
+    // spans are gone
+    blend_close( pv );
+
     switch( pv->type )
     {
         case VOBSUB:
@@ -0,0 +1,32 @@
+/* rendersub.h
+
+   Copyright (c) 2003-2015 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+typedef struct
+{
+    // dst[x] = (dst[x] * (255 - alpha[x]) + src[x] * alpha[x]) / 255
+    void (*blend_row)(uint8_t       *dst,
+                      const uint8_t *src,
+                      const uint8_t *alpha,
+                      int            w);
+
+    // Same as blend_row with the alpha of every other pixel, alpha[2 * x],
+    // for chroma planes that are subsampled horizontally
+    void (*blend_row_x2)(uint8_t       *dst,
+                         const uint8_t *src,
+                         const uint8_t *alpha,
+                         int            w);
+
+    // alpha[x] = opacity * bitmap[x] >> 8
+    void (*ssa_alpha_row)(uint8_t       *alpha,
+                          const uint8_t *bitmap,
+                          unsigned       opacity,
+                          int            w);
+} RenderSubFunctions;
+
+void rendersub_init_x86(RenderSubFunctions *functions);
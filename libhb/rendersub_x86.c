@@ -0,0 +1,218 @@
+/* rendersub_x86.c
+
+   Copyright (c) 2003-2015 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "hb.h"     // needed for ARCH_X86
+
+#if defined(ARCH_X86)
+
+#include <emmintrin.h>
+
+#include "libavutil/cpu.h"
+#include "x86_target.h"
+#include "rendersub.h"
+
+/*
+ * The kernels compute exactly what the scalar code in rendersub.c does.
+ * dst * (255 - alpha) + src * alpha is at most 255 * 255 and fits in an
+ * unsigned 16 bit lane, and for such values v / 255 == v * 0x8081 >> 23,
+ * which is a high multiply and a shift.  The pixels past the last whole
+ * vector are left to the scalar loops.
+ */
+static void blend_row_tail(uint8_t *dst, const uint8_t *src,
+                           const uint8_t *alpha, int step, int w)
+{
+    int x;
+
+    for (x = 0; x < w; x++)
+    {
+        unsigned a = alpha[x * step];
+        dst[x] = (dst[x] * (255 - a) + src[x] * a) / 255;
+    }
+}
+
+static inline __m128i blend_epi16_sse2(__m128i d, __m128i s, __m128i a)
+{
+    const __m128i c255 = _mm_set1_epi16(255);
+    const __m128i div  = _mm_set1_epi16((short)0x8081);
+    __m128i v;
+
+    v = _mm_add_epi16(_mm_mullo_epi16(d, _mm_sub_epi16(c255, a)),
+                      _mm_mullo_epi16(s, a));
+    return _mm_srli_epi16(_mm_mulhi_epu16(v, div), 7);
+}
+
+static void blend_row_sse2(uint8_t *dst, const uint8_t *src,
+                           const uint8_t *alpha, int w)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int x;
+
+    for (x = 0; x + 16 <= w; x += 16)
+    {
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + x));
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + x));
+        __m128i a = _mm_loadu_si128((const __m128i*)(alpha + x));
+        __m128i lo, hi;
+
+        lo = blend_epi16_sse2(_mm_unpacklo_epi8(d, zero),
+                              _mm_unpacklo_epi8(s, zero),
+                              _mm_unpacklo_epi8(a, zero));
+        hi = blend_epi16_sse2(_mm_unpackhi_epi8(d, zero),
+                              _mm_unpackhi_epi8(s, zero),
+                              _mm_unpackhi_epi8(a, zero));
+        _mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(lo, hi));
+    }
+    blend_row_tail(dst + x, src + x, alpha + x, 1, w - x);
+}
+
+static void blend_row_x2_sse2(uint8_t *dst, const uint8_t *src,
+                              const uint8_t *alpha, int w)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i even = _mm_set1_epi16(0xff);
+    int x;
+
+    for (x = 0; x + 16 <= w; x += 16)
+    {
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + x));
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + x));
+        __m128i a0 = _mm_loadu_si128((const __m128i*)(alpha + 2 * x));
+        __m128i a1 = _mm_loadu_si128((const __m128i*)(alpha + 2 * x + 16));
+        __m128i lo, hi;
+
+        lo = blend_epi16_sse2(_mm_unpacklo_epi8(d, zero),
+                              _mm_unpacklo_epi8(s, zero),
+                              _mm_and_si128(a0, even));
+        hi = blend_epi16_sse2(_mm_unpackhi_epi8(d, zero),
+                              _mm_unpackhi_epi8(s, zero),
+                              _mm_and_si128(a1, even));
+        _mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(lo, hi));
+    }
+    blend_row_tail(dst + x, src + x, alpha + 2 * x, 2, w - x);
+}
+
+static void ssa_alpha_row_sse2(uint8_t *alpha, const uint8_t *bitmap,
+                               unsigned opacity, int w)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i o    = _mm_set1_epi16(opacity);
+    int x;
+
+    for (x = 0; x + 16 <= w; x += 16)
+    {
+        __m128i b = _mm_loadu_si128((const __m128i*)(bitmap + x));
+        __m128i lo, hi;
+
+        lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), o), 8);
+        hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), o), 8);
+        _mm_storeu_si128((__m128i*)(alpha + x), _mm_packus_epi16(lo, hi));
+    }
+    for (; x < w; x++)
+    {
+        alpha[x] = opacity * bitmap[x] >> 8;
+    }
+}
+
+#if defined(HB_X86_AVX2)
+TARGET_AVX2
+static inline __m256i blend_epi16_avx2(__m256i d, __m256i s, __m256i a)
+{
+    const __m256i c255 = _mm256_set1_epi16(255);
+    const __m256i div  = _mm256_set1_epi16((short)0x8081);
+    __m256i v;
+
+    v = _mm256_add_epi16(_mm256_mullo_epi16(d, _mm256_sub_epi16(c255, a)),
+                         _mm256_mullo_epi16(s, a));
+    return _mm256_srli_epi16(_mm256_mulhi_epu16(v, div), 7);
+}
+
+TARGET_AVX2
+static void blend_row_avx2(uint8_t *dst, const uint8_t *src,
+                           const uint8_t *alpha, int w)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    int x;
+
+    for (x = 0; x + 32 <= w; x += 32)
+    {
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dst + x));
+        __m256i s = _mm256_loadu_si256((const __m256i*)(src + x));
+        __m256i a = _mm256_loadu_si256((const __m256i*)(alpha + x));
+        __m256i lo, hi;
+
+        // Unpacking and packing both work within 128 bit lanes, so the
+        // pixels come out in order
+        lo = blend_epi16_avx2(_mm256_unpacklo_epi8(d, zero),
+                              _mm256_unpacklo_epi8(s, zero),
+                              _mm256_unpacklo_epi8(a, zero));
+        hi = blend_epi16_avx2(_mm256_unpackhi_epi8(d, zero),
+                              _mm256_unpackhi_epi8(s, zero),
+                              _mm256_unpackhi_epi8(a, zero));
+        _mm256_storeu_si256((__m256i*)(dst + x), _mm256_packus_epi16(lo, hi));
+    }
+    blend_row_sse2(dst + x, src + x, alpha + x, w - x);
+}
+
+TARGET_AVX2
+static void blend_row_x2_avx2(uint8_t *dst, const uint8_t *src,
+                              const uint8_t *alpha, int w)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i even = _mm256_set1_epi16(0xff);
+    int x;
+
+    for (x = 0; x + 32 <= w; x += 32)
+    {
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dst + x));
+        __m256i s = _mm256_loadu_si256((const __m256i*)(src + x));
+        // alpha of pixels 0-15 and 16-31
+        __m256i a0 = _mm256_and_si256(
+            _mm256_loadu_si256((const __m256i*)(alpha + 2 * x)), even);
+        __m256i a1 = _mm256_and_si256(
+            _mm256_loadu_si256((const __m256i*)(alpha + 2 * x + 32)), even);
+        __m256i lo, hi;
+
+        // Unpacking works within 128 bit lanes, so the low halves hold
+        // pixels 0-7 and 16-23, the high halves 8-15 and 24-31
+        lo = blend_epi16_avx2(_mm256_unpacklo_epi8(d, zero),
+                              _mm256_unpacklo_epi8(s, zero),
+                              _mm256_permute2x128_si256(a0, a1, 0x20));
+        hi = blend_epi16_avx2(_mm256_unpackhi_epi8(d, zero),
+                              _mm256_unpackhi_epi8(s, zero),
+                              _mm256_permute2x128_si256(a0, a1, 0x31));
+        _mm256_storeu_si256((__m256i*)(dst + x), _mm256_packus_epi16(lo, hi));
+    }
+    blend_row_x2_sse2(dst + x, src + x, alpha + 2 * x, w - x);
+}
+#endif // HB_X86_AVX2
+
+void rendersub_init_x86(RenderSubFunctions *functions)
+{
+    int cpu_flags = av_get_cpu_flags();
+
+#if defined(HB_X86_AVX2)
+    if (cpu_flags & AV_CPU_FLAG_AVX2)
+    {
+        functions->blend_row     = blend_row_avx2;
+        functions->blend_row_x2  = blend_row_x2_avx2;
+        functions->ssa_alpha_row = ssa_alpha_row_sse2;
+        hb_log("Subtitle renderer using AVX2 optimizations");
+        return;
+    }
+#endif
+    if (cpu_flags & AV_CPU_FLAG_SSE2)
+    {
+        functions->blend_row     = blend_row_sse2;
+        functions->blend_row_x2  = blend_row_x2_sse2;
+        functions->ssa_alpha_row = ssa_alpha_row_sse2;
+        hb_log("Subtitle renderer using SSE2 optimizations");
+    }
+}
+
+#endif // ARCH_X86
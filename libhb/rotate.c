@@ -30,7 +30,7 @@ struct hb_filter_private_s
 
     int              cpu_count;
 
-    taskset_t         rotate_taskset;        // Threads for Rotate - one per CPU
+    taskslices_t      rotate_taskset;        // Slices for Rotate - one per CPU
     rotate_arguments_t *rotate_arguments;     // Arguments to thread for work
 };
 
@@ -55,7 +55,8 @@ hb_filter_object_t hb_filter_rotate =
     .init          = hb_rotate_init,
     .work          = hb_rotate_work,
     .close         = hb_rotate_close,
-    .info          = hb_rotate_info
+    .info          = hb_rotate_info,
+    .frame_threaded = 1,
 };
 
 
@@ -65,13 +66,12 @@ typedef struct rotate_thread_arg_s {
 } rotate_thread_arg_t;
 
 /*
- * rotate this segment of all three planes in a single thread.
+ * rotate this segment of all three planes in a single slice.
  */
-void rotate_filter_thread( void *thread_args_v )
+static void rotate_filter_slice( void *thread_args_v )
 {
     rotate_arguments_t *rotate_work = NULL;
     hb_filter_private_t * pv;
-    int run = 1;
     int plane;
     int segment, segment_start, segment_stop;
     rotate_thread_arg_t *thread_args = thread_args_v;
@@ -84,98 +84,72 @@ void rotate_filter_thread( void *thread_args_v )
     pv = thread_args->pv;
     segment = thread_args->segment;
 
-    hb_log("Rotate thread started for segment %d", segment);
+    rotate_work = &pv->rotate_arguments[segment];
+    if( rotate_work->dst == NULL )
+    {
+        hb_error( "Thread started when no work available" );
+        return;
+    }
 
-    while( run )
+    /*
+     * Process all three planes, but only this segment of it.
+     */
+    dst_buf = rotate_work->dst;
+    src_buf = rotate_work->src;
+    for( plane = 0; plane < 3; plane++)
     {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->rotate_taskset, segment );
+        int dst_stride, src_stride;
+
+        dst = dst_buf->plane[plane].data;
+        dst_stride = dst_buf->plane[plane].stride;
+        src_stride = src_buf->plane[plane].stride;
 
-        if( taskset_thread_stop( &pv->rotate_taskset, segment ) )
+        int h = src_buf->plane[plane].height;
+        int w = src_buf->plane[plane].width;
+        segment_start = ( h / pv->cpu_count ) * segment;
+        if( segment == pv->cpu_count - 1 )
         {
             /*
-             * No more work to do, exit this thread.
+             * Final segment
              */
-            run = 0;
-            goto report_completion;
-        } 
-
-        rotate_work = &pv->rotate_arguments[segment];
-        if( rotate_work->dst == NULL )
-        {
-            hb_error( "Thread started when no work available" );
-            hb_snooze(500);
-            goto report_completion;
+            segment_stop = h;
+        } else {
+            segment_stop = ( h / pv->cpu_count ) * ( segment + 1 );
         }
-        
-        /*
-         * Process all three planes, but only this segment of it.
-         */
-        dst_buf = rotate_work->dst;
-        src_buf = rotate_work->src;
-        for( plane = 0; plane < 3; plane++)
-        {
-            int dst_stride, src_stride;
-
-            dst = dst_buf->plane[plane].data;
-            dst_stride = dst_buf->plane[plane].stride;
-            src_stride = src_buf->plane[plane].stride;
 
-            int h = src_buf->plane[plane].height;
-            int w = src_buf->plane[plane].width;
-            segment_start = ( h / pv->cpu_count ) * segment;
-            if( segment == pv->cpu_count - 1 )
-            {
-                /*
-                 * Final segment
-                 */
-                segment_stop = h;
-            } else {
-                segment_stop = ( h / pv->cpu_count ) * ( segment + 1 );
-            }
+        for( y = segment_start; y < segment_stop; y++ )
+        {
+            uint8_t * cur;
+            int x, xo, yo;
 
-            for( y = segment_start; y < segment_stop; y++ )
+            cur = &src_buf->plane[plane].data[y * src_stride];
+            for( x = 0; x < w; x++)
             {
-                uint8_t * cur;
-                int x, xo, yo;
-
-                cur = &src_buf->plane[plane].data[y * src_stride];
-                for( x = 0; x < w; x++)
+                if( pv->mode & 1 )
+                {
+                    yo = h - y - 1;
+                }
+                else
+                {
+                    yo = y;
+                }
+                if( pv->mode & 2 )
+                {
+                    xo = w - x - 1;
+                }
+                else
                 {
-                    if( pv->mode & 1 )
-                    {
-                        yo = h - y - 1;
-                    }
-                    else
-                    {
-                        yo = y;
-                    }
-                    if( pv->mode & 2 )
-                    {
-                        xo = w - x - 1;
-                    }
-                    else
-                    {
-                        xo = x;
-                    }
-                    if( pv->mode & 4 ) // Rotate 90 clockwise
-                    {
-                        int tmp = xo;
-                        xo = h - yo - 1;
-                        yo = tmp;
-                    }
-                    dst[yo*dst_stride + xo] = cur[x];
+                    xo = x;
                 }
+                if( pv->mode & 4 ) // Rotate 90 clockwise
+                {
+                    int tmp = xo;
+                    xo = h - yo - 1;
+                    yo = tmp;
+                }
+                dst[yo*dst_stride + xo] = cur[x];
             }
         }
-
-report_completion:
-        /*
-         * Finished this segment, let everyone know.
-         */
-        taskset_thread_complete( &pv->rotate_taskset, segment );
     }
 }
 
@@ -205,9 +179,9 @@ static void rotate_filter(
     }
 
     /*
-     * Allow the taskset threads to make one pass over the data.
+     * Allow the shared workers to make one pass over the data.
      */
-    taskset_cycle( &pv->rotate_taskset );
+    taskslices_cycle( &pv->rotate_taskset );
 
     /*
      * Entire frame is now rotated.
@@ -232,14 +206,16 @@ static int hb_rotate_init( hb_filter_object_t * filter,
     pv->cpu_count = hb_get_cpu_count();
 
     /*
-     * Create rotate taskset.
+     * Create rotate slices.
      */
     pv->rotate_arguments = malloc( sizeof( rotate_arguments_t ) * pv->cpu_count );
     if( pv->rotate_arguments == NULL ||
-        taskset_init( &pv->rotate_taskset, /*thread_count*/pv->cpu_count,
-                      sizeof( rotate_thread_arg_t ) ) == 0 )
+        taskslices_init( &pv->rotate_taskset, hb_get_taskpool( init->job->h ),
+                         pv->cpu_count, sizeof( rotate_thread_arg_t ),
+                         rotate_filter_slice ) == 0 )
     {
             hb_error( "rotate could not initialize taskset" );
+            return -1;
     }
 
     int i;
@@ -247,19 +223,11 @@ static int hb_rotate_init( hb_filter_object_t * filter,
     {
         rotate_thread_arg_t *thread_args;
     
-        thread_args = taskset_thread_args( &pv->rotate_taskset, i );
+        thread_args = taskslices_args( &pv->rotate_taskset, i );
     
         thread_args->pv = pv;
         thread_args->segment = i;
         pv->rotate_arguments[i].dst = NULL;
-    
-        if( taskset_thread_spawn( &pv->rotate_taskset, i,
-                                  "rotate_filter_segment",
-                                  rotate_filter_thread,
-                                  HB_NORMAL_PRIORITY ) == 0 )
-        {
-            hb_error( "rotate could not spawn thread" );
-        }
     }
     // Set init width/height so the next stage in the pipline
     // knows what it will be getting
@@ -319,7 +287,7 @@ static void hb_rotate_close( hb_filter_object_t * filter )
         return;
     }
 
-    taskset_fini( &pv->rotate_taskset );
+    taskslices_fini( &pv->rotate_taskset );
     
     /*
      * free memory for rotate structs
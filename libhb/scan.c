@@ -28,18 +28,81 @@ typedef struct
     int            preview_count;
     int            store_previews;
 
+    int            title_threads;   // titles scanned concurrently
+    int            preview_threads; // previews of a title decoded concurrently
+
     uint64_t       min_title_duration;
 } hb_scan_t;
 
+/* Results of one preview, merged in preview order by DecodePreviews */
+typedef struct
+{
+    int             decoded;
+    hb_work_info_t  info;
+    int             pulldown;
+    int             doubled;
+    int             progressive;
+    int             interlaced;
+    int             crop_valid;
+    int             crop[4];
+
+    // Packets the serial scan reads before the title's audio is
+    // identified, INT_MAX if it isn't within this preview
+    int             audio_packets;
+    int             finished;       // set by the worker decoding it
+    int             aborted;
+} scan_preview_t;
+
+/*
+ * Audio probe progress of a parallel preview decode.  The audio worker
+ * probes the audio of every preview in order, as the serial scan does,
+ * and the other workers read each of their previews as long as the
+ * serial scan would have.
+ */
+typedef struct
+{
+    hb_lock_t      * lock;
+    hb_cond_t      * cond;
+    int              probed;    // previews whose audio_packets are known
+} scan_audio_sync_t;
+
+typedef struct
+{
+    hb_scan_t      * data;
+    hb_title_t     * title;
+    int              flush;
+    int              first;     // first preview decoded by this worker
+    int              step;      // distance to its next preview
+    int              audio;     // worker identifies the title's audio
+    scan_preview_t * previews;
+    int              abort;     // preview that could not be read
+    scan_audio_sync_t * sync;   // NULL when decoding serially
+    hb_thread_t    * thread;
+} scan_worker_t;
+
+/* Batch titles shared by the title workers of a parallel scan */
+typedef struct
+{
+    hb_scan_t    * data;
+    hb_lock_t    * lock;
+    int            count;
+    int            next;        // next title to scan
+    int            done;
+    hb_title_t  ** titles;      // scanned titles, in batch order
+} scan_batch_t;
+
 #define PREVIEW_READ_THRESH (1024 * 1024 * 10)
 
 static void ScanFunc( void * );
+static int  ScanTitle( hb_scan_t *, hb_title_t * title );
 static int  DecodePreviews( hb_scan_t *, hb_title_t * title, int flush );
 static void LookForAudio(hb_scan_t *scan, hb_title_t *title, hb_buffer_t *b);
 static int  AllAudioOK( hb_title_t * title );
 static void UpdateState1(hb_scan_t *scan, int title);
 static void UpdateState2(hb_scan_t *scan, int title);
 static void UpdateState3(hb_scan_t *scan, int preview);
+static void UpdateState4(hb_scan_t *scan, int done, int count);
+static void ScanBatchTitles( hb_scan_t * data );
 
 static const char *aspect_to_string(hb_rational_t *dar)
 {
@@ -91,15 +154,19 @@ hb_thread_t * hb_scan_init( hb_handle_t * handle, volatile int * die,
 
 static void ScanFunc( void * _data )
 {
-    hb_scan_t  * data = (hb_scan_t *) _data;
-    hb_title_t * title;
-    int          i;
-    int          feature = 0;
+    hb_scan_t   * data = (hb_scan_t *) _data;
+    hb_handle_t * h    = data->h;
+    hb_title_t  * title;
+    int           i;
+    int           feature = 0;
 
     data->bd = NULL;
     data->dvd = NULL;
     data->stream = NULL;
 
+    data->title_threads   = 1;
+    data->preview_threads = hb_get_scan_threads( data->h );
+
     /* Try to open the path as a DVD. If it fails, try as a file */
     if( ( data->bd = hb_bd_init( data->h, data->path ) ) )
     {
@@ -162,6 +229,13 @@ static void ScanFunc( void * _data )
                 hb_list_add( data->title_set->list_title, title );
             }
         }
+        else if( data->preview_threads > 1 &&
+                 hb_batch_title_count( data->batch ) > 1 )
+        {
+            /* Scan all titles concurrently, they are separate files */
+            ScanBatchTitles( data );
+            goto complete;
+        }
         else
         {
             /* Scan all titles */
@@ -206,9 +280,6 @@ static void ScanFunc( void * _data )
 
     for( i = 0; i < hb_list_count( data->title_set->list_title ); )
     {
-        int j, npreviews;
-        hb_audio_t * audio;
-
         if ( *data->die )
         {
             goto finish;
@@ -217,69 +288,21 @@ static void ScanFunc( void * _data )
 
         UpdateState2(data, i + 1);
 
-        /* Decode previews */
-        /* this will also detect more AC3 / DTS information */
-        npreviews = DecodePreviews( data, title, 1 );
-        if (npreviews < 2)
-        {
-            npreviews = DecodePreviews( data, title, 0 );
-        }
-        if (npreviews == 0)
+        if ( !ScanTitle( data, title ) )
         {
             /* TODO: free things */
             hb_list_rem( data->title_set->list_title, title );
-            for( j = 0; j < hb_list_count( title->list_audio ); j++)
-            {
-                audio = hb_list_item( title->list_audio, j );
-                if ( audio->priv.scan_cache )
-                {
-                    hb_fifo_flush( audio->priv.scan_cache );
-                    hb_fifo_close( &audio->priv.scan_cache );
-                }
-            }
             hb_title_close( &title );
             continue;
         }
-
-        /* Make sure we found audio rates and bitrates */
-        for( j = 0; j < hb_list_count( title->list_audio ); )
-        {
-            audio = hb_list_item( title->list_audio, j );
-            if ( audio->priv.scan_cache )
-            {
-                hb_fifo_flush( audio->priv.scan_cache );
-                hb_fifo_close( &audio->priv.scan_cache );
-            }
-            if( !audio->config.in.bitrate )
-            {
-                hb_log( "scan: removing audio 0x%x because no bitrate found",
-                        audio->id );
-                hb_list_rem( title->list_audio, audio );
-                free( audio );
-                continue;
-            }
-            j++;
-        }
-
-        if ( data->dvd || data->bd )
-        {
-            // The subtitle width and height needs to be set to the 
-            // title widht and height for DVDs.  title width and
-            // height don't get set until we decode previews, so
-            // we can't set subtitle width/height till we get here.
-            for( j = 0; j < hb_list_count( title->list_subtitle ); j++ )
-            {
-                hb_subtitle_t *subtitle = hb_list_item( title->list_subtitle, j );
-                if ( subtitle->source == VOBSUB || subtitle->source == PGSSUB )
-                {
-                    subtitle->width = title->geometry.width;
-                    subtitle->height = title->geometry.height;
-                }
-            }
-        }
         i++;
     }
 
+complete:
+    if ( *data->die )
+    {
+        goto finish;
+    }
     data->title_set->feature = feature;
 
     /* Mark title scan complete and init jobs */
@@ -310,7 +333,169 @@ finish:
     free( data->path );
     free( data );
     _data = NULL;
-    hb_buffer_pool_free();
+
+    // Leave the shared buffer pool to the jobs still running
+    if ( !hb_is_scan_handle( h ) && hb_current_job( h ) == NULL )
+    {
+        hb_buffer_pool_free();
+    }
+}
+
+/***********************************************************************
+ * ScanTitle
+ ***********************************************************************
+ * Decode the previews of a title and check what was found about its
+ * audio and subtitles.  Returns 0 if the title has no usable video,
+ * the caller then discards it.
+ **********************************************************************/
+static int ScanTitle( hb_scan_t * data, hb_title_t * title )
+{
+    int j, npreviews;
+    hb_audio_t * audio;
+
+    /* Decode previews */
+    /* this will also detect more AC3 / DTS information */
+    npreviews = DecodePreviews( data, title, 1 );
+    if (npreviews < 2)
+    {
+        npreviews = DecodePreviews( data, title, 0 );
+    }
+    if (npreviews == 0)
+    {
+        for( j = 0; j < hb_list_count( title->list_audio ); j++)
+        {
+            audio = hb_list_item( title->list_audio, j );
+            if ( audio->priv.scan_cache )
+            {
+                hb_fifo_flush( audio->priv.scan_cache );
+                hb_fifo_close( &audio->priv.scan_cache );
+            }
+        }
+        return 0;
+    }
+
+    /* Make sure we found audio rates and bitrates */
+    for( j = 0; j < hb_list_count( title->list_audio ); )
+    {
+        audio = hb_list_item( title->list_audio, j );
+        if ( audio->priv.scan_cache )
+        {
+            hb_fifo_flush( audio->priv.scan_cache );
+            hb_fifo_close( &audio->priv.scan_cache );
+        }
+        if( !audio->config.in.bitrate )
+        {
+            hb_log( "scan: removing audio 0x%x because no bitrate found",
+                    audio->id );
+            hb_list_rem( title->list_audio, audio );
+            free( audio );
+            continue;
+        }
+        j++;
+    }
+
+    if ( data->dvd || data->bd )
+    {
+        // The subtitle width and height needs to be set to the 
+        // title widht and height for DVDs.  title width and
+        // height don't get set until we decode previews, so
+        // we can't set subtitle width/height till we get here.
+        for( j = 0; j < hb_list_count( title->list_subtitle ); j++ )
+        {
+            hb_subtitle_t *subtitle = hb_list_item( title->list_subtitle, j );
+            if ( subtitle->source == VOBSUB || subtitle->source == PGSSUB )
+            {
+                subtitle->width = title->geometry.width;
+                subtitle->height = title->geometry.height;
+            }
+        }
+    }
+    return 1;
+}
+
+static void ScanBatchWorker( void * _b )
+{
+    scan_batch_t * b = (scan_batch_t *) _b;
+    hb_scan_t    * data = b->data;
+    hb_title_t   * title;
+    int            i;
+
+    while ( !*data->die )
+    {
+        hb_lock( b->lock );
+        i = b->next++;
+        hb_unlock( b->lock );
+        if ( i >= b->count )
+        {
+            break;
+        }
+
+        title = hb_batch_title_scan( data->batch, i + 1 );
+        if ( title != NULL && !ScanTitle( data, title ) )
+        {
+            hb_title_close( &title );
+        }
+        b->titles[i] = title;
+
+        hb_lock( b->lock );
+        b->done++;
+        UpdateState4( data, b->done, b->count );
+        hb_unlock( b->lock );
+    }
+}
+
+/***********************************************************************
+ * ScanBatchTitles
+ ***********************************************************************
+ * Scan the files of a batch with up to title_threads workers.  Each
+ * worker takes the next unscanned file, so slow files don't hold up
+ * the others, and the titles are added to the title set in batch
+ * order once all workers are done.
+ **********************************************************************/
+static void ScanBatchTitles( hb_scan_t * data )
+{
+    scan_batch_t   b;
+    hb_thread_t ** threads;
+    int            i, threads_count;
+
+    b.data   = data;
+    b.lock   = hb_lock_init();
+    b.count  = hb_batch_title_count( data->batch );
+    b.next   = 0;
+    b.done   = 0;
+    b.titles = calloc( b.count, sizeof( hb_title_t * ) );
+
+    // Split the scan threads between titles first, the previews of a
+    // title are only decoded concurrently with threads to spare
+    threads_count = MIN( data->preview_threads, b.count );
+    data->title_threads   = threads_count;
+    data->preview_threads = MAX( data->preview_threads / threads_count, 1 );
+    hb_log( "scan: scanning %d titles with %d threads", b.count,
+            threads_count );
+
+    UpdateState4( data, 0, b.count );
+    threads = calloc( threads_count, sizeof( hb_thread_t * ) );
+    for ( i = 1; i < threads_count; i++ )
+    {
+        threads[i] = hb_thread_init( "scan titles", ScanBatchWorker, &b,
+                                     HB_NORMAL_PRIORITY );
+    }
+    ScanBatchWorker( &b );
+    for ( i = 1; i < threads_count; i++ )
+    {
+        hb_thread_close( &threads[i] );
+    }
+    free( threads );
+
+    for ( i = 0; i < b.count; i++ )
+    {
+        if ( b.titles[i] != NULL )
+        {
+            hb_list_add( data->title_set->list_title, b.titles[i] );
+        }
+    }
+    free( b.titles );
+    hb_lock_close( &b.lock );
 }
 
 // -----------------------------------------------
@@ -498,52 +683,196 @@ static int is_close_to( int val, int target, int thresh )
     return diff < thresh;
 }
 
-/***********************************************************************
- * DecodePreviews
- ***********************************************************************
- * Decode 10 pictures for the given title.
- * It assumes that data->reader and data->vts have successfully been
- * DVDOpen()ed and ifoOpen()ed.
- **********************************************************************/
-static int DecodePreviews( hb_scan_t * data, hb_title_t * title, int flush )
+/*
+ * Whether the serial scan would have identified the title's audio after
+ * reading 'packets' packets of the current preview.
+ */
+static int PreviewAudioOK( scan_worker_t * w, int audio_packets, int packets )
 {
-    int             i, npreviews = 0, abort = 0;
-    hb_buffer_t   * buf, * buf_es;
-    hb_list_t     * list_es;
-    int progressive_count = 0;
-    int pulldown_count = 0;
-    int doubled_frame_count = 0;
-    int interlaced_preview_count = 0;
-    int frame_wait = 0;
-    int cc_wait = 10;
-    int frames;
-    hb_stream_t  * stream = NULL;
-    info_list_t * info_list = calloc( data->preview_count+1, sizeof(*info_list) );
-    crop_record_t *crops = crop_record_init( data->preview_count );
+    if ( w->audio )
+    {
+        return AllAudioOK( w->title );
+    }
+    return packets >= audio_packets;
+}
 
-    list_es  = hb_list_init();
+static void PublishAudioProbe( scan_worker_t * w, int probed )
+{
+    scan_audio_sync_t * sync = w->sync;
 
-    if( data->batch )
+    hb_lock( sync->lock );
+    sync->probed = MAX( sync->probed, probed );
+    hb_cond_broadcast( sync->cond );
+    hb_unlock( sync->lock );
+}
+
+static int WaitAudioProbe( scan_worker_t * w, int preview )
+{
+    scan_audio_sync_t * sync = w->sync;
+    int packets;
+
+    hb_lock( sync->lock );
+    while ( sync->probed <= preview )
     {
-        hb_log( "scan: decoding previews for title %d (%s)", title->index, title->path );
+        hb_cond_wait( sync->cond, sync->lock );
     }
-    else
+    packets = w->previews[preview].audio_packets;
+    hb_unlock( sync->lock );
+
+    return packets;
+}
+
+// Marks the worker's previews before 'last' as decoded or aborted
+static void FinishPreviews( scan_worker_t * w, int last )
+{
+    scan_audio_sync_t * sync = w->sync;
+    int i;
+
+    hb_lock( sync->lock );
+    for ( i = w->first; i < last; i += w->step )
     {
-        hb_log( "scan: decoding previews for title %d", title->index );
+        w->previews[i].finished = 1;
+        w->previews[i].aborted  = i == w->abort;
     }
+    hb_cond_broadcast( sync->cond );
+    hb_unlock( sync->lock );
+}
 
-    if (data->bd)
+/*
+ * Reads a preview decoded by another worker for its audio only, as far
+ * as the serial scan would have read it before identifying the audio.
+ * Returns 1 if the serial scan would have stopped at this preview.
+ */
+static int ProbePreviewAudio( scan_worker_t * w, hb_stream_t * stream,
+                              hb_list_t * list_es, int preview )
+{
+    hb_scan_t      * data  = w->data;
+    hb_title_t     * title = w->title;
+    scan_preview_t * p     = &w->previews[preview];
+    hb_buffer_t    * buf, * buf_es;
+    int total_read = 0, packets = 0, failed = 0, aborted, j;
+
+    if (!hb_stream_seek(stream, (float)preview / (data->preview_count + 1.0)))
     {
-        hb_bd_start( data->bd, title );
-        hb_log( "scan: title angle(s) %d", title->angle_count );
+        // Skipped by the serial scan too
+        PublishAudioProbe( w, preview + 1 );
+        return 0;
     }
-    else if (data->dvd)
+
+    while ( !AllAudioOK( title ) &&
+            ( total_read < PREVIEW_READ_THRESH || packets < 10000 ) )
     {
-        hb_dvd_start( data->dvd, title, 1 );
-        title->angle_count = hb_dvd_angle_count( data->dvd );
-        hb_log( "scan: title angle(s) %d", title->angle_count );
+        if ( ( buf = hb_stream_read( stream ) ) == NULL || buf->size <= 0 )
+        {
+            hb_buffer_close( &buf );
+            failed = 1;
+            break;
+        }
+        total_read += buf->size;
+        packets++;
+
+        (hb_demux[title->demuxer])(buf, list_es, 0 );
+
+        while( ( buf_es = hb_list_item( list_es, 0 ) ) )
+        {
+            hb_list_rem( list_es, buf_es );
+            if( buf_es->s.id != title->video_id && ! AllAudioOK( title ) )
+            {
+                LookForAudio( data, title, buf_es );
+                buf_es = NULL;
+            }
+            if ( buf_es )
+                hb_buffer_close( &buf_es );
+        }
+    }
+    for( j = 0; j < hb_list_count( title->list_audio ); j++ )
+    {
+        hb_audio_t * audio = hb_list_item( title->list_audio, j );
+        if ( audio->priv.scan_cache )
+        {
+            hb_fifo_flush( audio->priv.scan_cache );
+        }
     }
-    else if (data->batch)
+
+    p->audio_packets = AllAudioOK( title ) ? packets : INT_MAX;
+    PublishAudioProbe( w, AllAudioOK( title ) ? data->preview_count
+                                              : preview + 1 );
+    if ( !failed )
+    {
+        return 0;
+    }
+
+    // The serial scan stops at a read failure before the preview's
+    // picture is decoded, which only the decoding worker knows
+    hb_lock( w->sync->lock );
+    while ( !p->finished )
+    {
+        hb_cond_wait( w->sync->cond, w->sync->lock );
+    }
+    aborted = p->aborted;
+    hb_unlock( w->sync->lock );
+
+    return aborted;
+}
+
+/*
+ * Probes the audio of the previews from 'first' to 'last' that other
+ * workers decode.  Returns 1 if the serial scan would have stopped.
+ */
+static int ProbeAudio( scan_worker_t * w, hb_stream_t * stream,
+                       hb_list_t * list_es, int first, int last )
+{
+    int i;
+
+    for ( i = MAX( first, 0 ); i < last; i++ )
+    {
+        if ( *w->data->die )
+        {
+            return 1;
+        }
+        if ( AllAudioOK( w->title ) )
+        {
+            PublishAudioProbe( w, w->data->preview_count );
+            return 0;
+        }
+        if ( ProbePreviewAudio( w, stream, list_es, i ) )
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/***********************************************************************
+ * DecodePreviewsWorker
+ ***********************************************************************
+ * Decode the previews first, first + step, ... of a title.  The worker
+ * identifying the title's audio uses the title itself, other workers
+ * get a private copy without audio and subtitles so that they neither
+ * race on the title's lists nor on the stream info stored in it.
+ *
+ * When the previews are split, the audio worker also probes the audio
+ * of the other workers' previews, in preview order, until the audio is
+ * identified.  The other workers wait for each preview's probe, so that
+ * they read as much of it as the serial scan would have.
+ **********************************************************************/
+static void DecodePreviewsWorker( void * _w )
+{
+    scan_worker_t * w     = (scan_worker_t *) _w;
+    hb_scan_t     * data  = w->data;
+    hb_title_t    * title = w->title;
+    int             flush = w->flush;
+    int             i;
+    hb_buffer_t   * buf, * buf_es;
+    hb_list_t     * list_es;
+    int frame_wait = 0;
+    int cc_wait = 10;
+    int frames;
+    hb_stream_t  * stream = NULL;
+
+    w->abort = data->preview_count;
+
+    if (data->batch)
     {
         stream = hb_stream_open(data->h, title->path, title, 0);
     }
@@ -552,27 +881,42 @@ static int DecodePreviews( hb_scan_t * data, hb_title_t * title, int flush )
         stream = hb_stream_open(data->h, data->path, title, 0);
     }
 
-    if (title->video_codec == WORK_NONE)
-    {
-        hb_error("No video decoder set!");
-        return 0;
-    }
     hb_work_object_t *vid_decoder = hb_get_work(data->h, title->video_codec);
     vid_decoder->codec_param = title->video_codec_param;
     vid_decoder->title = title;
     vid_decoder->init( vid_decoder, NULL );
 
-    for( i = 0; i < data->preview_count; i++ )
+    list_es  = hb_list_init();
+
+    for( i = w->first; i < data->preview_count; i += w->step )
     {
-        int j;
+        int j, abort = 0, audio_packets = 0;
+        scan_preview_t * preview = &w->previews[i];
+
+        if ( w->sync != NULL )
+        {
+            FinishPreviews( w, i );
+            if ( w->audio )
+            {
+                if ( ProbeAudio( w, stream, list_es, i - w->step + 1, i ) )
+                {
+                    break;
+                }
+            }
+            else
+            {
+                audio_packets = WaitAudioProbe( w, i );
+            }
+        }
 
-        UpdateState3(data, i + 1);
+        if ( w->audio && data->title_threads == 1 )
+        {
+            UpdateState3(data, i + 1);
+        }
 
         if ( *data->die )
         {
-            free( info_list );
-            crop_record_free( crops );
-            return 0;
+            break;
         }
         if (data->bd)
         {
@@ -644,7 +988,7 @@ static int DecodePreviews( hb_scan_t * data, hb_title_t * title, int flush )
 
         int total_read = 0, packets = 0;
         while (total_read < PREVIEW_READ_THRESH ||
-              (!AllAudioOK(title) && packets < 10000)) 
+              (!PreviewAudioOK(w, audio_packets, packets) && packets < 10000))
         {
             if (data->bd)
             {
@@ -732,7 +1076,7 @@ static int DecodePreviews( hb_scan_t * data, hb_title_t * title, int flush )
                         frames++;
                     }
                 }
-                else if( ! AllAudioOK( title ) ) 
+                else if( w->audio && ! AllAudioOK( title ) )
                 {
                     LookForAudio( data, title, buf_es );
                     buf_es = NULL;
@@ -741,7 +1085,7 @@ static int DecodePreviews( hb_scan_t * data, hb_title_t * title, int flush )
                     hb_buffer_close( &buf_es );
             }
 
-            if( vid_buf && AllAudioOK( title ) )
+            if( vid_buf && PreviewAudioOK( w, audio_packets, packets ) )
                 break;
         }
 
@@ -753,8 +1097,8 @@ static int DecodePreviews( hb_scan_t * data, hb_title_t * title, int flush )
 
         /* Get size and rate infos */
 
-        hb_work_info_t vid_info;
-        if( !vid_decoder->info( vid_decoder, &vid_info ) )
+        hb_work_info_t * vid_info = &preview->info;
+        if( !vid_decoder->info( vid_decoder, vid_info ) )
         {
             /*
              * Could not fill vid_info, don't continue and try to use vid_info
@@ -768,13 +1112,11 @@ static int DecodePreviews( hb_scan_t * data, hb_title_t * title, int flush )
             continue;
         }
 
-        remember_info( info_list, &vid_info );
-
-        if( is_close_to( vid_info.rate.den, 900900, 100 ) &&
+        if( is_close_to( vid_info->rate.den, 900900, 100 ) &&
             ( vid_buf->s.flags & PIC_FLAG_REPEAT_FIRST_FIELD ) )
         {
             /* Potentially soft telecine material */
-            pulldown_count++;
+            preview->pulldown = 1;
         }
 
         if( vid_buf->s.flags & PIC_FLAG_REPEAT_FRAME )
@@ -782,15 +1124,15 @@ static int DecodePreviews( hb_scan_t * data, hb_title_t * title, int flush )
             // AVCHD-Lite specifies that all streams are
             // 50 or 60 fps.  To produce 25 or 30 fps, camera
             // makers are repeating all frames.
-            doubled_frame_count++;
+            preview->doubled = 1;
         }
 
-        if( is_close_to( vid_info.rate.den, 1126125, 100 ) )
+        if( is_close_to( vid_info->rate.den, 1126125, 100 ) )
         {
             // Frame FPS is 23.976 (meaning it's progressive), so start keeping
-            // track of how many are reporting at that speed. When enough 
+            // track of how many are reporting at that speed. When enough
             // show up that way, we want to make that the overall title FPS.
-            progressive_count++;
+            preview->progressive = 1;
         }
 
         while( ( buf_es = hb_list_item( list_es, 0 ) ) )
@@ -803,9 +1145,9 @@ static int DecodePreviews( hb_scan_t * data, hb_title_t * title, int flush )
         if( hb_detect_comb( vid_buf, 10, 30, 9, 10, 30, 9 ) )
         {
             hb_deep_log( 2, "Interlacing detected in preview frame %i", i+1);
-            interlaced_preview_count++;
+            preview->interlaced = 1;
         }
-        
+
         if( data->store_previews )
         {
             hb_save_preview( data->h, title->index, i, vid_buf );
@@ -814,7 +1156,7 @@ static int DecodePreviews( hb_scan_t * data, hb_title_t * title, int flush )
         /* Detect black borders */
 
         int top, bottom, left, right;
-        int h4 = vid_info.geometry.height / 4, w4 = vid_info.geometry.width / 4;
+        int h4 = vid_info->geometry.height / 4, w4 = vid_info->geometry.width / 4;
 
         // When widescreen content is matted to 16:9 or 4:3 there's sometimes
         // a thin border on the outer edge of the matte. On TV content it can be
@@ -824,7 +1166,7 @@ static int DecodePreviews( hb_scan_t * data, hb_title_t * title, int flush )
         // we can crop the matte. The border width depends on the resolution
         // (12 pixels on 1080i looks visually the same as 4 pixels on 480i)
         // so we allow the border to be up to 1% of the frame height.
-        const int border = vid_info.geometry.height / 100;
+        const int border = vid_info->geometry.height / 100;
 
         for ( top = border; top < h4; ++top )
         {
@@ -847,14 +1189,14 @@ static int DecodePreviews( hb_scan_t * data, hb_title_t * title, int flush )
         }
         for ( bottom = border; bottom < h4; ++bottom )
         {
-            if ( ! row_all_dark( vid_buf, vid_info.geometry.height - 1 - bottom ) )
+            if ( ! row_all_dark( vid_buf, vid_info->geometry.height - 1 - bottom ) )
                 break;
         }
         if ( bottom <= border )
         {
             for ( bottom = 0; bottom < border; ++bottom )
             {
-                if ( ! row_all_dark( vid_buf, vid_info.geometry.height - 1 - bottom ) )
+                if ( ! row_all_dark( vid_buf, vid_info->geometry.height - 1 - bottom ) )
                     break;
             }
             if ( bottom >= border )
@@ -869,7 +1211,7 @@ static int DecodePreviews( hb_scan_t * data, hb_title_t * title, int flush )
         }
         for ( right = 0; right < w4; ++right )
         {
-            if ( ! column_all_dark( vid_buf, top, bottom, vid_info.geometry.width - 1 - right ) )
+            if ( ! column_all_dark( vid_buf, top, bottom, vid_info->geometry.width - 1 - right ) )
                 break;
         }
 
@@ -878,13 +1220,17 @@ static int DecodePreviews( hb_scan_t * data, hb_title_t * title, int flush )
         // like titles, credits & fade-thru-black transitions.
         if ( top < h4 && bottom < h4 && left < w4 && right < w4 )
         {
-            record_crop( crops, top, bottom, left, right );
+            preview->crop_valid = 1;
+            preview->crop[0] = top;
+            preview->crop[1] = bottom;
+            preview->crop[2] = left;
+            preview->crop[3] = right;
         }
-        ++npreviews;
+        preview->decoded = 1;
 
 skip_preview:
         /* Make sure we found audio rates and bitrates */
-        for( j = 0; j < hb_list_count( title->list_audio ); j++ )
+        for( j = 0; w->audio && j < hb_list_count( title->list_audio ); j++ )
         {
             hb_audio_t * audio = hb_list_item( title->list_audio, j );
             if ( audio->priv.scan_cache )
@@ -898,10 +1244,28 @@ skip_preview:
         }
         if (abort)
         {
+            w->abort = i;
             break;
         }
     }
-    UpdateState3(data, i);
+    if ( w->sync != NULL )
+    {
+        // Probe the previews after this worker's last one
+        if ( w->audio && i >= data->preview_count )
+        {
+            ProbeAudio( w, stream, list_es, i - w->step + 1,
+                        data->preview_count );
+        }
+        FinishPreviews( w, data->preview_count );
+        if ( w->audio )
+        {
+            PublishAudioProbe( w, data->preview_count );
+        }
+    }
+    if ( w->audio && data->title_threads == 1 )
+    {
+        UpdateState3(data, i);
+    }
 
     vid_decoder->close( vid_decoder );
     free( vid_decoder );
@@ -911,6 +1275,195 @@ skip_preview:
         hb_stream_close(&stream);
     }
 
+    while( ( buf_es = hb_list_item( list_es, 0 ) ) )
+    {
+        hb_list_rem( list_es, buf_es );
+        hb_buffer_close( &buf_es );
+    }
+    hb_list_close( &list_es );
+}
+
+/*
+ * The video decoder adds closed captions it finds to the title it
+ * decodes.  Move the captions found by a helper worker to the title
+ * if its other workers didn't find them.
+ */
+static void MergeCaptions( hb_title_t * title, hb_title_t * copy )
+{
+    hb_subtitle_t * subtitle, * cc;
+    hb_audio_t    * audio;
+    int             i;
+
+    while( ( cc = hb_list_item( copy->list_subtitle, 0 ) ) )
+    {
+        hb_list_rem( copy->list_subtitle, cc );
+        for( i = 0; ( subtitle = hb_list_item( title->list_subtitle, i ) ); i++ )
+        {
+            if( subtitle->source == cc->source )
+                break;
+        }
+        if( subtitle != NULL )
+        {
+            hb_subtitle_close( &cc );
+            continue;
+        }
+        // The helper's title has no audio to take the language from
+        cc->track = hb_list_count( title->list_subtitle );
+        audio = hb_list_item( title->list_audio, 0 );
+        if( audio != NULL )
+        {
+            snprintf( cc->iso639_2, sizeof( cc->iso639_2 ), "%s",
+                      audio->config.lang.iso639_2 );
+        }
+        hb_list_add( title->list_subtitle, cc );
+    }
+}
+
+/***********************************************************************
+ * DecodePreviews
+ ***********************************************************************
+ * Decode 10 pictures for the given title.
+ * It assumes that data->reader and data->vts have successfully been
+ * DVDOpen()ed and ifoOpen()ed.
+ *
+ * Stream previews are independent of each other when the decoder is
+ * flushed between them, so with more than one scan thread they are
+ * split over several workers, each with its own stream and decoder.
+ * The results are merged in preview order so the title is the same
+ * whatever the number of workers.
+ **********************************************************************/
+static int DecodePreviews( hb_scan_t * data, hb_title_t * title, int flush )
+{
+    int             i, npreviews = 0, nworkers = 1, limit;
+    int progressive_count = 0;
+    int pulldown_count = 0;
+    int doubled_frame_count = 0;
+    int interlaced_preview_count = 0;
+    info_list_t * info_list = calloc( data->preview_count+1, sizeof(*info_list) );
+    crop_record_t *crops = crop_record_init( data->preview_count );
+    scan_preview_t * previews = calloc( data->preview_count, sizeof(*previews) );
+    scan_worker_t  * workers;
+    scan_audio_sync_t sync;
+
+    if( data->batch )
+    {
+        hb_log( "scan: decoding previews for title %d (%s)", title->index, title->path );
+    }
+    else
+    {
+        hb_log( "scan: decoding previews for title %d", title->index );
+    }
+
+    if (data->bd)
+    {
+        hb_bd_start( data->bd, title );
+        hb_log( "scan: title angle(s) %d", title->angle_count );
+    }
+    else if (data->dvd)
+    {
+        hb_dvd_start( data->dvd, title, 1 );
+        title->angle_count = hb_dvd_angle_count( data->dvd );
+        hb_log( "scan: title angle(s) %d", title->angle_count );
+    }
+    else if (flush && (data->batch || data->stream))
+    {
+        nworkers = MIN(data->preview_threads, data->preview_count);
+        nworkers = MAX(nworkers, 1);
+    }
+
+    if (title->video_codec == WORK_NONE)
+    {
+        hb_error("No video decoder set!");
+        crop_record_free( crops );
+        free( info_list );
+        free( previews );
+        return 0;
+    }
+
+    if( nworkers > 1 )
+    {
+        sync.lock   = hb_lock_init();
+        sync.cond   = hb_cond_init();
+        sync.probed = 0;
+    }
+
+    workers = calloc( nworkers, sizeof(*workers) );
+    for( i = 0; i < nworkers; i++ )
+    {
+        workers[i].data     = data;
+        workers[i].title    = title;
+        workers[i].flush    = flush;
+        workers[i].first    = i;
+        workers[i].step     = nworkers;
+        workers[i].audio    = i == 0;
+        workers[i].previews = previews;
+        workers[i].sync     = nworkers > 1 ? &sync : NULL;
+        if( i > 0 )
+        {
+            hb_title_t * copy = malloc( sizeof(*copy) );
+            *copy = *title;
+            copy->list_audio    = hb_list_init();
+            copy->list_subtitle = hb_list_init();
+            workers[i].title  = copy;
+            workers[i].thread = hb_thread_init( "scan previews",
+                                                DecodePreviewsWorker,
+                                                &workers[i],
+                                                HB_NORMAL_PRIORITY );
+        }
+    }
+    DecodePreviewsWorker( &workers[0] );
+
+    limit = data->preview_count;
+    for( i = 0; i < nworkers; i++ )
+    {
+        if( i > 0 )
+        {
+            hb_thread_close( &workers[i].thread );
+            MergeCaptions( title, workers[i].title );
+            hb_list_close( &workers[i].title->list_audio );
+            hb_list_close( &workers[i].title->list_subtitle );
+            free( workers[i].title );
+        }
+        limit = MIN(limit, workers[i].abort);
+    }
+    free( workers );
+    if( nworkers > 1 )
+    {
+        hb_cond_close( &sync.cond );
+        hb_lock_close( &sync.lock );
+    }
+
+    if ( *data->die )
+    {
+        crop_record_free( crops );
+        free( info_list );
+        free( previews );
+        return 0;
+    }
+
+    // Previews after a read failure are not used, as if they
+    // had been decoded serially
+    for( i = 0; i < limit; i++ )
+    {
+        scan_preview_t * preview = &previews[i];
+
+        if( !preview->decoded )
+        {
+            continue;
+        }
+        remember_info( info_list, &preview->info );
+        pulldown_count           += preview->pulldown;
+        doubled_frame_count      += preview->doubled;
+        progressive_count        += preview->progressive;
+        interlaced_preview_count += preview->interlaced;
+        if( preview->crop_valid )
+        {
+            record_crop( crops, preview->crop[0], preview->crop[1],
+                         preview->crop[2], preview->crop[3] );
+        }
+        ++npreviews;
+    }
+    free( previews );
     if ( npreviews )
     {
         // use the most common frame info for our final title dimensions
@@ -1044,12 +1597,6 @@ skip_preview:
     crop_record_free( crops );
     free( info_list );
 
-    while( ( buf_es = hb_list_item( list_es, 0 ) ) )
-    {
-        hb_list_rem( list_es, buf_es );
-        hb_buffer_close( &buf_es );
-    }
-    hb_list_close( &list_es );
     if (data->bd)
       hb_bd_stop( data->bd );
     if (data->dvd)
@@ -1398,6 +1945,23 @@ static void UpdateState2(hb_scan_t *scan, int title)
     hb_set_state(scan->h, &state);
 }
 
+static void UpdateState4(hb_scan_t *scan, int done, int count)
+{
+    hb_state_t state;
+
+#define p state.param.scanning
+    /* Update the UI */
+    state.state   = HB_STATE_SCANNING;
+    p.title_cur   = done;
+    p.title_count = count;
+    p.preview_cur = 0;
+    p.preview_count = 1;
+    p.progress = (float)done / count;
+#undef p
+
+    hb_set_state(scan->h, &state);
+}
+
 static void UpdateState3(hb_scan_t *scan, int preview)
 {
     hb_state_t state;
@@ -0,0 +1,782 @@
+/* segment.c
+
+   Copyright (c) 2003-2015 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "hb.h"
+
+/*
+ * Segmented video encoding.
+ *
+ * The video of a job is cut into segments, at chapter boundaries where
+ * one is close to an even split.  The job's own pipeline encodes the
+ * first segment together with all of the audio.  Every other segment
+ * gets a pipeline of its own, a copy of the job without audio, that
+ * seeks to the segment and spools the packets of its video encoder to a
+ * temporary file.  Each encoder starts its segment on a keyframe, so
+ * the segments join without re-encoding.
+ *
+ * All pipelines use the clock zero found by the reader of the job, so
+ * sync ends each segment on the frame that the next one starts with.
+ * In the job's pipeline hb_segment_encoder wraps the video encoder.
+ * Once the first segment is done it appends the spooled segments, each
+ * moved to the end of the video before it, while the reader of the job
+ * keeps the audio from running far ahead of the appended video.
+ */
+
+#define SEGMENT_MAX          16
+#define SEGMENT_MIN_DURATION (90000LL * 120) // shortest segment worth a pipeline
+#define SEGMENT_PREROLL      90000           // seek this far before a segment
+#define SEGMENT_LEAD         (90000LL * 4)   // audio lead over appended video
+
+typedef struct
+{
+    hb_segment_t * segment;
+    hb_job_t     * job;         // pipeline of the segment until it starts
+    hb_title_t   * title;       // title of the pipeline
+    hb_thread_t  * thread;
+    int64_t        start;       // first pts of the segment
+    char           path[1024];  // spool file
+    FILE         * spool_out;   // written by the segment's pipeline
+    FILE         * spool_in;    // read back by hb_segment_encoder
+    int64_t        written;     // bytes of whole packets in the spool
+    int64_t        read;
+    int            frames;      // frames through sync so far
+    int            done;        // all packets are in the spool
+    int            finished;    // the pipeline has returned
+} segment_part_t;
+
+struct hb_segment_s
+{
+    hb_lock_t      * lock;
+    hb_cond_t      * cond;
+    volatile int   * die;
+    int              count;
+    int              cpu_budget;    // CPUs of each pipeline
+    segment_part_t   part[SEGMENT_MAX];
+
+    int64_t          zero;          // clock zero of the job's reader
+    int              zero_set;
+    int              appending;     // the first segment is encoded
+    int              appended_all;
+    int64_t          appended;      // start of the last appended packet
+};
+
+struct hb_work_private_s
+{
+    hb_job_t         * job;
+    hb_segment_t     * segment;
+    hb_work_object_t * encoder;     // hb_segment_encoder
+    int64_t            stop;
+    segment_part_t   * part;        // hb_segment_spool
+};
+
+static int  segment_encoder_init( hb_work_object_t *, hb_job_t * );
+static int  segment_encoder_work( hb_work_object_t *, hb_buffer_t **,
+                                  hb_buffer_t ** );
+static void segment_encoder_close( hb_work_object_t * );
+static int  segment_spool_init( hb_work_object_t *, hb_job_t * );
+static int  segment_spool_work( hb_work_object_t *, hb_buffer_t **,
+                                hb_buffer_t ** );
+static void segment_spool_close( hb_work_object_t * );
+
+hb_work_object_t hb_segment_encoder =
+{
+    WORK_SEGMENT,
+    "Segment encoder",
+    segment_encoder_init,
+    segment_encoder_work,
+    segment_encoder_close
+};
+
+hb_work_object_t hb_segment_spool =
+{
+    WORK_SEGMENT_SPOOL,
+    "Segment spool",
+    segment_spool_init,
+    segment_spool_work,
+    segment_spool_close
+};
+
+/*
+ * Returns why the job can't be segmented, or NULL if it can.  Segments
+ * must be found by seeking and start from scratch in every filter and
+ * encoder, which rules out everything that carries state across the
+ * whole video.
+ */
+static const char * segment_check( hb_job_t * job )
+{
+    hb_subtitle_t      * subtitle;
+    hb_filter_object_t * filter;
+    int                  ii;
+
+    if( job->pass_id != HB_PASS_ENCODE || job->vquality < 0 )
+    {
+        return "only single pass constant quality encodes are segmented";
+    }
+    if( job->vcodec != HB_VCODEC_X264 && job->vcodec != HB_VCODEC_X265 )
+    {
+        return "the video encoder is not supported";
+    }
+    if( job->title->type != HB_FF_STREAM_TYPE )
+    {
+        return "the source can not be seeked exactly";
+    }
+    if( job->pts_to_start || job->pts_to_stop ||
+        job->frame_to_start || job->frame_to_stop || job->start_at_preview )
+    {
+        return "point-to-point encodes are not segmented";
+    }
+    if( job->use_opencl || job->use_hwd )
+    {
+        return "OpenCL and hardware decoding are not supported";
+    }
+    for( ii = 0; ii < hb_list_count( job->list_subtitle ); ii++ )
+    {
+        subtitle = hb_list_item( job->list_subtitle, ii );
+        if( subtitle->config.dest == PASSTHRUSUB )
+        {
+            return "subtitle pass-thru is not supported";
+        }
+    }
+    for( ii = 0; ii < hb_list_count( job->list_filter ); ii++ )
+    {
+        filter = hb_list_item( job->list_filter, ii );
+        if( filter->id == HB_FILTER_VFR )
+        {
+            int cfr = 0;
+            if( filter->settings != NULL )
+            {
+                sscanf( filter->settings, "%d", &cfr );
+            }
+            if( cfr != 0 )
+            {
+                return "constant and peak framerates are not supported";
+            }
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Picks the segment starts.  Segments are about even, but a segment
+ * starts at a chapter instead if one is within a quarter segment.
+ */
+static int segment_starts( hb_job_t * job, int count, int64_t * starts )
+{
+    hb_chapter_t * chapter;
+    int64_t        duration = 0;
+    int            ii, kk;
+
+    for( ii = job->chapter_start; ii <= job->chapter_end; ii++ )
+    {
+        chapter = hb_list_item( job->list_chapter, ii - 1 );
+        duration += chapter->duration;
+    }
+    count = MIN( count, duration / SEGMENT_MIN_DURATION );
+
+    starts[0] = 0;
+    for( kk = 1; kk < count; kk++ )
+    {
+        int64_t even  = duration * kk / count;
+        int64_t slack = duration / count / 4;
+        int64_t pos   = 0;
+
+        starts[kk] = even;
+        for( ii = job->chapter_start; ii < job->chapter_end; ii++ )
+        {
+            chapter = hb_list_item( job->list_chapter, ii - 1 );
+            pos += chapter->duration;
+            if( llabs( pos - even ) <= slack )
+            {
+                starts[kk] = pos;
+                slack = llabs( pos - even );
+            }
+        }
+    }
+    return count;
+}
+
+static void segment_func( void * _part )
+{
+    segment_part_t * part = _part;
+    hb_segment_t   * seg = part->segment;
+    hb_job_t       * job = part->job;
+
+    // do_job closes the job
+    part->job = NULL;
+    hb_work_segment( job );
+
+    hb_lock( seg->lock );
+    part->finished = 1;
+    hb_cond_broadcast( seg->cond );
+    hb_unlock( seg->lock );
+}
+
+static hb_job_t * segment_job( hb_job_t * job, int index )
+{
+    hb_segment_t * seg = job->segment;
+    hb_job_t     * copy;
+    hb_audio_t   * audio;
+
+    copy = hb_job_copy( job );
+    if( copy == NULL )
+    {
+        return NULL;
+    }
+
+    // The reader of a libavformat source leaves its context in the title
+    // for the decoders, so each pipeline needs a title of its own
+    seg->part[index].title = malloc( sizeof( hb_title_t ) );
+    if( seg->part[index].title == NULL )
+    {
+        hb_job_close( &copy );
+        return NULL;
+    }
+    *seg->part[index].title = *job->title;
+    copy->title = seg->part[index].title;
+
+    // All audio is encoded by the job's own pipeline
+    while( ( audio = hb_list_item( copy->list_audio, 0 ) ) )
+    {
+        hb_list_rem( copy->list_audio, audio );
+        hb_audio_close( &audio );
+    }
+    copy->h             = job->h;
+    copy->segment_index = index;
+    copy->pts_to_start  = seg->part[index].start;
+    copy->cpu_budget    = seg->cpu_budget;
+    return copy;
+}
+
+/**
+ * Splits the video of a job into segments and starts a pipeline for
+ * every segment but the first.  Leaves job->segment NULL if the job
+ * can't be segmented, which encodes it the usual way.
+ * @param job Job about to be run by do_job.
+ */
+void hb_segment_init( hb_job_t * job )
+{
+    hb_segment_t * seg;
+    int64_t        starts[SEGMENT_MAX];
+    const char   * reason;
+    int            count, cpu_count, ii;
+
+    if( job->segments < 2 )
+    {
+        return;
+    }
+    reason = segment_check( job );
+    if( reason != NULL )
+    {
+        hb_log( "segment: encoding in one segment, %s", reason );
+        return;
+    }
+    count = segment_starts( job, MIN( job->segments, SEGMENT_MAX ), starts );
+    if( count < 2 )
+    {
+        hb_log( "segment: encoding in one segment, the title is too short" );
+        return;
+    }
+
+    seg = calloc( 1, sizeof( hb_segment_t ) );
+    seg->lock  = hb_lock_init();
+    seg->cond  = hb_cond_init();
+    seg->die   = job->die;
+    seg->count = count;
+    cpu_count  = job->cpu_budget > 0 ? job->cpu_budget : hb_get_cpu_count();
+    seg->cpu_budget = MAX( cpu_count / count, 1 );
+    for( ii = 0; ii < count; ii++ )
+    {
+        seg->part[ii].segment = seg;
+        seg->part[ii].start   = starts[ii];
+    }
+
+    for( ii = 1; ii < count; ii++ )
+    {
+        segment_part_t * part = &seg->part[ii];
+
+        hb_get_tempory_filename( job->h, part->path, "segment%d_%d_%d.spool",
+                                 hb_get_instance_id(job->h), job->slot, ii );
+        part->spool_out = hb_fopen( part->path, "wb" );
+        if( part->spool_out != NULL )
+        {
+            part->spool_in = hb_fopen( part->path, "rb" );
+        }
+        if( part->spool_in == NULL )
+        {
+            hb_error( "segment: failed to create spool %s", part->path );
+            break;
+        }
+    }
+    if( ii < count )
+    {
+        seg->count = ii + 1;
+        job->segment = seg;
+        hb_segment_close( job );
+        hb_log( "segment: encoding in one segment" );
+        return;
+    }
+
+    job->segment = seg;
+    job->segment_index = 0;
+    hb_log( "segment: encoding video in %d segments, %d CPUs each",
+            count, seg->cpu_budget );
+    for( ii = 0; ii < count; ii++ )
+    {
+        int64_t start = seg->part[ii].start;
+        hb_log( "segment: segment %d starts at %02d:%02d:%02d", ii + 1,
+                (int)( start / 90000 / 3600 ),
+                (int)( start / 90000 / 60 % 60 ),
+                (int)( start / 90000 % 60 ) );
+    }
+
+    // The pipelines start right away, their readers wait for the clock
+    // zero of the job's reader before they seek
+    for( ii = 1; ii < count; ii++ )
+    {
+        segment_part_t * part = &seg->part[ii];
+
+        part->job = segment_job( job, ii );
+        if( part->job == NULL )
+        {
+            hb_error( "segment: failed to set up segment %d", ii + 1 );
+            *job->done_error = HB_ERROR_INIT;
+            *job->die = 1;
+            part->finished = 1;
+            continue;
+        }
+        part->thread = hb_thread_init( "segment", segment_func, part,
+                                       HB_LOW_PRIORITY );
+    }
+}
+
+/**
+ * Waits for the segment pipelines of a job and removes their spools.
+ * @param job Job with a segment context, or without one.
+ */
+void hb_segment_close( hb_job_t * job )
+{
+    hb_segment_t * seg = job->segment;
+    int            ii;
+
+    if( seg == NULL || job->segment_index != 0 )
+    {
+        return;
+    }
+    for( ii = 1; ii < seg->count; ii++ )
+    {
+        segment_part_t * part = &seg->part[ii];
+
+        if( part->thread != NULL )
+        {
+            hb_thread_close( &part->thread );
+        }
+        if( part->job != NULL )
+        {
+            hb_job_close( &part->job );
+        }
+        free( part->title );
+        if( part->spool_in != NULL )
+        {
+            fclose( part->spool_in );
+        }
+        if( part->spool_out != NULL )
+        {
+            fclose( part->spool_out );
+            unlink( part->path );
+        }
+    }
+    hb_cond_close( &seg->cond );
+    hb_lock_close( &seg->lock );
+    free( seg );
+    job->segment = NULL;
+}
+
+/**
+ * Returns the pts the segment of a pipeline ends at, on the clock of
+ * the job's reader, or 0 if it runs to the end of the video.
+ */
+int64_t hb_segment_stop( hb_job_t * job )
+{
+    hb_segment_t * seg = job->segment;
+
+    if( seg == NULL || job->segment_index + 1 >= seg->count )
+    {
+        return 0;
+    }
+    return seg->part[job->segment_index + 1].start;
+}
+
+/**
+ * Counts the frames sync has passed in a pipeline and returns the
+ * number passed in all pipelines of the job, for progress reports.
+ */
+int hb_segment_frames( hb_job_t * job, int count )
+{
+    hb_segment_t * seg = job->segment;
+    int            frames = 0, ii;
+
+    hb_lock( seg->lock );
+    seg->part[job->segment_index].frames = count;
+    for( ii = 0; ii < seg->count; ii++ )
+    {
+        frames += seg->part[ii].frames;
+    }
+    hb_unlock( seg->lock );
+    return frames;
+}
+
+/**
+ * Shares the clock zero of the job's reader with the readers of the
+ * segment pipelines, and returns the one to use.
+ * @param job Job of the reader.
+ * @param zero Zero the reader found, used by the job's reader.
+ */
+int64_t hb_segment_zero( hb_job_t * job, int64_t zero )
+{
+    hb_segment_t * seg = job->segment;
+
+    hb_lock( seg->lock );
+    if( job->segment_index == 0 )
+    {
+        if( !seg->zero_set )
+        {
+            seg->zero = zero;
+            seg->zero_set = 1;
+            hb_cond_broadcast( seg->cond );
+        }
+    }
+    else
+    {
+        while( !seg->zero_set && !*seg->die )
+        {
+            hb_cond_timedwait( seg->cond, seg->lock, 200 );
+        }
+    }
+    zero = seg->zero;
+    hb_unlock( seg->lock );
+    return zero;
+}
+
+/**
+ * Returns the source pts the reader of a segment pipeline seeks to, a
+ * little before its segment so that decoding starts on a keyframe.
+ */
+int64_t hb_segment_seek( hb_job_t * job )
+{
+    int64_t zero = hb_segment_zero( job, 0 );
+
+    return zero + job->segment->part[job->segment_index].start -
+           SEGMENT_PREROLL;
+}
+
+/**
+ * Paces the reader of the job once the first segment is encoded.  The
+ * reader then only needs audio, which waits for the appended video.
+ * Returns 0 if the packet should be dropped.
+ * @param job Job of the reader.
+ * @param start Start of the packet, on the clock of the reader.
+ * @param audio Whether the packet is audio.
+ */
+int hb_segment_pace( hb_job_t * job, int64_t start, int audio )
+{
+    hb_segment_t * seg = job->segment;
+    int            keep = 1;
+
+    hb_lock( seg->lock );
+    if( seg->appending )
+    {
+        keep = audio;
+        while( audio && start != AV_NOPTS_VALUE &&
+               start - SEGMENT_LEAD > seg->appended &&
+               !seg->appended_all && !*seg->die && !job->done )
+        {
+            hb_cond_timedwait( seg->cond, seg->lock, 200 );
+        }
+    }
+    hb_unlock( seg->lock );
+    return keep;
+}
+
+/**
+ * Wraps the video encoder of the job's pipeline so that the other
+ * segments are appended to its output.
+ * @param job Job with a segment context.
+ * @param encoder Video encoder, set up with its fifos and config.
+ */
+hb_work_object_t * hb_segment_encoder_init( hb_job_t * job,
+                                            hb_work_object_t * encoder )
+{
+    hb_work_object_t  * w = hb_get_work( job->h, WORK_SEGMENT );
+    hb_work_private_t * pv = calloc( 1, sizeof( hb_work_private_t ) );
+
+    pv->job       = job;
+    pv->segment   = job->segment;
+    pv->encoder   = encoder;
+    w->name       = encoder->name;
+    w->private_data = pv;
+    w->fifo_in    = encoder->fifo_in;
+    w->fifo_out   = encoder->fifo_out;
+    w->config     = encoder->config;
+    return w;
+}
+
+static int segment_encoder_init( hb_work_object_t * w, hb_job_t * job )
+{
+    hb_work_private_t * pv = w->private_data;
+    hb_work_object_t  * encoder = pv->encoder;
+    int                 cpu_budget = job->cpu_budget;
+    int                 result;
+
+    encoder->done = w->done;
+    encoder->thread_sleep_interval = w->thread_sleep_interval;
+
+    // Encoders size their threads by the job's CPU budget, the first
+    // segment gets the same share as the others
+    job->cpu_budget = pv->segment->cpu_budget;
+    result = encoder->init( encoder, job );
+    job->cpu_budget = cpu_budget;
+    return result;
+}
+
+static void segment_encoder_close( hb_work_object_t * w )
+{
+    hb_work_private_t * pv = w->private_data;
+
+    pv->encoder->close( pv->encoder );
+    free( pv->encoder );
+    free( pv );
+}
+
+static void segment_push( hb_work_object_t * w, hb_buffer_t * buf )
+{
+    hb_work_private_t * pv = w->private_data;
+
+    while( !*pv->job->die )
+    {
+        if( hb_fifo_full_wait( w->fifo_out ) )
+        {
+            hb_fifo_push( w->fifo_out, buf );
+            return;
+        }
+    }
+    hb_buffer_close( &buf );
+}
+
+// Reads the next packet from a spool, NULL if it is not written yet
+static hb_buffer_t * segment_read( segment_part_t * part, int64_t written )
+{
+    hb_buffer_settings_t s;
+    hb_buffer_t        * buf;
+    int                  size;
+
+    if( part->read >= written )
+    {
+        return NULL;
+    }
+    if( fread( &s, sizeof( s ), 1, part->spool_in ) != 1 ||
+        fread( &size, sizeof( size ), 1, part->spool_in ) != 1 )
+    {
+        return NULL;
+    }
+    buf = hb_buffer_init( size );
+    if( size > 0 && fread( buf->data, size, 1, part->spool_in ) != 1 )
+    {
+        hb_buffer_close( &buf );
+        return NULL;
+    }
+    buf->s = s;
+    part->read += sizeof( s ) + sizeof( size ) + size;
+    return buf;
+}
+
+/*
+ * Passes on the spooled packets of a segment as they are written,
+ * moved by 'offset'.  Returns 0 if the segment's pipeline failed.
+ */
+static int segment_append( hb_work_object_t * w, segment_part_t * part,
+                           int64_t offset )
+{
+    hb_work_private_t * pv = w->private_data;
+    hb_segment_t      * seg = pv->segment;
+    hb_buffer_t       * buf;
+    int64_t             written;
+    int                 done;
+
+    while( !*pv->job->die )
+    {
+        hb_lock( seg->lock );
+        while( part->read >= part->written && !part->done &&
+               !part->finished && !*pv->job->die )
+        {
+            hb_cond_timedwait( seg->cond, seg->lock, 200 );
+        }
+        written = part->written;
+        done = part->done;
+        hb_unlock( seg->lock );
+
+        if( part->read >= written )
+        {
+            return done;
+        }
+        while( ( buf = segment_read( part, written ) ) != NULL )
+        {
+            buf->s.start += offset;
+            buf->s.stop  += offset;
+            if( buf->s.renderOffset != AV_NOPTS_VALUE )
+            {
+                buf->s.renderOffset += offset;
+            }
+            pv->stop = MAX( pv->stop, buf->s.stop );
+
+            hb_lock( seg->lock );
+            seg->appended = buf->s.start;
+            hb_cond_broadcast( seg->cond );
+            hb_unlock( seg->lock );
+
+            segment_push( w, buf );
+        }
+        if( part->read < written )
+        {
+            hb_error( "segment: failed to read spool %s", part->path );
+            return 0;
+        }
+    }
+    return 0;
+}
+
+static int segment_encoder_work( hb_work_object_t * w, hb_buffer_t ** buf_in,
+                                 hb_buffer_t ** buf_out )
+{
+    hb_work_private_t * pv = w->private_data;
+    hb_segment_t      * seg = pv->segment;
+    hb_job_t          * job = pv->job;
+    hb_buffer_t       * buf, * next, * out = NULL, ** tail = &out;
+    int                 eof = (*buf_in)->size <= 0;
+    int                 status, ii;
+
+    status = pv->encoder->work( pv->encoder, buf_in, buf_out );
+    for( buf = *buf_out; buf != NULL; buf = buf->next )
+    {
+        pv->stop = MAX( pv->stop, buf->s.stop );
+    }
+    if( !eof )
+    {
+        return status;
+    }
+
+    // The first segment is flushed.  Pass it on without the end of
+    // stream, then append the other segments as they come in.
+    for( buf = *buf_out; buf != NULL; buf = next )
+    {
+        next = buf->next;
+        buf->next = NULL;
+        if( buf->size <= 0 )
+        {
+            hb_buffer_close( &buf );
+            continue;
+        }
+        *tail = buf;
+        tail = &buf->next;
+    }
+    *buf_out = NULL;
+    if( out != NULL )
+    {
+        segment_push( w, out );
+    }
+
+    hb_lock( seg->lock );
+    seg->appending = 1;
+    hb_cond_broadcast( seg->cond );
+    hb_unlock( seg->lock );
+
+    for( ii = 1; ii < seg->count && !*job->die; ii++ )
+    {
+        if( !segment_append( w, &seg->part[ii], pv->stop ) && !*job->die )
+        {
+            hb_error( "segment: segment %d failed", ii + 1 );
+            if( *job->done_error == HB_ERROR_NONE )
+            {
+                *job->done_error = HB_ERROR_UNKNOWN;
+            }
+            *job->die = 1;
+        }
+    }
+
+    hb_lock( seg->lock );
+    seg->appended_all = 1;
+    hb_cond_broadcast( seg->cond );
+    hb_unlock( seg->lock );
+
+    *buf_out = hb_buffer_init( 0 );
+    return HB_WORK_DONE;
+}
+
+/**
+ * Sets up the sink of a segment pipeline, which takes the place of the
+ * muxer and spools the video packets for hb_segment_encoder.
+ * @param job Segment pipeline.
+ */
+hb_work_object_t * hb_segment_spool_init( hb_job_t * job )
+{
+    hb_work_object_t  * w = hb_get_work( job->h, WORK_SEGMENT_SPOOL );
+    hb_work_private_t * pv = calloc( 1, sizeof( hb_work_private_t ) );
+
+    pv->job       = job;
+    pv->segment   = job->segment;
+    pv->part      = &job->segment->part[job->segment_index];
+    w->private_data = pv;
+    w->fifo_in    = job->fifo_mpeg4;
+    w->done       = &job->done;
+    return w;
+}
+
+static int segment_spool_init( hb_work_object_t * w, hb_job_t * job )
+{
+    return 0;
+}
+
+static void segment_spool_close( hb_work_object_t * w )
+{
+    free( w->private_data );
+}
+
+static int segment_spool_work( hb_work_object_t * w, hb_buffer_t ** buf_in,
+                               hb_buffer_t ** buf_out )
+{
+    hb_work_private_t * pv = w->private_data;
+    segment_part_t    * part = pv->part;
+    hb_buffer_t       * in = *buf_in;
+
+    *buf_out = NULL;
+    if( in->size <= 0 )
+    {
+        hb_lock( pv->segment->lock );
+        part->done = 1;
+        hb_cond_broadcast( pv->segment->cond );
+        hb_unlock( pv->segment->lock );
+        return HB_WORK_DONE;
+    }
+
+    if( fwrite( &in->s, sizeof( in->s ), 1, part->spool_out ) != 1 ||
+        fwrite( &in->size, sizeof( in->size ), 1, part->spool_out ) != 1 ||
+        fwrite( in->data, in->size, 1, part->spool_out ) != 1 ||
+        fflush( part->spool_out ) != 0 )
+    {
+        hb_error( "segment: failed to write spool %s", part->path );
+        *pv->job->done_error = HB_ERROR_UNKNOWN;
+        *pv->job->die = 1;
+        return HB_WORK_DONE;
+    }
+
+    hb_lock( pv->segment->lock );
+    part->written += sizeof( in->s ) + sizeof( in->size ) + in->size;
+    hb_cond_broadcast( pv->segment->cond );
+    hb_unlock( pv->segment->lock );
+    return HB_WORK_OK;
+}
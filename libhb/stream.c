@@ -10,16 +10,38 @@
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 
 #include "hb.h"
 #include "hbffmpeg.h"
 #include "lang.h"
+#include "nal_units.h"
 #include "libbluray/bluray.h"
 #include "vadxva2.h"
 
 #define min(a, b) a < b ? a : b
 #define HB_MAX_PROBE_SIZE (1*1024*1024)
 
+/*
+ * Transport and program streams are read in chunks into a buffer and
+ * packets are parsed in place.  The first read after a seek is small since
+ * seeks during scan only look at a few packets; the chunk then doubles
+ * on each sequential refill up to STREAM_CHUNK_MAX.
+ */
+#define STREAM_CHUNK_MIN (64*1024)
+#define STREAM_CHUNK_MAX (2*1024*1024)
+
+/*
+ * Transport streams keep an index of the video PES found while sampling
+ * the duration during scan and while seeking by timestamp.  The index is
+ * saved in the temporary directory so the stream opened for encoding
+ * can use it.  Timestamp seeks bisect the file until the keyframe found
+ * is within TS_SEEK_SLACK bytes of the target.
+ */
+#define TS_INDEX_MAX   4096
+#define TS_INDEX_MAGIC "HBTSIDX1"
+#define TS_SEEK_SLACK  (1024*1024)
+
 /*
  * This table defines how ISO MPEG stream type codes map to HandBrake
  * codecs. It is indexed by the 8 bit stream type and contains the codec
@@ -142,6 +164,12 @@ typedef struct {
     int      probe_next_size;
 } hb_pes_stream_t;
 
+typedef struct {
+    int64_t  pos;       // file offset of the TS packet starting the PES
+    int64_t  pts;       // PTS of the video PES
+    int      key;       // non-zero if the PES starts with a keyframe
+} hb_ts_index_entry_t;
+
 struct hb_stream_s
 {
     hb_handle_t * h;
@@ -170,7 +198,6 @@ struct hb_stream_s
         int64_t last_timestamp; // used for discontinuity detection when
                                 // there are no PCRs
 
-        uint8_t *packet;        // buffer for one TS packet
         hb_ts_stream_t *list;
         int count;
         int alloc;
@@ -197,8 +224,25 @@ struct hb_stream_s
 #define         TS_HAS_RAP  (1 << 1)    // Random Access Point bit seen
 #define         TS_HAS_RSEI (1 << 2)    // "Restart point" SEI seen
 
+    struct
+    {
+        hb_ts_index_entry_t *list;  // sorted by file offset
+        int count;
+        int alloc;
+        int loaded;             // non-zero once the saved index was read
+    } index;
+
     char    *path;
     FILE    *file_handle;
+
+    struct
+    {
+        uint8_t *buf;           // read buffer, STREAM_CHUNK_MAX bytes
+        int      size;          // bytes of file data in buf
+        int      pos;           // read position in buf
+        int      fill;          // size of the next read
+        off_t    offset;        // file offset of buf[0]
+    } chunk;
     hb_stream_type_t hb_stream_type;
     hb_title_t *title;
 
@@ -252,6 +296,7 @@ typedef struct
  * Local prototypes
  **********************************************************************/
 static void hb_stream_duration(hb_stream_t *stream, hb_title_t *inTitle);
+static int stream_chunk_init(hb_stream_t *stream);
 static off_t align_to_next_packet(hb_stream_t *stream);
 static int64_t pes_timestamp( const uint8_t *pes );
 
@@ -620,13 +665,16 @@ static int hb_stream_get_type(hb_stream_t *stream)
                    " offset %d bytes", psize, offset);
             stream->packetsize = psize;
             stream->hb_stream_type = transport;
-            if (hb_ts_stream_init(stream) == 0)
+            if (stream_chunk_init(stream) == 0 &&
+                hb_ts_stream_init(stream) == 0)
                 return 1;
         }
         else if ( hb_stream_check_for_ps(stream) != 0 )
         {
             hb_log("file is MPEG Program Stream");
             stream->hb_stream_type = program;
+            if (stream_chunk_init(stream) < 0)
+                return 0;
             hb_ps_stream_init(stream);
             // We default to mpeg codec for ps streams if no
             // video found in program stream map
@@ -646,10 +694,10 @@ static void hb_stream_delete_dynamic( hb_stream_t *d )
 
     int i=0;
 
-    if ( d->ts.packet )
+    if ( d->chunk.buf )
     {
-        free( d->ts.packet );
-        d->ts.packet = NULL;
+        free( d->chunk.buf );
+        d->chunk.buf = NULL;
     }
     if ( d->ts.list )
     {
@@ -671,6 +719,7 @@ static void hb_stream_delete( hb_stream_t *d )
     hb_stream_delete_dynamic( d );
     free( d->ts.list );
     free( d->pes.list );
+    free( d->index.list );
     free( d->path );
     free( d );
 }
@@ -940,7 +989,7 @@ hb_stream_t * hb_bd_stream_open( hb_handle_t *h, hb_title_t *title )
     d->file_handle = NULL;
     d->title = title;
     d->path = NULL;
-    d->ts.packet = NULL;
+    d->chunk.buf = NULL;
 
     int pid = title->video_id;
     int stream_type = title->video_stream_type;
@@ -1086,6 +1135,11 @@ hb_title_t * hb_stream_title_scan(hb_stream_t *stream, hb_title_t * title)
     // IDRs will be search for in hb_stream_duration
     stream->has_IDRs = 0;
     hb_stream_duration(stream, title);
+    if ( stream->hb_stream_type == transport )
+    {
+        // the duration samples seed the seek index
+        ts_index_save( stream );
+    }
 
     // One Chapter
     hb_chapter_t * chapter;
@@ -1129,27 +1183,214 @@ hb_title_t * hb_stream_title_scan(hb_stream_t *stream, hb_title_t * title)
     return title;
 }
 
+/*
+ * Transport and program streams are read through 'chunk'.  The file
+ * position of 'file_handle' is always chunk.offset + chunk.size once the
+ * chunk buffer exists.
+ */
+static int stream_chunk_init( hb_stream_t *stream )
+{
+    if ( stream->chunk.buf == NULL )
+    {
+        stream->chunk.buf = malloc( STREAM_CHUNK_MAX );
+        if ( stream->chunk.buf == NULL )
+        {
+            hb_error( "stream: can't allocate read buffer" );
+            return -1;
+        }
+    }
+    stream->chunk.offset = ftello( stream->file_handle );
+    stream->chunk.size = 0;
+    stream->chunk.pos = 0;
+    stream->chunk.fill = STREAM_CHUNK_MIN;
+#if defined(POSIX_FADV_SEQUENTIAL)
+    posix_fadvise( fileno( stream->file_handle ), 0, 0, POSIX_FADV_SEQUENTIAL );
+#endif
+    return 0;
+}
+
+static off_t stream_tell( hb_stream_t *stream )
+{
+    if ( stream->chunk.buf == NULL )
+    {
+        return ftello( stream->file_handle );
+    }
+    return stream->chunk.offset + stream->chunk.pos;
+}
+
+static int stream_seek( hb_stream_t *stream, off_t offset, int whence )
+{
+    if ( stream->chunk.buf == NULL )
+    {
+        return fseeko( stream->file_handle, offset, whence );
+    }
+    if ( whence == SEEK_CUR )
+    {
+        offset += stream_tell( stream );
+        whence = SEEK_SET;
+    }
+    if ( whence == SEEK_SET && offset >= stream->chunk.offset &&
+         offset <= stream->chunk.offset + stream->chunk.size )
+    {
+        // still inside the data we have
+        stream->chunk.pos = offset - stream->chunk.offset;
+        return 0;
+    }
+    if ( fseeko( stream->file_handle, offset, whence ) == -1 )
+    {
+        return -1;
+    }
+    stream->chunk.offset = ftello( stream->file_handle );
+    stream->chunk.size   = 0;
+    stream->chunk.pos    = 0;
+    stream->chunk.fill   = STREAM_CHUNK_MIN;
+    return 0;
+}
+
+/*
+ * Make at least 'len' bytes available at chunk.pos unless we hit eof.
+ * Returns the number of bytes available.
+ */
+static int stream_fill( hb_stream_t *stream, int len )
+{
+    if ( stream->chunk.size - stream->chunk.pos < len )
+    {
+        // Move the unread tail (e.g. a packet split by the end of the
+        // previous chunk) to the front and refill behind it.
+        int left = stream->chunk.size - stream->chunk.pos;
+        memmove( stream->chunk.buf, stream->chunk.buf + stream->chunk.pos, left );
+        stream->chunk.offset += stream->chunk.pos;
+        stream->chunk.pos = 0;
+        stream->chunk.size = left;
+
+        int fill = stream->chunk.fill;
+        if ( fill < len )
+            fill = len;
+        if ( fill > STREAM_CHUNK_MAX - left )
+            fill = STREAM_CHUNK_MAX - left;
+        stream->chunk.size += fread( stream->chunk.buf + left, 1, fill,
+                                     stream->file_handle );
+        if ( stream->chunk.fill < STREAM_CHUNK_MAX )
+        {
+            stream->chunk.fill *= 2;
+        }
+#if defined(POSIX_FADV_WILLNEED)
+        else
+        {
+            // reading sequentially, have the OS fetch the next chunk
+            // while we demux this one.
+            posix_fadvise( fileno( stream->file_handle ),
+                           stream->chunk.offset + stream->chunk.size,
+                           STREAM_CHUNK_MAX, POSIX_FADV_WILLNEED );
+        }
+#endif
+    }
+    return stream->chunk.size - stream->chunk.pos;
+}
+
+/*
+ * Return a pointer to the next 'len' bytes of the stream and advance
+ * past them, or NULL at eof.  The data stays valid until the next
+ * read or seek.
+ */
+static const uint8_t *stream_read( hb_stream_t *stream, int len )
+{
+    const uint8_t *buf;
+
+    if ( stream_fill( stream, len ) < len )
+    {
+        return NULL;
+    }
+    buf = stream->chunk.buf + stream->chunk.pos;
+    stream->chunk.pos += len;
+    return buf;
+}
+
+/*
+ * Copy up to 'len' bytes of the stream to 'dst'.  Returns the number
+ * of bytes copied, which is less than 'len' only at eof.
+ */
+static int stream_read_buf( hb_stream_t *stream, uint8_t *dst, int len )
+{
+    int avail = stream_fill( stream, len );
+
+    if ( avail > len )
+        avail = len;
+    memcpy( dst, stream->chunk.buf + stream->chunk.pos, avail );
+    stream->chunk.pos += avail;
+    return avail;
+}
+
+// Advance 'len' bytes, appending them to 'b' at *pos if 'b' is non-NULL
+static void stream_skip( hb_stream_t *stream, int len, hb_buffer_t *b, int *pos )
+{
+    if ( b != NULL )
+    {
+        if ( *pos + len > b->alloc )
+        {
+            if ( b->alloc * 2 > *pos + len )
+                hb_buffer_realloc( b, b->alloc * 2 );
+            else
+                hb_buffer_realloc( b, *pos + len );
+        }
+        memcpy( b->data + *pos, stream->chunk.buf + stream->chunk.pos, len );
+        *pos += len;
+    }
+    stream->chunk.pos += len;
+}
+
+/*
+ * Advance to the next start code 00 00 01 xx with min_id <= xx <= max_id.
+ * Returns 1 with the start code as the next bytes to be read, or 0 at
+ * eof.  The bytes skipped are appended to 'b' at *pos if 'b' is non-NULL.
+ */
+static int stream_find_start_code( hb_stream_t *stream, int min_id, int max_id,
+                                   hb_buffer_t *b, int *pos )
+{
+    while ( stream_fill( stream, 4 ) >= 4 )
+    {
+        const uint8_t *start = stream->chunk.buf + stream->chunk.pos;
+        const uint8_t *end   = stream->chunk.buf + stream->chunk.size;
+        const uint8_t *sc    = start;
+
+        // the id byte has to be in the chunk too, so search to end - 1
+        while ( ( sc = hb_find_startcode( sc, end - 1 ) ) < end - 1 )
+        {
+            if ( sc[3] >= min_id && sc[3] <= max_id )
+            {
+                stream_skip( stream, sc - start, b, pos );
+                return 1;
+            }
+            sc++;
+        }
+        // The last 3 bytes may begin a start code that continues in the
+        // next chunk.
+        stream_skip( stream, end - 3 - start, b, pos );
+    }
+    stream_skip( stream, stream->chunk.size - stream->chunk.pos, b, pos );
+    return 0;
+}
+
 /*
  * read the next transport stream packet from 'stream'. Return NULL if
  * we hit eof & a pointer to the sync byte otherwise.
  */
 static const uint8_t *next_packet( hb_stream_t *stream )
 {
-    uint8_t *buf = stream->ts.packet + stream->packetsize - 188;
-
     while ( 1 )
     {
-        if ( fread(stream->ts.packet, 1, stream->packetsize, stream->file_handle) !=
-             stream->packetsize )
+        const uint8_t *buf = stream_read( stream, stream->packetsize );
+        if ( buf == NULL )
         {
             return NULL;
         }
+        buf += stream->packetsize - 188;
         if (buf[0] == 0x47)
         {
             return buf;
         }
         // lost sync - back up to where we started then try to re-establish.
-        off_t pos = ftello(stream->file_handle) - stream->packetsize;
+        off_t pos = stream_tell(stream) - stream->packetsize;
         off_t pos2 = align_to_next_packet(stream);
         if ( pos2 == 0 )
         {
@@ -1166,26 +1407,9 @@ static const uint8_t *next_packet( hb_stream_t *stream )
  */
 static void skip_to_next_pack( hb_stream_t *src_stream )
 {
-    // scan forward until we find the start of the next pack
-    uint32_t strt_code = -1;
-    int c;
-
-    flockfile( src_stream->file_handle );
-    while ( ( c = getc_unlocked( src_stream->file_handle ) ) != EOF )
-    {
-        strt_code = ( strt_code << 8 ) | c;
-        if ( strt_code == 0x000001ba )
-            // we found the start of the next pack
-            break;
-    }
-    funlockfile( src_stream->file_handle );
-
-    // if we didn't terminate on an eof back up so the next read
-    // starts on the pack boundary.
-    if ( c != EOF )
-    {
-        fseeko( src_stream->file_handle, -4, SEEK_CUR );
-    }
+    // scan forward until we find the start of the next pack, leaving
+    // the pack header as the next thing to read.
+    stream_find_start_code( src_stream, 0xba, 0xba, NULL, NULL );
 }
 
 static void CreateDecodedNAL( uint8_t **dst, int *dst_len,
@@ -1259,13 +1483,24 @@ static int isRecoveryPoint( const uint8_t *buf, int len )
     return recovery_frames;
 }
 
+/*
+ * Returns the index of the id byte of the first start code that begins
+ * at or after buf[ii], or -1 if there is none.
+ */
+static int next_start_code( const uint8_t *buf, int ii, int len )
+{
+    if ( len - ii < 4 )
+        return -1;
+    const uint8_t *sc = hb_find_startcode( buf + ii, buf + len - 1 );
+    return sc < buf + len - 1 ? sc + 3 - buf : -1;
+}
+
 static int isIframe( hb_stream_t *stream, const uint8_t *buf, int len )
 {
     // For mpeg2: look for a gop start or i-frame picture start
     // for h.264: look for idr nal type or a slice header for an i-frame
     // for vc1:   look for a Sequence header
     int ii;
-    uint32_t strid = 0;
 
 
     int vid = pes_index_of_video( stream );
@@ -1275,32 +1510,29 @@ static int isIframe( hb_stream_t *stream, const uint8_t *buf, int len )
          pes->codec_param == AV_CODEC_ID_MPEG2VIDEO )
     {
         // This section of the code handles MPEG-1 and MPEG-2 video streams
-        for (ii = 0; ii < len; ii++)
+        for ( ii = next_start_code( buf, 0, len ); ii >= 0;
+              ii = next_start_code( buf, ii, len ) )
         {
-            strid = (strid << 8) | buf[ii];
-            if ( ( strid >> 8 ) == 1 )
+            // we found a start code
+            uint8_t id = buf[ii];
+            switch ( id )
             {
-                // we found a start code
-                uint8_t id = strid;
-                switch ( id )
-                {
-                    case 0xB8: // group_start_code (GOP header)
-                    case 0xB3: // sequence_header code
-                        return 1;
+                case 0xB8: // group_start_code (GOP header)
+                case 0xB3: // sequence_header code
+                    return 1;
 
-                    case 0x00: // picture_start_code
-                        // picture_header, let's see if it's an I-frame
-                        if (ii < len - 3)
+                case 0x00: // picture_start_code
+                    // picture_header, let's see if it's an I-frame
+                    if (ii < len - 3)
+                    {
+                        // check if picture_coding_type == 1
+                        if ((buf[ii+2] & (0x7 << 3)) == (1 << 3))
                         {
-                            // check if picture_coding_type == 1
-                            if ((buf[ii+2] & (0x7 << 3)) == (1 << 3))
-                            {
-                                // found an I-frame picture
-                                return 1;
-                            }
+                            // found an I-frame picture
+                            return 1;
                         }
-                        break;
-                }
+                    }
+                    break;
             }
         }
         // didn't find an I-frame
@@ -1309,31 +1541,28 @@ static int isIframe( hb_stream_t *stream, const uint8_t *buf, int len )
     if ( pes->stream_type == 0x1b || pes->codec_param == AV_CODEC_ID_H264 )
     {
         // we have an h.264 stream
-        for (ii = 0; ii < len; ii++)
+        for ( ii = next_start_code( buf, 0, len ); ii >= 0;
+              ii = next_start_code( buf, ii, len ) )
         {
-            strid = (strid << 8) | buf[ii];
-            if ( ( strid >> 8 ) == 1 )
+            // we found a start code - remove the ref_idc from the nal type
+            uint8_t nal_type = buf[ii] & 0x1f;
+            if ( nal_type == 0x01 )
             {
-                // we found a start code - remove the ref_idc from the nal type
-                uint8_t nal_type = strid & 0x1f;
-                if ( nal_type == 0x01 )
-                {
-                    // Found slice and no recovery point
-                    return 0;
-                }
-                if ( nal_type == 0x05 )
-                {
-                    // h.264 IDR picture start
-                    return 1;
-                }
-                else if ( nal_type == 0x06 )
+                // Found slice and no recovery point
+                return 0;
+            }
+            if ( nal_type == 0x05 )
+            {
+                // h.264 IDR picture start
+                return 1;
+            }
+            else if ( nal_type == 0x06 )
+            {
+                int off = ii + 1;
+                int recovery_frames = isRecoveryPoint( buf+off, len-off );
+                if ( recovery_frames )
                 {
-                    int off = ii + 1;
-                    int recovery_frames = isRecoveryPoint( buf+off, len-off );
-                    if ( recovery_frames )
-                    {
-                        return recovery_frames;
-                    }
+                    return recovery_frames;
                 }
             }
         }
@@ -1343,10 +1572,10 @@ static int isIframe( hb_stream_t *stream, const uint8_t *buf, int len )
     if ( pes->stream_type == 0xea || pes->codec_param == AV_CODEC_ID_VC1 )
     {
         // we have an vc1 stream
-        for (ii = 0; ii < len; ii++)
+        for ( ii = next_start_code( buf, 0, len ); ii >= 0;
+              ii = next_start_code( buf, ii, len ) )
         {
-            strid = (strid << 8) | buf[ii];
-            if ( strid == 0x10f )
+            if ( buf[ii] == 0x0f )
             {
                 // the ffmpeg vc1 decoder requires a seq hdr code in the first
                 // frame.
@@ -1359,10 +1588,10 @@ static int isIframe( hb_stream_t *stream, const uint8_t *buf, int len )
     if ( pes->stream_type == 0x10 || pes->codec_param == AV_CODEC_ID_MPEG4 )
     {
         // we have an mpeg4 stream
-        for (ii = 0; ii < len-1; ii++)
+        for ( ii = next_start_code( buf, 0, len ); ii >= 0 && ii < len-1;
+              ii = next_start_code( buf, ii, len ) )
         {
-            strid = (strid << 8) | buf[ii];
-            if ( strid == 0x1b6 )
+            if ( buf[ii] == 0xb6 )
             {
                 if ((buf[ii+1] & 0xC0) == 0)
                     return 1;
@@ -1455,6 +1684,198 @@ static const uint8_t *hb_ts_stream_getPEStype(hb_stream_t *stream, uint32_t pid,
     return 0;
 }
 
+static void ts_index_add( hb_stream_t *stream, off_t pos, int64_t pts, int key )
+{
+    int ii = stream->index.count;
+
+    while ( ii > 0 && stream->index.list[ii-1].pos >= pos )
+    {
+        ii--;
+    }
+    if ( ii < stream->index.count && stream->index.list[ii].pos == pos )
+    {
+        // already indexed
+        return;
+    }
+    if ( stream->index.count >= TS_INDEX_MAX )
+    {
+        return;
+    }
+    if ( stream->index.count == stream->index.alloc )
+    {
+        int num = stream->index.alloc ? stream->index.alloc * 2 : 256;
+        hb_ts_index_entry_t *list = realloc( stream->index.list,
+                                             sizeof( hb_ts_index_entry_t ) * num );
+        if ( list == NULL )
+        {
+            return;
+        }
+        stream->index.list = list;
+        stream->index.alloc = num;
+    }
+    memmove( &stream->index.list[ii+1], &stream->index.list[ii],
+             ( stream->index.count - ii ) * sizeof( hb_ts_index_entry_t ) );
+    stream->index.list[ii].pos = pos;
+    stream->index.list[ii].pts = pts;
+    stream->index.list[ii].key = key;
+    stream->index.count++;
+}
+
+// The saved index belongs to this path, file size and modification time
+static int ts_index_key( hb_stream_t *stream, char name[1024], int64_t key[2] )
+{
+    hb_stat_t sb;
+    uint32_t hash = 2166136261u;
+    const char *p;
+
+    if ( stream->path == NULL || hb_stat( stream->path, &sb ) )
+    {
+        return -1;
+    }
+    key[0] = sb.st_size;
+    key[1] = sb.st_mtime;
+
+    // FNV-1a hash of the path
+    for ( p = stream->path; *p; p++ )
+    {
+        hash = ( hash ^ (uint8_t)*p ) * 16777619u;
+    }
+    hb_get_tempory_filename( stream->h, name, "tsindex_%08x", hash );
+    return 0;
+}
+
+static void ts_index_save( hb_stream_t *stream )
+{
+    char name[1024], tmp[1100];
+    int64_t key[2];
+    int32_t len, count = stream->index.count;
+    FILE *f;
+
+    if ( count == 0 || ts_index_key( stream, name, key ) < 0 )
+    {
+        return;
+    }
+    // write to a private file first so concurrent readers never see
+    // a partial index
+    snprintf( tmp, sizeof( tmp ), "%s.%p", name, (void*)stream );
+    f = hb_fopen( tmp, "wb" );
+    if ( f == NULL )
+    {
+        return;
+    }
+    len = strlen( stream->path );
+    if ( fwrite( TS_INDEX_MAGIC, 8, 1, f ) != 1 ||
+         fwrite( key, sizeof( key ), 1, f ) != 1 ||
+         fwrite( &len, sizeof( len ), 1, f ) != 1 ||
+         fwrite( stream->path, len, 1, f ) != 1 ||
+         fwrite( &count, sizeof( count ), 1, f ) != 1 ||
+         fwrite( stream->index.list, sizeof( hb_ts_index_entry_t ),
+                 count, f ) != count )
+    {
+        fclose( f );
+        unlink( tmp );
+        return;
+    }
+    fclose( f );
+    unlink( name );
+    if ( rename( tmp, name ) )
+    {
+        unlink( tmp );
+    }
+}
+
+static void ts_index_load( hb_stream_t *stream )
+{
+    char name[1024], magic[8], path[1024];
+    int64_t key[2], saved_key[2];
+    int32_t len, count;
+    hb_ts_index_entry_t *list;
+    FILE *f;
+
+    stream->index.loaded = 1;
+    if ( stream->index.count || ts_index_key( stream, name, key ) < 0 )
+    {
+        return;
+    }
+    f = hb_fopen( name, "rb" );
+    if ( f == NULL )
+    {
+        return;
+    }
+    if ( fread( magic, 8, 1, f ) != 1 ||
+         memcmp( magic, TS_INDEX_MAGIC, 8 ) ||
+         fread( saved_key, sizeof( saved_key ), 1, f ) != 1 ||
+         memcmp( key, saved_key, sizeof( key ) ) ||
+         fread( &len, sizeof( len ), 1, f ) != 1 ||
+         len <= 0 || len >= sizeof( path ) ||
+         fread( path, len, 1, f ) != 1 )
+    {
+        fclose( f );
+        return;
+    }
+    path[len] = 0;
+    if ( strcmp( path, stream->path ) ||
+         fread( &count, sizeof( count ), 1, f ) != 1 ||
+         count <= 0 || count > TS_INDEX_MAX )
+    {
+        fclose( f );
+        return;
+    }
+    list = malloc( sizeof( hb_ts_index_entry_t ) * count );
+    if ( list != NULL &&
+         fread( list, sizeof( hb_ts_index_entry_t ), count, f ) == count )
+    {
+        free( stream->index.list );
+        stream->index.list = list;
+        stream->index.count = count;
+        stream->index.alloc = count;
+        hb_deep_log( 2, "stream: loaded index of %d video PES", count );
+    }
+    else
+    {
+        free( list );
+    }
+    fclose( f );
+}
+
+/*
+ * Find the first video PES starting with a keyframe at (or one packet
+ * before) file offset 'pos' and add it to the index.  When the stream
+ * has no IDRs, any video PES will do.  Returns 0 if none was found.
+ */
+static int ts_index_probe( hb_stream_t *stream, off_t pos,
+                           hb_ts_index_entry_t *entry )
+{
+    int pid = stream->ts.list[ts_index_of_video(stream)].pid;
+    int ii, adapt_len;
+
+    stream_seek( stream, pos, SEEK_SET );
+    align_to_next_packet( stream );
+
+    // give up after the same number of frames the demuxer waits for
+    // a keyframe
+    for ( ii = 0; ii < 512; ii++ )
+    {
+        const uint8_t *buf = hb_ts_stream_getPEStype( stream, pid, &adapt_len );
+        if ( buf == NULL )
+        {
+            return 0;
+        }
+        const uint8_t *pes = buf + 4 + adapt_len;
+        if ( ( pes[7] >> 7 ) != 1 ||
+             ( stream->has_IDRs && !ts_isIframe( stream, buf, adapt_len ) ) )
+        {
+            continue;
+        }
+        entry->pos = stream_tell( stream ) - stream->packetsize;
+        entry->pts = pes_timestamp( pes + 9 );
+        entry->key = 1;
+        ts_index_add( stream, entry->pos, entry->pts, entry->key );
+        return 1;
+    }
+    return 0;
+}
+
 static hb_buffer_t * hb_ps_stream_getVideo(
     hb_stream_t *stream,
     hb_pes_info_t *pi)
@@ -1543,7 +1964,7 @@ static struct pts_pos hb_sample_pts(hb_stream_t *stream, uint64_t fpos)
     {
         const uint8_t *buf;
         int adapt_len;
-        fseeko( stream->file_handle, fpos, SEEK_SET );
+        stream_seek( stream, fpos, SEEK_SET );
         align_to_next_packet( stream );
         int pid = stream->ts.list[ts_index_of_video(stream)].pid;
         buf = hb_ts_stream_getPEStype( stream, pid, &adapt_len );
@@ -1564,14 +1985,16 @@ static struct pts_pos hb_sample_pts(hb_stream_t *stream, uint64_t fpos)
                  (  (uint64_t)pes[12] << 7 )             |
                  (  (uint64_t)pes[13] >> 1 );
 
-        if ( ts_isIframe( stream, buf, adapt_len ) )
+        int key = ts_isIframe( stream, buf, adapt_len );
+        if ( key )
         {
             if (  stream->has_IDRs < 255 )
             {
                 ++stream->has_IDRs;
             }
         }
-        pp.pos = ftello(stream->file_handle);
+        pp.pos = stream_tell(stream);
+        ts_index_add( stream, pp.pos - stream->packetsize, pp.pts, key );
         if ( !stream->has_IDRs )
         {
             // Scan a little more to see if we will stumble upon one
@@ -1596,7 +2019,7 @@ static struct pts_pos hb_sample_pts(hb_stream_t *stream, uint64_t fpos)
 
         // round address down to nearest dvd sector start
         fpos &=~ ( HB_DVD_READ_BUFFER_SIZE - 1 );
-        fseeko( stream->file_handle, fpos, SEEK_SET );
+        stream_seek( stream, fpos, SEEK_SET );
         if ( stream->hb_stream_type == program )
         {
             skip_to_next_pack( stream );
@@ -1641,7 +2064,7 @@ static struct pts_pos hb_sample_pts(hb_stream_t *stream, uint64_t fpos)
         }
 
         pp.pts = pes_info.pts;
-        pp.pos = ftello(stream->file_handle);
+        pp.pos = stream_tell(stream);
     }
     return pp;
 }
@@ -1701,8 +2124,8 @@ static void hb_stream_duration(hb_stream_t *stream, hb_title_t *inTitle)
     struct pts_pos *pp = ptspos;
     int i;
 
-    fseeko(stream->file_handle, 0, SEEK_END);
-    uint64_t fsize = ftello(stream->file_handle);
+    stream_seek(stream, 0, SEEK_END);
+    uint64_t fsize = stream_tell(stream);
     uint64_t fincr = fsize / NDURSAMPLES;
     uint64_t fpos = fincr / 2;
     for ( i = NDURSAMPLES; --i >= 0; fpos += fincr )
@@ -1716,7 +2139,7 @@ static void hb_stream_duration(hb_stream_t *stream, hb_title_t *inTitle)
     inTitle->minutes  = ( dur % 3600 ) / 60;
     inTitle->seconds  = dur % 60;
 
-    rewind(stream->file_handle);
+    stream_seek(stream, 0, SEEK_SET);
 }
 
 /***********************************************************************
@@ -1811,16 +2234,16 @@ int hb_stream_seek( hb_stream_t * stream, float f )
     }
     off_t stream_size, cur_pos, new_pos;
     double pos_ratio = f;
-    cur_pos = ftello( stream->file_handle );
-    fseeko( stream->file_handle, 0, SEEK_END );
-    stream_size = ftello( stream->file_handle );
+    cur_pos = stream_tell( stream );
+    stream_seek( stream, 0, SEEK_END );
+    stream_size = stream_tell( stream );
     new_pos = (off_t) ((double) (stream_size) * pos_ratio);
     new_pos &=~ (HB_DVD_READ_BUFFER_SIZE - 1);
 
-    int r = fseeko( stream->file_handle, new_pos, SEEK_SET );
+    int r = stream_seek( stream, new_pos, SEEK_SET );
     if (r == -1)
     {
-        fseeko( stream->file_handle, cur_pos, SEEK_SET );
+        stream_seek( stream, cur_pos, SEEK_SET );
         return 0;
     }
 
@@ -1850,12 +2273,123 @@ int hb_stream_seek( hb_stream_t * stream, float f )
     return 1;
 }
 
+/*
+ * Seek a transport stream to the last keyframe at or before video
+ * timestamp 'ts'.  Starting from the closest index entries, the file
+ * is bisected with keyframe probes.  Fails without moving if the
+ * timestamps aren't increasing through the file (e.g. the file was
+ * cut together from several recordings).
+ */
+static int ts_seek_ts( hb_stream_t *stream, int64_t ts )
+{
+    hb_ts_index_entry_t lo, entry;
+    off_t cur_pos, hi_pos;
+    int ii, count;
+
+    if ( ts_index_of_video( stream ) < 0 )
+    {
+        return -1;
+    }
+    if ( !stream->index.loaded )
+    {
+        ts_index_load( stream );
+    }
+    count = stream->index.count;
+    cur_pos = stream_tell( stream );
+    stream_seek( stream, 0, SEEK_END );
+    hi_pos = stream_tell( stream );
+
+    // Only keyframes are checked for increasing timestamps since other
+    // frames may be reordered.
+    lo.pos = -1;
+    for ( ii = 0; ii < stream->index.count; ii++ )
+    {
+        hb_ts_index_entry_t *e = &stream->index.list[ii];
+        if ( !e->key && stream->has_IDRs )
+        {
+            continue;
+        }
+        if ( lo.pos >= 0 && e->pts < lo.pts )
+        {
+            hb_log( "hb_stream_seek_ts: timestamps aren't increasing, can't seek" );
+            stream_seek( stream, cur_pos, SEEK_SET );
+            return -1;
+        }
+        lo = *e;
+    }
+
+    lo.pos = -1;
+    for ( ii = 0; ii < stream->index.count; ii++ )
+    {
+        hb_ts_index_entry_t *e = &stream->index.list[ii];
+        if ( e->pts > ts )
+        {
+            hi_pos = e->pos;
+            break;
+        }
+        if ( e->key || !stream->has_IDRs )
+        {
+            lo = *e;
+        }
+    }
+    if ( lo.pos < 0 && ( !ts_index_probe( stream, 0, &lo ) || lo.pts > ts ) )
+    {
+        // ts is before the first keyframe
+        stream_seek( stream, cur_pos, SEEK_SET );
+        return -1;
+    }
+
+    while ( hi_pos - lo.pos > TS_SEEK_SLACK )
+    {
+        off_t mid = lo.pos + ( hi_pos - lo.pos ) / 2;
+        if ( !ts_index_probe( stream, mid, &entry ) || entry.pos >= hi_pos )
+        {
+            // no keyframe between mid and hi
+            hi_pos = mid;
+            continue;
+        }
+        if ( entry.pts < lo.pts )
+        {
+            hb_log( "hb_stream_seek_ts: timestamps aren't increasing, can't seek" );
+            stream_seek( stream, cur_pos, SEEK_SET );
+            return -1;
+        }
+        if ( entry.pts <= ts )
+        {
+            lo = entry;
+        }
+        else
+        {
+            hi_pos = mid;
+        }
+    }
+
+    hb_deep_log( 2, "hb_stream_seek_ts: ts %"PRId64", keyframe pts %"PRId64" @ %"PRId64,
+                 ts, lo.pts, lo.pos );
+    stream_seek( stream, lo.pos, SEEK_SET );
+    hb_ts_stream_reset( stream );
+    if ( !stream->has_IDRs )
+    {
+        // the stream has no IDRs so don't look for one.
+        stream->need_keyframe = 0;
+    }
+    if ( stream->index.count != count )
+    {
+        ts_index_save( stream );
+    }
+    return 0;
+}
+
 int hb_stream_seek_ts( hb_stream_t * stream, int64_t ts )
 {
     if ( stream->hb_stream_type == ffmpeg )
     {
         return ffmpeg_seek_ts( stream, ts );
     }
+    if ( stream->hb_stream_type == transport && stream->file_handle != NULL )
+    {
+        return ts_seek_ts( stream, ts );
+    }
     return -1;
 }
 
@@ -2213,8 +2747,6 @@ static int hb_ts_stream_init(hb_stream_t *stream)
     }
     stream->pes.count = 0;
 
-    stream->ts.packet = malloc( stream->packetsize );
-
     // Find the audio and video pids in the stream
     if (hb_ts_stream_find_pids(stream) < 0)
     {
@@ -2392,25 +2924,25 @@ static void hb_ps_stream_init(hb_stream_t *stream)
 
 static off_t align_to_next_packet(hb_stream_t *stream)
 {
-    uint8_t buf[MAX_HOLE];
+    const uint8_t *buf;
     off_t pos = 0;
-    off_t start = ftello(stream->file_handle);
+    off_t start = stream_tell(stream);
     off_t orig;
 
     if ( start >= stream->packetsize ) {
         start -= stream->packetsize;
-        fseeko(stream->file_handle, start, SEEK_SET);
+        stream_seek(stream, start, SEEK_SET);
     }
     orig = start;
 
     while (1)
     {
-        if (fread(buf, sizeof(buf), 1, stream->file_handle) == 1)
+        if ((buf = stream_read(stream, MAX_HOLE)) != NULL)
         {
             const uint8_t *bp = buf;
             int i;
 
-            for ( i = sizeof(buf) - 8 * stream->packetsize; --i >= 0; ++bp )
+            for ( i = MAX_HOLE - 8 * stream->packetsize; --i >= 0; ++bp )
             {
                 if ( have_ts_sync( bp, stream->packetsize, 8 ) )
                 {
@@ -2422,15 +2954,15 @@ static off_t align_to_next_packet(hb_stream_t *stream)
                 pos = ( bp - buf ) - stream->packetsize + 188;
                 break;
             }
-            fseeko(stream->file_handle, -8 * stream->packetsize, SEEK_CUR);
-            start = ftello(stream->file_handle);
+            stream_seek(stream, -8 * stream->packetsize, SEEK_CUR);
+            start = stream_tell(stream);
         }
         else
         {
             return 0;
         }
     }
-    fseeko(stream->file_handle, start+pos, SEEK_SET);
+    stream_seek(stream, start+pos, SEEK_SET);
     return start - orig + pos;
 }
 
@@ -3239,21 +3771,13 @@ static int hb_parse_ps(
 static int hb_ps_read_packet( hb_stream_t * stream, hb_buffer_t *b )
 {
     // Appends to buffer if size != 0
-    int start_code = -1;
-    int pos = b->size;
+    int size = b->size;
+    int pos = size;
     int stream_id = -1;
-    int c;
+    const uint8_t *start_code;
 
 #define cp (b->data)
-    flockfile( stream->file_handle );
-    while ( ( c = getc_unlocked( stream->file_handle ) ) != EOF )
-    {
-        start_code = ( start_code << 8 ) | c;
-        if ( ( start_code >> 8 )== 0x000001 )
-            // we found the start of the next start
-            break;
-    }
-    if ( c == EOF )
+    if ( !stream_find_start_code( stream, 0x00, 0xff, NULL, NULL ) )
         goto done;
 
     if ( pos + 4 > b->alloc )
@@ -3261,11 +3785,10 @@ static int hb_ps_read_packet( hb_stream_t * stream, hb_buffer_t *b )
         // need to expand the buffer
         hb_buffer_realloc( b, b->alloc * 2 );
     }
-    cp[pos++] = ( start_code >> 24 ) & 0xff;
-    cp[pos++] = ( start_code >> 16 ) & 0xff;
-    cp[pos++] = ( start_code >>  8 ) & 0xff;
-    cp[pos++] = ( start_code )       & 0xff;
-    stream_id = start_code & 0xff;
+    start_code = stream_read( stream, 4 );
+    memcpy( cp+pos, start_code, 4 );
+    pos += 4;
+    stream_id = start_code[3];
 
     if ( stream_id == 0xba )
     {
@@ -3278,17 +3801,17 @@ static int hb_ps_read_packet( hb_stream_t * stream, hb_buffer_t *b )
         }
 
         // There are at least 8 bytes.  More if this is mpeg2 pack.
-        fread( cp+pos, 1, 8, stream->file_handle );
+        stream_read_buf( stream, cp+pos, 8 );
         int mark = cp[pos] >> 4;
         pos += 8;
 
         if ( mark != 0x02 )
         {
             // mpeg-2 pack,
-            fread( cp+pos, 1, 2, stream->file_handle );
+            stream_read_buf( stream, cp+pos, 2 );
             pos += 2;
             int len = cp[start+13] & 0x7;
-            fread( cp+pos, 1, len, stream->file_handle );
+            stream_read_buf( stream, cp+pos, len );
             pos += len;
         }
     }
@@ -3297,15 +3820,10 @@ static int hb_ps_read_packet( hb_stream_t * stream, hb_buffer_t *b )
     // sections to avoid mis-detection of the next pack or pes start code
     else if ( stream_id >= 0xbb )
     {
-        int len = 0;
-        c = getc_unlocked( stream->file_handle );
-        if ( c == EOF )
+        const uint8_t *len_buf = stream_read( stream, 2 );
+        if ( len_buf == NULL )
             goto done;
-        len = c << 8;
-        c = getc_unlocked( stream->file_handle );
-        if ( c == EOF )
-            goto done;
-        len |= c;
+        int len = ( len_buf[0] << 8 ) | len_buf[1];
         if ( pos + len + 2 > b->alloc )
         {
             if ( b->alloc * 2 > pos + len + 2 )
@@ -3318,66 +3836,25 @@ static int hb_ps_read_packet( hb_stream_t * stream, hb_buffer_t *b )
         if ( len )
         {
             // Length is non-zero, read the packet all at once
-            len = fread( cp+pos, 1, len, stream->file_handle );
+            len = stream_read_buf( stream, cp+pos, len );
             pos += len;
         }
         else
         {
             // Length is zero, read bytes till we find a start code.
             // Only video PES packets are allowed to have zero length.
-            start_code = -1;
-            while ( ( c = getc_unlocked( stream->file_handle ) ) != EOF )
-            {
-                start_code = ( start_code << 8 ) | c;
-                if ( pos  >= b->alloc )
-                {
-                    // need to expand the buffer
-                    hb_buffer_realloc( b, b->alloc * 2 );
-                }
-                cp[pos++] = c;
-                if ( ( start_code >> 8   ) == 0x000001 &&
-                     ( start_code & 0xff ) >= 0xb9 )
-                {
-                    // we found the start of the next start
-                    break;
-                }
-            }
-            if ( c == EOF )
-                goto done;
-            pos -= 4;
-            fseeko( stream->file_handle, -4, SEEK_CUR );
+            stream_find_start_code( stream, 0xb9, 0xff, b, &pos );
         }
     }
     else
     {
         // Unknown, find next start code
-        start_code = -1;
-        while ( ( c = getc_unlocked( stream->file_handle ) ) != EOF )
-        {
-            start_code = ( start_code << 8 ) | c;
-            if ( pos  >= b->alloc )
-            {
-                // need to expand the buffer
-                hb_buffer_realloc( b, b->alloc * 2 );
-            }
-            cp[pos++] = c;
-            if ( ( start_code >> 8 ) == 0x000001 &&
-                 ( start_code & 0xff ) >= 0xb9 )
-                // we found the start of the next start
-                break;
-        }
-        if ( c == EOF )
-            goto done;
-        pos -= 4;
-        fseeko( stream->file_handle, -4, SEEK_CUR );
+        stream_find_start_code( stream, 0xb9, 0xff, b, &pos );
     }
 done:
-    // Parse packet for information we might need
-    funlockfile( stream->file_handle );
-    int len = pos - b->size;
     b->size = pos;
 #undef cp
-    return len;
+    return pos - size;
 }
 
 static hb_buffer_t * hb_ps_stream_decode( hb_stream_t *stream )
@@ -3748,7 +4225,7 @@ static void hb_ps_stream_find_streams(hb_stream_t *stream)
     int ii, jj;
     hb_buffer_t *buf  = hb_buffer_init(HB_DVD_READ_BUFFER_SIZE);
 
-    fseeko( stream->file_handle, 0, SEEK_SET );
+    stream_seek( stream, 0, SEEK_SET );
     // Scan beginning of file, then if no program stream map is found
     // seek to 20% and scan again since there's occasionally no
     // audio at the beginning (particularly for vobs).
@@ -4370,9 +4847,9 @@ static int hb_ts_stream_find_pids(hb_stream_t *stream)
     // changes PMTs (and thus video & audio PIDs) when 'programs' change. Since
     // we may have the tail of the previous program at the beginning of this
     // file, take our PMT from the middle of the file.
-    fseeko(stream->file_handle, 0, SEEK_END);
-    uint64_t fsize = ftello(stream->file_handle);
-    fseeko(stream->file_handle, fsize >> 1, SEEK_SET);
+    stream_seek(stream, 0, SEEK_END);
+    uint64_t fsize = stream_tell(stream);
+    stream_seek(stream, fsize >> 1, SEEK_SET);
     align_to_next_packet(stream);
 
     // Read the Transport Stream Packets (188 bytes each) looking at first for PID 0 (the PAT PID), then decode that
@@ -5855,5 +6332,27 @@ static int ffmpeg_seek_ts( hb_stream_t *stream, int64_t ts )
     // Seek to the nearest timestamp before that requested where
     // there is an I-frame
     ret = avformat_seek_file( ic, stream->ffmpeg_video_id, 0, pos, pos, 0);
+
+    // Pick up chapter tracking at the seek point, the way
+    // hb_stream_seek_chapter does, so that the packets after the seek
+    // don't each mark one of the chapters that were skipped
+    if ( ret >= 0 && stream->title != NULL )
+    {
+        hb_chapter_t *chapter = NULL;
+        int64_t sum_dur = 0;
+        int i;
+
+        for ( i = 0; i < hb_list_count( stream->title->list_chapter ); i++ )
+        {
+            chapter = hb_list_item( stream->title->list_chapter, i );
+            sum_dur += chapter->duration;
+            if ( sum_dur > ts )
+            {
+                stream->chapter = i;
+                stream->chapter_end = sum_dur;
+                break;
+            }
+        }
+    }
     return ret;
 }
@@ -75,6 +75,7 @@ typedef struct
     int        count_frames_max;
     int        chap_mark;     /* to propagate chapter mark across a drop */
     hb_buffer_t * cur;        /* The next picture to process */
+    int64_t    segment_stop;  /* pts the segment ends at, see segment.c */
 
     subtitle_sanitizer_t *subtitle_sanitizer;
 
@@ -158,7 +159,7 @@ hb_work_object_t * hb_sync_init( hb_job_t * job )
     if( job->pass_id == HB_PASS_ENCODE_2ND )
     {
         /* We already have an accurate frame count from pass 1 */
-        hb_interjob_t * interjob = hb_interjob_get( job->h );
+        hb_interjob_t * interjob = hb_job_interjob( job );
         sync->count_frames_max = interjob->frame_count;
     }
     else
@@ -187,6 +188,7 @@ hb_work_object_t * hb_sync_init( hb_job_t * job )
     }
 
     hb_log( "sync: expecting %d video frames", sync->count_frames_max );
+    sync->segment_stop = hb_segment_stop( job );
 
     /* Initialize libsamplerate for every audio track we have */
     if ( ! job->indepth_scan )
@@ -266,7 +268,7 @@ void syncVideoClose( hb_work_object_t * w )
     if( job->pass_id == HB_PASS_ENCODE_1ST )
     {
         /* Preserve frame count for better accuracy in pass 2 */
-        hb_interjob_t * interjob = hb_interjob_get( job->h );
+        hb_interjob_t * interjob = hb_job_interjob( job );
         interjob->frame_count = pv->common->count_frames;
         interjob->last_job = job->sequence_id;
     }
@@ -910,6 +912,44 @@ int syncVideoWork( hb_work_object_t * w, hb_buffer_t ** buf_in,
         }
     }
 
+    /* Check for the end of a segment of a segmented encode */
+    if ( sync->segment_stop && next->s.start >= sync->segment_stop )
+    {
+        // 'next' is the first frame of the next segment.  So output the
+        // current frame with its full duration and end the video here.
+        int64_t duration = next_start - cur->s.start;
+
+        hb_log( "sync: reached end of segment at pts %"PRId64,
+                sync->segment_stop );
+        hb_buffer_close( &next );
+        sync->cur = NULL;
+        cur->s.start = sync->next_start;
+        sync->next_start += duration;
+        cur->s.stop = sync->next_start;
+        if ( sync->chap_mark )
+        {
+            cur->s.new_chap = sync->chap_mark;
+            sync->chap_mark = 0;
+        }
+        cur->next = hb_buffer_init( 0 );
+        *buf_out = cur;
+        UpdateState( w );
+
+        for( i = 0; i < hb_list_count( job->list_subtitle ); i++)
+        {
+            subtitle = hb_list_item( job->list_subtitle, i );
+            // flush out any pending subtitle buffers in the sanitizer
+            hb_buffer_t *out = sanitizeSubtitle(pv, i, NULL);
+            if (out != NULL)
+                hb_fifo_push( subtitle->fifo_out, out );
+            if( subtitle->config.dest == PASSTHRUSUB )
+            {
+                hb_fifo_push( subtitle->fifo_out, hb_buffer_init( 0 ) );
+            }
+        }
+        return HB_WORK_DONE;
+    }
+
     /*
      * Adjust the pts of the current frame so that it's contiguous
      * with the previous frame. The start time of the current frame
@@ -1637,8 +1677,14 @@ static void UpdateState( hb_work_object_t * w )
     hb_work_private_t * pv = w->private_data;
     hb_sync_video_t   * sync = &pv->type.video;
     hb_state_t state;
+    int count_frames;
 
-    hb_get_state2( pv->job->h, &state );
+    if ( pv->job->segment_index == 0 )
+    {
+        hb_profile_sample( hb_get_profile( pv->job->h ) );
+    }
+
+    hb_get_job_state( pv->job, &state );
     if( !pv->common->count_frames )
     {
         sync->st_first = hb_get_date();
@@ -1655,6 +1701,14 @@ static void UpdateState( hb_work_object_t * w )
         return;
     }
 
+    count_frames = pv->common->count_frames;
+    if ( pv->job->segment != NULL )
+    {
+        // Every pipeline of a segmented encode reports the progress
+        // of all of them
+        count_frames = hb_segment_frames( pv->job, count_frames );
+    }
+
     if( hb_get_date() > sync->st_dates[3] + 1000 )
     {
         memmove( &sync->st_dates[0], &sync->st_dates[1],
@@ -1662,12 +1716,12 @@ static void UpdateState( hb_work_object_t * w )
         memmove( &sync->st_counts[0], &sync->st_counts[1],
                  3 * sizeof( uint64_t ) );
         sync->st_dates[3]  = hb_get_date();
-        sync->st_counts[3] = pv->common->count_frames;
+        sync->st_counts[3] = count_frames;
     }
 
 #define p state.param.working
     state.state = HB_STATE_WORKING;
-    p.progress  = (float) pv->common->count_frames / (float) sync->count_frames_max;
+    p.progress  = (float) count_frames / (float) sync->count_frames_max;
     if( p.progress > 1.0 )
     {
         p.progress = 1.0;
@@ -1695,7 +1749,7 @@ static void UpdateState( hb_work_object_t * w )
     }
 #undef p
 
-    hb_set_state( pv->job->h, &state );
+    hb_set_job_state( pv->job, &state );
 }
 
 static void UpdateSearchState( hb_work_object_t * w, int64_t start )
@@ -1715,11 +1769,12 @@ static void UpdateSearchState( hb_work_object_t * w, int64_t start )
     }
     pv->common->count_frames++;
 
-    if (pv->job->indepth_scan)
+    if (pv->job->indepth_scan || pv->job->segment_index > 0)
     {
         // Progress for indept scan is handled by reader
         // pv->common->count_frames is used during indepth_scan
         // to find start & end points.
+        // Segment pipelines only report progress once they encode.
         return;
     }
 
@@ -1763,7 +1818,7 @@ static void UpdateSearchState( hb_work_object_t * w, int64_t start )
     }
 #undef p
 
-    hb_set_state( pv->job->h, &state );
+    hb_set_job_state( pv->job, &state );
 }
 
 static void getPtsOffset( hb_work_object_t * w )
@@ -232,3 +232,223 @@ taskset_fini( taskset_t *ts )
     free( ts->task_complete_bitmap );
     free( ts->task_stop_bitmap );
 }
+
+/*
+ * One taskslices_cycle() call that is waiting for its slices to be run.
+ */
+typedef struct taskpool_run_s {
+    taskslices_t * ts;
+    int            next;        // Next slice to be claimed
+    int            complete;    // Slices that have finished
+} taskpool_run_t;
+
+struct hb_taskpool_s {
+    int                thread_count;
+    int                started;
+    int                die;
+    hb_thread_t     ** threads;
+    hb_lock_t        * lock;
+    hb_cond_t        * work;        // Slices are available or pool closing
+    hb_cond_t        * complete;    // A run has completed
+    hb_list_t        * runs;        // Runs that still have unclaimed slices
+    int                next_run;    // Round robin position in runs
+};
+
+/*
+ * Claim one slice, run it and account for its completion.
+ * If run is NULL, the next run is picked in round robin order.
+ * Must be called with pool->lock held.  Returns 0 if there was no work.
+ */
+static int
+taskpool_run_slice( hb_taskpool_t *pool, taskpool_run_t *run )
+{
+    int slice;
+
+    if( run == NULL )
+    {
+        int count = hb_list_count( pool->runs );
+        if( count == 0 )
+            return 0;
+        if( pool->next_run >= count )
+            pool->next_run = 0;
+        run = hb_list_item( pool->runs, pool->next_run );
+        pool->next_run++;
+    }
+    if( run->next >= run->ts->slice_count )
+        return 0;
+
+    slice = run->next++;
+    if( run->next >= run->ts->slice_count )
+    {
+        hb_list_rem( pool->runs, run );
+    }
+
+    hb_unlock( pool->lock );
+    run->ts->func( taskslices_args( run->ts, slice ) );
+    hb_lock( pool->lock );
+
+    /*
+     * Once the last slice is accounted for, the submitter may return
+     * and release the run, so it must not be touched after this.
+     */
+    run->complete++;
+    if( run->complete >= run->ts->slice_count )
+    {
+        hb_cond_broadcast( pool->complete );
+    }
+    return 1;
+}
+
+static void
+taskpool_thread( void *pool_v )
+{
+    hb_taskpool_t *pool = pool_v;
+
+    hb_lock( pool->lock );
+    while( !pool->die )
+    {
+        if( !taskpool_run_slice( pool, NULL ) )
+        {
+            hb_cond_wait( pool->work, pool->lock );
+        }
+    }
+    hb_unlock( pool->lock );
+}
+
+hb_taskpool_t *
+taskpool_init( int thread_count )
+{
+    hb_taskpool_t *pool = calloc( 1, sizeof( hb_taskpool_t ) );
+    if( pool == NULL )
+        return NULL;
+
+    pool->thread_count = thread_count;
+    pool->threads = calloc( thread_count, sizeof( hb_thread_t* ) );
+    pool->lock = hb_lock_init();
+    pool->work = hb_cond_init();
+    pool->complete = hb_cond_init();
+    pool->runs = hb_list_init();
+    if( pool->threads == NULL || pool->lock == NULL || pool->work == NULL ||
+        pool->complete == NULL || pool->runs == NULL )
+    {
+        taskpool_close( &pool );
+        return NULL;
+    }
+
+    /*
+     * Worker threads are started on first use so that handles which
+     * never run a filter (e.g. scan only) don't carry idle threads.
+     */
+    return pool;
+}
+
+int
+taskpool_thread_count( hb_taskpool_t *pool )
+{
+    return pool->thread_count;
+}
+
+void
+taskpool_close( hb_taskpool_t **_pool )
+{
+    hb_taskpool_t *pool = *_pool;
+    int i;
+
+    if( pool == NULL )
+        return;
+
+    if( pool->lock != NULL )
+    {
+        hb_lock( pool->lock );
+        pool->die = 1;
+        if( pool->work != NULL )
+            hb_cond_broadcast( pool->work );
+        hb_unlock( pool->lock );
+    }
+
+    for( i = 0; i < pool->thread_count && pool->threads != NULL; i++ )
+    {
+        if( pool->threads[i] != NULL )
+            hb_thread_close( &pool->threads[i] );
+    }
+    hb_list_close( &pool->runs );
+    if( pool->complete != NULL )
+        hb_cond_close( &pool->complete );
+    if( pool->work != NULL )
+        hb_cond_close( &pool->work );
+    if( pool->lock != NULL )
+        hb_lock_close( &pool->lock );
+    free( pool->threads );
+    free( pool );
+    *_pool = NULL;
+}
+
+int
+taskslices_init( taskslices_t *ts, hb_taskpool_t *pool, int slice_count,
+                 size_t arg_size, taskslice_func_t *func )
+{
+    memset( ts, 0, sizeof( *ts ) );
+    if( pool == NULL || slice_count <= 0 )
+        return (0);
+
+    ts->pool = pool;
+    ts->slice_count = slice_count;
+    ts->arg_size = arg_size;
+    ts->func = func;
+    if( arg_size != 0 )
+    {
+        ts->slice_args = calloc( slice_count, arg_size );
+        if( ts->slice_args == NULL )
+            return (0);
+    }
+    return (1);
+}
+
+void
+taskslices_cycle( taskslices_t *ts )
+{
+    hb_taskpool_t *pool = ts->pool;
+    taskpool_run_t run;
+    int i;
+
+    memset( &run, 0, sizeof( run ) );
+    run.ts = ts;
+
+    hb_lock( pool->lock );
+    if( !pool->started )
+    {
+        for( i = 0; i < pool->thread_count; i++ )
+        {
+            pool->threads[i] = hb_thread_init( "taskpool", taskpool_thread,
+                                               pool, HB_NORMAL_PRIORITY );
+        }
+        pool->started = 1;
+    }
+
+    /*
+     * Publish the slices for the workers, and work on them ourselves
+     * until all of them have been claimed.
+     */
+    hb_list_add( pool->runs, &run );
+    hb_cond_broadcast( pool->work );
+    while( taskpool_run_slice( pool, &run ) )
+        ;
+
+    /*
+     * Wait until slices claimed by other threads have completed.  Note that
+     * we must loop here as hb_cond_wait() on some platforms may unblock
+     * prematurely.
+     */
+    while( run.complete < ts->slice_count )
+    {
+        hb_cond_wait( pool->complete, pool->lock );
+    }
+    hb_unlock( pool->lock );
+}
+
+void
+taskslices_fini( taskslices_t *ts )
+{
+    free( ts->slice_args );
+    memset( ts, 0, sizeof( *ts ) );
+}
@@ -52,4 +52,44 @@ taskset_thread_stop( taskset_t *ts, int thr_idx )
     return bit_is_set( ts->task_stop_bitmap, thr_idx );
 }
 
+/*
+ * Shared worker pool.
+ *
+ * One pool is created per hb_handle_t and shared by every filter of every
+ * job on that handle.  A filter describes one frame's worth of work as a
+ * set of slices (taskslices_t) and taskslices_cycle() hands them to the
+ * pool instead of waking a private gang of threads.  Idle workers claim
+ * unclaimed slices from all pending cycles in round robin order, so
+ * concurrent filters and jobs share the workers fairly, and the thread
+ * calling taskslices_cycle() works on its own slices too.
+ */
+typedef struct hb_taskpool_s hb_taskpool_t;
+typedef void (taskslice_func_t)( void * /*slice_args*/ );
+
+hb_taskpool_t * taskpool_init( int /*thread_count*/ );
+void            taskpool_close( hb_taskpool_t ** );
+int             taskpool_thread_count( hb_taskpool_t * );
+hb_taskpool_t * hb_get_taskpool( hb_handle_t * );
+
+typedef struct hb_taskslices_s {
+    hb_taskpool_t    * pool;
+    int                slice_count;
+    int                arg_size;
+    uint8_t          * slice_args;
+    taskslice_func_t * func;
+} taskslices_t;
+
+int  taskslices_init( taskslices_t *, hb_taskpool_t *, int /*slice_count*/,
+                      size_t /*user_arg_size*/, taskslice_func_t * );
+void taskslices_cycle( taskslices_t * );
+void taskslices_fini( taskslices_t * );
+
+static inline void *taskslices_args( taskslices_t *, int );
+
+static inline void *
+taskslices_args( taskslices_t *ts, int slice )
+{
+    return( ts->slice_args + ( ts->arg_size * slice ) );
+}
+
 #endif /* HB_TASKSET_H */
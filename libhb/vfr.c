@@ -8,6 +8,15 @@
  */
  
 #include "hb.h"
+#include "taskset.h"
+#include "vfr.h"
+
+typedef struct
+{
+    hb_filter_private_t * pv;
+    int                   segment;
+    uint64_t              sum;
+} motion_metric_arg_t;
 
 struct hb_filter_private_s
 {
@@ -36,6 +45,21 @@ struct hb_filter_private_s
     float         out_metric;   // motion metric of last output frame
     int           sync_parity;
     unsigned      gamma_lut[256];
+
+    // Gamma adjusted luma of the two frames last compared by
+    // motion_metric().  The second frame of one comparison is normally
+    // the first frame of the next, so its plane is kept and reused.
+    uint16_t    * gamma_plane[2];
+    hb_buffer_t * gamma_buf[2];
+    int64_t       gamma_start[2];
+    int           gamma_width;
+    int           gamma_height;
+    int           gamma_convert;    // gamma_plane[0] needs to be filled
+
+    VFRFunctions  functions;
+
+    int           cpu_count;
+    taskslices_t  metric_taskslices;  // Slices for motion_metric
 };
 
 static int hb_vfr_init( hb_filter_object_t * filter,
@@ -62,7 +86,7 @@ hb_filter_object_t hb_filter_vfr =
 
 // Create gamma lookup table.
 // Note that we are creating a scaled integer lookup table that will
-// not cause overflows in sse_block16() below.  This results in
+// not cause overflows in the sse_block16_row kernels.  This results in
 // small values being truncated to 0 which is ok for this usage.
 static void build_gamma_lut( hb_filter_private_t * pv )
 {
@@ -86,49 +110,132 @@ static hb_buffer_t *insert_buffer_in_chain(
 
 #define DUP_THRESH_SSE 5.0
 
-// Compute ths sum of squared errors for a 16x16 block
-// Gamma adjusts pixel values so that less visible diffreences
-// count less.
-static inline unsigned sse_block16( hb_filter_private_t *pv, uint8_t *a, uint8_t *b, int stride )
+// Gamma adjust the luma of rows y0 to y1 of buffer 'buf'
+static void gamma_convert( hb_filter_private_t * pv, uint16_t * dst,
+                           hb_buffer_t * buf, int y0, int y1 )
 {
     int x, y;
-    unsigned sum = 0;
+    int stride = buf->plane[0].stride;
+    uint8_t * src = buf->plane[0].data + y0 * stride;
+    unsigned * g = pv->gamma_lut;
+
+    dst += y0 * pv->gamma_width;
+    for( y = y0; y < y1; y++ )
+    {
+        for( x = 0; x < pv->gamma_width; x++ )
+        {
+            dst[x] = g[src[x]];
+        }
+        src += stride;
+        dst += pv->gamma_width;
+    }
+}
+
+// Compute the sum of squared errors for a row of 16x16 blocks
+// of gamma adjusted pixels.  Gamma adjusts pixel values so that
+// less visible differences count less.
+static uint64_t sse_block16_row_c( const uint16_t *a, const uint16_t *b,
+                                   int width )
+{
+    int x, y;
+    uint64_t sum = 0;
     int diff;
-    unsigned *g = pv->gamma_lut;
 
     for( y = 0; y < 16; y++ )
     {
-        for( x = 0; x < 16; x++ )
+        for( x = 0; x < width; x++ )
         {
-            diff =  g[a[x]] - g[b[x]];
+            diff = a[x] - b[x];
             sum += diff * diff;
         }
-        a += stride;
-        b += stride;
+        a += width;
+        b += width;
     }
     return sum;
 }
 
+// Computes the SSE of a horizontal band of 16x16 blocks
+static void motion_metric_slice( void * thread_args_v )
+{
+    motion_metric_arg_t * arg = thread_args_v;
+    hb_filter_private_t * pv = arg->pv;
+    int bh = pv->gamma_height / 16;
+    int y0 = bh * arg->segment / pv->cpu_count;
+    int y1 = bh * ( arg->segment + 1 ) / pv->cpu_count;
+    int y;
+
+    if( pv->gamma_convert )
+    {
+        gamma_convert( pv, pv->gamma_plane[0], pv->gamma_buf[0],
+                       y0 * 16, y1 * 16 );
+    }
+    gamma_convert( pv, pv->gamma_plane[1], pv->gamma_buf[1],
+                   y0 * 16, y1 * 16 );
+
+    arg->sum = 0;
+    for( y = y0; y < y1; y++ )
+    {
+        int offset = y * 16 * pv->gamma_width;
+        arg->sum += pv->functions.sse_block16_row( pv->gamma_plane[0] + offset,
+                                                   pv->gamma_plane[1] + offset,
+                                                   pv->gamma_width );
+    }
+}
+
 // Sum of squared errors.  Computes and sums the SSEs for all
 // 16x16 blocks in the images.  Only checks the Y component.
 static float motion_metric( hb_filter_private_t * pv, hb_buffer_t * a, hb_buffer_t * b )
 {
-    int bw = a->f.width / 16;
-    int bh = a->f.height / 16;
-    int stride = a->plane[0].stride;
-    uint8_t * pa = a->plane[0].data;
-    uint8_t * pb = b->plane[0].data;
-    int x, y;
+    int width = a->f.width / 16 * 16;
+    int height = a->f.height / 16 * 16;
     uint64_t sum = 0;
+    int ii;
+
+    if( width != pv->gamma_width || height != pv->gamma_height )
+    {
+        free( pv->gamma_plane[0] );
+        free( pv->gamma_plane[1] );
+        pv->gamma_plane[0] = malloc( width * height * sizeof( uint16_t ) );
+        pv->gamma_plane[1] = malloc( width * height * sizeof( uint16_t ) );
+        pv->gamma_buf[0] = pv->gamma_buf[1] = NULL;
+        pv->gamma_width = width;
+        pv->gamma_height = height;
+    }
+
+    // Reuse the plane of 'a' if it was the second frame of the
+    // previous comparison
+    if( pv->gamma_buf[1] == a && pv->gamma_start[1] == a->s.start )
+    {
+        uint16_t * tmp = pv->gamma_plane[0];
+        pv->gamma_plane[0] = pv->gamma_plane[1];
+        pv->gamma_plane[1] = tmp;
+        pv->gamma_convert = 0;
+    }
+    else
+    {
+        pv->gamma_convert = 1;
+    }
+    pv->gamma_buf[0] = a;
+    pv->gamma_buf[1] = b;
+    pv->gamma_start[0] = a->s.start;
+    pv->gamma_start[1] = b->s.start;
 
-    for( y = 0; y < bh; y++ )
+    if( pv->metric_taskslices.slice_args != NULL )
     {
-        for( x = 0; x < bw; x++ )
+        taskslices_cycle( &pv->metric_taskslices );
+        for( ii = 0; ii < pv->cpu_count; ii++ )
         {
-            sum +=  sse_block16( pv, pa + y * 16 * stride + x * 16,
-                                 pb + y * 16 * stride + x * 16, stride );
+            motion_metric_arg_t * arg;
+            arg = taskslices_args( &pv->metric_taskslices, ii );
+            sum += arg->sum;
         }
     }
+    else
+    {
+        motion_metric_arg_t arg = { pv, 0, 0 };
+        motion_metric_slice( &arg );
+        sum = arg.sum;
+    }
     return (float)sum / ( a->f.width * a->f.height );;
 }
 
@@ -173,6 +280,8 @@ static void adjust_frame_rate( hb_filter_private_t *pv, hb_buffer_t **buf_out )
         float next_metric = 0;
         if( next )
             next_metric = motion_metric( pv, out, next );
+        else
+            pv->gamma_buf[0] = pv->gamma_buf[1] = NULL;
 
         if( pv->out_last_stop >= out->s.stop )
         {
@@ -305,6 +414,11 @@ static int hb_vfr_init(hb_filter_object_t *filter, hb_filter_init_t *init)
     hb_filter_private_t *pv = filter->private_data;
     build_gamma_lut(pv);
 
+    pv->functions.sse_block16_row = sse_block16_row_c;
+#if defined(ARCH_X86)
+    vfr_init_x86(&pv->functions);
+#endif
+
     pv->cfr              = init->cfr;
     pv->input_vrate = pv->vrate = init->vrate;
     if (filter->settings != NULL)
@@ -315,6 +429,29 @@ static int hb_vfr_init(hb_filter_object_t *filter, hb_filter_init_t *init)
 
     pv->job = init->job;
 
+    // motion_metric() runs on the job's task pool if there is one
+    pv->cpu_count = 1;
+    if( pv->job != NULL )
+    {
+        pv->cpu_count = hb_get_cpu_count();
+        if( taskslices_init( &pv->metric_taskslices,
+                             hb_get_taskpool( pv->job->h ), pv->cpu_count,
+                             sizeof( motion_metric_arg_t ),
+                             motion_metric_slice ) == 0 )
+        {
+            hb_error( "vfr could not initialize taskslices" );
+            return -1;
+        }
+        int ii;
+        for( ii = 0; ii < pv->cpu_count; ii++ )
+        {
+            motion_metric_arg_t * arg;
+            arg = taskslices_args( &pv->metric_taskslices, ii );
+            arg->pv = pv;
+            arg->segment = ii;
+        }
+    }
+
     /* Setup FIFO queue for subtitle cache */
     pv->delay_queue = hb_fifo_init( 8, 1 );
 
@@ -428,7 +565,7 @@ static void hb_vfr_close( hb_filter_object_t * filter )
 
     if( pv->job )
     {
-        hb_interjob_t * interjob = hb_interjob_get( pv->job->h );
+        hb_interjob_t * interjob = hb_job_interjob( pv->job );
         
         /* Preserve dropped frame count for more accurate 
          * framerates in 2nd passes. 
@@ -454,6 +591,10 @@ static void hb_vfr_close( hb_filter_object_t * filter )
         hb_fifo_close( &pv->delay_queue );
     }
 
+    taskslices_fini( &pv->metric_taskslices );
+    free( pv->gamma_plane[0] );
+    free( pv->gamma_plane[1] );
+
     /* Cleanup render work structure */
     free( pv );
     filter->private_data = NULL;
@@ -0,0 +1,20 @@
+/* vfr.h
+
+   Copyright (c) 2003-2015 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+typedef struct
+{
+    // Sum of squared errors of a row of 16x16 blocks of gamma adjusted
+    // luma.  a and b hold 16 rows of width pixels, width is a multiple
+    // of 16 and the pixels are at most 12 bits.
+    uint64_t (*sse_block16_row)(const uint16_t *a,
+                                const uint16_t *b,
+                                int             width);
+} VFRFunctions;
+
+void vfr_init_x86(VFRFunctions *functions);
@@ -0,0 +1,109 @@
+/* vfr_x86.c
+
+   Copyright (c) 2003-2015 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "hb.h"     // needed for ARCH_X86
+
+#if defined(ARCH_X86)
+
+#include <emmintrin.h>
+
+#include "libavutil/cpu.h"
+#include "x86_target.h"
+#include "vfr.h"
+
+/*
+ * The kernels compute exactly what the C code in vfr.c does.  The
+ * squared differences are summed with pmaddwd into 32 bit lanes.  The
+ * pixels are at most 12 bits, so these sums can't overflow within one
+ * block, and each block's sums are added to 64 bit totals.
+ */
+static uint64_t sse_block16_row_sse2(const uint16_t *a, const uint16_t *b,
+                                     int width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = _mm_setzero_si128();
+    uint64_t result[2];
+    int x, y;
+
+    for (x = 0; x < width; x += 16)
+    {
+        __m128i block = _mm_setzero_si128();
+        for (y = 0; y < 16; y++)
+        {
+            const uint16_t *pa = a + y * width + x;
+            const uint16_t *pb = b + y * width + x;
+            __m128i d0, d1;
+
+            d0 = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(pa)),
+                               _mm_loadu_si128((const __m128i*)(pb)));
+            d1 = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(pa + 8)),
+                               _mm_loadu_si128((const __m128i*)(pb + 8)));
+            block = _mm_add_epi32(block, _mm_madd_epi16(d0, d0));
+            block = _mm_add_epi32(block, _mm_madd_epi16(d1, d1));
+        }
+        sum = _mm_add_epi64(sum, _mm_unpacklo_epi32(block, zero));
+        sum = _mm_add_epi64(sum, _mm_unpackhi_epi32(block, zero));
+    }
+    _mm_storeu_si128((__m128i*)result, sum);
+    return result[0] + result[1];
+}
+
+#if defined(HB_X86_AVX2)
+
+// A block row is one 16 pixel vector
+TARGET_AVX2
+static uint64_t sse_block16_row_avx2(const uint16_t *a, const uint16_t *b,
+                                     int width)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i sum = _mm256_setzero_si256();
+    uint64_t result[4];
+    int x, y;
+
+    for (x = 0; x < width; x += 16)
+    {
+        __m256i block = _mm256_setzero_si256();
+        for (y = 0; y < 16; y++)
+        {
+            __m256i d;
+
+            d = _mm256_sub_epi16(
+                    _mm256_loadu_si256((const __m256i*)(a + y * width + x)),
+                    _mm256_loadu_si256((const __m256i*)(b + y * width + x)));
+            block = _mm256_add_epi32(block, _mm256_madd_epi16(d, d));
+        }
+        sum = _mm256_add_epi64(sum, _mm256_unpacklo_epi32(block, zero));
+        sum = _mm256_add_epi64(sum, _mm256_unpackhi_epi32(block, zero));
+    }
+    _mm256_storeu_si256((__m256i*)result, sum);
+    return result[0] + result[1] + result[2] + result[3];
+}
+
+#endif // HB_X86_AVX2
+
+void vfr_init_x86(VFRFunctions *functions)
+{
+    int cpu_flags = av_get_cpu_flags();
+
+#if defined(HB_X86_AVX2)
+    if (cpu_flags & AV_CPU_FLAG_AVX2)
+    {
+        functions->sse_block16_row = sse_block16_row_avx2;
+        hb_log("Framerate Shaper using AVX2 optimizations");
+        return;
+    }
+#endif
+    if (cpu_flags & AV_CPU_FLAG_SSE2)
+    {
+        functions->sse_block16_row = sse_block16_row_sse2;
+        hb_log("Framerate Shaper using SSE2 optimizations");
+    }
+}
+
+#endif // ARCH_X86
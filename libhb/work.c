@@ -11,6 +11,7 @@
 #include "libavformat/avformat.h"
 #include "openclwrapper.h"
 #include "opencl.h"
+#include "taskset.h"
 
 #ifdef USE_QSV
 #include "qsv_common.h"
@@ -20,16 +21,29 @@
 typedef struct
 {
     hb_list_t * jobs;
-    hb_job_t  ** current_job;
     hb_error_code * error;
     volatile int * die;
 
+    hb_lock_t * lock;       // protects jobs when several jobs run at once
+    int         slots;
+
 } hb_work_t;
 
+/* One per job slot, each runs the queued jobs one at a time */
+typedef struct
+{
+    hb_work_t   * work;
+    int           slot;
+    hb_thread_t * thread;
+} hb_work_slot_t;
+
 static void work_func();
 static void do_job( hb_job_t *);
 static void work_loop( void * );
 static void filter_loop( void * );
+static int  filter_frames_init( hb_filter_object_t *, hb_filter_init_t * );
+static void filter_frames_close( hb_filter_object_t * );
+static void filter_frame_slice( void * );
 
 #define FIFO_UNBOUNDED 65536
 #define FIFO_UNBOUNDED_WAKE 65535
@@ -40,25 +54,101 @@ static void filter_loop( void * );
 #define FIFO_MINI 4
 #define FIFO_MINI_WAKE 3
 
+/* Maximum number of frames a frame_threaded filter processes at once.
+ * A filter can't gather more frames than its input fifo holds. */
+#define FILTER_FRAME_THREADS FIFO_MINI
+
+/* Private instances of a frame_threaded filter, one per frame in flight.
+ * instance[0] is the filter itself. */
+struct hb_filter_frames_s
+{
+    int                   count;
+    hb_filter_object_t  * instance[FILTER_FRAME_THREADS];
+    taskslices_t          slices;
+};
+
+typedef struct
+{
+    hb_filter_object_t  * filter;
+    hb_buffer_t         * in;
+    hb_buffer_t         * out;
+    int                   status;
+    int                   chapter_val;
+    int64_t               chapter_time;
+} filter_frame_arg_t;
+
+/*
+ * Pipeline profiler accounting (see profile.c).  A stage can be NULL
+ * if it couldn't be allocated.
+ */
+static hb_buffer_t * profile_get_wait( hb_profile_stage_t * stage,
+                                       hb_fifo_t * fifo )
+{
+    uint64_t start = hb_get_time_us();
+    hb_buffer_t * buf = hb_fifo_get_wait( fifo );
+    if( stage != NULL )
+        stage->wait_in_time += hb_get_time_us() - start;
+    return buf;
+}
+
+static int profile_full_wait( hb_profile_stage_t * stage, hb_fifo_t * fifo )
+{
+    uint64_t start = hb_get_time_us();
+    int result = hb_fifo_full_wait( fifo );
+    if( stage != NULL )
+        stage->wait_out_time += hb_get_time_us() - start;
+    return result;
+}
+
+static void profile_work_begin( hb_profile_stage_t * stage, uint64_t start[2] )
+{
+    if( stage != NULL )
+    {
+        start[0] = hb_get_time_us();
+        start[1] = hb_get_thread_cpu_time_us();
+    }
+}
+
+static void profile_work_end( hb_profile_stage_t * stage, uint64_t start[2],
+                              int buffers )
+{
+    if( stage != NULL )
+    {
+        stage->work_time += hb_get_time_us() - start[0];
+        stage->cpu_time  += hb_get_thread_cpu_time_us() - start[1];
+        stage->buffers   += buffers;
+    }
+}
+
+/*
+ * The profiler follows one job at a time, the job in the first job slot.
+ * Of a segmented job it follows the pipeline of the first segment.
+ */
+static hb_profile_t * job_profile( hb_job_t * job )
+{
+    return job->slot == 0 && job->segment_index == 0 ?
+           hb_get_profile( job->h ) : NULL;
+}
+
 /**
  * Allocates work object and launches work thread with work_func.
  * @param jobs Handle to hb_list_t.
  * @param die Handle to user inititated exit indicator.
  * @param error Handle to error indicator.
  */
-hb_thread_t * hb_work_init( hb_list_t * jobs, volatile int * die, hb_error_code * error, hb_job_t ** job )
+hb_thread_t * hb_work_init( hb_list_t * jobs, volatile int * die, hb_error_code * error )
 {
     hb_work_t * work = calloc( sizeof( hb_work_t ), 1 );
 
     work->jobs      = jobs;
-    work->current_job = job;
     work->die       = die;
     work->error     = error;
+    work->lock      = hb_lock_init();
 
     return hb_thread_init( "work", work_func, work, HB_LOW_PRIORITY );
 }
 
-static void InitWorkState(hb_handle_t *h, int pass_id, int pass, int pass_count)
+static void InitWorkState(hb_job_t *job, int pass_id, int pass, int pass_count)
 {
     hb_state_t state;
 
@@ -75,73 +165,167 @@ static void InitWorkState(hb_handle_t *h, int pass_id, int pass, int pass_count)
     p.seconds    = -1; 
 #undef p
 
-    hb_set_state( h, &state );
+    hb_set_job_state( job, &state );
 
 }
 
 /**
- * Iterates through job list and calls do_job for each job.
- * @param _work Handle work object.
+ * Runs the passes of a job.
+ * @param work Handle work object.
+ * @param job Job removed from the job list.
+ * @param slot Job slot the job runs in.
  */
-static void work_func( void * _work )
+static void work_job( hb_work_t * work, hb_job_t * job, int slot )
 {
-    hb_work_t  * work = _work;
-    hb_job_t   * job;
-
-    hb_log( "%d job(s) to process", hb_list_count( work->jobs ) );
-
-    while( !*work->die && ( job = hb_list_item( work->jobs, 0 ) ) )
+    hb_handle_t * scan_h = NULL;
+    hb_list_t   * passes = hb_list_init();
+
+    // JSON jobs get special treatment.  We want to perform the title
+    // scan for the JSON job automatically.  This requires that we delay
+    // filling the job struct till we have performed the title scan
+    // because the default values for the job come from the title.
+    if (job->json != NULL)
     {
-        hb_list_rem( work->jobs, job );
-        hb_list_t * passes = hb_list_init();
-
-        // JSON jobs get special treatment.  We want to perform the title
-        // scan for the JSON job automatically.  This requires that we delay
-        // filling the job struct till we have performed the title scan
-        // because the default values for the job come from the title.
-        if (job->json != NULL)
+        // The scan replaces the titles of the instance it runs on, which
+        // the other running jobs may use.  So with several job slots,
+        // scan on a scan handle that lives as long as the job.
+        hb_handle_t *h = job->h;
+        if (work->slots > 1)
         {
-            // Perform title scan for json job
-            hb_json_job_scan(job->h, job->json);
+            scan_h = hb_scan_handle_init(job->h);
+            h = scan_h;
+        }
 
-            // Expand json string to full job struct
-            hb_job_t *new_job = hb_json_to_job(job->h, job->json);
-            if (new_job == NULL)
-            {
-                hb_job_close(&job);
-                hb_list_close(&passes);
-                *work->error = HB_ERROR_INIT;
-                *work->die = 1;
-                break;
-            }
-            new_job->h = job->h;
+        // Perform title scan for json job
+        hb_json_job_scan(h, job->json);
+
+        // Expand json string to full job struct
+        hb_job_t *new_job = hb_json_to_job(h, job->json);
+        if (new_job == NULL)
+        {
             hb_job_close(&job);
-            job = new_job;
+            hb_list_close(&passes);
+            hb_scan_handle_close(&scan_h);
+            *work->error = HB_ERROR_INIT;
+            *work->die = 1;
+            return;
         }
-        hb_job_setup_passes(job->h, job, passes);
+        new_job->h = job->h;
         hb_job_close(&job);
+        job = new_job;
+    }
+    hb_job_setup_passes(job->h, job, passes);
+    hb_job_close(&job);
 
-        int pass_count, pass;
-        pass_count = hb_list_count(passes);
-        for (pass = 0; pass < pass_count && !*work->die; pass++)
+    int pass_count, pass;
+    pass_count = hb_list_count(passes);
+    for (pass = 0; pass < pass_count && !*work->die; pass++)
+    {
+        job = hb_list_item(passes, pass);
+        job->die = work->die;
+        job->done_error = work->error;
+        job->slot = slot;
+        job->cpu_budget = work->slots > 1 ?
+                          MAX(hb_get_cpu_count() / work->slots, 1) : 0;
+        hb_set_current_job(job->h, slot, job);
+        InitWorkState(job, job->pass_id, pass + 1, pass_count);
+        do_job( job );
+        hb_set_current_job(job->h, slot, NULL);
+    }
+    // Clean up any incomplete jobs
+    for (; pass < pass_count; pass++)
+    {
+        job = hb_list_item(passes, pass);
+        hb_job_close(&job);
+    }
+    hb_list_close(&passes);
+
+    hb_scan_handle_close(&scan_h);
+}
+
+/**
+ * Runs the pipeline of one segment of a segmented job, see segment.c.
+ * @param job Copy of the job made by hb_segment_init.
+ */
+void hb_work_segment( hb_job_t * job )
+{
+    do_job( job );
+}
+
+/**
+ * Takes jobs from the job list and runs them until the list is empty.
+ * @param _slot Handle to hb_work_slot_t.
+ */
+static void work_slot_func( void * _slot )
+{
+    hb_work_slot_t * slot = _slot;
+    hb_work_t      * work = slot->work;
+    hb_job_t       * job;
+
+    while( !*work->die )
+    {
+        hb_lock( work->lock );
+        job = hb_list_item( work->jobs, 0 );
+        if( job != NULL )
         {
-            job = hb_list_item(passes, pass);
-            job->die = work->die;
-            job->done_error = work->error;
-            *(work->current_job) = job;
-            InitWorkState(job->h, job->pass_id, pass + 1, pass_count);
-            do_job( job );
-            *(work->current_job) = NULL;
+            hb_list_rem( work->jobs, job );
         }
-        // Clean up any incomplete jobs
-        for (; pass < pass_count; pass++)
+        hb_unlock( work->lock );
+        if( job == NULL )
         {
-            job = hb_list_item(passes, pass);
-            hb_job_close(&job);
+            break;
         }
-        hb_list_close(&passes);
+        work_job( work, job, slot->slot );
+    }
+}
+
+/**
+ * Iterates through job list and calls do_job for each job.  With more
+ * than one job slot, that many jobs are run concurrently, each slot
+ * taking the next job of the list when its job is done.
+ * @param _work Handle work object.
+ */
+static void work_func( void * _work )
+{
+    hb_work_t      * work = _work;
+    hb_work_slot_t   slots[HB_MAX_JOB_SLOTS];
+    hb_job_t       * job;
+    int              ii;
+
+    hb_log( "%d job(s) to process", hb_list_count( work->jobs ) );
+
+    job = hb_list_item( work->jobs, 0 );
+    work->slots = job != NULL ? hb_get_job_slots( job->h ) : 1;
+    work->slots = MIN( work->slots, hb_list_count( work->jobs ) );
+    work->slots = MAX( work->slots, 1 );
+    if( work->slots > 1 )
+    {
+        hb_log( "work: running %d jobs concurrently, %d CPUs each",
+                work->slots, MAX( hb_get_cpu_count() / work->slots, 1 ) );
+    }
+
+    for( ii = 0; ii < work->slots; ii++ )
+    {
+        slots[ii].work   = work;
+        slots[ii].slot   = ii;
+        slots[ii].thread = NULL;
+        if( ii > 0 )
+        {
+            slots[ii].thread = hb_thread_init( "work slot", work_slot_func,
+                                               &slots[ii], HB_LOW_PRIORITY );
+        }
+    }
+    work_slot_func( &slots[0] );
+    for( ii = 1; ii < work->slots; ii++ )
+    {
+        hb_thread_close( &slots[ii].thread );
+    }
+    if( work->slots > 1 )
+    {
+        hb_buffer_pool_free();
     }
 
+    hb_lock_close( &work->lock );
     free( work );
 }
 
@@ -259,7 +443,9 @@ void hb_display_job_info(hb_job_t *job)
     switch (job->mux)
     {
         case HB_MUX_AV_MP4:
-            if (job->mp4_optimize)
+            if (job->mp4_fragment)
+                hb_log("     + fragmented");
+            else if (job->mp4_optimize)
                 hb_log("     + optimized for HTTP streaming (fast start)");
             if (job->ipod_atom)
                 hb_log("     + compatibility atom for iPod 5G");
@@ -417,13 +603,21 @@ void hb_display_job_info(hb_job_t *job)
         }
     }
 
-    if( job->indepth_scan )
+    if( job->indepth_scan || job->list_subtitle_search != NULL )
     {
         hb_log( " * Foreign Audio Search: %s%s%s",
                 job->select_subtitle_config.dest == RENDERSUB ? "Render/Burn-in" : "Passthrough",
                 job->select_subtitle_config.force ? ", Forced Only" : "",
                 job->select_subtitle_config.default_track ? ", Default" : "" );
     }
+    for( i = 0; i < hb_list_count( job->list_subtitle_search ); i++ )
+    {
+        subtitle = hb_list_item( job->list_subtitle_search, i );
+        hb_log( "   + search subtitle, %s (track %d, id 0x%x) %s [%s]",
+                subtitle->lang, subtitle->track, subtitle->id,
+                subtitle->format == PICTURESUB ? "Picture" : "Text",
+                hb_subsource_name( subtitle->source ) );
+    }
 
     for( i = 0; i < hb_list_count( job->list_subtitle ); i++ )
     {
@@ -540,7 +734,7 @@ void hb_display_job_info(hb_job_t *job)
 /* Corrects framerates when actual duration and frame count numbers are known. */
 void correct_framerate( hb_job_t * job )
 {
-    hb_interjob_t * interjob = hb_interjob_get( job->h );
+    hb_interjob_t * interjob = hb_job_interjob( job );
 
     if( ( job->sequence_id & 0xFFFFFF ) != ( interjob->last_job & 0xFFFFFF) )
         return; // Interjob information is for a different encode.
@@ -551,6 +745,98 @@ void correct_framerate( hb_job_t * job )
     interjob->vrate.num = job->vrate.num;
 }
 
+/**
+ * Picks the Foreign Audio Search result from the subtitle statistics
+ * and hands it to the next pass in the interjob data.
+ * @param job Job of the pass that did the search.
+ * @param list Subtitles the search counted.
+ */
+static void subtitle_search_select( hb_job_t * job, hb_list_t * list )
+{
+    hb_interjob_t * interjob = hb_job_interjob( job );
+    hb_subtitle_t * subtitle;
+    unsigned int subtitle_highest     = 0;
+    unsigned int subtitle_lowest      = 0;
+    unsigned int subtitle_lowest_id   = 0;
+    unsigned int subtitle_forced_id   = 0;
+    unsigned int subtitle_forced_hits = 0;
+    unsigned int subtitle_hit         = 0;
+    int i;
+
+    /* Before closing the title print out our subtitle stats if we need to
+     * find the highest and lowest. */
+    for( i = 0; i < hb_list_count( list ); i++ )
+    {
+        subtitle = hb_list_item( list, i );
+
+        hb_log( "Subtitle track %d (id 0x%x) '%s': %d hits (%d forced)",
+                subtitle->track, subtitle->id, subtitle->lang,
+                subtitle->hits, subtitle->forced_hits );
+
+        if( subtitle->hits == 0 )
+            continue;
+
+        if( subtitle_highest < subtitle->hits )
+        {
+            subtitle_highest = subtitle->hits;
+        }
+
+        if( subtitle_lowest == 0 ||
+            subtitle_lowest > subtitle->hits )
+        {
+            subtitle_lowest = subtitle->hits;
+            subtitle_lowest_id = subtitle->id;
+        }
+
+        // pick the track with fewest forced hits
+        if( subtitle->forced_hits > 0 &&
+            ( subtitle_forced_hits == 0 ||
+              subtitle_forced_hits > subtitle->forced_hits ) )
+        {
+            subtitle_forced_id = subtitle->id;
+            subtitle_forced_hits = subtitle->forced_hits;
+        }
+    }
+
+    if( subtitle_forced_id && job->select_subtitle_config.force )
+    {
+        /* If there is a subtitle stream with forced subtitles and forced-only
+         * is set, then select it in preference to the lowest. */
+        subtitle_hit = subtitle_forced_id;
+        hb_log( "Found a subtitle candidate with id 0x%x (contains forced subs)",
+                subtitle_hit );
+    }
+    else if( subtitle_lowest > 0 &&
+             subtitle_lowest < ( subtitle_highest * 0.1 ) )
+    {
+        /* OK we have more than one, and the lowest is lower,
+         * but how much lower to qualify for turning it on by
+         * default?
+         *
+         * Let's say 10% as a default. */
+        subtitle_hit = subtitle_lowest_id;
+        hb_log( "Found a subtitle candidate with id 0x%x", subtitle_hit );
+    }
+    else
+    {
+        hb_log( "No candidate detected during subtitle scan" );
+    }
+
+    for( i = 0; i < hb_list_count( list ); i++ )
+    {
+        subtitle = hb_list_item( list, i );
+        if( subtitle->id == subtitle_hit )
+        {
+            subtitle->config = job->select_subtitle_config;
+            // Remove from list since we are taking ownership
+            // of the subtitle.
+            hb_list_rem( list, subtitle );
+            interjob->select_subtitle = subtitle;
+            break;
+        }
+    }
+}
+
 /**
  * Job initialization rountine.
  * Initializes fifos.
@@ -570,18 +856,13 @@ static void do_job(hb_job_t *job)
     hb_work_object_t *sync;
     hb_work_object_t *muxer;
     hb_work_object_t *reader = hb_get_work(job->h, WORK_READER);
+    int frame_spool = 0;
 
     hb_audio_t *audio;
     hb_subtitle_t *subtitle;
-    unsigned int subtitle_highest     = 0;
-    unsigned int subtitle_lowest      = 0;
-    unsigned int subtitle_lowest_id   = 0;
-    unsigned int subtitle_forced_id   = 0;
-    unsigned int subtitle_forced_hits = 0;
-    unsigned int subtitle_hit         = 0;
 
     title = job->title;
-    interjob = hb_interjob_get( job->h );
+    interjob = hb_job_interjob( job );
 
     if( job->pass_id == HB_PASS_ENCODE_2ND )
     {
@@ -600,6 +881,13 @@ static void do_job(hb_job_t *job)
 
     hb_log( "starting job" );
 
+    if( job->list_subtitle_search != NULL )
+    {
+        // This pass does the Foreign Audio Search, a result left behind
+        // by an earlier job is stale
+        hb_subtitle_close( &interjob->select_subtitle );
+    }
+
     /* Look for the scanned subtitle in the existing subtitle list
      * select_subtitle implies that we did a scan. */
     if( !job->indepth_scan && interjob->select_subtitle )
@@ -735,6 +1023,13 @@ static void do_job(hb_job_t *job)
         }
     }
 
+    // Split the video into segments that are encoded at the same time.
+    // The pipelines of the other segments are copies of this job.
+    if ( job->segment == NULL )
+    {
+        hb_segment_init( job );
+    }
+
 #ifdef USE_QSV
     /*
      * XXX: mfxCoreInterface's CopyFrame doesn't work in old drivers, and our
@@ -913,6 +1208,7 @@ static void do_job(hb_job_t *job)
         for( i = 0; i < hb_list_count( job->list_filter ); )
         {
             hb_filter_object_t * filter = hb_list_item( job->list_filter, i );
+            hb_filter_init_t     filter_init = init;
             if( filter->init( filter, &init ) )
             {
                 hb_log( "Failure to initialise filter '%s', disabling",
@@ -921,6 +1217,12 @@ static void do_job(hb_job_t *job)
                 hb_filter_close( &filter );
                 continue;
             }
+            if( filter->frame_threaded )
+            {
+                // Extra instances are set up from the same input
+                // parameters the filter itself was initialized with
+                filter_frames_init( filter, &filter_init );
+            }
             i++;
         }
         job->width = init.geometry.width;
@@ -936,11 +1238,26 @@ static void do_job(hb_job_t *job)
         for( i = 0; i < hb_list_count( job->list_filter ); )
         {
             hb_filter_object_t * filter = hb_list_item( job->list_filter, i );
+            if (filter->frames != NULL && filter->post_init != NULL)
+            {
+                int ii;
+                for (ii = 1; ii < filter->frames->count; ii++)
+                {
+                    hb_filter_object_t * instance = filter->frames->instance[ii];
+                    if (instance->post_init(instance, job))
+                    {
+                        // Fall back to processing one frame at a time
+                        filter_frames_close(filter);
+                        break;
+                    }
+                }
+            }
             if (filter->post_init != NULL && filter->post_init(filter, job))
             {
                 hb_log( "Failure to initialise filter '%s', disabling",
                         filter->name );
                 hb_list_rem( job->list_filter, filter );
+                filter_frames_close( filter );
                 hb_filter_close( &filter );
                 continue;
             }
@@ -957,6 +1274,26 @@ static void do_job(hb_job_t *job)
         job->cfr = 0;
     }
 
+    // The 2nd pass of a 2-pass encode can encode the frames that the 1st
+    // pass filtered.  The job settings from the filters stay, the filters
+    // themselves are not needed then.
+    if ( !job->indepth_scan )
+    {
+        frame_spool = hb_frame_spool_init( job );
+    }
+    if ( frame_spool == HB_FRAME_SPOOL_READ )
+    {
+        hb_filter_object_t * filter;
+
+        while( ( filter = hb_list_item( job->list_filter, 0 ) ) )
+        {
+            hb_list_rem( job->list_filter, filter );
+            filter_frames_close( filter );
+            filter->close( filter );
+            hb_filter_close( &filter );
+        }
+    }
+
     /*
      * MPEG-4 Part 2 stores the PAR num/den as unsigned 8-bit fields,
      * and libavcodec's encoder fails to initialize if we don't handle it.
@@ -986,10 +1323,13 @@ static void do_job(hb_job_t *job)
     else
 #endif
     {
-        job->fifo_mpeg2  = hb_fifo_init( FIFO_LARGE, FIFO_LARGE_WAKE );
-        job->fifo_raw    = hb_fifo_init( FIFO_SMALL, FIFO_SMALL_WAKE );
-        job->fifo_sync   = hb_fifo_init( FIFO_SMALL, FIFO_SMALL_WAKE );
-        job->fifo_mpeg4  = hb_fifo_init( FIFO_LARGE, FIFO_LARGE_WAKE );
+        // reader -> decoder -> sync -> filters -> encoder -> muxer each
+        // have exactly one producer and one consumer thread, so these
+        // hand-offs can use the lock-free fifo.
+        job->fifo_mpeg2  = hb_fifo_init_spsc( FIFO_LARGE, FIFO_LARGE_WAKE );
+        job->fifo_raw    = hb_fifo_init_spsc( FIFO_SMALL, FIFO_SMALL_WAKE );
+        job->fifo_sync   = hb_fifo_init_spsc( FIFO_SMALL, FIFO_SMALL_WAKE );
+        job->fifo_mpeg4  = hb_fifo_init_spsc( FIFO_LARGE, FIFO_LARGE_WAKE );
         job->fifo_render = NULL; // Attached to filter chain
     }
 
@@ -1259,6 +1599,20 @@ static void do_job(hb_job_t *job)
         }
     }
 
+    /* Foreign Audio Search done by this pass.  The decoders only count
+     * the subtitles, their output is dropped. */
+    for( i = 0; i < hb_list_count( job->list_subtitle_search ); i++ )
+    {
+        subtitle = hb_list_item( job->list_subtitle_search, i );
+        subtitle->fifo_in = hb_fifo_init( FIFO_SMALL, FIFO_SMALL_WAKE );
+
+        w = hb_get_work( job->h, subtitle->codec );
+        w->fifo_in = subtitle->fifo_in;
+        w->fifo_out = NULL;
+        w->subtitle = subtitle;
+        hb_list_add( job->list_work, w );
+    }
+
     /* Set up the video filter fifo pipeline */
     if( !job->indepth_scan )
     {
@@ -1273,7 +1627,7 @@ static void do_job(hb_job_t *job)
                 hb_filter_object_t * filter = hb_list_item( job->list_filter, i );
 
                 filter->fifo_in = fifo_in;
-                filter->fifo_out = hb_fifo_init( FIFO_MINI, FIFO_MINI_WAKE );
+                filter->fifo_out = hb_fifo_init_spsc( FIFO_MINI, FIFO_MINI_WAKE );
                 fifo_in = filter->fifo_out;
             }
             job->fifo_render = fifo_in;
@@ -1324,6 +1678,17 @@ static void do_job(hb_job_t *job)
         w->fifo_out = job->fifo_mpeg4;
         w->config   = &job->config;
 
+        if ( job->segment != NULL && job->segment_index == 0 )
+        {
+            // Appends the video of the other segments
+            w = hb_segment_encoder_init( job, w );
+        }
+        else if ( frame_spool )
+        {
+            // Writes the frames of the 1st pass or reads them back
+            w = hb_frame_spool_encoder_init( job, w );
+        }
+
         hb_list_add( job->list_work, w );
 
         for( i = 0; i < hb_list_count( job->list_audio ); i++ )
@@ -1386,7 +1751,13 @@ static void do_job(hb_job_t *job)
     }
 
     /* Display settings */
-    hb_display_job_info( job );
+    if ( job->segment_index == 0 )
+    {
+        hb_display_job_info( job );
+    }
+
+    hb_profile_t * profile = job_profile( job );
+    hb_profile_start( profile );
 
     /* Init read & write threads */
     if ( reader->init( reader, job ) )
@@ -1415,6 +1786,9 @@ static void do_job(hb_job_t *job)
             // Filters were initialized earlier, so we just need
             // to start the filter's thread
             filter->done = &job->done;
+            filter->profile = hb_profile_add_stage( profile, filter->name,
+                                                    filter->fifo_in,
+                                                    filter->fifo_out );
             filter->thread = hb_thread_init( filter->name, filter_loop, filter,
                                              HB_LOW_PRIORITY );
         }
@@ -1433,6 +1807,8 @@ static void do_job(hb_job_t *job)
             *job->die = 1;
             goto cleanup;
         }
+        w->profile = hb_profile_add_stage( profile, w->name,
+                                           w->fifo_in, w->fifo_out );
         w->thread = hb_thread_init( w->name, work_loop, w,
                                     HB_LOW_PRIORITY );
     }
@@ -1454,20 +1830,33 @@ static void do_job(hb_job_t *job)
             *job->die = 1;
             goto cleanup;
         }
+        sync->profile = hb_profile_add_stage( profile, sync->name,
+                                              sync->fifo_in, sync->fifo_out );
         sync->thread = hb_thread_init( sync->name, work_loop, sync,
                                     HB_LOW_PRIORITY );
 
         // The muxer requires track information that's set up by the encoder
         // init routines so we have to init the muxer last.
-        muxer = hb_muxer_init( job );
+        if ( job->segment_index > 0 )
+        {
+            // Segment pipelines spool their video for the job's pipeline
+            muxer = hb_segment_spool_init( job );
+        }
+        else
+        {
+            muxer = hb_muxer_init( job );
+        }
         w = muxer;
+        muxer->profile = hb_profile_add_stage( profile, muxer->name,
+                                               muxer->fifo_in, NULL );
     }
 
     hb_buffer_t      * buf_in, * buf_out = NULL;
+    uint64_t           work_start[2];
 
     while ( !*job->die && !*w->done && w->status != HB_WORK_DONE )
     {
-        buf_in = hb_fifo_get_wait( w->fifo_in );
+        buf_in = profile_get_wait( w->profile, w->fifo_in );
         if ( buf_in == NULL )
             continue;
         if ( *job->die )
@@ -1480,7 +1869,9 @@ static void do_job(hb_job_t *job)
         }
 
         buf_out = NULL;
+        profile_work_begin( w->profile, work_start );
         w->status = w->work( w, &buf_in, &buf_out );
+        profile_work_end( w->profile, work_start, 1 );
 
         if( buf_in )
         {
@@ -1494,7 +1885,7 @@ static void do_job(hb_job_t *job)
         {
             while ( !*job->die )
             {
-                if ( hb_fifo_full_wait( w->fifo_out ) )
+                if ( profile_full_wait( w->profile, w->fifo_out ) )
                 {
                     hb_fifo_push( w->fifo_out, buf_out );
                     buf_out = NULL;
@@ -1511,7 +1902,7 @@ static void do_job(hb_job_t *job)
 
     hb_handle_t * h = job->h;
     hb_state_t state;
-    hb_get_state2( h, &state );
+    hb_get_job_state( job, &state );
 
     hb_log("work: average encoding speed for job is %f fps", state.param.working.rate_avg);
 
@@ -1549,6 +1940,7 @@ cleanup:
             {
                 hb_thread_close( &filter->thread );
             }
+            filter_frames_close( filter );
             filter->close( filter );
         }
     }
@@ -1567,6 +1959,9 @@ cleanup:
 
     hb_list_close( &job->list_work );
 
+    /* Wait for the pipelines of the other segments */
+    hb_segment_close( job );
+
     /* Stop the read thread */
     if( reader->thread != NULL )
     {
@@ -1575,6 +1970,9 @@ cleanup:
     }
     free( reader );
 
+    // All threads are done, log where the time went
+    hb_profile_stop( job_profile( job ) );
+
     /* Close fifos */
     hb_fifo_close( &job->fifo_mpeg2 );
     hb_fifo_close( &job->fifo_raw );
@@ -1592,6 +1990,11 @@ cleanup:
             hb_fifo_close( &subtitle->fifo_out );
         }
     }
+    for( i = 0; i < hb_list_count( job->list_subtitle_search ); i++ )
+    {
+        subtitle = hb_list_item( job->list_subtitle_search, i );
+        hb_fifo_close( &subtitle->fifo_in );
+    }
     for( i = 0; i < hb_list_count( job->list_audio ); i++ )
     {
         audio = hb_list_item( job->list_audio, i );
@@ -1616,81 +2019,19 @@ cleanup:
 
     if( job->indepth_scan )
     {
-        /* Before closing the title print out our subtitle stats if we need to
-         * find the highest and lowest. */
-        for( i = 0; i < hb_list_count( job->list_subtitle ); i++ )
-        {
-            subtitle = hb_list_item( job->list_subtitle, i );
-
-            hb_log( "Subtitle track %d (id 0x%x) '%s': %d hits (%d forced)",
-                    subtitle->track, subtitle->id, subtitle->lang,
-                    subtitle->hits, subtitle->forced_hits );
-
-            if( subtitle->hits == 0 )
-                continue;
-
-            if( subtitle_highest < subtitle->hits )
-            {
-                subtitle_highest = subtitle->hits;
-            }
-
-            if( subtitle_lowest == 0 ||
-                subtitle_lowest > subtitle->hits )
-            {
-                subtitle_lowest = subtitle->hits;
-                subtitle_lowest_id = subtitle->id;
-            }
-
-            // pick the track with fewest forced hits
-            if( subtitle->forced_hits > 0 &&
-                ( subtitle_forced_hits == 0 ||
-                  subtitle_forced_hits > subtitle->forced_hits ) )
-            {
-                subtitle_forced_id = subtitle->id;
-                subtitle_forced_hits = subtitle->forced_hits;
-            }
-        }
-
-        if( subtitle_forced_id && job->select_subtitle_config.force )
-        {
-            /* If there is a subtitle stream with forced subtitles and forced-only
-             * is set, then select it in preference to the lowest. */
-            subtitle_hit = subtitle_forced_id;
-            hb_log( "Found a subtitle candidate with id 0x%x (contains forced subs)",
-                    subtitle_hit );
-        }
-        else if( subtitle_lowest > 0 &&
-                 subtitle_lowest < ( subtitle_highest * 0.1 ) )
-        {
-            /* OK we have more than one, and the lowest is lower,
-             * but how much lower to qualify for turning it on by
-             * default?
-             *
-             * Let's say 10% as a default. */
-            subtitle_hit = subtitle_lowest_id;
-            hb_log( "Found a subtitle candidate with id 0x%x", subtitle_hit );
-        }
-        else
-        {
-            hb_log( "No candidate detected during subtitle scan" );
-        }
-
-        for( i = 0; i < hb_list_count( job->list_subtitle ); i++ )
-        {
-            subtitle = hb_list_item( job->list_subtitle, i );
-            if( subtitle->id == subtitle_hit )
-            {
-                subtitle->config = job->select_subtitle_config;
-                // Remove from list since we are taking ownership
-                // of the subtitle.
-                hb_list_rem( job->list_subtitle, subtitle );
-                interjob->select_subtitle = subtitle;
-                break;
-            }
-        }
+        subtitle_search_select( job, job->list_subtitle );
+    }
+    else if( job->list_subtitle_search != NULL )
+    {
+        subtitle_search_select( job, job->list_subtitle_search );
     }
 
-    hb_buffer_pool_free();
+    // Concurrent jobs share the buffer pool, work_func frees it
+    // once they are all done
+    if (job->cpu_budget == 0)
+    {
+        hb_buffer_pool_free();
+    }
           
     /* OpenCL: must be closed *after* freeing the buffer pool */
     if (job->use_opencl)
@@ -1726,10 +2067,11 @@ static void work_loop( void * _w )
 {
     hb_work_object_t * w = _w;
     hb_buffer_t      * buf_in = NULL, * buf_out = NULL;
+    uint64_t           work_start[2];
 
     while( !*w->done && w->status != HB_WORK_DONE )
     {
-        buf_in = hb_fifo_get_wait( w->fifo_in );
+        buf_in = profile_get_wait( w->profile, w->fifo_in );
         if ( buf_in == NULL )
             continue;
         if ( *w->done )
@@ -1743,7 +2085,9 @@ static void work_loop( void * _w )
         // Invalidate buf_out so that if there is no output
         // we don't try to pass along junk.
         buf_out = NULL;
+        profile_work_begin( w->profile, work_start );
         w->status = w->work( w, &buf_in, &buf_out );
+        profile_work_end( w->profile, work_start, 1 );
 
         copy_chapter( buf_out, buf_in );
 
@@ -1759,7 +2103,7 @@ static void work_loop( void * _w )
         {
             while ( !*w->done )
             {
-                if ( hb_fifo_full_wait( w->fifo_out ) )
+                if ( profile_full_wait( w->profile, w->fifo_out ) )
                 {
                     hb_fifo_push( w->fifo_out, buf_out );
                     buf_out = NULL;
@@ -1783,6 +2127,261 @@ static void work_loop( void * _w )
     }
 }
 
+/**
+ * Creates the extra instances of a frame_threaded filter that allow
+ * filter_loop to work on several frames at once.  Each instance gets its
+ * own private data so that instances can run concurrently.  On failure
+ * the filter is left to process one frame at a time.
+ * @param filter Filter that has already been initialized.
+ * @param init Filter parameters as they were before filter->init().
+ */
+static int filter_frames_init( hb_filter_object_t * filter,
+                               hb_filter_init_t * init )
+{
+    struct hb_filter_frames_s * frames;
+    int count, ii;
+
+    count = MIN( hb_get_cpu_count(), FILTER_FRAME_THREADS );
+    if( count < 2 || init->job == NULL )
+    {
+        return 0;
+    }
+
+    frames = calloc( 1, sizeof( struct hb_filter_frames_s ) );
+    if( frames == NULL )
+    {
+        return -1;
+    }
+    frames->instance[0] = filter;
+    frames->count = 1;
+    filter->frames = frames;
+
+    for( ii = 1; ii < count; ii++ )
+    {
+        hb_filter_object_t * instance = hb_filter_copy( filter );
+        hb_filter_init_t     instance_init = *init;
+
+        instance->private_data = NULL;
+        instance->frames = NULL;
+        if( instance->init( instance, &instance_init ) )
+        {
+            hb_filter_close( &instance );
+            break;
+        }
+        frames->instance[frames->count++] = instance;
+    }
+
+    if( frames->count < 2 ||
+        taskslices_init( &frames->slices, hb_get_taskpool( init->job->h ),
+                         frames->count, sizeof( filter_frame_arg_t ),
+                         filter_frame_slice ) == 0 )
+    {
+        hb_log( "%s: failed to set up frame threads", filter->name );
+        filter_frames_close( filter );
+        return -1;
+    }
+
+    for( ii = 0; ii < frames->count; ii++ )
+    {
+        filter_frame_arg_t * arg = taskslices_args( &frames->slices, ii );
+        arg->filter = frames->instance[ii];
+        arg->filter->frame_threads = frames->count;
+    }
+    hb_log( "%s: processing %d frames at a time", filter->name,
+            frames->count );
+
+    return 0;
+}
+
+/**
+ * Closes the extra instances created by filter_frames_init.
+ * The filter itself (instance 0) is left to the caller.
+ */
+static void filter_frames_close( hb_filter_object_t * filter )
+{
+    struct hb_filter_frames_s * frames = filter->frames;
+    int ii;
+
+    if( frames == NULL )
+    {
+        return;
+    }
+    for( ii = 1; ii < frames->count; ii++ )
+    {
+        hb_filter_object_t * instance = frames->instance[ii];
+        instance->close( instance );
+        hb_filter_close( &instance );
+    }
+    if( frames->slices.slice_args != NULL )
+    {
+        taskslices_fini( &frames->slices );
+    }
+    free( frames );
+    filter->frames = NULL;
+    filter->frame_threads = 0;
+}
+
+static void filter_frame_slice( void * _arg )
+{
+    filter_frame_arg_t * arg = _arg;
+
+    if( arg->in == NULL )
+    {
+        return;
+    }
+    arg->out = NULL;
+    arg->status = arg->filter->work( arg->filter, &arg->in, &arg->out );
+}
+
+/**
+ * Passes a filtered frame to the next stage, applying any chapter mark
+ * that was dropped along with an earlier frame.
+ */
+static void filter_frame_output( hb_filter_object_t * f,
+                                 hb_buffer_t * buf_out )
+{
+    if ( f->chapter_val && f->chapter_time <= buf_out->s.start )
+    {
+        buf_out->s.new_chap = f->chapter_val;
+        f->chapter_val = 0;
+    }
+    if ( f->fifo_out == NULL )
+    {
+        hb_buffer_close( &buf_out );
+        return;
+    }
+    while ( !*f->done )
+    {
+        if ( profile_full_wait( f->profile, f->fifo_out ) )
+        {
+            hb_fifo_push( f->fifo_out, buf_out );
+            return;
+        }
+    }
+    hb_buffer_close( &buf_out );
+}
+
+/**
+ * filter_loop for filters with frame threads.  Up to frames->count
+ * queued frames are gathered and filtered concurrently, each by its own
+ * filter instance.  Output order is preserved.  The end of stream buffer
+ * is always handled on its own by the filter itself.
+ */
+static void filter_frames_loop( hb_filter_object_t * f )
+{
+    struct hb_filter_frames_s * frames = f->frames;
+    hb_buffer_t * eof;
+    uint64_t work_start[2];
+    int count, ii;
+
+    while( !*f->done && f->status != HB_FILTER_DONE )
+    {
+        hb_buffer_t * buf_in = profile_get_wait( f->profile, f->fifo_in );
+        if ( buf_in == NULL )
+            continue;
+
+        eof = NULL;
+        count = 0;
+        while ( buf_in != NULL )
+        {
+            filter_frame_arg_t * arg;
+
+            if ( buf_in->size <= 0 )
+            {
+                eof = buf_in;
+                break;
+            }
+            arg = taskslices_args( &frames->slices, count );
+            arg->in = buf_in;
+            arg->out = NULL;
+            arg->status = HB_FILTER_OK;
+            arg->chapter_val = buf_in->s.new_chap;
+            arg->chapter_time = buf_in->s.start;
+            buf_in->s.new_chap = 0;
+            if ( ++count >= frames->count )
+                break;
+            buf_in = hb_fifo_get( f->fifo_in );
+        }
+        for ( ii = count; ii < frames->count; ii++ )
+        {
+            filter_frame_arg_t * arg = taskslices_args( &frames->slices, ii );
+            arg->in = NULL;
+            arg->out = NULL;
+        }
+
+        if ( *f->done )
+        {
+            for ( ii = 0; ii < count; ii++ )
+            {
+                filter_frame_arg_t * arg = taskslices_args( &frames->slices, ii );
+                hb_buffer_close( &arg->in );
+            }
+            hb_buffer_close( &eof );
+            break;
+        }
+
+        if ( count > 0 )
+        {
+            // CPU time of the pool threads isn't accounted, only the
+            // share of this thread
+            profile_work_begin( f->profile, work_start );
+            taskslices_cycle( &frames->slices );
+            profile_work_end( f->profile, work_start, count );
+        }
+
+        for ( ii = 0; ii < count; ii++ )
+        {
+            filter_frame_arg_t * arg = taskslices_args( &frames->slices, ii );
+
+            // Filters can drop buffers.  Remember chapter information
+            // so that it can be propagated to the next buffer
+            if ( arg->chapter_val )
+            {
+                f->chapter_time = arg->chapter_time;
+                f->chapter_val = arg->chapter_val;
+            }
+            if ( arg->in )
+            {
+                hb_buffer_close( &arg->in );
+            }
+            if ( arg->status == HB_FILTER_DONE )
+            {
+                f->status = HB_FILTER_DONE;
+            }
+            if ( arg->out )
+            {
+                filter_frame_output( f, arg->out );
+                arg->out = NULL;
+            }
+        }
+
+        if ( eof != NULL && f->status != HB_FILTER_DONE )
+        {
+            hb_buffer_t * buf_out = NULL;
+
+            profile_work_begin( f->profile, work_start );
+            f->status = f->work( f, &eof, &buf_out );
+            profile_work_end( f->profile, work_start, 1 );
+            if ( buf_out )
+            {
+                filter_frame_output( f, buf_out );
+            }
+        }
+        if ( eof != NULL )
+        {
+            hb_buffer_close( &eof );
+        }
+    }
+    // Consume data in incoming fifo till job completes so that
+    // upstream threads don't get blocked.
+    while ( !*f->done )
+    {
+        hb_buffer_t * buf_in = hb_fifo_get_wait( f->fifo_in );
+        if ( buf_in != NULL )
+            hb_buffer_close( &buf_in );
+    }
+}
+
 /**
  * Performs the filter object's specific work function.
  * Loops calling work function for associated filter object. 
@@ -1795,10 +2394,17 @@ static void filter_loop( void * _f )
 {
     hb_filter_object_t * f = _f;
     hb_buffer_t      * buf_in, * buf_out = NULL;
+    uint64_t           work_start[2];
+
+    if ( f->frames != NULL )
+    {
+        filter_frames_loop( f );
+        return;
+    }
 
     while( !*f->done && f->status != HB_FILTER_DONE )
     {
-        buf_in = hb_fifo_get_wait( f->fifo_in );
+        buf_in = profile_get_wait( f->profile, f->fifo_in );
         if ( buf_in == NULL )
             continue;
 
@@ -1826,7 +2432,9 @@ static void filter_loop( void * _f )
         hb_buffer_t *last_buf_in = buf_in;
 #endif
 
+        profile_work_begin( f->profile, work_start );
         f->status = f->work( f, &buf_in, &buf_out );
+        profile_work_end( f->profile, work_start, 1 );
 
 #ifdef USE_QSV
         if (f->status == HB_FILTER_DELAY &&
@@ -1860,7 +2468,7 @@ static void filter_loop( void * _f )
         {
             while ( !*f->done )
             {
-                if ( hb_fifo_full_wait( f->fifo_out ) )
+                if ( profile_full_wait( f->profile, f->fifo_out ) )
                 {
                     hb_fifo_push( f->fifo_out, buf_out );
                     buf_out = NULL;
@@ -0,0 +1,351 @@
+/* writebehind.c
+
+   Copyright (c) 2003-2015 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+ * Write-behind output for the muxer.
+ *
+ * The muxer writes to an AVIOContext whose buffer is flushed into a
+ * bounded in-memory queue instead of the file.  A dedicated I/O thread
+ * takes everything queued and writes it to the file, so the muxer only
+ * waits on the file when the queue is full.  The muxer may seek back to
+ * patch headers, every queued chunk carries the file position it was
+ * written at and the I/O thread seeks when a chunk doesn't follow the
+ * previous one.
+ */
+
+#include "hb.h"
+#include "hbffmpeg.h"
+
+// Size of the muxer's AVIOContext buffer, the largest chunk queued
+#define WRITE_BEHIND_CHUNK  (1024 * 1024)
+
+// Bytes queued before the muxer has to wait for the I/O thread
+#define WRITE_BEHIND_QUEUE  (32 * 1024 * 1024)
+
+typedef struct write_behind_chunk_s write_behind_chunk_t;
+
+struct write_behind_chunk_s
+{
+    write_behind_chunk_t * next;
+    int64_t                pos;
+    int                    size;
+    uint8_t                data[];
+};
+
+struct hb_write_behind_s
+{
+    AVIOContext          * file;    // The output, only used by the thread
+    AVIOContext          * pb;      // Given to the muxer
+    hb_thread_t          * thread;
+    hb_lock_t            * lock;
+    hb_cond_t            * cond;
+
+    write_behind_chunk_t * head;
+    write_behind_chunk_t * tail;
+    int64_t                queued;  // Bytes queued or being written
+    int                    stop;
+    int                    direct;  // No thread, write to file directly
+    int                    error;
+
+    int64_t                pos;     // Muxer's position in the file
+    int64_t                size;    // End of the data written so far
+
+    // Statistics
+    uint64_t               bytes;       // Bytes queued in total
+    uint64_t               writes;      // Batches written by the thread
+    int64_t                max_queued;
+    uint64_t               stall_us;    // Time the muxer waited for space
+};
+
+static int write_chunk( hb_write_behind_t * wb, int64_t pos,
+                        const uint8_t * data, int size )
+{
+    if( avio_tell( wb->file ) != pos )
+    {
+        int64_t ret = avio_seek( wb->file, pos, SEEK_SET );
+        if( ret < 0 )
+        {
+            return ret;
+        }
+    }
+    avio_write( wb->file, data, size );
+    return wb->file->error;
+}
+
+static void write_behind_thread( void * _wb )
+{
+    hb_write_behind_t    * wb = _wb;
+    write_behind_chunk_t * batch, * chunk;
+    int64_t                size;
+    int                    error;
+
+    hb_lock( wb->lock );
+    while( 1 )
+    {
+        while( wb->head == NULL && !wb->stop )
+        {
+            hb_cond_wait( wb->cond, wb->lock );
+        }
+        if( wb->head == NULL )
+        {
+            break;
+        }
+
+        // Take everything queued, the muxer can keep queueing meanwhile
+        batch = wb->head;
+        wb->head = wb->tail = NULL;
+        error = wb->error;
+        hb_unlock( wb->lock );
+
+        size = 0;
+        while( batch != NULL )
+        {
+            chunk = batch;
+            batch = chunk->next;
+            if( !error )
+            {
+                error = write_chunk( wb, chunk->pos, chunk->data, chunk->size );
+            }
+            size += chunk->size;
+            free( chunk );
+        }
+        if( !error )
+        {
+            avio_flush( wb->file );
+            error = wb->file->error;
+        }
+
+        hb_lock( wb->lock );
+        wb->queued -= size;
+        wb->writes++;
+        if( error && !wb->error )
+        {
+            wb->error = error;
+        }
+        hb_cond_broadcast( wb->cond );
+    }
+    hb_unlock( wb->lock );
+}
+
+static int write_behind_write( void * opaque, uint8_t * buf, int size )
+{
+    hb_write_behind_t    * wb = opaque;
+    write_behind_chunk_t * chunk;
+    int                    error;
+
+    if( wb->direct )
+    {
+        error = wb->error;
+        if( !error )
+        {
+            error = wb->error = write_chunk( wb, wb->pos, buf, size );
+        }
+    }
+    else
+    {
+        chunk = malloc( sizeof( write_behind_chunk_t ) + size );
+        if( chunk == NULL )
+        {
+            return AVERROR(ENOMEM);
+        }
+        chunk->next = NULL;
+        chunk->pos  = wb->pos;
+        chunk->size = size;
+        memcpy( chunk->data, buf, size );
+
+        hb_lock( wb->lock );
+        if( wb->queued > 0 && wb->queued + size > WRITE_BEHIND_QUEUE &&
+            !wb->error )
+        {
+            uint64_t start = hb_get_time_us();
+            while( wb->queued > 0 && wb->queued + size > WRITE_BEHIND_QUEUE &&
+                   !wb->error )
+            {
+                hb_cond_wait( wb->cond, wb->lock );
+            }
+            wb->stall_us += hb_get_time_us() - start;
+        }
+        error = wb->error;
+        if( !error )
+        {
+            if( wb->tail != NULL )
+                wb->tail->next = chunk;
+            else
+                wb->head = chunk;
+            wb->tail = chunk;
+            wb->queued += size;
+            wb->bytes  += size;
+            if( wb->queued > wb->max_queued )
+                wb->max_queued = wb->queued;
+            hb_cond_broadcast( wb->cond );
+        }
+        hb_unlock( wb->lock );
+
+        if( error )
+        {
+            free( chunk );
+        }
+    }
+    if( error )
+    {
+        return error;
+    }
+
+    wb->pos += size;
+    if( wb->pos > wb->size )
+    {
+        wb->size = wb->pos;
+    }
+    return size;
+}
+
+static int64_t write_behind_seek( void * opaque, int64_t offset, int whence )
+{
+    hb_write_behind_t * wb = opaque;
+
+    switch( whence & ~AVSEEK_FORCE )
+    {
+        case AVSEEK_SIZE:
+            return wb->size;
+        case SEEK_SET:
+            break;
+        case SEEK_CUR:
+            offset += wb->pos;
+            break;
+        case SEEK_END:
+            offset += wb->size;
+            break;
+        default:
+            return AVERROR(EINVAL);
+    }
+    if( offset < 0 )
+    {
+        return AVERROR(EINVAL);
+    }
+    wb->pos = offset;
+    return offset;
+}
+
+/*
+ * Opens url for writing and sets *pb to the AVIOContext the muxer writes
+ * to.  Returns 0 or a negative AVERROR.
+ */
+int hb_write_behind_open( hb_write_behind_t ** _wb, AVIOContext ** pb,
+                          const char * url, const AVIOInterruptCB * int_cb )
+{
+    hb_write_behind_t * wb;
+    uint8_t           * buffer;
+    int                 flags = AVIO_FLAG_WRITE;
+    int                 ret;
+
+    *_wb = NULL;
+    wb = calloc( 1, sizeof( hb_write_behind_t ) );
+    if( wb == NULL )
+    {
+        return AVERROR(ENOMEM);
+    }
+
+#ifdef AVIO_FLAG_DIRECT
+    // Chunks are large already, write them without another copy
+    flags |= AVIO_FLAG_DIRECT;
+#endif
+    ret = avio_open2( &wb->file, url, flags, int_cb, NULL );
+    if( ret < 0 )
+    {
+        free( wb );
+        return ret;
+    }
+
+    buffer = av_malloc( WRITE_BEHIND_CHUNK );
+    if( buffer != NULL )
+    {
+        wb->pb = avio_alloc_context( buffer, WRITE_BEHIND_CHUNK, 1, wb, NULL,
+                                     write_behind_write, write_behind_seek );
+    }
+    if( wb->pb == NULL )
+    {
+        av_free( buffer );
+        avio_close( wb->file );
+        free( wb );
+        return AVERROR(ENOMEM);
+    }
+    wb->pb->seekable = wb->file->seekable;
+
+    wb->lock   = hb_lock_init();
+    wb->cond   = hb_cond_init();
+    wb->thread = hb_thread_init( "write-behind", write_behind_thread, wb,
+                                 HB_NORMAL_PRIORITY );
+
+    *_wb = wb;
+    *pb  = wb->pb;
+    return 0;
+}
+
+/*
+ * Waits for everything queued to be written and stops the I/O thread.
+ * From then on the muxer writes to the file directly, which is what a
+ * muxer that reads back what it wrote (mp4 faststart) needs.
+ */
+int hb_write_behind_sync( hb_write_behind_t * wb )
+{
+    if( wb->direct )
+    {
+        return wb->error;
+    }
+
+    avio_flush( wb->pb );
+
+    hb_lock( wb->lock );
+    wb->stop = 1;
+    hb_cond_broadcast( wb->cond );
+    hb_unlock( wb->lock );
+    hb_thread_close( &wb->thread );
+
+    wb->direct = 1;
+    return wb->error;
+}
+
+/*
+ * Writes whatever is left and closes the output.  Returns 0 or the first
+ * write error.
+ */
+int hb_write_behind_close( hb_write_behind_t ** _wb )
+{
+    hb_write_behind_t * wb = *_wb;
+    int                 error;
+
+    if( wb == NULL )
+    {
+        return 0;
+    }
+
+    hb_write_behind_sync( wb );
+    avio_flush( wb->pb );
+    avio_flush( wb->file );
+    if( !wb->error )
+    {
+        wb->error = wb->file->error;
+    }
+    error = wb->error;
+
+    hb_log( "muxer: write-behind queued %"PRIu64" bytes in %"PRIu64" writes, "
+            "largest queue %"PRId64" KiB, muxer waited %.3f s",
+            wb->bytes, wb->writes, wb->max_queued / 1024,
+            (double)wb->stall_us / 1000000. );
+
+    avio_close( wb->file );
+    av_free( wb->pb->buffer );
+    av_free( wb->pb );
+    hb_cond_close( &wb->cond );
+    hb_lock_close( &wb->lock );
+    free( wb );
+    *_wb = NULL;
+
+    return error;
+}
@@ -0,0 +1,34 @@
+/* x86_target.h
+
+   Copyright (c) 2003-2015 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#ifndef HB_X86_TARGET_H
+#define HB_X86_TARGET_H
+
+/*
+ * The *_x86.c files build their AVX2 and AVX-512 kernels with function
+ * target attributes, so libhb itself needs no special compiler flags.
+ * The kernels are only built by compilers that support the attribute
+ * together with the matching intrinsics, and are only called after
+ * checking the CPU flags at runtime.
+ */
+#if defined(__clang__) || \
+    (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#include <immintrin.h>
+#define HB_X86_AVX2 1
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#if (defined(__clang__) && \
+     (__clang_major__ > 3 || (__clang_major__ == 3 && __clang_minor__ >= 9))) || \
+    (!defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 5)
+#define HB_X86_AVX512 1
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+
+#endif // HB_X86_TARGET_H
@@ -0,0 +1,269 @@
+/* combdetect_test.c
+
+   Copyright (c) 2003-2015 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+ * Checks that the comb detection kernels of every dispatch level give
+ * exactly the masks and counts of the C kernels, on random rows with
+ * random thresholds, including out of range ones.
+ *
+ * Usage: combdetect_test [--bench]
+ *
+ * With --bench it also times each kernel on 1080p planes.
+ */
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "hb.h"
+#include "combdetect.h"
+#include "harness.h"
+
+#define STRIDE  256
+#define ROWS    8
+
+static float gamma_lut[256];
+
+// Three frames of ROWS rows: random noise, two interleaved fields of
+// different brightness, or a still picture with a little noise
+static void frames_fill(uint8_t frame[3][ROWS * STRIDE], uint32_t *seed)
+{
+    int mode = harness_rand(seed) % 3;
+    int f, ii;
+
+    for (f = 0; f < 3; f++)
+    {
+        for (ii = 0; ii < ROWS * STRIDE; ii++)
+        {
+            uint32_t r = harness_rand(seed);
+            int base = (ii / STRIDE) & 1 ? 200 : 30;
+
+            switch (mode)
+            {
+                case 0:
+                    frame[f][ii] = r;
+                    break;
+                case 1:
+                    frame[f][ii] = base + r % 40 - 20;
+                    break;
+                default:
+                    frame[f][ii] = f ? frame[0][ii] ^ (r % 4) : r;
+                    break;
+            }
+        }
+    }
+}
+
+static void params_fill(hb_comb_params_t *p, uint32_t *seed)
+{
+    p->spatial_metric = harness_rand(seed) % 4;
+    if (harness_rand(seed) % 20 == 0)
+    {
+        p->spatial_metric = -1;
+    }
+    if (harness_rand(seed) % 8 == 0)
+    {
+        p->motion_threshold = -(int)(harness_rand(seed) % 5);
+    }
+    else
+    {
+        p->motion_threshold = harness_rand(seed) % (harness_rand(seed) % 2 ? 300 : 20);
+    }
+    if (harness_rand(seed) % 10 == 0)
+    {
+        p->spatial_threshold = harness_rand(seed) % 600 - 300;
+    }
+    else
+    {
+        p->spatial_threshold = harness_rand(seed) % (harness_rand(seed) % 2 ? 60 : 10);
+    }
+    p->ignore_motion = harness_rand(seed) % 4 == 0;
+    p->gamma_lut     = gamma_lut;
+}
+
+static int threshold(uint32_t *seed, int range)
+{
+    if (harness_rand(seed) % 10 == 0)
+    {
+        return harness_rand(seed) % 300 - 20;
+    }
+    return harness_rand(seed) % range;
+}
+
+static int check(hb_comb_functions_t *c, hb_comb_functions_t *x,
+                 const char *name)
+{
+    static uint8_t frame[3][ROWS * STRIDE];
+    static uint8_t mask_c[ROWS * STRIDE], mask_x[ROWS * STRIDE];
+    const int cur = 3 * STRIDE;     // 2 rows above and below it
+    uint32_t seed = 1;
+    int t;
+
+    for (t = 0; t < 100000; t++)
+    {
+        hb_comb_params_t p;
+        int width = 1 + harness_rand(&seed) % (STRIDE - 32);
+        int gamma = harness_rand(&seed) % 2;
+        int color_equal, color_diff, f;
+        int c1 = 3, c2 = 5, x1 = 3, x2 = 5;
+
+        frames_fill(frame, &seed);
+        params_fill(&p, &seed);
+
+        // The masks are filled with a value the kernels never write, so
+        // a write past width shows up
+        memset(mask_c, 7, sizeof(mask_c));
+        memset(mask_x, 7, sizeof(mask_x));
+        if (gamma)
+        {
+            c->detect_gamma_combed_row(&p, frame[0] + cur, frame[1] + cur,
+                                       frame[2] + cur, mask_c, STRIDE, width);
+            x->detect_gamma_combed_row(&p, frame[0] + cur, frame[1] + cur,
+                                       frame[2] + cur, mask_x, STRIDE, width);
+        }
+        else
+        {
+            c->detect_combed_row(&p, frame[0] + cur, frame[1] + cur,
+                                 frame[2] + cur, mask_c, STRIDE, width);
+            x->detect_combed_row(&p, frame[0] + cur, frame[1] + cur,
+                                 frame[2] + cur, mask_x, STRIDE, width);
+        }
+        if (memcmp(mask_c, mask_x, sizeof(mask_c)))
+        {
+            fprintf(stderr, "combdetect %s: %s mask mismatch, metric %d, "
+                    "motion %d, spatial %d, width %d\n", name,
+                    gamma ? "gamma" : "detect", p.spatial_metric,
+                    p.motion_threshold, p.spatial_threshold, width);
+            return 1;
+        }
+
+        color_equal = threshold(&seed, 40);
+        color_diff  = threshold(&seed, 60);
+        f = t % 3;
+        c->count_combed_row(frame[f] + STRIDE, STRIDE, width,
+                            color_equal, color_diff, &c1, &c2);
+        x->count_combed_row(frame[f] + STRIDE, STRIDE, width,
+                            color_equal, color_diff, &x1, &x2);
+        if (c1 != x1 || c2 != x2)
+        {
+            fprintf(stderr, "combdetect %s: count mismatch, equal %d, "
+                    "diff %d, width %d: %d/%d %d/%d\n", name, color_equal,
+                    color_diff, width, c1, x1, c2, x2);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void bench(hb_comb_functions_t *x, const char *name)
+{
+    const int width = 1920, height = 1080, stride = 1920;
+    uint8_t *frame[3], *mask = malloc(stride * height);
+    uint32_t seed = 1;
+    hb_comb_params_t p;
+    uint64_t start;
+    int f, ii, y, rep, reps = 20, c1 = 0, c2 = 0;
+
+    for (f = 0; f < 3; f++)
+    {
+        frame[f] = malloc(stride * height);
+        for (ii = 0; ii < stride * height; ii++)
+        {
+            frame[f][ii] = ((ii / stride) & 1 ? 140 : 90) +
+                           harness_rand(&seed) % 16;
+        }
+    }
+    // The decomb defaults
+    p.spatial_metric    = 2;
+    p.motion_threshold  = 3;
+    p.spatial_threshold = 3;
+    p.ignore_motion     = 0;
+    p.gamma_lut         = gamma_lut;
+
+    printf("combdetect %-8s", name);
+
+    start = hb_get_time_us();
+    for (rep = 0; rep < reps; rep++)
+    {
+        for (y = 2; y < height - 2; y++)
+        {
+            x->detect_combed_row(&p, frame[0] + y * stride,
+                                 frame[1] + y * stride, frame[2] + y * stride,
+                                 mask + y * stride, stride, width);
+        }
+    }
+    printf(" detect %7.3f ms", (hb_get_time_us() - start) / 1000.0 / reps);
+
+    start = hb_get_time_us();
+    for (rep = 0; rep < reps; rep++)
+    {
+        for (y = 2; y < height - 2; y++)
+        {
+            x->detect_gamma_combed_row(&p, frame[0] + y * stride,
+                                       frame[1] + y * stride,
+                                       frame[2] + y * stride,
+                                       mask + y * stride, stride, width);
+        }
+    }
+    printf(", gamma %7.3f ms", (hb_get_time_us() - start) / 1000.0 / reps);
+
+    start = hb_get_time_us();
+    for (rep = 0; rep < reps; rep++)
+    {
+        for (y = 0; y < height - 4; y += 2)
+        {
+            x->count_combed_row(frame[1] + y * stride, stride, width,
+                                10, 15, &c1, &c2);
+        }
+    }
+    printf(", count %7.3f ms per 1080p plane\n",
+           (hb_get_time_us() - start) / 1000.0 / reps);
+
+    for (f = 0; f < 3; f++)
+    {
+        free(frame[f]);
+    }
+    free(mask);
+}
+
+int main(int argc, char **argv)
+{
+    harness_level_t levels[4];
+    hb_comb_functions_t c, x;
+    int count, ii;
+
+    // Same table as decomb
+    for (ii = 0; ii < 256; ii++)
+    {
+        gamma_lut[ii] = pow(((float)ii / (float)255), 2.2f);
+    }
+
+    // hb_comb_functions holds the C kernels until hb_comb_detect_init()
+    c = hb_comb_functions;
+
+    count = harness_levels(levels);
+    for (ii = 0; ii < count; ii++)
+    {
+        x = c;
+        harness_force_level(&levels[ii]);
+#if defined(ARCH_X86)
+        hb_comb_detect_init_x86(&x);
+#endif
+        if (check(&c, &x, levels[ii].name))
+        {
+            return 1;
+        }
+        if (harness_bench_arg(argc, argv))
+        {
+            bench(&x, levels[ii].name);
+        }
+    }
+    printf("combdetect: ok\n");
+
+    return 0;
+}
@@ -0,0 +1,186 @@
+/* denoise_test.c
+
+   Copyright (c) 2003-2015 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+ * Checks that the hqdn3d kernels of every dispatch level give exactly
+ * the output and previous frame of the C kernels.
+ *
+ * Usage: denoise_test [--bench]
+ *
+ * With --bench it also times each level on a 1080p plane.
+ */
+
+#include "../../libhb/denoise.c"
+#include "harness.h"
+
+#define FRAMES 8
+
+typedef struct
+{
+    int            w;
+    int            h;
+    unsigned char  * src;
+    unsigned char  * dst;
+    unsigned short * line_ant;
+    unsigned int   * row_ant;
+    unsigned short * frame_ant;
+} plane_t;
+
+static void plane_init(plane_t *p, int w, int h)
+{
+    p->w         = w;
+    p->h         = h;
+    p->src       = malloc(w * h);
+    p->dst       = malloc(w * h);
+    p->line_ant  = malloc(w * sizeof(unsigned short));
+    p->row_ant   = malloc(HQDN3D_ROWS * w * sizeof(unsigned int));
+    p->frame_ant = NULL;
+}
+
+static void plane_close(plane_t *p)
+{
+    free(p->src);
+    free(p->dst);
+    free(p->line_ant);
+    free(p->row_ant);
+    free(p->frame_ant);
+}
+
+// Mostly smooth content with noise, so that both small and large
+// differences index the coefficient tables
+static void plane_fill(plane_t *p, int frame, uint32_t *seed)
+{
+    int x, y;
+
+    for (y = 0; y < p->h; y++)
+    {
+        for (x = 0; x < p->w; x++)
+        {
+            uint32_t r = harness_rand(seed);
+            p->src[y * p->w + x] = r % 3 ? (x * 7 + y * 3 + frame * 13) & 0xff
+                                         : r >> 8;
+        }
+    }
+}
+
+static void denoise_frame(HQDN3DFunctions *functions, plane_t *p,
+                          short *spatial, short *temporal)
+{
+    hqdn3d_denoise(functions, p->src, p->dst, p->line_ant, p->row_ant,
+                   &p->frame_ant, p->w, p->h, spatial, temporal);
+}
+
+static int check(HQDN3DFunctions *c, HQDN3DFunctions *x, const char *name)
+{
+    static const double strength[][2] =
+    {
+        // spatial, temporal
+        {  4.0,  6.0 },
+        {  3.0,  4.5 },
+        {  0.0,  6.0 },     // temporal only
+        { 12.0, 20.0 },
+        {  1.0,  0.5 },
+    };
+    // One spare entry for the 32 bit gathers, as in the filter
+    static short spatial[512 * 16 + 1], temporal[512 * 16 + 1];
+    const int count = sizeof(strength) / sizeof(strength[0]);
+    uint32_t seed = 1;
+    int s, t, f;
+
+    for (s = 0; s < count; s++)
+    {
+        hqdn3d_precalc_coef(spatial,  strength[s][0]);
+        hqdn3d_precalc_coef(temporal, strength[s][1]);
+
+        for (t = 0; t < 20; t++)
+        {
+            int w = 1 + harness_rand(&seed) % 300;
+            int h = 1 + harness_rand(&seed) % 40;
+            plane_t ref, out;
+
+            plane_init(&ref, w, h);
+            plane_init(&out, w, h);
+            for (f = 0; f < FRAMES; f++)
+            {
+                plane_fill(&ref, f, &seed);
+                memcpy(out.src, ref.src, w * h);
+                denoise_frame(c, &ref, spatial, temporal);
+                denoise_frame(x, &out, spatial, temporal);
+                if (memcmp(ref.dst, out.dst, w * h) ||
+                    memcmp(ref.frame_ant, out.frame_ant,
+                           w * h * sizeof(unsigned short)))
+                {
+                    fprintf(stderr, "denoise %s: mismatch, strength %g:%g, "
+                            "%dx%d, frame %d\n", name, strength[s][0],
+                            strength[s][1], w, h, f);
+                    return 1;
+                }
+            }
+            plane_close(&ref);
+            plane_close(&out);
+        }
+    }
+    return 0;
+}
+
+static void bench(HQDN3DFunctions *x, const char *name)
+{
+    static short spatial[512 * 16 + 1], temporal[512 * 16 + 1];
+    uint32_t seed = 1;
+    uint64_t start;
+    plane_t p;
+    int f, frames = 50;
+
+    hqdn3d_precalc_coef(spatial,  HQDN3D_SPATIAL_LUMA_DEFAULT);
+    hqdn3d_precalc_coef(temporal, HQDN3D_TEMPORAL_LUMA_DEFAULT);
+    plane_init(&p, 1920, 1080);
+    plane_fill(&p, 0, &seed);
+    denoise_frame(x, &p, spatial, temporal);
+
+    start = hb_get_time_us();
+    for (f = 0; f < frames; f++)
+    {
+        denoise_frame(x, &p, spatial, temporal);
+    }
+    printf("denoise %-8s %8.2f ms per 1080p luma plane\n", name,
+           (hb_get_time_us() - start) / 1000.0 / frames);
+
+    plane_close(&p);
+}
+
+int main(int argc, char **argv)
+{
+    harness_level_t levels[4];
+    HQDN3DFunctions c, x;
+    int count, ii;
+
+    c.denoise_temporal = hqdn3d_denoise_temporal;
+    c.denoise_spatial  = hqdn3d_denoise_spatial_c;
+
+    count = harness_levels(levels);
+    for (ii = 0; ii < count; ii++)
+    {
+        x = c;
+        harness_force_level(&levels[ii]);
+#if defined(ARCH_X86)
+        hqdn3d_init_x86(&x);
+#endif
+        if (check(&c, &x, levels[ii].name))
+        {
+            return 1;
+        }
+        if (harness_bench_arg(argc, argv))
+        {
+            bench(&x, levels[ii].name);
+        }
+    }
+    printf("denoise: ok\n");
+
+    return 0;
+}
@@ -0,0 +1,208 @@
+/* fifo_bench.c
+
+   Copyright (c) 2003-2015 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+ * Passes buffers through a chain of threads connected by libhb fifos,
+ * the way work objects pass them from the reader to the muxer, and
+ * reports buffers per second for locked and hb_fifo_init_spsc() fifos.
+ *
+ * Usage: fifo_bench [--bench] [stages] [buffers]
+ *
+ * Without --bench a short run only checks that every buffer comes out
+ * of the chain once and in order.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hb.h"
+
+#define FIFO_CAPACITY 32
+#define FIFO_THRESH   8
+
+typedef struct
+{
+    hb_fifo_t     * fifo_in;
+    hb_fifo_t     * fifo_out;
+    hb_thread_t   * thread;
+    int             count;      // Buffers the sink received
+    int             errors;     // Buffers the sink received out of order
+} stage_t;
+
+// Moves buffers from fifo_in to fifo_out until the end of stream buffer
+// has been passed on, like hb_work_loop does
+static void stage_loop( void * _s )
+{
+    stage_t     * s = _s;
+    hb_buffer_t * buf;
+
+    for (;;)
+    {
+        buf = hb_fifo_get_wait( s->fifo_in );
+        if ( buf == NULL )
+        {
+            continue;
+        }
+        while ( !hb_fifo_full_wait( s->fifo_out ) )
+        {
+        }
+        if ( buf->size <= 0 )
+        {
+            hb_fifo_push( s->fifo_out, buf );
+            break;
+        }
+        hb_fifo_push( s->fifo_out, buf );
+    }
+}
+
+// Last stage, checks and frees the buffers
+static void sink_loop( void * _s )
+{
+    stage_t     * s = _s;
+    hb_buffer_t * buf;
+
+    for (;;)
+    {
+        buf = hb_fifo_get_wait( s->fifo_in );
+        if ( buf == NULL )
+        {
+            continue;
+        }
+        if ( buf->size <= 0 )
+        {
+            hb_buffer_close( &buf );
+            break;
+        }
+        if ( buf->s.start != s->count )
+        {
+            s->errors++;
+        }
+        s->count++;
+        hb_buffer_close( &buf );
+    }
+}
+
+// Pushes 'buffers' buffers through 'stages' threads and returns the
+// elapsed time in microseconds, or 0 if buffers were lost or reordered
+static uint64_t run_chain( int stages, int buffers, int spsc )
+{
+    stage_t   * stage = calloc( stages + 1, sizeof( stage_t ) );
+    hb_fifo_t * fifo_in;
+    uint64_t    start, elapsed;
+    int         ii;
+
+    // stage[ii] reads the fifo stage[ii - 1] writes, stage[stages] is
+    // the sink
+    fifo_in = spsc ? hb_fifo_init_spsc( FIFO_CAPACITY, FIFO_THRESH ) :
+                     hb_fifo_init( FIFO_CAPACITY, FIFO_THRESH );
+    stage[0].fifo_in = fifo_in;
+    for ( ii = 0; ii < stages; ii++ )
+    {
+        stage[ii].fifo_out = spsc ?
+                hb_fifo_init_spsc( FIFO_CAPACITY, FIFO_THRESH ) :
+                hb_fifo_init( FIFO_CAPACITY, FIFO_THRESH );
+        stage[ii + 1].fifo_in = stage[ii].fifo_out;
+    }
+
+    start = hb_get_time_us();
+    for ( ii = 0; ii < stages; ii++ )
+    {
+        stage[ii].thread = hb_thread_init( "stage", stage_loop, &stage[ii],
+                                           HB_NORMAL_PRIORITY );
+    }
+    stage[stages].thread = hb_thread_init( "sink", sink_loop, &stage[stages],
+                                           HB_NORMAL_PRIORITY );
+
+    for ( ii = 0; ii <= buffers; ii++ )
+    {
+        hb_buffer_t * buf = hb_buffer_init( ii < buffers ? 16 : 0 );
+        buf->s.start = ii;
+        while ( !hb_fifo_full_wait( fifo_in ) )
+        {
+        }
+        hb_fifo_push( fifo_in, buf );
+    }
+
+    for ( ii = 0; ii <= stages; ii++ )
+    {
+        hb_thread_close( &stage[ii].thread );
+    }
+    elapsed = hb_get_time_us() - start;
+
+    if ( stage[stages].count != buffers || stage[stages].errors )
+    {
+        fprintf( stderr, "%s fifos: %d of %d buffers arrived, %d out of order\n",
+                 spsc ? "spsc" : "locked", stage[stages].count, buffers,
+                 stage[stages].errors );
+        elapsed = 0;
+    }
+
+    for ( ii = 0; ii <= stages; ii++ )
+    {
+        hb_fifo_close( &stage[ii].fifo_in );
+    }
+    free( stage );
+
+    return elapsed;
+}
+
+int main( int argc, char ** argv )
+{
+    int bench   = 0;
+    int stages  = 6;
+    int buffers = 0;
+    int spsc;
+
+    if ( argc > 1 && !strcmp( argv[1], "--bench" ) )
+    {
+        bench = 1;
+        argc--;
+        argv++;
+    }
+    if ( argc > 1 )
+    {
+        stages = atoi( argv[1] );
+    }
+    if ( argc > 2 )
+    {
+        buffers = atoi( argv[2] );
+    }
+    if ( stages < 1 )
+    {
+        stages = 1;
+    }
+    if ( buffers < 1 )
+    {
+        buffers = bench ? 1000000 : 20000;
+    }
+
+    hb_buffer_pool_init();
+
+    for ( spsc = 0; spsc < 2; spsc++ )
+    {
+        uint64_t us = run_chain( stages, buffers, spsc );
+        if ( us == 0 )
+        {
+            return 1;
+        }
+        if ( bench )
+        {
+            printf( "%-6s fifos, %d stages: %10.0f buffers/s\n",
+                    spsc ? "spsc" : "locked", stages,
+                    buffers * 1000000.0 / us );
+        }
+    }
+    if ( !bench )
+    {
+        printf( "fifo chain: ok\n" );
+    }
+
+    return 0;
+}
@@ -0,0 +1,92 @@
+/* harness.h
+
+   Copyright (c) 2003-2015 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#ifndef HB_HARNESS_H
+#define HB_HARNESS_H
+
+/*
+ * Helpers shared by the kernel check programs.  Each program selects
+ * the kernels of every dispatch level the CPU supports by forcing the
+ * libavutil CPU flags before calling the *_init_x86() function, and
+ * compares their output with the C kernels on the same random input.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "libavutil/cpu.h"
+
+typedef struct
+{
+    const char * name;
+    int          flags;         // Flags forced with av_force_cpu_flags()
+} harness_level_t;
+
+#define HARNESS_SSE2_FLAGS  (AV_CPU_FLAG_MMX | AV_CPU_FLAG_MMXEXT | \
+                             AV_CPU_FLAG_SSE | AV_CPU_FLAG_SSE2)
+#define HARNESS_AVX2_FLAGS  (HARNESS_SSE2_FLAGS | AV_CPU_FLAG_SSE3 | \
+                             AV_CPU_FLAG_SSSE3 | AV_CPU_FLAG_SSE4 | \
+                             AV_CPU_FLAG_SSE42 | AV_CPU_FLAG_AVX | \
+                             AV_CPU_FLAG_AVX2)
+
+/*
+ * Fills 'levels' with the dispatch levels to check and returns their
+ * count.  The first one is the C code, the last one is whatever the
+ * CPU detection selects.  Levels libavutil has no flag for, such as
+ * AVX-512, are only selected once hb_platform_init() has detected them,
+ * so a program checking them calls it before the last level.
+ */
+static inline int harness_levels(harness_level_t levels[4])
+{
+    int cpu_flags, count = 0;
+
+    av_force_cpu_flags(-1);
+    cpu_flags = av_get_cpu_flags();
+
+    levels[count].name    = "C";
+    levels[count++].flags = 0;
+    if ((cpu_flags & HARNESS_SSE2_FLAGS) == HARNESS_SSE2_FLAGS)
+    {
+        levels[count].name    = "SSE2";
+        levels[count++].flags = HARNESS_SSE2_FLAGS;
+    }
+    if ((cpu_flags & HARNESS_AVX2_FLAGS) == HARNESS_AVX2_FLAGS)
+    {
+        levels[count].name    = "AVX2";
+        levels[count++].flags = HARNESS_AVX2_FLAGS;
+    }
+    levels[count].name    = "detected";
+    levels[count++].flags = -1;
+
+    return count;
+}
+
+// Selects the kernels of 'level' for the next *_init_x86() call
+static inline void harness_force_level(const harness_level_t *level)
+{
+    av_force_cpu_flags(level->flags);
+}
+
+/*
+ * Small deterministic generator, so that a mismatch can be reproduced
+ * from the seed a program prints on any platform.
+ */
+static inline uint32_t harness_rand(uint32_t *state)
+{
+    *state = *state * 1664525 + 1013904223;
+    return *state >> 8;
+}
+
+static inline int harness_bench_arg(int argc, char **argv)
+{
+    return argc > 1 && !strcmp(argv[1], "--bench");
+}
+
+#endif // HB_HARNESS_H
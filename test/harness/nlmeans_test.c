@@ -0,0 +1,404 @@
+/* nlmeans_test.c
+
+   Copyright (c) 2003-2015 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+ * Checks that the NLMeans kernels of every dispatch level give exactly
+ * the integral images and pixel sums of build_integral_scalar() and
+ * accumulate_row_scalar(), and that a plane filtered in tiles by them
+ * is exactly the plane the C kernels filter in one piece.
+ *
+ * Usage: nlmeans_test [--bench]
+ *
+ * With --bench it also times each kernel and a whole plane on a 1080p
+ * luma plane with the default settings.
+ */
+
+#include "../../libhb/nlmeans.c"
+#include "harness.h"
+
+#define FRAMES 3
+
+typedef struct
+{
+    double strength;
+    double origin_tune;
+    int    patch_size;
+    int    range;
+    int    nframes;
+    int    prefilter;
+
+    float  exptable[NLMEANS_EXPSIZE];
+    float  weight_fact_table;
+    int    diff_max;
+} params_t;
+
+// Same tables as nlmeans_init()
+static void params_init(params_t *p)
+{
+    const float weight_factor       = 1.0/p->patch_size/p->patch_size / (p->strength * p->strength);
+    const float min_weight_in_table = 0.0005;
+    const float stretch             = NLMEANS_EXPSIZE / (-log(min_weight_in_table));
+    int ii;
+
+    p->weight_fact_table = weight_factor * stretch;
+    p->diff_max          = NLMEANS_EXPSIZE / p->weight_fact_table;
+    for (ii = 0; ii < NLMEANS_EXPSIZE; ii++)
+    {
+        p->exptable[ii] = exp(-ii/stretch);
+    }
+    p->exptable[NLMEANS_EXPSIZE-1] = 0;
+}
+
+// A gradient that moves a little from frame to frame, with noise, copied
+// into frames with borders like nlmeans_add_frame() does
+static void frames_init(Frame *frame, int count, int w, int h, int range,
+                        uint32_t *seed)
+{
+    const int border = ((range + 2) / 2 + 15) / 16 * 16;
+    uint8_t *src = malloc(w * h);
+    int f, x, y;
+
+    for (f = 0; f < count; f++)
+    {
+        for (y = 0; y < h; y++)
+        {
+            for (x = 0; x < w; x++)
+            {
+                uint32_t r = harness_rand(seed);
+                src[y * w + x] = r % 8 ? ((x + y + f * 3) * 2 + r % 24) & 0xff
+                                       : r >> 8;
+            }
+        }
+        memset(&frame[f], 0, sizeof(Frame));
+        frame[f].plane[0].mutex = hb_lock_init();
+        nlmeans_alloc(src, w, w, h, &frame[f].plane[0], border);
+        frame[f].width  = w;
+        frame[f].height = h;
+    }
+    free(src);
+}
+
+static void frames_close(Frame *frame, int count)
+{
+    int f;
+
+    for (f = 0; f < count; f++)
+    {
+        nlmeans_plane_free(&frame[f].plane[0]);
+        hb_lock_close(&frame[f].plane[0].mutex);
+    }
+}
+
+// Integral image laid out like nlmeans_plane() does
+static uint32_t * integral_alloc(int dst_w, int rows, int *stride,
+                                 uint32_t **mem)
+{
+    *stride = ((dst_w + 15) / 16 * 16) + 2 * 16;
+    *mem = calloc((size_t)*stride * (rows + 1), sizeof(uint32_t));
+    return *mem + *stride + 16;
+}
+
+static int check_kernels(NLMeansFunctions *c, NLMeansFunctions *x,
+                         const char *name)
+{
+    uint32_t seed = 1;
+    int t, ii, y;
+
+    for (t = 0; t < 300; t++)
+    {
+        params_t p;
+        Frame frame[2];
+        uint32_t *mem_c, *mem_x, *integral_c, *integral_x;
+        int stride;
+
+        p.strength   = 0.5 + harness_rand(&seed) % 200 / 10.0;
+        p.patch_size = 1 + 2 * (harness_rand(&seed) % 5);
+        p.range      = 1 + 2 * (harness_rand(&seed) % 5);
+        params_init(&p);
+
+        const int w      = p.patch_size + harness_rand(&seed) % 300;
+        const int h      = p.patch_size + harness_rand(&seed) % 40;
+        const int r_half = (p.range - 1) / 2;
+        const int dx     = (int)(harness_rand(&seed) % p.range) - r_half;
+        const int dy     = (int)(harness_rand(&seed) % p.range) - r_half;
+        const int n      = p.patch_size;
+
+        frames_init(frame, 2, w, h, p.range, &seed);
+        const BorderedPlane *src = &frame[0].plane[0];
+        const BorderedPlane *cmp = &frame[harness_rand(&seed) % 2].plane[0];
+
+        integral_c = integral_alloc(w, h, &stride, &mem_c);
+        integral_x = integral_alloc(w, h, &stride, &mem_x);
+        c->build_integral(integral_c, stride, src->image, src->image_pre,
+                          cmp->image, cmp->image_pre, w, src->border,
+                          w, h, dx, dy);
+        x->build_integral(integral_x, stride, src->image, src->image_pre,
+                          cmp->image, cmp->image_pre, w, src->border,
+                          w, h, dx, dy);
+
+        // The SIMD kernels may write the row up to the next multiple of 16
+        for (y = 0; y < h; y++)
+        {
+            if (memcmp(integral_c + y * stride, integral_x + y * stride,
+                       w * sizeof(uint32_t)))
+            {
+                fprintf(stderr, "nlmeans %s: integral mismatch, %dx%d, "
+                        "displacement %d,%d, row %d\n", name, w, h, dx, dy, y);
+                return 1;
+            }
+        }
+
+        // Random starting sums, as left by earlier displacements
+        const int bw    = w + 2 * src->border;
+        const int count = w - n + 1;
+        struct PixelSum *tmp_c = malloc(count * sizeof(struct PixelSum));
+        struct PixelSum *tmp_x = malloc(count * sizeof(struct PixelSum));
+        for (ii = 0; ii < count; ii++)
+        {
+            tmp_c[ii].weight_sum = harness_rand(&seed) % 1000 / 100.0f;
+            tmp_c[ii].pixel_sum  = harness_rand(&seed) % 100000 / 100.0f;
+        }
+        memcpy(tmp_x, tmp_c, count * sizeof(struct PixelSum));
+
+        for (y = 0; y + n <= h; y++)
+        {
+            const uint8_t *compare = cmp->image + (y + n / 2 + dy) * bw +
+                                     n / 2 + dx;
+            c->accumulate_row(tmp_c, integral_c + (y - 1) * stride - 1,
+                              integral_c + (y + n - 1) * stride - 1, compare,
+                              n, count, p.exptable, p.weight_fact_table,
+                              p.diff_max);
+            x->accumulate_row(tmp_x, integral_c + (y - 1) * stride - 1,
+                              integral_c + (y + n - 1) * stride - 1, compare,
+                              n, count, p.exptable, p.weight_fact_table,
+                              p.diff_max);
+            if (memcmp(tmp_c, tmp_x, count * sizeof(struct PixelSum)))
+            {
+                fprintf(stderr, "nlmeans %s: sums mismatch, %dx%d, "
+                        "strength %g, patch %d, displacement %d,%d, row %d\n",
+                        name, w, h, p.strength, n, dx, dy, y);
+                return 1;
+            }
+        }
+
+        free(tmp_c);
+        free(tmp_x);
+        free(mem_c);
+        free(mem_x);
+        frames_close(frame, 2);
+    }
+    return 0;
+}
+
+static void plane_filter(NLMeansFunctions *functions, Frame *frame,
+                         params_t *p, uint8_t *dst, int tiles)
+{
+    Frame *window[FRAMES];
+    nlmeans_thread_arg_t scratch[8];
+    const int w = frame[0].width, h = frame[0].height;
+    int f, seg;
+
+    for (f = 0; f < FRAMES; f++)
+    {
+        window[f] = &frame[f];
+    }
+    memset(scratch, 0, sizeof(scratch));
+
+    // The tiles of nlmeans_filter_slice(), each with the scratch of its
+    // own slice
+    for (seg = 0; seg < tiles; seg++)
+    {
+        const int y_start = h *  seg      / tiles;
+        const int y_end   = h * (seg + 1) / tiles;
+
+        if (y_start >= y_end)
+        {
+            continue;
+        }
+        nlmeans_plane(functions, window, p->prefilter, 0, p->nframes,
+                      dst, w, w, h, y_start, y_end, p->strength,
+                      p->origin_tune, p->patch_size, p->range, p->exptable,
+                      p->weight_fact_table, p->diff_max, &scratch[seg]);
+    }
+    for (seg = 0; seg < tiles; seg++)
+    {
+        free(scratch[seg].tmp_data);
+        free(scratch[seg].integral_mem);
+    }
+}
+
+static int check_planes(NLMeansFunctions *c, NLMeansFunctions *x,
+                        const char *name)
+{
+    static const params_t settings[] =
+    {
+        // strength, origin tune, patch size, range, frames, prefilter
+        {  8.0, 1.0,  7, 3, 2,    0 },     // the defaults
+        {  6.0, 0.8,  7, 5, 3,    0 },
+        {  4.0, 0.2,  3, 3, 1, 1025 },
+        { 12.0, 0.5,  9, 3, 3,  258 },
+        {  1.5, 0.01, 5, 7, 2,    4 },
+        { 20.0, 1.0,  1, 1, 2,    0 },
+    };
+    static const int tile_counts[] = { 1, 2, 3, 5, 8 };
+    const int count = sizeof(settings) / sizeof(settings[0]);
+    const int tiles = sizeof(tile_counts) / sizeof(tile_counts[0]);
+    uint32_t seed = 1;
+    int s, t, ii;
+
+    for (s = 0; s < count; s++)
+    {
+        params_t p = settings[s];
+        params_init(&p);
+
+        for (t = 0; t < 4; t++)
+        {
+            const int w = p.patch_size + harness_rand(&seed) % 200;
+            const int h = p.patch_size + harness_rand(&seed) % 120;
+            uint8_t *ref = malloc(w * h), *out = malloc(w * h);
+            Frame frame[FRAMES];
+
+            frames_init(frame, FRAMES, w, h, p.range, &seed);
+            plane_filter(c, frame, &p, ref, 1);
+            for (ii = 0; ii < tiles; ii++)
+            {
+                memset(out, 0, w * h);
+                plane_filter(x, frame, &p, out, tile_counts[ii]);
+                if (memcmp(ref, out, w * h))
+                {
+                    fprintf(stderr, "nlmeans %s: plane mismatch, settings "
+                            "%d, %dx%d, %d tiles\n", name, s, w, h,
+                            tile_counts[ii]);
+                    return 1;
+                }
+            }
+            frames_close(frame, FRAMES);
+            free(ref);
+            free(out);
+        }
+    }
+    return 0;
+}
+
+static void bench(NLMeansFunctions *x, const char *name)
+{
+    const int w = 1920, h = 1080, reps = 3;
+    params_t p = { NLMEANS_STRENGTH_LUMA_DEFAULT,
+                   NLMEANS_ORIGIN_TUNE_LUMA_DEFAULT,
+                   NLMEANS_PATCH_SIZE_LUMA_DEFAULT,
+                   NLMEANS_RANGE_LUMA_DEFAULT,
+                   NLMEANS_FRAMES_LUMA_DEFAULT,
+                   NLMEANS_PREFILTER_LUMA_DEFAULT };
+    const int n = p.patch_size, r_half = (p.range - 1) / 2;
+    const int count = w - n + 1;
+    uint32_t seed = 1, *mem, *integral;
+    struct PixelSum *tmp = calloc(count, sizeof(struct PixelSum));
+    uint8_t *dst = malloc(w * h);
+    Frame frame[FRAMES];
+    uint64_t start;
+    int stride, rep, dx, dy, y, bw;
+
+    params_init(&p);
+    frames_init(frame, FRAMES, w, h, p.range, &seed);
+    integral = integral_alloc(w, h, &stride, &mem);
+    bw = w + 2 * frame[0].plane[0].border;
+
+    printf("nlmeans %-8s", name);
+
+    // One integral image per displacement of a frame, like the filter
+    start = hb_get_time_us();
+    for (rep = 0; rep < reps; rep++)
+    {
+        for (dy = -r_half; dy <= r_half; dy++)
+        {
+            for (dx = -r_half; dx <= r_half; dx++)
+            {
+                x->build_integral(integral, stride,
+                                  frame[0].plane[0].image,
+                                  frame[0].plane[0].image_pre,
+                                  frame[1].plane[0].image,
+                                  frame[1].plane[0].image_pre,
+                                  w, frame[0].plane[0].border, w, h, dx, dy);
+            }
+        }
+    }
+    printf(" integral %7.2f ms", (hb_get_time_us() - start) / 1000.0 / reps);
+
+    start = hb_get_time_us();
+    for (rep = 0; rep < reps; rep++)
+    {
+        for (dy = -r_half; dy <= r_half; dy++)
+        {
+            for (dx = -r_half; dx <= r_half; dx++)
+            {
+                for (y = 0; y + n <= h; y++)
+                {
+                    x->accumulate_row(tmp, integral + (y - 1) * stride - 1,
+                                      integral + (y + n - 1) * stride - 1,
+                                      frame[1].plane[0].image +
+                                      (y + n / 2 + dy) * bw + n / 2 + dx,
+                                      n, count, p.exptable,
+                                      p.weight_fact_table, p.diff_max);
+                }
+            }
+        }
+    }
+    printf(", accumulate %7.2f ms per compared frame",
+           (hb_get_time_us() - start) / 1000.0 / reps);
+
+    start = hb_get_time_us();
+    for (rep = 0; rep < reps; rep++)
+    {
+        plane_filter(x, frame, &p, dst, 1);
+    }
+    printf(", plane %7.2f ms\n",
+           (hb_get_time_us() - start) / 1000.0 / reps);
+
+    frames_close(frame, FRAMES);
+    free(mem);
+    free(tmp);
+    free(dst);
+}
+
+int main(int argc, char **argv)
+{
+    harness_level_t levels[4];
+    NLMeansFunctions c, x;
+    int count, ii;
+
+    c.build_integral = build_integral_scalar;
+    c.accumulate_row = accumulate_row_scalar;
+
+    count = harness_levels(levels);
+    for (ii = 0; ii < count; ii++)
+    {
+        // The AVX-512 kernels are selected by the detected level
+        if (ii == count - 1)
+        {
+            hb_platform_init();
+        }
+        x = c;
+        harness_force_level(&levels[ii]);
+#if defined(ARCH_X86)
+        nlmeans_init_x86(&x);
+#endif
+        if (check_kernels(&c, &x, levels[ii].name) ||
+            check_planes(&c, &x, levels[ii].name))
+        {
+            return 1;
+        }
+        if (harness_bench_arg(argc, argv))
+        {
+            bench(&x, levels[ii].name);
+        }
+    }
+    printf("nlmeans: ok\n");
+
+    return 0;
+}
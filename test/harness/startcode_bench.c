@@ -0,0 +1,582 @@
+/* startcode_bench.c
+
+   Copyright (c) 2003-2015 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+ * Compares hb_find_startcode() and the chunked program stream reader
+ * in stream.c with the byte-wise code they replaced.
+ *
+ * Usage: startcode_bench [--bench] [file.mpg]
+ *
+ * Checks that every dispatch level of hb_find_startcode() finds the
+ * same start codes as the old shift register loop, and that
+ * hb_ps_read_packet() and skip_to_next_pack() return the same packets
+ * and leave the same file positions as the old getc_unlocked() reader,
+ * with random seeks.  The program stream is a synthetic one written to
+ * the temporary directory unless a file is given.  With --bench it also
+ * reports the throughput of each version.
+ */
+
+#include <unistd.h>
+
+#include "../../libhb/stream.c"
+#include "harness.h"
+
+/*
+ * The byte-wise code as it was before hb_find_startcode()
+ */
+static const uint8_t * find_startcode_old( const uint8_t *start,
+                                           const uint8_t *end )
+{
+    uint32_t start_code = -1;
+    const uint8_t *buf;
+
+    for ( buf = start; buf < end; buf++ )
+    {
+        start_code = ( start_code << 8 ) | *buf;
+        if ( ( start_code & 0xffffff ) == 1 && buf - 2 >= start )
+        {
+            return buf - 2;
+        }
+    }
+    return end;
+}
+
+static void skip_to_next_pack_old( hb_stream_t *src_stream )
+{
+    // scan forward until we find the start of the next pack
+    uint32_t strt_code = -1;
+    int c;
+
+    flockfile( src_stream->file_handle );
+    while ( ( c = getc_unlocked( src_stream->file_handle ) ) != EOF )
+    {
+        strt_code = ( strt_code << 8 ) | c;
+        if ( strt_code == 0x000001ba )
+            // we found the start of the next pack
+            break;
+    }
+    funlockfile( src_stream->file_handle );
+
+    // if we didn't terminate on an eof back up so the next read
+    // starts on the pack boundary.
+    if ( c != EOF )
+    {
+        fseeko( src_stream->file_handle, -4, SEEK_CUR );
+    }
+}
+
+static int ps_read_packet_old( hb_stream_t * stream, hb_buffer_t *b )
+{
+    // Appends to buffer if size != 0
+    int start_code = -1;
+    int pos = b->size;
+    int stream_id = -1;
+    int c;
+
+#define cp (b->data)
+    flockfile( stream->file_handle );
+    while ( ( c = getc_unlocked( stream->file_handle ) ) != EOF )
+    {
+        start_code = ( start_code << 8 ) | c;
+        if ( ( start_code >> 8 )== 0x000001 )
+            // we found the start of the next start
+            break;
+    }
+    if ( c == EOF )
+        goto done;
+
+    if ( pos + 4 > b->alloc )
+    {
+        // need to expand the buffer
+        hb_buffer_realloc( b, b->alloc * 2 );
+    }
+    cp[pos++] = ( start_code >> 24 ) & 0xff;
+    cp[pos++] = ( start_code >> 16 ) & 0xff;
+    cp[pos++] = ( start_code >>  8 ) & 0xff;
+    cp[pos++] = ( start_code )       & 0xff;
+    stream_id = start_code & 0xff;
+
+    if ( stream_id == 0xba )
+    {
+        int start = pos - 4;
+        // Read pack header
+        if ( pos + 21 >= b->alloc )
+        {
+            // need to expand the buffer
+            hb_buffer_realloc( b, b->alloc * 2 );
+        }
+
+        // There are at least 8 bytes.  More if this is mpeg2 pack.
+        fread( cp+pos, 1, 8, stream->file_handle );
+        int mark = cp[pos] >> 4;
+        pos += 8;
+
+        if ( mark != 0x02 )
+        {
+            // mpeg-2 pack,
+            fread( cp+pos, 1, 2, stream->file_handle );
+            pos += 2;
+            int len = cp[start+13] & 0x7;
+            fread( cp+pos, 1, len, stream->file_handle );
+            pos += len;
+        }
+    }
+    // Non-video streams can emulate start codes, so we need
+    // to inspect PES packets and skip over their data
+    // sections to avoid mis-detection of the next pack or pes start code
+    else if ( stream_id >= 0xbb )
+    {
+        int len = 0;
+        c = getc_unlocked( stream->file_handle );
+        if ( c == EOF )
+            goto done;
+        len = c << 8;
+        c = getc_unlocked( stream->file_handle );
+        if ( c == EOF )
+            goto done;
+        len |= c;
+        if ( pos + len + 2 > b->alloc )
+        {
+            if ( b->alloc * 2 > pos + len + 2 )
+                hb_buffer_realloc( b, b->alloc * 2 );
+            else
+                hb_buffer_realloc( b, b->alloc * 2 + len + 2 );
+        }
+        cp[pos++] = len >> 8;
+        cp[pos++] = len & 0xff;
+        if ( len )
+        {
+            // Length is non-zero, read the packet all at once
+            len = fread( cp+pos, 1, len, stream->file_handle );
+            pos += len;
+        }
+        else
+        {
+            // Length is zero, read bytes till we find a start code.
+            // Only video PES packets are allowed to have zero length.
+            start_code = -1;
+            while ( ( c = getc_unlocked( stream->file_handle ) ) != EOF )
+            {
+                start_code = ( start_code << 8 ) | c;
+                if ( pos  >= b->alloc )
+                {
+                    // need to expand the buffer
+                    hb_buffer_realloc( b, b->alloc * 2 );
+                }
+                cp[pos++] = c;
+                if ( ( start_code >> 8   ) == 0x000001 &&
+                     ( start_code & 0xff ) >= 0xb9 )
+                {
+                    // we found the start of the next start
+                    break;
+                }
+            }
+            if ( c == EOF )
+                goto done;
+            pos -= 4;
+            fseeko( stream->file_handle, -4, SEEK_CUR );
+        }
+    }
+    else
+    {
+        // Unknown, find next start code
+        start_code = -1;
+        while ( ( c = getc_unlocked( stream->file_handle ) ) != EOF )
+        {
+            start_code = ( start_code << 8 ) | c;
+            if ( pos  >= b->alloc )
+            {
+                // need to expand the buffer
+                hb_buffer_realloc( b, b->alloc * 2 );
+            }
+            cp[pos++] = c;
+            if ( ( start_code >> 8 ) == 0x000001 &&
+                 ( start_code & 0xff ) >= 0xb9 )
+                // we found the start of the next start
+                break;
+        }
+        if ( c == EOF )
+            goto done;
+        pos -= 4;
+        fseeko( stream->file_handle, -4, SEEK_CUR );
+    }
+done:
+    funlockfile( stream->file_handle );
+    int len = pos - b->size;
+    b->size = pos;
+#undef cp
+    return len;
+}
+
+/*
+ * hb_find_startcode()
+ */
+typedef struct
+{
+    const char             * name;
+    hb_find_startcode_func * func;
+} finder_t;
+
+// The finders to compare: the old loop, the C version (which
+// hb_find_startcode() is until hb_find_startcode_init() is called) and
+// the kernels of each dispatch level
+static int finders_init( finder_t finder[6] )
+{
+    harness_level_t levels[4];
+    int count = 0, n, ii;
+
+    finder[count].name   = "old loop";
+    finder[count++].func = find_startcode_old;
+    finder[count].name   = "C";
+    finder[count++].func = hb_find_startcode;
+
+    n = harness_levels( levels );
+    for ( ii = 0; ii < n; ii++ )
+    {
+        hb_find_startcode_func * func = NULL;
+
+        harness_force_level( &levels[ii] );
+#if defined(ARCH_X86)
+        func = hb_find_startcode_init_x86();
+#endif
+        if ( func != NULL )
+        {
+            finder[count].name   = levels[ii].name;
+            finder[count++].func = func;
+        }
+    }
+    av_force_cpu_flags( -1 );
+
+    return count;
+}
+
+static int check_find( finder_t *finder, int count )
+{
+    uint32_t seed = 1;
+    uint8_t buf[256];
+    int t, ii;
+
+    for ( t = 0; t < 200000; t++ )
+    {
+        // Mostly zeros and ones, so there are many near misses
+        int n = harness_rand( &seed ) % 200;
+        int s = harness_rand( &seed ) % ( n + 1 );
+        const uint8_t *ref;
+
+        for ( ii = 0; ii < n; ii++ )
+        {
+            uint32_t r = harness_rand( &seed );
+            buf[ii] = r % 8 < 4 ? 0 : r % 8 < 6 ? 1 : r >> 8;
+        }
+        ref = finder[0].func( buf + s, buf + n );
+        for ( ii = 1; ii < count; ii++ )
+        {
+            if ( finder[ii].func( buf + s, buf + n ) != ref )
+            {
+                fprintf( stderr, "startcode %s: mismatch, size %d, start %d\n",
+                         finder[ii].name, n, s );
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static void bench_find( finder_t *finder, int count )
+{
+    const int size = 64 << 20;
+    uint8_t *buf = malloc( size );
+    uint32_t seed = 1;
+    int ii, rep;
+
+    // Compressed payload: mostly non-zero bytes, some zeros, and a start
+    // code every 2 KiB like the packs of a program stream
+    for ( ii = 0; ii < size; ii++ )
+    {
+        uint32_t r = harness_rand( &seed );
+        buf[ii] = r % 8 ? ( r >> 8 ) | 0x80 : r >> 8;
+    }
+    for ( ii = 0; ii + 4 <= size; ii += 2048 )
+    {
+        buf[ii]     = 0;
+        buf[ii + 1] = 0;
+        buf[ii + 2] = 1;
+        buf[ii + 3] = 0xe0;
+    }
+
+    for ( ii = 0; ii < count; ii++ )
+    {
+        uint64_t start = hb_get_time_us();
+        int found = 0;
+
+        for ( rep = 0; rep < 5; rep++ )
+        {
+            const uint8_t *p = buf, *end = buf + size;
+            while ( ( p = finder[ii].func( p, end ) ) < end )
+            {
+                found++;
+                p += 3;
+            }
+        }
+        printf( "find start code %-10s %8.0f MB/s (%d found)\n",
+                finder[ii].name,
+                5.0 * size / ( hb_get_time_us() - start ), found );
+    }
+    free( buf );
+}
+
+/*
+ * Program stream reader
+ */
+
+// Writes an MPEG-2 program stream of 'packs' packs.  Some video PES
+// packets have zero length, some audio payloads emulate start codes and,
+// if 'garbage' is set, there is junk between the packs.
+static int write_stream( const char *path, int packs, int garbage )
+{
+    FILE *file = hb_fopen( path, "wb" );
+    uint32_t seed = packs;
+    uint8_t pkt[4096];
+    int ii, jj;
+
+    if ( file == NULL )
+    {
+        fprintf( stderr, "startcode: can't create %s\n", path );
+        return -1;
+    }
+    for ( ii = 0; ii < packs; ii++ )
+    {
+        static const uint8_t pack[14] =
+        {
+            0x00, 0x00, 0x01, 0xba, 0x44, 0x00, 0x04, 0x00,
+            0x04, 0x01, 0x01, 0x89, 0xc3, 0xf8
+        };
+        int id  = ii % 3 ? 0xe0 : 0xc0;
+        int len = 512 + harness_rand( &seed ) % 1500;
+
+        fwrite( pack, 1, sizeof( pack ), file );
+        for ( jj = 0; jj < len; jj++ )
+        {
+            pkt[jj] = harness_rand( &seed ) >> 8;
+        }
+        if ( id == 0xc0 && len > 16 )
+        {
+            // Start code emulation, skipped because of the PES length
+            memcpy( pkt + 8, pack, 4 );
+        }
+        fputc( 0x00, file );
+        fputc( 0x00, file );
+        fputc( 0x01, file );
+        fputc( id, file );
+        if ( id == 0xe0 && ii % 7 == 1 )
+        {
+            // Unbounded video PES packet, ends at the next start code
+            fputc( 0, file );
+            fputc( 0, file );
+        }
+        else
+        {
+            fputc( len >> 8, file );
+            fputc( len & 0xff, file );
+        }
+        fwrite( pkt, 1, len, file );
+        if ( garbage && ii % 5 == 0 )
+        {
+            len = harness_rand( &seed ) % sizeof( pkt );
+            for ( jj = 0; jj < len; jj++ )
+            {
+                pkt[jj] = harness_rand( &seed ) >> 8;
+            }
+            fwrite( pkt, 1, len, file );
+        }
+    }
+    fclose( file );
+    return 0;
+}
+
+static int stream_init( hb_stream_t *stream, const char *path, int chunked )
+{
+    memset( stream, 0, sizeof( *stream ) );
+    stream->file_handle = hb_fopen( path, "rb" );
+    if ( stream->file_handle == NULL )
+    {
+        fprintf( stderr, "startcode: can't open %s\n", path );
+        return -1;
+    }
+    if ( chunked )
+    {
+        return stream_chunk_init( stream );
+    }
+    return 0;
+}
+
+static void stream_close( hb_stream_t *stream )
+{
+    fclose( stream->file_handle );
+    free( stream->chunk.buf );
+}
+
+static int check_ps( const char *path )
+{
+    hb_stream_t a, b;
+    hb_buffer_t *ba = hb_buffer_init( 2048 );
+    hb_buffer_t *bb = hb_buffer_init( 2048 );
+    int n, la, lb, result = 0;
+
+    if ( stream_init( &a, path, 1 ) || stream_init( &b, path, 0 ) )
+    {
+        return 1;
+    }
+    for ( n = 0; ; n++ )
+    {
+        ba->size = 0;
+        bb->size = 0;
+        if ( n % 97 == 5 )
+        {
+            // Seek somewhere nearby, then resync on the next pack
+            off_t offset = stream_tell( &a ) + ( n * 7919 ) % 300000 - 100000;
+            if ( offset < 0 )
+            {
+                offset = 0;
+            }
+            stream_seek( &a, offset, SEEK_SET );
+            fseeko( b.file_handle, offset, SEEK_SET );
+            skip_to_next_pack( &a );
+            skip_to_next_pack_old( &b );
+        }
+        la = hb_ps_read_packet( &a, ba );
+        lb = ps_read_packet_old( &b, bb );
+        if ( la != lb || memcmp( ba->data, bb->data, la ) ||
+             stream_tell( &a ) != ftello( b.file_handle ) )
+        {
+            fprintf( stderr, "startcode: packet %d of %s differs\n", n, path );
+            result = 1;
+            break;
+        }
+        if ( la == 0 )
+        {
+            break;
+        }
+    }
+    stream_close( &a );
+    stream_close( &b );
+    hb_buffer_close( &ba );
+    hb_buffer_close( &bb );
+    return result;
+}
+
+static void bench_ps( const char *path, const char *name, const char *finder )
+{
+    hb_buffer_t *buf = hb_buffer_init( 2048 );
+    int chunked;
+
+    for ( chunked = 1; chunked >= 0; chunked-- )
+    {
+        hb_stream_t stream;
+        uint64_t start;
+        off_t size;
+
+        if ( stream_init( &stream, path, chunked ) )
+        {
+            break;
+        }
+        start = hb_get_time_us();
+        for (;;)
+        {
+            buf->size = 0;
+            if ( ( chunked ? hb_ps_read_packet( &stream, buf ) :
+                             ps_read_packet_old( &stream, buf ) ) == 0 )
+            {
+                break;
+            }
+        }
+        fseeko( stream.file_handle, 0, SEEK_END );
+        size = ftello( stream.file_handle );
+        printf( "read %-7s packets, %-24s %8.0f MB/s\n", name,
+                chunked ? finder : "old getc_unlocked reader",
+                (double)size / ( hb_get_time_us() - start ) );
+        stream_close( &stream );
+    }
+    hb_buffer_close( &buf );
+}
+
+int main( int argc, char **argv )
+{
+    int bench = harness_bench_arg( argc, argv );
+    char dir[512], path[1024], garbage[1024];
+    finder_t finder[6];
+    int count, result = 0;
+
+    hb_buffer_pool_init();
+
+    count = finders_init( finder );
+    if ( check_find( finder, count ) )
+    {
+        return 1;
+    }
+    if ( bench )
+    {
+        bench_find( finder, count );
+    }
+
+    if ( argc > 1 + bench )
+    {
+        strcpy( path, argv[1 + bench] );
+        garbage[0] = 0;
+    }
+    else
+    {
+        hb_get_temporary_directory( dir );
+        hb_mkdir( dir );
+        snprintf( path, sizeof( path ), "%s/startcode.mpg", dir );
+        snprintf( garbage, sizeof( garbage ), "%s/startcode_garbage.mpg", dir );
+        if ( write_stream( path, bench ? 100000 : 5000, 0 ) ||
+             write_stream( garbage, bench ? 50000 : 5000, 1 ) )
+        {
+            return 1;
+        }
+    }
+
+    // stream.c uses the C finder until hb_find_startcode_init()
+    result = check_ps( path ) || ( garbage[0] && check_ps( garbage ) );
+    if ( !result && bench )
+    {
+        bench_ps( path, "clean", "chunked, C finder" );
+        if ( garbage[0] )
+        {
+            bench_ps( garbage, "garbage", "chunked, C finder" );
+        }
+    }
+    hb_find_startcode_init();
+    if ( !result )
+    {
+        result = check_ps( path ) || ( garbage[0] && check_ps( garbage ) );
+    }
+    if ( !result && bench )
+    {
+        bench_ps( path, "clean", "chunked, fastest finder" );
+        if ( garbage[0] )
+        {
+            bench_ps( garbage, "garbage", "chunked, fastest finder" );
+        }
+    }
+
+    if ( garbage[0] )
+    {
+        remove( path );
+        remove( garbage );
+        rmdir( dir );
+    }
+    if ( !result )
+    {
+        printf( "startcode: ok\n" );
+    }
+
+    return result;
+}
@@ -0,0 +1,212 @@
+/* vfr_test.c
+
+   Copyright (c) 2003-2015 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+ * Checks that the Framerate Shaper's sse_block16_row kernels of every
+ * dispatch level give exactly the sums of the C kernel, on random rows
+ * and through motion_metric() on synthetic frame pairs.
+ *
+ * Usage: vfr_test [--bench]
+ *
+ * With --bench it also times motion_metric() on 1080p frame pairs for
+ * each level.
+ */
+
+#include "../../libhb/vfr.c"
+#include "harness.h"
+
+#define FRAMES 8
+
+static int check_rows(VFRFunctions *c, VFRFunctions *x, const char *name)
+{
+    uint32_t seed = 1;
+    int t, ii;
+
+    for (t = 0; t < 200; t++)
+    {
+        int width = 16 * (1 + harness_rand(&seed) % 130);
+        int size  = 16 * width;
+        uint16_t *a = malloc(size * sizeof(uint16_t));
+        uint16_t *b = malloc(size * sizeof(uint16_t));
+
+        // Extreme values in some rows to catch overflows
+        for (ii = 0; ii < size; ii++)
+        {
+            if (t % 4 == 0)
+            {
+                a[ii] = harness_rand(&seed) & 1 ? 4095 : 0;
+                b[ii] = 4095 - a[ii];
+            }
+            else
+            {
+                a[ii] = harness_rand(&seed) % 4096;
+                b[ii] = harness_rand(&seed) % 4096;
+            }
+        }
+        if (c->sse_block16_row(a, b, width) != x->sse_block16_row(a, b, width))
+        {
+            fprintf(stderr, "vfr %s: row mismatch, width %d\n", name, width);
+            return 1;
+        }
+        free(a);
+        free(b);
+    }
+    return 0;
+}
+
+// A gradient that moves a little from frame to frame, with noise
+static hb_buffer_t ** frames_init(int width, int height)
+{
+    hb_buffer_t **frame = calloc(FRAMES, sizeof(hb_buffer_t*));
+    uint32_t seed = 1;
+    int f, x, y;
+
+    for (f = 0; f < FRAMES; f++)
+    {
+        frame[f] = hb_frame_buffer_init(AV_PIX_FMT_YUV420P, width, height);
+        frame[f]->s.start = f * 3003;
+        for (y = 0; y < height; y++)
+        {
+            uint8_t *row = frame[f]->plane[0].data +
+                           y * frame[f]->plane[0].stride;
+            for (x = 0; x < width; x++)
+            {
+                row[x] = ((x + y + f * 4) / 4 + harness_rand(&seed) % 8) & 0xff;
+            }
+        }
+    }
+    return frame;
+}
+
+static void frames_close(hb_buffer_t **frame)
+{
+    int f;
+
+    for (f = 0; f < FRAMES; f++)
+    {
+        hb_buffer_close(&frame[f]);
+    }
+    free(frame);
+}
+
+static hb_filter_private_t * metric_init(VFRFunctions *functions)
+{
+    hb_filter_private_t *pv = calloc(1, sizeof(hb_filter_private_t));
+
+    build_gamma_lut(pv);
+    pv->functions = *functions;
+    pv->cpu_count = 1;
+    return pv;
+}
+
+static void metric_close(hb_filter_private_t *pv)
+{
+    free(pv->gamma_plane[0]);
+    free(pv->gamma_plane[1]);
+    free(pv);
+}
+
+// Compares consecutive frames, like the filter does, so that the gamma
+// plane of the second frame of one pair is reused for the next
+static int check_metric(VFRFunctions *c, VFRFunctions *x, const char *name)
+{
+    static const int size[][2] = { { 720, 480 }, { 1280, 720 }, { 330, 250 } };
+    const int count = sizeof(size) / sizeof(size[0]);
+    int s, f;
+
+    for (s = 0; s < count; s++)
+    {
+        hb_buffer_t **frame = frames_init(size[s][0], size[s][1]);
+        hb_filter_private_t *ref = metric_init(c);
+        hb_filter_private_t *out = metric_init(x);
+
+        for (f = 0; f + 1 < FRAMES; f++)
+        {
+            float m0 = motion_metric(ref, frame[f], frame[f + 1]);
+            float m1 = motion_metric(out, frame[f], frame[f + 1]);
+            if (m0 != m1)
+            {
+                fprintf(stderr, "vfr %s: metric mismatch, %dx%d, frame %d: "
+                        "%f %f\n", name, size[s][0], size[s][1], f, m0, m1);
+                return 1;
+            }
+        }
+        metric_close(ref);
+        metric_close(out);
+        frames_close(frame);
+    }
+    return 0;
+}
+
+static void bench(VFRFunctions *x, const char *name)
+{
+    hb_buffer_t **frame = frames_init(1920, 1080);
+    hb_filter_private_t *pv = metric_init(x);
+    uint64_t start;
+    int f, y, pairs = 0;
+
+    start = hb_get_time_us();
+    for (f = 0; f < 20 * FRAMES; f++)
+    {
+        motion_metric(pv, frame[f % FRAMES], frame[(f + 1) % FRAMES]);
+        pairs++;
+    }
+    printf("vfr %-8s %8.3f ms per 1080p frame pair", name,
+           (hb_get_time_us() - start) / 1000.0 / pairs);
+
+    // The sums alone, on the gamma planes of the last pair
+    start = hb_get_time_us();
+    for (f = 0; f < 20 * FRAMES; f++)
+    {
+        for (y = 0; y < pv->gamma_height; y += 16)
+        {
+            int offset = y * pv->gamma_width;
+            x->sse_block16_row(pv->gamma_plane[0] + offset,
+                               pv->gamma_plane[1] + offset,
+                               pv->gamma_width);
+        }
+    }
+    printf(", sums only %8.3f ms\n",
+           (hb_get_time_us() - start) / 1000.0 / (20 * FRAMES));
+
+    metric_close(pv);
+    frames_close(frame);
+}
+
+int main(int argc, char **argv)
+{
+    harness_level_t levels[4];
+    VFRFunctions c, x;
+    int count, ii;
+
+    hb_buffer_pool_init();
+    c.sse_block16_row = sse_block16_row_c;
+
+    count = harness_levels(levels);
+    for (ii = 0; ii < count; ii++)
+    {
+        x = c;
+        harness_force_level(&levels[ii]);
+#if defined(ARCH_X86)
+        vfr_init_x86(&x);
+#endif
+        if (check_rows(&c, &x, levels[ii].name) ||
+            check_metric(&c, &x, levels[ii].name))
+        {
+            return 1;
+        }
+        if (harness_bench_arg(argc, argv))
+        {
+            bench(&x, levels[ii].name);
+        }
+    }
+    printf("vfr: ok\n");
+
+    return 0;
+}
@@ -133,6 +133,7 @@ static int    preset        = 0;
 static char * preset_name   = 0;
 static int    cfr           = 0;
 static int    mp4_optimize  = 0;
+static int    mp4_fragment  = 0;
 static int    ipod_atom     = 0;
 static int    color_matrix_code = 0;
 static int    preview_count = 10;
@@ -1831,6 +1832,10 @@ static int HandleEvents( hb_handle_t * h )
             {
                 job->mp4_optimize = 1;
             }
+            if (mp4_fragment)
+            {
+                job->mp4_fragment = 1;
+            }
             if (ipod_atom)
             {
                 job->ipod_atom = 1;
@@ -2976,6 +2981,8 @@ static void ShowHelp()
     "                            (default: autodetected from file name)\n"
     "    -m, --markers           Add chapter markers\n"
     "    -O, --optimize          Optimize mp4 files for HTTP streaming (\"fast start\")\n"
+    "        --mp4-fragment      Write fragmented mp4 files progressively\n"
+    "                            (no \"fast start\" rewrite at the end)\n"
     "    -I, --ipod-atom         Mark mp4 files so 5.5G iPods will accept them\n"
     "    -P, --use-opencl        Use OpenCL where applicable\n"
     "    -U, --use-hwd           Use DXVA2 hardware decoding\n"
@@ -3554,6 +3561,7 @@ static int ParseOptions( int argc, char ** argv )
     #define QSV_IMPLEMENTATION   297
     #define FILTER_NLMEANS       298
     #define FILTER_NLMEANS_TUNE  299
+    #define MP4_FRAGMENT         300
 
     for( ;; )
     {
@@ -3576,6 +3584,7 @@ static int ParseOptions( int argc, char ** argv )
             { "input",       required_argument, NULL,    'i' },
             { "output",      required_argument, NULL,    'o' },
             { "optimize",    no_argument,       NULL,    'O' },
+            { "mp4-fragment",no_argument,       NULL,    MP4_FRAGMENT },
             { "ipod-atom",   no_argument,       NULL,    'I' },
             { "use-opencl",  no_argument,       NULL,    'P' },
             { "use-hwd",     no_argument,       NULL,    'U' },
@@ -3750,6 +3759,9 @@ static int ParseOptions( int argc, char ** argv )
             case 'O':
                 mp4_optimize = 1;
                 break;
+            case MP4_FRAGMENT:
+                mp4_fragment = 1;
+                break;
             case 'I':
                 ipod_atom = 1;
                 break;